@@ -1,17 +1,74 @@
 #include <stdlib.h>
+#include <sys/mman.h>
 #include "bufline.h"
+#include "colindex.h"
 
 struct bufline *bufline_new_with_string(string_t s) {
 	struct bufline *ret = malloc(sizeof(struct bufline));
 	ret->string = s;
 	ret->prev = NULL;
 	ret->next = NULL;
+	ret->orig_off = -1;
+	ret->dirty = 0;
+	ret->indexed = 0;
+	ret->shared = NULL;
+	ret->layout = NULL;
+	ret->colindex = NULL;
 
 	return ret;
 }
 
+// a line whose text is `st`. takes over a reference to `st`.
+struct bufline *bufline_new_shared(struct sharedtext *st) {
+	struct bufline *ret = bufline_new_with_string((string_t) { .ptr = st->ptr, .len = st->len });
+	ret->shared = st;
+	return ret;
+}
+
+// turns the line's text into shared text (without copying it), and returns a new reference to it
+struct sharedtext *bufline_share(struct bufline *bl) {
+	if (bl->shared == NULL) {
+		struct sharedtext *st = malloc(sizeof(struct sharedtext));
+		*st = (struct sharedtext) { .refcount = 1, .ptr = bl->string.ptr, .len = bl->string.len };
+		bl->shared = st;
+		bl->string.cap = 0;
+	}
+	// a truncated view doesn't match the shared text anymore
+	if (bl->string.len != bl->shared->len) {
+		bufline_unshare(bl);
+		return bufline_share(bl);
+	}
+	bl->shared->refcount += 1;
+	return bl->shared;
+}
+
+// gives the line its own copy of its text, so that it can be changed
+void bufline_unshare(struct bufline *bl) {
+	if (bl->shared == NULL)
+		return;
+	struct sharedtext *st = bl->shared;
+	bl->string = str_to_string(string_as_str(bl->string));
+	bl->shared = NULL;
+	sharedtext_release(st);
+}
+
+void sharedtext_release(struct sharedtext *st) {
+	if (--st->refcount > 0)
+		return;
+	if (st->map_len > 0)
+		munmap(st->ptr, st->map_len);
+	else
+		free(st->ptr);
+	free(st);
+}
+
 void bufline_free(struct bufline *bl) {
-	string_free(bl->string);
+	if (bl->shared != NULL)
+		sharedtext_release(bl->shared);
+	else
+		string_free(bl->string);
+	free(bl->layout);
+	colindex_drop(bl);
 	free(bl);
 }
 
@@ -27,6 +84,7 @@ struct bufline *str_to_buflines(str_t s) {
 	struct bufline *prev = bufline_new_with_string(
 		str_to_string(str_slice_idx_to_eol(s, 0))
 	);
+	prev->orig_off = 0;
 	size_t idx = prev->string.len + 1;
 	struct bufline *ret = prev;
 	struct bufline *head = NULL;
@@ -35,6 +93,7 @@ struct bufline *str_to_buflines(str_t s) {
 		head = bufline_new_with_string(
 			str_to_string(str_slice_idx_to_eol(s, idx))
 		);
+		head->orig_off = idx;
 		idx += head->string.len + 1;
 		prev->next = head;
 		head->prev = prev;
@@ -1,16 +1,45 @@
 #ifndef __HAVE_BUFLINES_H
 #define __HAVE_BUFLINES_H
 
+#include <sys/types.h>
 #include "mf_string.h"
 
+// immutable text that several lines and registers can point at without copying it
+struct sharedtext {
+	size_t refcount;
+	char *ptr;
+	size_t len;
+	// if nonzero, `ptr` is the start of a mapping this long (e.g. a session snapshot),
+	// which lines may point anywhere into. it is unmapped instead of freed.
+	size_t map_len;
+};
+
 // a single line in a pane buffer
 struct bufline {
 	string_t string;
 	struct bufline *prev;
 	struct bufline *next;
+	// offset of this line in the file it was loaded from, or -1
+	off_t orig_off;
+	// contents changed since the line was loaded
+	unsigned dirty : 1;
+	// the line's words are counted in the pane's completion index
+	unsigned indexed : 1;
+	// if non-NULL, `string` doesn't own its memory but points into this (with cap 0),
+	// and bufline_unshare() has to be called before changing it
+	struct sharedtext *shared;
+	// soft wrap: where the line breaks into screen rows, or NULL if it hasn't been laid
+	// out since it last changed
+	struct wraplayout *layout;
+	// display columns of the line's bytes, for long lines. NULL until it is asked for.
+	struct colindex *colindex;
 };
 
 struct bufline *bufline_new_with_string(string_t s);
+struct bufline *bufline_new_shared(struct sharedtext *st);
+struct sharedtext *bufline_share(struct bufline *bl);
+void bufline_unshare(struct bufline *bl);
+void sharedtext_release(struct sharedtext *st);
 void bufline_free(struct bufline *bl);
 struct bufline *str_to_buflines(str_t s);
 void free_bufline_list(struct bufline *head);
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+#include "colindex.h"
+#include "config.h"
+#include "wrap.h"
+
+static size_t measure(const char *p, size_t n) {
+	size_t w = 0;
+	for (size_t i = 0; i < n; i++)
+		w += wrap_char_width(p[i]);
+	return w;
+}
+
+static struct colindex *get_index(struct bufline *bl) {
+	if (bl->colindex == NULL)
+		bl->colindex = calloc(1, sizeof(struct colindex));
+	return bl->colindex;
+}
+
+// how many checkpoints are at or before `idx`
+static size_t points_upto(const struct colindex *ci, size_t idx) {
+	size_t lo = 0;
+	size_t hi = ci->npts;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ci->pts[mid].idx <= idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// how many checkpoints are at or before column `col`
+static size_t points_upto_col(const struct colindex *ci, size_t col) {
+	size_t lo = 0;
+	size_t hi = ci->npts;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ci->pts[mid].col <= col)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// the checkpoint that `n` checkpoints come before (with 0, the start of the line)
+static struct colpoint nth_point(const struct colindex *ci, size_t n) {
+	return n == 0 ? (struct colpoint) { 0, 0 } : ci->pts[n - 1];
+}
+
+static void insert_point(struct colindex *ci, size_t at, struct colpoint pt) {
+	if (ci->npts == ci->cap) {
+		ci->cap = ci->cap == 0 ? 16 : ci->cap * 2;
+		ci->pts = realloc(ci->pts, sizeof(ci->pts[0]) * ci->cap);
+	}
+	memmove(&ci->pts[at + 1], &ci->pts[at], sizeof(ci->pts[0]) * (ci->npts - at));
+	ci->pts[at] = pt;
+	ci->npts++;
+}
+
+// adds checkpoints a stride apart after the n-th one, if the gap up to the one after it
+// (or up to `end`, after the last one) has grown past two strides. a gap is only filled
+// once it's that big, so that typing in the middle of one doesn't measure it again on
+// every key.
+static void fill_gap(struct colindex *ci, str_t line, size_t n, size_t end) {
+	struct colpoint pt = nth_point(ci, n);
+	size_t limit = n < ci->npts ? ci->pts[n].idx : end;
+	while (limit - pt.idx > 2 * COLINDEX_STRIDE) {
+		pt.col += measure(line.ptr + pt.idx, COLINDEX_STRIDE);
+		pt.idx += COLINDEX_STRIDE;
+		insert_point(ci, n, pt);
+		n++;
+	}
+}
+
+// the display column that byte `idx` starts at (with `idx` the length of the line, the
+// width of the whole line)
+size_t colindex_col(struct bufline *bl, size_t idx) {
+	str_t line = string_as_str(bl->string);
+	if (line.len <= COLINDEX_STRIDE)
+		return measure(line.ptr, idx);
+
+	struct colindex *ci = get_index(bl);
+	size_t n = points_upto(ci, idx);
+	if (n == ci->npts) {
+		fill_gap(ci, line, n, idx);
+		n = points_upto(ci, idx);
+	}
+	struct colpoint pt = nth_point(ci, n);
+	return pt.col + measure(line.ptr + pt.idx, idx - pt.idx);
+}
+
+// the byte that covers display column `col`, or the length of the line if it is
+// narrower. `*idx_col` is set to the column that byte starts at, which is before `col`
+// if a tab or a <XX> covers it.
+size_t colindex_idx_at_col(struct bufline *bl, size_t col, size_t *idx_col) {
+	str_t line = string_as_str(bl->string);
+	struct colpoint pt = { 0, 0 };
+	if (line.len > COLINDEX_STRIDE) {
+		struct colindex *ci = get_index(bl);
+		// measure further along the line until it is past `col`
+		while (ci->npts == 0 || ci->pts[ci->npts - 1].col <= col) {
+			size_t from = nth_point(ci, ci->npts).idx;
+			if (line.len - from <= 2 * COLINDEX_STRIDE)
+				break;
+			fill_gap(ci, line, ci->npts, MIN(from + 64 * COLINDEX_STRIDE, line.len));
+		}
+		pt = nth_point(ci, points_upto_col(ci, col));
+	}
+
+	for (size_t i = pt.idx; i < line.len; i++) {
+		size_t w = wrap_char_width(line.ptr[i]);
+		if (pt.col + w > col) {
+			*idx_col = pt.col;
+			return i;
+		}
+		pt.col += w;
+	}
+	*idx_col = pt.col;
+	return line.len;
+}
+
+// `text` was inserted at `idx`
+void colindex_inserted(struct bufline *bl, size_t idx, str_t text) {
+	struct colindex *ci = bl->colindex;
+	if (ci == NULL)
+		return;
+	size_t w = measure(text.ptr, text.len);
+	size_t n = points_upto(ci, idx);
+	for (size_t i = n; i < ci->npts; i++) {
+		ci->pts[i].idx += text.len;
+		ci->pts[i].col += w;
+	}
+	fill_gap(ci, string_as_str(bl->string), n, idx + text.len);
+}
+
+// `n` bytes at `idx` are about to be removed
+void colindex_deleting(struct bufline *bl, size_t idx, size_t n) {
+	struct colindex *ci = bl->colindex;
+	if (ci == NULL || n == 0)
+		return;
+	size_t w = measure(bl->string.ptr + idx, n);
+	// the checkpoints inside the removed bytes go away
+	size_t first = points_upto(ci, idx);
+	size_t last = points_upto(ci, idx + n - 1);
+	memmove(&ci->pts[first], &ci->pts[last], sizeof(ci->pts[0]) * (ci->npts - last));
+	ci->npts -= last - first;
+	for (size_t i = first; i < ci->npts; i++) {
+		ci->pts[i].idx -= n;
+		ci->pts[i].col -= w;
+	}
+}
+
+// the line was cut to `len` bytes (text added after that doesn't matter: the index is
+// only ever extended from its last checkpoint)
+void colindex_truncate(struct bufline *bl, size_t len) {
+	if (bl->colindex != NULL)
+		bl->colindex->npts = points_upto(bl->colindex, len);
+}
+
+// the line was replaced
+void colindex_drop(struct bufline *bl) {
+	if (bl->colindex == NULL)
+		return;
+	free(bl->colindex->pts);
+	free(bl->colindex);
+	bl->colindex = NULL;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+// every column lookup on `bl` agrees with measuring from the start
+static void check_line(struct bufline *bl) {
+	str_t line = string_as_str(bl->string);
+	for (size_t i = 0; i <= line.len; i += 97) {
+		assert(colindex_col(bl, i) == measure(line.ptr, i));
+		size_t at;
+		size_t idx = colindex_idx_at_col(bl, measure(line.ptr, i), &at);
+		assert(idx == i && at == measure(line.ptr, i));
+	}
+	size_t col = measure(line.ptr, line.len);
+	size_t at;
+	assert(colindex_idx_at_col(bl, col + 5, &at) == line.len && at == col);
+	if (bl->colindex != NULL) {
+		for (size_t i = 0; i < bl->colindex->npts; i++) {
+			struct colpoint pt = bl->colindex->pts[i];
+			assert(pt.idx <= line.len && pt.col == measure(line.ptr, pt.idx));
+			assert(i == 0 || bl->colindex->pts[i - 1].idx < pt.idx);
+		}
+	}
+}
+
+void colindex_run_tests(void) {
+	string_t s = string_new();
+	for (size_t i = 0; i < 10 * COLINDEX_STRIDE; i++)
+		string_push(&s, i % 13 == 0 ? '\t' : i % 29 == 0 ? '\x01' : 'a' + i % 26);
+	struct bufline *bl = bufline_new_with_string(s);
+
+	// looked up near the start, only the start is measured
+	assert(colindex_col(bl, 10) == measure(bl->string.ptr, 10));
+	assert(bl->colindex == NULL || bl->colindex->npts == 0);
+	check_line(bl);
+	assert(bl->colindex->npts >= 3);
+	size_t at;
+	assert(colindex_idx_at_col(bl, 8, &at) == 1 && at == 8);
+	assert(colindex_idx_at_col(bl, 3, &at) == 0 && at == 0);
+
+	// edits shift the checkpoints after them
+	bufline_unshare(bl);
+	string_insert(&bl->string, 5, '\t');
+	string_insert(&bl->string, 5, '\t');
+	colindex_inserted(bl, 5, STR("\t\t"));
+	check_line(bl);
+	colindex_deleting(bl, 3 * COLINDEX_STRIDE - 10, 20);
+	for (int i = 0; i < 20; i++)
+		string_remove(&bl->string, 3 * COLINDEX_STRIDE - 10);
+	check_line(bl);
+
+	// a big insert gets checkpoints of its own
+	string_t big = string_new();
+	for (size_t i = 0; i < 5 * COLINDEX_STRIDE; i++)
+		string_push(&big, i % 7 == 0 ? '\x02' : 'x');
+	string_t spliced = str_to_string((str_t) { .ptr = bl->string.ptr, .len = COLINDEX_STRIDE });
+	string_append(&spliced, string_as_str(big));
+	string_append(&spliced, str_slice_idx_to_eol(string_as_str(bl->string), COLINDEX_STRIDE));
+	string_free(bl->string);
+	bl->string = spliced;
+	size_t npts = bl->colindex->npts;
+	colindex_inserted(bl, COLINDEX_STRIDE, string_as_str(big));
+	assert(bl->colindex->npts >= npts + 3);
+	check_line(bl);
+	string_free(big);
+
+	colindex_truncate(bl, 2 * COLINDEX_STRIDE + 1);
+	bl->string.len = 2 * COLINDEX_STRIDE + 1;
+	check_line(bl);
+	for (size_t i = 0; i < 4 * COLINDEX_STRIDE; i++)
+		string_push(&bl->string, '\t');
+	check_line(bl);
+
+	colindex_drop(bl);
+	assert(bl->colindex == NULL);
+	check_line(bl);
+	bufline_free(bl);
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef __HAVE_COLINDEX_H
+#define __HAVE_COLINDEX_H
+
+#include <stddef.h>
+#include "bufline.h"
+
+// the display column that byte `idx` of a line starts at
+struct colpoint {
+	size_t idx;
+	size_t col;
+};
+
+// maps byte offsets of a long line to display columns without measuring it from the
+// start. there is a checkpoint about every COLINDEX_STRIDE bytes up to the furthest point
+// that was looked up; edits shift the checkpoints after them instead of measuring again.
+struct colindex {
+	// by increasing `idx`. the start of the line (0, 0) isn't stored.
+	struct colpoint *pts;
+	size_t npts;
+	size_t cap;
+};
+
+size_t colindex_col(struct bufline *bl, size_t idx);
+size_t colindex_idx_at_col(struct bufline *bl, size_t col, size_t *idx_col);
+void colindex_inserted(struct bufline *bl, size_t idx, str_t text);
+void colindex_deleting(struct bufline *bl, size_t idx, size_t n);
+void colindex_truncate(struct bufline *bl, size_t len);
+void colindex_drop(struct bufline *bl);
+
+#endif
@@ -5,6 +5,67 @@
 
 #define TAB_WIDTH 8
 
+// files bigger than this are opened in paged mode instead of being read into memory
+#define LARGEFILE_THRESHOLD (512L * 1024 * 1024)
+// paged mode: how much of the file may be mmap'd at once
+#define PAGER_MEM_CAP (256L * 1024 * 1024)
+#define PAGER_CHUNK_SIZE (4L * 1024 * 1024)
+// paged mode: a line offset is sampled every this many lines
+#define PAGER_INDEX_STRIDE 1024
+// paged mode: number of lines kept loaded around the cursor
+#define PAGER_WINDOW_LINES 4096
+// streaming from a pipe: max bytes read before the screen is redrawn
+#define STREAM_READ_BUDGET (1L * 1024 * 1024)
+// how long edits may sit in memory before they are synced to the recovery journal
+#define JOURNAL_SYNC_INTERVAL_MS 1000
+// a macro that replays itself (or another one that does) gives up past this depth
+#define MACRO_MAX_DEPTH 100
+// a counted repeat checks for keys that came in (e.g. Esc), which stop it, this often
+#define REPEAT_INPUT_CHECK_EVERY 1024
+// background jobs (e.g. :s) run on up to this many threads, and no more than there
+// are CPUs
+#define POOL_MAX_THREADS 16
+// :s on fewer lines than this is done right away instead of in the background
+#define SUBST_BACKGROUND_MIN_LINES 20000
+// a :s in the background is split into jobs of this many lines
+#define SUBST_CHUNK_LINES 16384
+// how often (in lines) a :s worker reports progress and checks for Escape
+#define SUBST_PROGRESS_LINES 1024
+#define SUBST_REDRAW_INTERVAL_MS 100
+// how much of a :! range is taken out of the buffer to be written to the command at once
+#define FILTER_CHUNK_SIZE (64L * 1024)
+// how often to check whether a :!cmd that closed its output has exited
+#define FILTER_REAP_INTERVAL_MS 10
+// :open walks the tree with up to this many threads. reading directories mostly waits
+// on the disk, so it uses more threads than there are CPUs.
+#define PICKER_MAX_THREADS 8
+// a walker thread hands over the files it finds in batches of up to this many
+#define PICKER_BATCH_SIZE 1024
+
+// most events the main loop takes in from one epoll_wait()
+#define EVLOOP_MAX_EVENTS 16
+
+// lines longer than this get a column index: the display column is remembered about
+// every this many bytes, so that the far end of a line can be drawn without measuring
+// all of it
+#define COLINDEX_STRIDE 4096
+// the diff gutter lines up changed lines with the file by the unchanged ones around them,
+// looking at most this many lines past the screen for them
+#define DIFF_MAX_GAP 2048
+// past this many added and removed lines in one changed stretch, its lines are just
+// paired up in order instead of being diffed
+#define DIFF_MAX_EDITS 256
+// insert mode completion: words shorter or longer than this aren't offered
+#define COMPL_MIN_WORD_LEN 2
+#define COMPL_MAX_WORD_LEN 64
+// most words Ctrl-N and Ctrl-P offer at once
+#define COMPL_MAX_CANDIDATES 10
+// the words of the buffer are counted in the background this many lines at a time
+#define COMPL_INDEX_CHUNK_LINES 4096
+// hex view: the file is mapped this much at a time, aligned to it. two of these are
+// mapped around the screen.
+#define HEXVIEW_MAP_CHUNK (1L * 1024 * 1024)
+
 #define BG_COLOR 0x282c34
 #define WHITE_COLOR 0xabb2bf
 #define GREEN_COLOR 0x98bb6c
@@ -15,6 +76,10 @@
 #define LIGHTBG_COLOR 0x2c323c
 #define LIGHTERBG_COLOR 0x3e4452
 #define GUTTER_COLOR 0x4b5263
+// every color above. on terminals with 256 or 16 colors, these are matched to the
+// nearest color the terminal has once at startup.
+#define PALETTE_COLORS BG_COLOR, WHITE_COLOR, GREEN_COLOR, BLUE_COLOR, RED_COLOR, YELLOW_COLOR, \
+	PURPLE_COLOR, LIGHTBG_COLOR, LIGHTERBG_COLOR, GUTTER_COLOR
 
 #define GUTTER_STYLE ((struct style) { .fg = GUTTER_COLOR, .bg = BG_COLOR })
 #define NORMAL_STYLE ((struct style) { .fg = WHITE_COLOR, .bg = BG_COLOR })
@@ -22,7 +87,14 @@
 #define STATUSLINE_COMMAND_MODE_STYLE ((struct style) { .fg = BG_COLOR, .bg = GREEN_COLOR })
 #define STATUSLINE_INSERT_MODE_STYLE ((struct style) { .fg = BG_COLOR, .bg = BLUE_COLOR })
 #define STATUSLINE_SECONDARY_STYLE ((struct style) { .fg = WHITE_COLOR, .bg = LIGHTERBG_COLOR, })
+#define STATUSLINE_INFO_STYLE ((struct style) { .fg = WHITE_COLOR, .bg = LIGHTBG_COLOR })
 #define ERRORMSG_STYLE ((struct style) { .fg = RED_COLOR, .bg = BG_COLOR })
 #define NONPRINT_STYLE ((struct style) { .fg = GUTTER_COLOR, .bg = BG_COLOR })
+#define EXTRA_CURSOR_STYLE ((struct style) { .fg = BG_COLOR, .bg = WHITE_COLOR })
+#define DIFF_ADDED_STYLE ((struct style) { .fg = GREEN_COLOR, .bg = BG_COLOR })
+#define DIFF_MODIFIED_STYLE ((struct style) { .fg = BLUE_COLOR, .bg = BG_COLOR })
+#define DIFF_REMOVED_STYLE ((struct style) { .fg = RED_COLOR, .bg = BG_COLOR })
+#define COMPL_STYLE ((struct style) { .fg = WHITE_COLOR, .bg = LIGHTERBG_COLOR })
+#define COMPL_SELECTED_STYLE ((struct style) { .fg = BG_COLOR, .bg = BLUE_COLOR })
 
 #endif
@@ -1,26 +1,316 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "config.h"
 #include "editor.h"
+#include "idxcache.h"
+#include "colindex.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "wrap.h"
 
 static str_t commandline_prompt = STR(">> ");
 
-static void pane_new(struct pane *p, str_t initial_contents) {
-	p->_priv_cursor_line = str_to_buflines(initial_contents);
-	p->screen_top_line = p->_priv_cursor_line;
-	p->_priv_cursor_line_no = 1;
+static void pane_init(struct pane *p) {
 	p->cursor_line_idx = 0;
 	p->show_line_nums = 1;
+	p->cursors = NULL;
+	p->ncursors = 0;
+	p->cursorcap = 0;
 	p->name = STRING("[No Name]");
+	p->path = string_new();
+	p->loaded_size = 0;
+	p->last_line_open = 0;
+	p->follow = NULL;
+	p->stream_fd = -1;
+	p->journal = NULL;
+	p->last_height = 1;
+	p->text_width = 0;
+	p->soft_wrap = 0;
+	p->left_col = 0;
+	p->diff = NULL;
+	p->words = NULL;
+	p->words_next = NULL;
+	p->pager = NULL;
+	p->win_start = 0;
+	p->win_end = 0;
+	p->win_nlines = 0;
+	p->change_seq = 0;
+	p->subst = NULL;
+	p->subst_lines = NULL;
+	p->subst_strs = NULL;
+	p->subst_lineno = 0;
+	p->filter = NULL;
+	p->undo = NULL;
+	p->nundo = 0;
+	p->undo_range = (struct undo_range) { 0 };
+	p->undo_seq = 0;
+}
+
+static void pane_new(struct pane *p, str_t initial_contents) {
+	pane_init(p);
+	p->_priv_first_line = str_to_buflines(initial_contents);
+	p->_priv_last_line = p->_priv_first_line;
+	while (p->_priv_last_line->next != NULL)
+		p->_priv_last_line = p->_priv_last_line->next;
+	p->_priv_cursor_line = p->_priv_first_line;
+	p->screen_top_line = p->_priv_cursor_line;
+	p->_priv_cursor_line_no = 1;
+	p->last_line_open = initial_contents.len == 0 || initial_contents.ptr[initial_contents.len - 1] != '\n';
 }
 
 static struct bufline *pane_get_cursor_line(struct pane *p) {
 	return p->_priv_cursor_line;
 }
 
+// links the lines `head`..`tail` into the buffer after `after` (at the start if `after` is NULL)
+static void pane_link_lines(struct pane *p, struct bufline *after, struct bufline *head, struct bufline *tail) {
+	struct bufline *before = after != NULL ? after->next : p->_priv_first_line;
+	head->prev = after;
+	tail->next = before;
+
+	if (after != NULL)
+		after->next = head;
+	else
+		p->_priv_first_line = head;
+
+	if (before != NULL)
+		before->prev = tail;
+	else
+		p->_priv_last_line = tail;
+
+	// lines that go in among the ones the completion index has counted are counted
+	// right away. the others are left to the background.
+	if (p->words != NULL) {
+		if (after != NULL ? after->indexed : p->words_next != before) {
+			for (struct bufline *bl = head; ; bl = bl->next) {
+				bl->indexed = 1;
+				wordindex_update(p->words, string_as_str(bl->string), 0, bl->string.len, 1);
+				if (bl == tail)
+					break;
+			}
+		} else if (p->words_next == before) {
+			p->words_next = head;
+		}
+	}
+}
+
+// unlinks the lines `head`..`tail` from the buffer, leaving them as a standalone list
+static void pane_unlink_lines(struct pane *p, struct bufline *head, struct bufline *tail) {
+	if (p->words != NULL) {
+		for (struct bufline *bl = head; ; bl = bl->next) {
+			if (bl->indexed)
+				wordindex_update(p->words, string_as_str(bl->string), 0, bl->string.len, 0);
+			bl->indexed = 0;
+			if (bl == p->words_next)
+				p->words_next = tail->next;
+			if (bl == tail)
+				break;
+		}
+	}
+
+	if (head->prev != NULL)
+		head->prev->next = tail->next;
+	else
+		p->_priv_first_line = tail->next;
+
+	if (tail->next != NULL)
+		tail->next->prev = head->prev;
+	else
+		p->_priv_last_line = head->prev;
+
+	head->prev = NULL;
+	tail->next = NULL;
+}
+
+static size_t bufline_list_len(struct bufline *head, struct bufline **tail) {
+	size_t n = 0;
+	*tail = NULL;
+	for (struct bufline *bl = head; bl != NULL; bl = bl->next) {
+		*tail = bl;
+		n++;
+	}
+	return n;
+}
+
+// paged mode: the buffer only holds the lines of the file between win_start and win_end.
+// moving past either end loads more lines from the pager, and lines far from the cursor
+// are handed back to it (as a `struct pager_edit` if they were changed).
+
+// the lines of `e` are taken out of the pager; returns them
+static struct bufline *pane_window_take_edit(struct pane *p, struct pager_edit *e, struct bufline **tail, size_t *n) {
+	struct bufline *head = e->lines;
+	*n = bufline_list_len(head, tail);
+	for (struct bufline *bl = head; bl != NULL; bl = bl->next)
+		bl->dirty = 1;
+	if (head != NULL)
+		head->orig_off = e->start;
+	pager_take_edit(p->pager, e);
+	return head;
+}
+
+static void pane_window_extend_down(struct pane *p, size_t n) {
+	struct pager *pg = p->pager;
+
+	while (n > 0 && p->win_end < pg->size) {
+		struct pager_edit *e = pager_edit_starting_at(pg, p->win_end);
+		if (e != NULL) {
+			off_t end = e->end;
+			struct bufline *tail;
+			size_t count;
+			struct bufline *head = pane_window_take_edit(p, e, &tail, &count);
+			if (head != NULL)
+				pane_link_lines(p, p->_priv_last_line, head, tail);
+			p->win_nlines += count;
+			p->win_end = end;
+			n -= MIN(n, count);
+			continue;
+		}
+
+		string_t s = string_new();
+		off_t next = pager_read_line(pg, p->win_end, &s);
+		struct bufline *bl = bufline_new_with_string(s);
+		bl->orig_off = p->win_end;
+		pane_link_lines(p, p->_priv_last_line, bl, bl);
+		p->win_nlines += 1;
+		p->win_end = next;
+		n--;
+	}
+}
+
+static void pane_window_extend_up(struct pane *p, size_t n) {
+	struct pager *pg = p->pager;
+
+	while (n > 0 && p->win_start > 0) {
+		struct pager_edit *e = pager_edit_ending_at(pg, p->win_start);
+		if (e != NULL) {
+			off_t start = e->start;
+			struct bufline *tail;
+			size_t count;
+			struct bufline *head = pane_window_take_edit(p, e, &tail, &count);
+			if (head != NULL)
+				pane_link_lines(p, NULL, head, tail);
+			p->win_nlines += count;
+			p->win_start = start;
+			n -= MIN(n, count);
+			continue;
+		}
+
+		off_t start = pager_prev_line_start(pg, p->win_start);
+		string_t s = string_new();
+		pager_read_line(pg, start, &s);
+		struct bufline *bl = bufline_new_with_string(s);
+		bl->orig_off = start;
+		pane_link_lines(p, NULL, bl, bl);
+		p->win_nlines += 1;
+		p->win_start = start;
+		n--;
+	}
+}
+
+// hands the lines `head`..`tail`, which cover the file range [start, end), back to the pager
+static void pane_window_evict(struct pane *p, struct bufline *head, struct bufline *tail, off_t start, off_t end) {
+	struct pager *pg = p->pager;
+
+	size_t n = 0;
+	int modified = 0;
+	off_t expect = start;
+	for (struct bufline *bl = head; ; bl = bl->next) {
+		n++;
+		if (bl->dirty || bl->orig_off != expect)
+			modified = 1;
+		else
+			expect = bl->orig_off + bl->string.len + 1;
+		if (bl == tail)
+			break;
+	}
+	if (MIN(expect, pg->size) != end)
+		modified = 1;
+
+	pane_unlink_lines(p, head, tail);
+	p->win_nlines -= n;
+
+	if (!modified || start == end) {
+		free_bufline_list(head);
+		return;
+	}
+
+	pager_add_edit(pg, (struct pager_edit) {
+		.start = start,
+		.end = end,
+		.lines = head,
+		.line_delta = (long) n - (long) pager_count_lines(pg, start, end),
+	});
+}
+
+// shrinks the window back to around PAGER_WINDOW_LINES lines centered on the cursor
+static void pane_window_trim(struct pane *p) {
+	if (p->win_nlines <= 2 * PAGER_WINDOW_LINES)
+		return;
+
+	struct bufline *cut = pane_get_cursor_line(p);
+	for (size_t i = 0; i < PAGER_WINDOW_LINES / 2 && cut->prev != NULL; i++)
+		cut = cut->prev;
+	// can only cut in front of a line whose position in the file is known
+	while (cut->prev != NULL && (cut->orig_off < 0 || cut->orig_off <= p->win_start))
+		cut = cut->prev;
+	if (cut->prev != NULL) {
+		off_t cut_off = cut->orig_off;
+		pane_window_evict(p, p->_priv_first_line, cut->prev, p->win_start, cut_off);
+		p->win_start = cut_off;
+	}
+
+	cut = pane_get_cursor_line(p);
+	for (size_t i = 0; i < PAGER_WINDOW_LINES / 2 && cut->next != NULL; i++)
+		cut = cut->next;
+	cut = cut->next;
+	while (cut != NULL && (cut->orig_off < 0 || cut->orig_off >= p->win_end))
+		cut = cut->next;
+	if (cut != NULL) {
+		off_t cut_off = cut->orig_off;
+		pane_window_evict(p, cut, p->_priv_last_line, cut_off, p->win_end);
+		p->win_end = cut_off;
+	}
+}
+
+// drops the whole window and starts a new, empty one at `off`
+static void pane_window_reload(struct pane *p, off_t off) {
+	if (p->_priv_first_line != NULL)
+		pane_window_evict(p, p->_priv_first_line, p->_priv_last_line, p->win_start, p->win_end);
+	p->_priv_cursor_line = NULL;
+	p->screen_top_line = NULL;
+	p->win_start = off;
+	p->win_end = off;
+}
+
+static void pane_new_paged(struct pane *p, struct pager *pg) {
+	pane_init(p);
+	// without a cached index, it gets built in the background instead
+	(void) idxcache_load(pg);
+	p->pager = pg;
+	p->_priv_first_line = NULL;
+	p->_priv_last_line = NULL;
+	pane_window_extend_down(p, PAGER_WINDOW_LINES);
+	if (p->_priv_first_line == NULL) {
+		struct bufline *bl = bufline_new_with_string(string_new());
+		pane_link_lines(p, NULL, bl, bl);
+	}
+	p->_priv_cursor_line = p->_priv_first_line;
+	p->screen_top_line = p->_priv_cursor_line;
+	p->_priv_cursor_line_no = 1;
+}
+
 struct pane *editor_get_focused_pane(struct editor *e) {
 	return &e->foobar123lol;
 }
@@ -30,26 +320,189 @@ static size_t pane_get_cursor_line_no(struct pane *p) {
 	return p->_priv_cursor_line_no;
 }
 
+// paged mode: works out the cursor's line number once the index has reached the window
+static void pane_resolve_line_no(struct pane *p) {
+	if (p->_priv_cursor_line_no != 0 || p->pager == NULL)
+		return;
+
+	size_t first_no = pager_offset_line_no(p->pager, p->win_start);
+	if (first_no == 0)
+		return;
+
+	size_t n = first_no + pager_line_delta_before(p->pager, p->win_start);
+	for (struct bufline *bl = p->_priv_first_line; bl != pane_get_cursor_line(p); bl = bl->next)
+		n++;
+	p->_priv_cursor_line_no = n;
+}
+
+// stops a running :s and throws away what it has done so far
+static void pane_cancel_substitute(struct pane *p) {
+	if (p->subst == NULL)
+		return;
+	subst_job_free(p->subst);
+	free(p->subst);
+	free(p->subst_lines);
+	free(p->subst_strs);
+	p->subst = NULL;
+	p->subst_lines = NULL;
+	p->subst_strs = NULL;
+}
+
+static void pane_clear_undo(struct pane *p) {
+	for (size_t i = 0; i < p->nundo; i++)
+		sharedtext_release(p->undo[i].text);
+	free(p->undo);
+	p->undo = NULL;
+	p->nundo = 0;
+	free_bufline_list(p->undo_range.head);
+	p->undo_range = (struct undo_range) { 0 };
+}
+
 static void pane_free(struct pane *p) {
-	struct bufline *first_line;
-	for (first_line = pane_get_cursor_line(p); first_line->prev; first_line = first_line->prev)
-		;
+	if (p->follow != NULL) {
+		follow_stop(p->follow);
+		free(p->follow);
+	}
+	if (p->stream_fd != -1)
+		close(p->stream_fd);
+	if (p->journal != NULL) {
+		journal_close(p->journal, 1);
+		free(p->journal);
+	}
+	pane_cancel_substitute(p);
+	if (p->filter != NULL) {
+		filter_abandon(&p->filter->proc);
+		free_bufline_list(p->filter->sent_head);
+		string_free(p->filter->inbuf);
+		string_free(p->filter->partial);
+		free(p->filter);
+	}
+	pane_clear_undo(p);
+	free(p->cursors);
+	if (p->diff != NULL) {
+		diffbase_free(p->diff);
+		free(p->diff);
+	}
+	if (p->words != NULL) {
+		wordindex_free(p->words);
+		free(p->words);
+	}
 	string_free(p->name);
-	free_bufline_list(first_line);
+	string_free(p->path);
+	free_bufline_list(p->_priv_first_line);
+	if (p->pager != NULL) {
+		pager_close(p->pager);
+		free(p->pager);
+	}
 }
 
-void editor_new(struct editor *e, str_t initial_contents) {
+static void editor_init(struct editor *e) {
 	e->mode = MODE_NORMAL;
 	e->commandline = string_new();
 	e->errormsg = string_new();
 	e->should_exit = 0;
+	e->on_server = 0;
+	e->should_detach = 0;
+	e->needs_redraw = 0;
+	e->count = 0;
+	e->pending_reg_key = 0;
+	e->recording = 0;
+	e->last_macro = 0;
+	memset(e->macros, 0, sizeof(e->macros));
+	e->replay_depth = 0;
+	e->cmd_failed = 0;
+	e->input_fd = -1;
+	e->pending_op = 0;
+	e->op_count = 0;
+	memset(e->registers, 0, sizeof(e->registers));
+	e->selected_reg = 0;
+	e->msg_is_info = 0;
+	e->compl_words = NULL;
+	e->ncompl = 0;
+	e->compl_sel = 0;
+	e->compl_idx = 0;
+	e->picker = NULL;
+	e->hex = NULL;
+	e->screen_bytes = 0;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (pool_init(&e->pool, MIN((size_t) MAX(ncpu, 1L), (size_t) POOL_MAX_THREADS)))
+		err(1, "eventfd");
+}
+
+void editor_new(struct editor *e, str_t initial_contents) {
+	editor_init(e);
 	pane_new(&e->foobar123lol, initial_contents);
 }
 
+// takes ownership of `pg`
+void editor_new_paged(struct editor *e, struct pager *pg) {
+	editor_init(e);
+	pane_new_paged(&e->foobar123lol, pg);
+}
+
+// counts the words of the next lines for completion, starting over from the first line
+// the first time. returns nonzero if there are lines left.
+static int pane_index_words(struct pane *p) {
+	if (p->words == NULL) {
+		p->words = malloc(sizeof(struct wordindex));
+		wordindex_init(p->words);
+		p->words_next = p->_priv_first_line;
+	}
+
+	struct bufline *bl = p->words_next;
+	for (size_t i = 0; bl != NULL && i < COMPL_INDEX_CHUNK_LINES; i++, bl = bl->next) {
+		bl->indexed = 1;
+		wordindex_update(p->words, string_as_str(bl->string), 0, bl->string.len, 1);
+	}
+	p->words_next = bl;
+	return bl != NULL;
+}
+
+// does a slice of background work. returns nonzero if there is more left to do.
+int editor_idle_work(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	if (p->pager == NULL)
+		return pane_index_words(p);
+
+	if (!p->pager->index_complete) {
+		off_t before = p->pager->indexed_off * 100 / p->pager->size;
+		int more = pager_index_step(p->pager, PAGER_CHUNK_SIZE);
+		if (!more || p->pager->indexed_off * 100 / p->pager->size != before)
+			e->needs_redraw = 1;
+		if (more)
+			return 1;
+	}
+
+	// so that the next time this file is opened, the index doesn't have to be rebuilt.
+	// the index may also have been completed by a jump rather than here. a failed save
+	// isn't retried.
+	if (!p->pager->index_cached) {
+		(void) idxcache_save(p->pager);
+		p->pager->index_cached = 1;
+	}
+	return 0;
+}
+
 void editor_free(struct editor *e) {
 	pane_free(&e->foobar123lol);
 	string_free(e->commandline);
 	string_free(e->errormsg);
+	for (int i = 0; i < 26; i++)
+		free(e->macros[i].keys);
+	for (int i = 0; i < 27; i++)
+		regtext_release(e->registers[i]);
+	for (size_t i = 0; i < e->ncompl; i++)
+		string_free(e->compl_words[i]);
+	free(e->compl_words);
+	if (e->picker != NULL) {
+		picker_free(e->picker);
+		free(e->picker);
+	}
+	if (e->hex != NULL) {
+		hexview_close(e->hex);
+		free(e->hex);
+	}
+	pool_free(&e->pool);
 }
 
 static void render_flowed_text(struct framebuf *fb, struct rect area, str_t text, struct style sty) {
@@ -72,9 +525,15 @@ static void render_flowed_text(struct framebuf *fb, struct rect area, str_t text
 }
 
 static void editor_render_cursor(struct editor *e, struct framebuf *fb, struct rect editor_area) {
+	if (e->picker != NULL) {
+		// cursorx/cursory set in editor_render_picker()
+		fb->cursor_style = CURSOR_BAR;
+		return;
+	}
+
 	switch (e->mode) {
 	case MODE_NORMAL:
-		// cursorx/cursory set in pane_render()
+		// cursorx/cursory set in pane_render() (or editor_render_hex())
 		fb->cursor_style = CURSOR_BLOCK;
 		break;
 	case MODE_INSERT:
@@ -93,304 +552,3384 @@ static void editor_render_cursor(struct editor *e, struct framebuf *fb, struct r
 // factor in tab width, nonprint characters "<XX>" width, ...
 static int cursor_idx_to_col(str_t cursor_line, size_t cursor_idx) {
 	int ret = 0;
-	for (int i = 0; i < cursor_idx; i++) {
-		// TODO: more generic/less "hardcodey" way of handling >1-wide characters
-		if (cursor_line.ptr[i] == '\t') {
-			ret += TAB_WIDTH;
-		} else if (isprint(cursor_line.ptr[i])) {
-			ret += 1;
-		} else {
-			ret += sizeof("<XX>") - 1;
-		}
-	}
+	for (size_t i = 0; i < cursor_idx && i < cursor_line.len; i++)
+		ret += wrap_char_width(cursor_line.ptr[i]);
 	return ret;
 }
 
-static void pane_line_up(struct pane *p) {
+static void pane_clamp_cursor_idx(struct pane *p) {
+	if (p->_priv_cursor_line->string.len == 0) {
+		p->cursor_line_idx = 0;
+	} else {
+		p->cursor_line_idx = MIN(p->cursor_line_idx, p->_priv_cursor_line->string.len - 1);
+	}
+}
+
+// returns nonzero if the cursor moved
+static int pane_line_up(struct pane *p) {
+	if (p->_priv_cursor_line->prev == NULL && p->pager != NULL) {
+		pane_window_extend_up(p, PAGER_WINDOW_LINES / 4);
+		pane_window_trim(p);
+	}
+
 	if (p->_priv_cursor_line->prev != NULL) {
 		p->_priv_cursor_line = p->_priv_cursor_line->prev;
-		if (p->_priv_cursor_line->string.len == 0) {
-			p->cursor_line_idx = 0;
-		} else {
-			p->cursor_line_idx = MIN(p->cursor_line_idx, p->_priv_cursor_line->string.len - 1);
-		}
-		p->_priv_cursor_line_no -= 1;
+		pane_clamp_cursor_idx(p);
+		if (p->_priv_cursor_line_no != 0)
+			p->_priv_cursor_line_no -= 1;
+		return 1;
 	}
+	return 0;
 }
 
-static void pane_line_down(struct pane *p) {
+// returns nonzero if the cursor moved
+static int pane_line_down(struct pane *p) {
+	if (p->_priv_cursor_line->next == NULL && p->pager != NULL) {
+		pane_window_extend_down(p, PAGER_WINDOW_LINES / 4);
+		pane_window_trim(p);
+	}
+
 	if (p->_priv_cursor_line->next != NULL) {
 		p->_priv_cursor_line = p->_priv_cursor_line->next;
-		if (p->_priv_cursor_line->string.len == 0) {
-			p->cursor_line_idx = 0;
-		} else {
-			p->cursor_line_idx = MIN(p->cursor_line_idx, p->_priv_cursor_line->string.len - 1);
-		}
-		p->_priv_cursor_line_no += 1;
+		pane_clamp_cursor_idx(p);
+		if (p->_priv_cursor_line_no != 0)
+			p->_priv_cursor_line_no += 1;
+		return 1;
 	}
+	return 0;
 }
 
-static void pane_render(struct pane *p, struct framebuf *fb, struct rect area) {
-	area = framebuf_intersect(fb, area);
-	if (rect_empty(area))
-		return;
+// soft wrap: moves the cursor one screen row down, which may be on the same line. it keeps
+// its column within the row where it can. returns nonzero if the cursor moved.
+static int pane_row_down(struct pane *p) {
+	struct bufline *bl = pane_get_cursor_line(p);
+	const struct wraplayout *l = wrap_layout(bl, p->text_width);
+	size_t row = wrap_row_of(l, p->cursor_line_idx);
+	int col = cursor_idx_to_col(wrap_row_str(l, string_as_str(bl->string), row), p->cursor_line_idx - l->starts[row]);
+	if (row + 1 < l->nrows) {
+		p->cursor_line_idx = wrap_idx_at_col(l, string_as_str(bl->string), row + 1, col);
+		return 1;
+	}
+	if (!pane_line_down(p))
+		return 0;
+	bl = pane_get_cursor_line(p);
+	l = wrap_layout(bl, p->text_width);
+	p->cursor_line_idx = wrap_idx_at_col(l, string_as_str(bl->string), 0, col);
+	return 1;
+}
 
-	// TODO: proper viewport scrolling
-	p->screen_top_line = pane_get_cursor_line(p);
+static int pane_row_up(struct pane *p) {
+	struct bufline *bl = pane_get_cursor_line(p);
+	const struct wraplayout *l = wrap_layout(bl, p->text_width);
+	size_t row = wrap_row_of(l, p->cursor_line_idx);
+	int col = cursor_idx_to_col(wrap_row_str(l, string_as_str(bl->string), row), p->cursor_line_idx - l->starts[row]);
+	if (row > 0) {
+		p->cursor_line_idx = wrap_idx_at_col(l, string_as_str(bl->string), row - 1, col);
+		return 1;
+	}
+	if (!pane_line_up(p))
+		return 0;
+	bl = pane_get_cursor_line(p);
+	l = wrap_layout(bl, p->text_width);
+	p->cursor_line_idx = wrap_idx_at_col(l, string_as_str(bl->string), l->nrows - 1, col);
+	return 1;
+}
 
-	struct rect gutter_area = { .x = area.x, .y = area.y };
-	struct rect content_area = area;
-	if (p->show_line_nums) {
-		gutter_area.height = area.height;
-		gutter_area.width = 4;
-		content_area.width -= gutter_area.width;
-		content_area.x += gutter_area.width;
+// j and k go by screen rows with soft wrap on. other cursors only move by whole lines, so
+// they go by lines while there are any.
+static int pane_moves_by_row(struct pane *p) {
+	return p->soft_wrap && p->text_width > 0 && p->ncursors == 0;
+}
+
+static void pane_goto_last_line(struct pane *p) {
+	if (p->pager == NULL) {
+		while (pane_line_down(p))
+			;
+		return;
 	}
 
-	struct rect line_area = content_area;
-	line_area.height = 1;
-	{
-		str_t str = string_as_str(pane_get_cursor_line(p)->string);
-		fb->cursorx = line_area.x + cursor_idx_to_col(str, p->cursor_line_idx);
+	pane_window_reload(p, p->pager->size);
+	pane_window_extend_up(p, PAGER_WINDOW_LINES / 2);
+	if (p->_priv_first_line == NULL) {
+		struct bufline *bl = bufline_new_with_string(string_new());
+		pane_link_lines(p, NULL, bl, bl);
 	}
-	fb->cursory = line_area.y;
+	p->_priv_cursor_line = p->_priv_last_line;
+	p->_priv_cursor_line_no = 0;
+	pane_clamp_cursor_idx(p);
+	pane_resolve_line_no(p);
+}
 
-	struct rect line_num_area = gutter_area;
-	line_num_area.height = 1;
+static void pane_goto_line(struct pane *p, size_t lineno) {
+	lineno = MAX(lineno, 1);
+	size_t cur = pane_get_cursor_line_no(p);
 
-	int cursorline_screen_y = 0;
-	for (struct bufline *bl = p->screen_top_line; bl != NULL; bl = bl->next) {
-		if (line_area.y >= content_area.height)
-			break;
+	// close enough to walk there
+	if (p->pager == NULL || (cur != 0 && (lineno > cur ? lineno - cur : cur - lineno) < p->win_nlines)) {
+		while (pane_get_cursor_line_no(p) < lineno && pane_line_down(p))
+			;
+		while (pane_get_cursor_line_no(p) > lineno && pane_line_up(p))
+			;
+		return;
+	}
 
-		char linenum[10];
-		if (bl == pane_get_cursor_line(p)) {
-			snprintf(linenum, sizeof(linenum), "%-3zu ", pane_get_cursor_line_no(p));
-			fb->cursory += cursorline_screen_y;
-		} else {
-			snprintf(linenum, sizeof(linenum), "%3d ", cursorline_screen_y + 1);
+	// the window's own changes only count towards the line numbers of the rest of the
+	// file once they are back in the pager
+	pane_window_reload(p, p->win_start);
+
+	size_t n;
+	off_t off;
+	struct pager_edit *e = pager_resolve_line(p->pager, lineno, &n);
+	if (e != NULL) {
+		off = e->start;
+	} else {
+		off = pager_line_offset(p->pager, n);
+		n = 0;
+		if (off == -1) {
+			pane_goto_last_line(p);
+			return;
 		}
-		cursorline_screen_y += 1;
+	}
 
-		str_t linenum_str = { .ptr = linenum, .len = strlen(linenum) };
-		render_flowed_text(fb, line_num_area, linenum_str, GUTTER_STYLE);
-		line_num_area.y += 1;
+	pane_window_reload(p, off);
+	pane_window_extend_down(p, PAGER_WINDOW_LINES / 2 + n);
+	p->_priv_cursor_line = p->_priv_first_line;
+	for (; n > 0 && p->_priv_cursor_line->next != NULL; n--)
+		p->_priv_cursor_line = p->_priv_cursor_line->next;
+	p->_priv_cursor_line_no = lineno;
+	pane_clamp_cursor_idx(p);
+}
+
+// all changes to the buffer's contents go through the pane_* edit functions below.
+// `lineno` is the line number of `bl`, for the recovery journal (not used in paged mode).
+// lines may share their text with registers, so each function makes sure the line has
+// its own copy first.
+
+static void pane_journal(struct pane *p, struct bufline *bl, struct journal_record rec) {
+	p->change_seq += 1;
+	if (p->journal == NULL)
+		return;
 
-		render_flowed_text(fb, line_area, string_as_str(bl->string), NORMAL_STYLE);
-		line_area.y += 1;
+	// paged mode: the line number may not be known yet, but where the window starts in
+	// the file always is
+	if (p->pager != NULL) {
+		rec.lineno = 0;
+		rec.line_off = p->win_start;
+		rec.line_skip = pager_line_delta_before(p->pager, p->win_start);
+		for (struct bufline *l = p->_priv_first_line; l != bl; l = l->next)
+			rec.line_skip++;
 	}
+	journal_record(p->journal, rec);
 }
 
-static void render_statusline(struct editor *e, struct framebuf *fb, struct rect area) {
-	area = framebuf_intersect(fb, area);
-	if (rect_empty(area))
-		return;
+// keeps the completion index up to date: takes out the words of `bl` around the range
+// [lo, hi] that an edit is about to change (`add` 0), or puts back the ones around the
+// range it changed (`add` 1)
+static void pane_words_update(struct pane *p, struct bufline *bl, size_t lo, size_t hi, int add) {
+	if (p->words != NULL && bl->indexed)
+		wordindex_update(p->words, string_as_str(bl->string), lo, hi, add);
+}
 
-	render_solid_color(fb, area, LIGHTBG_COLOR);
+static void pane_insert_char(struct pane *p, struct bufline *bl, size_t lineno, size_t idx, char ch) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_INSERT_CHAR, .lineno = lineno, .arg = idx, .ch = ch });
+	bufline_unshare(bl);
+	pane_words_update(p, bl, idx, idx, 0);
+	string_insert(&bl->string, idx, ch);
+	pane_words_update(p, bl, idx, idx + 1, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+	colindex_inserted(bl, idx, (str_t) { .ptr = &ch, .len = 1 });
+}
 
-	struct style modestyle;
-	str_t modestr;
+static void pane_remove_char(struct pane *p, struct bufline *bl, size_t lineno, size_t idx) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_REMOVE_CHAR, .lineno = lineno, .arg = idx });
+	bufline_unshare(bl);
+	colindex_deleting(bl, idx, 1);
+	pane_words_update(p, bl, idx, idx + 1, 0);
+	string_remove(&bl->string, idx);
+	pane_words_update(p, bl, idx, idx, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+}
 
-	switch (e->mode) {
-	case MODE_NORMAL:
-		modestyle = STATUSLINE_NORMAL_MODE_STYLE;
-		modestr = STR(" NORMAL ");
-		break;
-	case MODE_COMMAND:
-		modestyle = STATUSLINE_COMMAND_MODE_STYLE;
-		modestr = STR(" COMMAND ");
-		break;
-	case MODE_INSERT:
-		modestyle = STATUSLINE_INSERT_MODE_STYLE;
-		modestr = STR(" INSERT ");
-		break;
-	}
+static void pane_truncate_line(struct pane *p, struct bufline *bl, size_t lineno, size_t len) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_TRUNCATE, .lineno = lineno, .arg = len });
+	bufline_unshare(bl);
+	pane_words_update(p, bl, len, bl->string.len, 0);
+	bl->string.len = len;
+	pane_words_update(p, bl, len, len, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+	colindex_truncate(bl, len);
+}
 
-	struct rect mode_area = { .x = area.x, .y = area.y, .width = modestr.len, .height = 1 };
-	render_str(fb, mode_area, modestr, modestyle);
+// moves the text after `idx` onto a new line below `bl`, and returns the new line
+static struct bufline *pane_split_line(struct pane *p, struct bufline *bl, size_t lineno, size_t idx) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_SPLIT, .lineno = lineno, .arg = idx });
+	bufline_unshare(bl);
+	string_t tail = str_to_string(str_slice_idx_to_eol(string_as_str(bl->string), idx));
+	if (idx < bl->string.len) {
+		pane_words_update(p, bl, idx, bl->string.len, 0);
+		bl->string.len = idx;
+		pane_words_update(p, bl, idx, idx, 1);
+		bl->dirty = 1;
+		wrap_invalidate(bl);
+		colindex_truncate(bl, idx);
+	}
 
-	struct pane *curp = editor_get_focused_pane(e);
+	struct bufline *newl = bufline_new_with_string(tail);
+	newl->dirty = 1;
+	pane_link_lines(p, bl, newl, newl);
+	p->win_nlines += 1;
+	return newl;
+}
 
-	struct rect name_area = {
-		.x = area.x + mode_area.width,
-		.y = area.y,
-		// +2 for an extra ' ' on both sides
-		.width = curp->name.len + 2,
-		.height = 1,
-	};
-	render_solid_color(fb, name_area, STATUSLINE_SECONDARY_STYLE.bg);
-	name_area.x += 1;
-	render_str(fb, name_area, string_as_str(curp->name), STATUSLINE_SECONDARY_STYLE);
+// appends the line after `bl` onto the end of `bl`, and removes it
+static void pane_join_next_line(struct pane *p, struct bufline *bl, size_t lineno) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_JOIN, .lineno = lineno });
+	bufline_unshare(bl);
+	struct bufline *next = bl->next;
+	size_t len = bl->string.len;
+	pane_words_update(p, bl, len, len, 0);
+	string_append(&bl->string, string_as_str(next->string));
+	pane_words_update(p, bl, len, bl->string.len, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+	pane_unlink_lines(p, next, next);
+	p->win_nlines -= 1;
+	bufline_free(next);
 }
 
-void editor_render(struct editor *e, struct framebuf *fb, struct rect area) {
-	area = framebuf_intersect(fb, area);
-	if (rect_empty(area))
-		return;
+// removes `n` bytes starting at `idx`
+static void pane_delete_chars(struct pane *p, struct bufline *bl, size_t lineno, size_t idx, size_t n) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_DELETE_CHARS, .lineno = lineno, .arg = idx, .count = n });
+	bufline_unshare(bl);
+	colindex_deleting(bl, idx, n);
+	pane_words_update(p, bl, idx, idx + n, 0);
+	memmove(bl->string.ptr + idx, bl->string.ptr + idx + n, bl->string.len - idx - n);
+	bl->string.len -= n;
+	pane_words_update(p, bl, idx, idx, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+}
 
-	int commandline_line_used = e->mode == MODE_COMMAND || e->errormsg.len > 0;
+// takes the `n` lines `first`..`last` out of the buffer in one splice, leaving them to the
+// caller as a standalone list. returns the line that took their place (the one after
+// them, or before them if they were at the end) and its line number.
+static struct cursor pane_take_lines(struct pane *p, struct bufline *first, struct bufline *last, size_t lineno, size_t n) {
+	pane_journal(p, first, (struct journal_record) { .op = JOP_DELETE_LINES, .lineno = lineno, .arg = n });
 
-	int statusline_y = area.height - (commandline_line_used ? 2 : 1);
-	struct rect statusline_area = {
-		.x = area.x,
-		.y = statusline_y,
-		.width = area.width,
-		.height = 1,
-	};
-	render_statusline(e, fb, statusline_area);
+	// paged mode: the rest of the file may just not be loaded yet
+	if (p->pager != NULL && first->prev == NULL && last->next == NULL) {
+		pane_window_extend_down(p, 1);
+		if (last->next == NULL)
+			pane_window_extend_up(p, 1);
+	}
 
-	struct rect cmdline_area = {
-		.x = area.x,
-		.y = area.y + area.height - 1,
-		.width = area.width,
-		.height = 1
-	};
-	if (e->mode == MODE_COMMAND) {
-		render_str(fb, cmdline_area, commandline_prompt, GUTTER_STYLE);
-		cmdline_area.x += commandline_prompt.len;
-		cmdline_area.width = e->commandline.len;
-		render_str(fb, cmdline_area, string_as_str(e->commandline), NORMAL_STYLE);
-	} else if (e->errormsg.len > 0) {
-		render_str(fb, cmdline_area, string_as_str(e->errormsg), ERRORMSG_STYLE);
+	struct cursor ret = { .line = last->next, .lineno = lineno };
+	if (ret.line == NULL) {
+		ret.line = first->prev;
+		ret.lineno = lineno > 1 ? lineno - 1 : 0;
 	}
+	pane_unlink_lines(p, first, last);
+	p->win_nlines -= n;
 
-	struct rect mainview_area = {
-		.x = area.x,
-		.y = area.y,
-		.width = area.width,
-		.height = area.height - (commandline_line_used ? 2 : 1),
-	};
-	pane_render(&e->foobar123lol, fb, mainview_area);
+	// the buffer always has at least one line
+	if (ret.line == NULL) {
+		ret.line = bufline_new_with_string(string_new());
+		ret.line->dirty = 1;
+		pane_link_lines(p, NULL, ret.line, ret.line);
+		p->win_nlines += 1;
+		ret.lineno = 1;
+	}
+	return ret;
+}
 
-	// render cursor last, because pane_render() can set cursorx/cursory for e.g. normal mode.
-	// it doesn't matter that the cursor gets moved during rendering; fb->cursor(x|y) just stores
-	// the position and then actually moves the cursor as the final step of rendering in
-	// framebuf_display().
-	editor_render_cursor(e, fb, area);
+// removes the `n` lines `first`..`last`, like pane_take_lines()
+static struct cursor pane_delete_lines(struct pane *p, struct bufline *first, struct bufline *last, size_t lineno, size_t n) {
+	struct cursor ret = pane_take_lines(p, first, last, lineno, n);
+	free_bufline_list(first);
+	return ret;
 }
 
-static void editor_handle_normal_mode_keyevt(struct editor *e, struct keyevt evt) {
-	struct pane *curp = editor_get_focused_pane(e);
+// inserts `text`, which may span several lines, at `idx`. the new lines are linked in
+// all at once. returns the line the text ends on, and the index just past it.
+static struct cursor pane_insert_text(struct pane *p, struct bufline *bl, size_t lineno, size_t idx, str_t text) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_INSERT_TEXT, .lineno = lineno, .arg = idx, .text = text });
+	bufline_unshare(bl);
 
-	if (EVT_IS_CHAR(evt, ' ')) {
-		string_clear(&e->commandline);
-		string_clear(&e->errormsg);
-		e->mode = MODE_COMMAND;
-		return;
-	}
+	string_t rest = str_to_string(str_slice_idx_to_eol(string_as_str(bl->string), idx));
+	str_t first = str_slice_idx_to_eol(text, 0);
+	pane_words_update(p, bl, idx, bl->string.len, 0);
+	bl->string.len = idx;
+	string_append(&bl->string, first);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
 
-	if (EVT_IS_CHAR(evt, 'i')) {
-		e->mode = MODE_INSERT;
-		return;
+	struct cursor end = { .line = bl, .lineno = lineno, .idx = bl->string.len };
+	struct bufline *head = NULL;
+	struct bufline *tail = NULL;
+	for (size_t pos = first.len + 1; pos <= text.len; ) {
+		str_t seg = str_slice_idx_to_eol(text, pos);
+		struct bufline *newl = bufline_new_with_string(str_to_string(seg));
+		newl->dirty = 1;
+		newl->prev = tail;
+		if (tail != NULL)
+			tail->next = newl;
+		else
+			head = newl;
+		tail = newl;
+		pos += seg.len + 1;
+		p->win_nlines += 1;
+		end = (struct cursor) { .line = newl, .lineno = end.lineno != 0 ? end.lineno + 1 : 0, .idx = seg.len };
 	}
+	// the rest goes on before the new lines are linked in, so that they are linked in
+	// as they will stay
+	string_append(&end.line->string, string_as_str(rest));
+	string_free(rest);
+	pane_words_update(p, bl, idx, bl->string.len, 1);
+	if (head != NULL)
+		pane_link_lines(p, bl, head, tail);
 
-	if (EVT_IS_CHAR(evt, 'x')) {
-		struct bufline *curlin = pane_get_cursor_line(curp);
-		if (curlin->string.len == 0)
-			return;
+	// the line's checkpoints past `idx` only still hold (shifted) if it wasn't split
+	if (end.line == bl)
+		colindex_inserted(bl, idx, first);
+	else
+		colindex_truncate(bl, idx);
+	return end;
+}
 
-		string_remove(&curlin->string, curp->cursor_line_idx);
+// links the `n` new lines `head`..`tail` in after `after` (line `lineno`), or at the very
+// start of the buffer if `after` is NULL
+static void pane_insert_lines(struct pane *p, struct bufline *after, size_t lineno, struct bufline *head, struct bufline *tail, size_t n) {
+	// journaled as the equivalent text insertion
+	string_t text = string_new();
+	for (struct bufline *bl = head; p->journal != NULL; bl = bl->next) {
+		if (after != NULL)
+			string_push(&text, '\n');
+		string_append(&text, string_as_str(bl->string));
+		if (after == NULL)
+			string_push(&text, '\n');
+		if (bl == tail)
+			break;
+	}
+	if (after != NULL)
+		pane_journal(p, after, (struct journal_record) { .op = JOP_INSERT_TEXT, .lineno = lineno, .arg = after->string.len, .text = string_as_str(text) });
+	else
+		pane_journal(p, p->_priv_first_line, (struct journal_record) { .op = JOP_INSERT_TEXT, .lineno = 1, .arg = 0, .text = string_as_str(text) });
+	string_free(text);
+
+	for (struct bufline *bl = head; ; bl = bl->next) {
+		bl->dirty = 1;
+		if (bl == tail)
+			break;
+	}
+	pane_link_lines(p, after, head, tail);
+	p->win_nlines += n;
+}
+
+// replaces the contents of `bl` with `s`, which it takes over
+static void pane_replace_line(struct pane *p, struct bufline *bl, size_t lineno, string_t s) {
+	pane_journal(p, bl, (struct journal_record) { .op = JOP_REPLACE_LINE, .lineno = lineno, .text = string_as_str(s) });
+	pane_words_update(p, bl, 0, bl->string.len, 0);
+	if (bl->shared != NULL)
+		sharedtext_release(bl->shared);
+	else
+		string_free(bl->string);
+	bl->shared = NULL;
+	bl->string = s;
+	pane_words_update(p, bl, 0, bl->string.len, 1);
+	bl->dirty = 1;
+	wrap_invalidate(bl);
+	colindex_drop(bl);
+}
+
+// multi-cursor editing. an edit is applied at every cursor in a single pass over the
+// cursors in buffer order. earlier cursors' edits shift the positions of later ones,
+// so the pass carries the accumulated shift along instead of looking each cursor up again.
+
+static struct cursor pane_main_cursor(struct pane *p) {
+	return (struct cursor) {
+		.line = p->_priv_cursor_line,
+		.lineno = p->_priv_cursor_line_no,
+		.idx = p->cursor_line_idx,
+	};
+}
+
+static int cursor_cmp(struct cursor a, struct cursor b) {
+	if (a.lineno != b.lineno)
+		return a.lineno < b.lineno ? -1 : 1;
+	if (a.idx != b.idx)
+		return a.idx < b.idx ? -1 : 1;
+	return 0;
+}
+
+// drops cursors that ended up on the same spot (as another one or as the main cursor)
+static void pane_dedup_cursors(struct pane *p) {
+	struct cursor main = pane_main_cursor(p);
+	size_t n = 0;
+	for (size_t i = 0; i < p->ncursors; i++) {
+		if (cursor_cmp(p->cursors[i], main) == 0)
+			continue;
+		if (n > 0 && cursor_cmp(p->cursors[i], p->cursors[n - 1]) == 0)
+			continue;
+		p->cursors[n++] = p->cursors[i];
+	}
+	p->ncursors = n;
+}
+
+// merges the sorted cursors `add` into the pane's
+static void pane_add_cursors(struct pane *p, struct cursor *add, size_t n) {
+	if (n == 0)
+		return;
+
+	size_t cap = MAX(p->ncursors + n, 16);
+	struct cursor *merged = malloc(sizeof(merged[0]) * cap);
+	size_t i = 0, j = 0, k = 0;
+	while (i < p->ncursors || j < n) {
+		if (j == n || (i < p->ncursors && cursor_cmp(p->cursors[i], add[j]) <= 0))
+			merged[k++] = p->cursors[i++];
+		else
+			merged[k++] = add[j++];
+	}
+
+	free(p->cursors);
+	p->cursors = merged;
+	p->ncursors = k;
+	p->cursorcap = cap;
+	pane_dedup_cursors(p);
+}
+
+static void pane_clear_cursors(struct pane *p) {
+	p->ncursors = 0;
+}
+
+enum cursor_motion {
+	CURSOR_LEFT,
+	CURSOR_RIGHT,
+	CURSOR_UP,
+	CURSOR_DOWN,
+	CURSOR_LINE_START,
+	// one past the last character (insert mode)
+	CURSOR_LINE_END,
+	// one to the right, up to one past the last character (insert mode)
+	CURSOR_APPEND,
+	// back onto a character after leaving insert mode
+	CURSOR_CLAMP,
+};
+
+static void cursor_move(struct cursor *c, enum cursor_motion m) {
+	size_t len = c->line->string.len;
+	switch (m) {
+	case CURSOR_LEFT:
+		c->idx = c->idx > 0 ? c->idx - 1 : 0;
+		return;
+	case CURSOR_RIGHT:
+		if (len > 0)
+			c->idx = MIN(len - 1, c->idx + 1);
+		return;
+	case CURSOR_UP:
+		if (c->line->prev == NULL)
+			return;
+		c->line = c->line->prev;
+		c->lineno -= 1;
+		break;
+	case CURSOR_DOWN:
+		if (c->line->next == NULL)
+			return;
+		c->line = c->line->next;
+		c->lineno += 1;
+		break;
+	case CURSOR_LINE_START:
+		c->idx = 0;
+		return;
+	case CURSOR_LINE_END:
+		c->idx = len;
+		return;
+	case CURSOR_APPEND:
+		c->idx = MIN(len, c->idx + 1);
+		return;
+	case CURSOR_CLAMP:
+		break;
+	}
+
+	len = c->line->string.len;
+	c->idx = len == 0 ? 0 : MIN(c->idx, len - 1);
+}
+
+// moves the other cursors; the main one is moved by the caller
+static void pane_move_cursors(struct pane *p, enum cursor_motion m) {
+	for (size_t i = 0; i < p->ncursors; i++)
+		cursor_move(&p->cursors[i], m);
+	pane_dedup_cursors(p);
+}
+
+enum cursor_edit {
+	CURSOR_INSERT_CHAR,
+	// removes the character under the cursor
+	CURSOR_DELETE,
+	// removes the character before the cursor, or joins onto the previous line
+	CURSOR_BACKSPACE,
+	CURSOR_NEWLINE,
+	// removes everything from the cursor to the end of the line
+	CURSOR_TRUNCATE,
+};
+
+// state carried from one cursor to the next during an edit pass
+struct cursor_pass {
+	// the line the previous cursor was on before the edit
+	struct bufline *orig;
+	// where the rest of `orig`, past the previous cursor, is now
+	struct bufline *now;
+	size_t now_lineno;
+	// add to a position on `orig` to get the position on `now`
+	long col_shift;
+	// lines added (or removed, if negative) so far
+	long line_shift;
+};
+
+static void pane_cursor_edit(struct pane *p, struct cursor_pass *pass, struct cursor *c, enum cursor_edit op, char ch) {
+	if (c->line != pass->orig) {
+		pass->orig = c->line;
+		pass->now = c->line;
+		pass->now_lineno = c->lineno + pass->line_shift;
+		pass->col_shift = 0;
+	}
+
+	struct bufline *bl = pass->now;
+	size_t idx = MIN(c->idx + pass->col_shift, bl->string.len);
+	switch (op) {
+	case CURSOR_INSERT_CHAR:
+		pane_insert_char(p, bl, pass->now_lineno, idx, ch);
+		pass->col_shift += 1;
+		idx += 1;
+		break;
+	case CURSOR_DELETE:
+		if (idx < bl->string.len) {
+			pane_remove_char(p, bl, pass->now_lineno, idx);
+			pass->col_shift -= 1;
+		}
+		break;
+	case CURSOR_BACKSPACE:
+		if (idx > 0) {
+			pane_remove_char(p, bl, pass->now_lineno, idx - 1);
+			pass->col_shift -= 1;
+			idx -= 1;
+		} else if (bl->prev != NULL) {
+			struct bufline *prev = bl->prev;
+			size_t origlen = prev->string.len;
+			pane_join_next_line(p, prev, pass->now_lineno - 1);
+			pass->now = prev;
+			pass->now_lineno -= 1;
+			pass->line_shift -= 1;
+			pass->col_shift += origlen;
+			idx = origlen;
+		}
+		break;
+	case CURSOR_NEWLINE:
+		pass->now = pane_split_line(p, bl, pass->now_lineno, idx);
+		pass->now_lineno += 1;
+		pass->line_shift += 1;
+		pass->col_shift -= idx;
+		idx = 0;
+		break;
+	case CURSOR_TRUNCATE:
+		if (idx < bl->string.len)
+			pane_truncate_line(p, bl, pass->now_lineno, idx);
+		break;
+	}
+
+	c->line = pass->now;
+	c->lineno = pass->now_lineno;
+	c->idx = idx;
+}
+
+// applies `op` at every cursor, including the main one
+static void pane_edit_at_cursors(struct pane *p, enum cursor_edit op, char ch) {
+	struct cursor_pass pass = { 0 };
+	struct cursor main = pane_main_cursor(p);
+	int main_done = 0;
+
+	for (size_t i = 0; i < p->ncursors; i++) {
+		if (!main_done && cursor_cmp(main, p->cursors[i]) < 0) {
+			pane_cursor_edit(p, &pass, &main, op, ch);
+			main_done = 1;
+		}
+		pane_cursor_edit(p, &pass, &p->cursors[i], op, ch);
+	}
+	if (!main_done)
+		pane_cursor_edit(p, &pass, &main, op, ch);
+
+	p->_priv_cursor_line = main.line;
+	p->_priv_cursor_line_no = main.lineno;
+	p->cursor_line_idx = main.idx;
+	pane_dedup_cursors(p);
+}
+
+// adds a cursor on the line below the last cursor, in the main cursor's column
+static void pane_add_cursor_below(struct pane *p) {
+	struct cursor last = pane_main_cursor(p);
+	if (p->ncursors > 0 && cursor_cmp(p->cursors[p->ncursors - 1], last) > 0)
+		last = p->cursors[p->ncursors - 1];
+	if (last.line->next == NULL)
+		return;
+
+	last.idx = p->cursor_line_idx;
+	cursor_move(&last, CURSOR_DOWN);
+	pane_add_cursors(p, &last, 1);
+}
+
+// adds cursors in the main cursor's column on the `n` lines below it, or on as many as there
+// are. returns -1 if out of memory.
+static int pane_add_cursor_column(struct pane *p, size_t n) {
+	// grown as lines are found rather than sized by `n`, which can be anything
+	struct cursor *add = NULL;
+	size_t cap = 0;
+	struct cursor c = pane_main_cursor(p);
+	size_t count = 0;
+	for (; count < n && c.line->next != NULL; count++) {
+		if (count == cap) {
+			cap = MAX(cap * 2, 64);
+			struct cursor *grown = realloc(add, sizeof(add[0]) * cap);
+			if (grown == NULL) {
+				free(add);
+				return -1;
+			}
+			add = grown;
+		}
+		c.idx = p->cursor_line_idx;
+		cursor_move(&c, CURSOR_DOWN);
+		add[count] = c;
+	}
+	pane_add_cursors(p, add, count);
+	free(add);
+	return 0;
+}
+
+// adds a cursor at the start of every occurrence of `needle` (at most one per position)
+static size_t pane_add_cursors_at_matches(struct pane *p, str_t needle) {
+	if (needle.len == 0)
+		return 0;
+
+	struct cursor *add = NULL;
+	size_t count = 0;
+	size_t cap = 0;
+	size_t lineno = 1;
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next, lineno++) {
+		str_t hay = string_as_str(bl->string);
+		for (size_t idx = 0; idx + needle.len <= hay.len; idx++) {
+			if (memcmp(hay.ptr + idx, needle.ptr, needle.len))
+				continue;
+			if (count == cap) {
+				cap = MAX(cap * 2, 64);
+				add = realloc(add, sizeof(add[0]) * cap);
+			}
+			add[count++] = (struct cursor) { .line = bl, .lineno = lineno, .idx = idx };
+			idx += needle.len - 1;
+		}
+	}
+
+	pane_add_cursors(p, add, count);
+	free(add);
+	return count;
+}
+
+// the word (or, if not on one, the character) under the main cursor
+static str_t pane_word_at_cursor(struct pane *p) {
+	str_t line = string_as_str(pane_get_cursor_line(p)->string);
+	size_t idx = p->cursor_line_idx;
+	if (idx >= line.len)
+		return (str_t) { .ptr = line.ptr, .len = 0 };
+	if (!isalnum((unsigned char) line.ptr[idx]) && line.ptr[idx] != '_')
+		return (str_t) { .ptr = line.ptr + idx, .len = 1 };
+
+	size_t start = idx;
+	size_t end = idx;
+	while (start > 0 && (isalnum((unsigned char) line.ptr[start - 1]) || line.ptr[start - 1] == '_'))
+		start--;
+	while (end < line.len && (isalnum((unsigned char) line.ptr[end]) || line.ptr[end] == '_'))
+		end++;
+	return (str_t) { .ptr = line.ptr + start, .len = end - start };
+}
+
+// adds a cursor at the next occurrence, after the last cursor, of the word under the main cursor
+static int pane_add_cursor_at_next_match(struct pane *p) {
+	str_t word = pane_word_at_cursor(p);
+	if (word.len == 0)
+		return -1;
+	// matches are marked by their first character, so the main cursor should be too
+	p->cursor_line_idx = word.ptr - pane_get_cursor_line(p)->string.ptr;
+
+	struct cursor c = pane_main_cursor(p);
+	if (p->ncursors > 0 && cursor_cmp(p->cursors[p->ncursors - 1], c) > 0)
+		c = p->cursors[p->ncursors - 1];
+	size_t from = c.idx + 1;
+	for (; c.line != NULL; c.line = c.line->next, c.lineno++, from = 0) {
+		str_t hay = string_as_str(c.line->string);
+		for (size_t idx = from; idx + word.len <= hay.len; idx++) {
+			if (!memcmp(hay.ptr + idx, word.ptr, word.len)) {
+				c.idx = idx;
+				pane_add_cursors(p, &c, 1);
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+// follow mode and streaming: appends text that was added to the end of the file
+static void pane_append_text(struct pane *p, str_t text) {
+	if (text.len == 0)
+		return;
+
+	size_t idx = 0;
+	if (p->last_line_open) {
+		str_t rest_of_line = str_slice_idx_to_eol(text, 0);
+		struct bufline *last = p->_priv_last_line;
+		size_t len = last->string.len;
+		bufline_unshare(last);
+		pane_words_update(p, last, len, len, 0);
+		string_append(&last->string, rest_of_line);
+		pane_words_update(p, last, len, last->string.len, 1);
+		wrap_invalidate(p->_priv_last_line);
+		idx = rest_of_line.len + 1;
+		// the line is still the file's last one, which has more to it now
+		if (p->diff != NULL && !p->_priv_last_line->dirty && p->diff->n > 0)
+			p->diff->hashes[p->diff->n - 1] = str_hash(string_as_str(p->_priv_last_line->string));
+	}
+
+	if (idx < text.len) {
+		struct bufline *tail;
+		struct bufline *head = str_to_buflines((str_t) { .ptr = text.ptr + idx, .len = text.len - idx });
+		for (struct bufline *bl = head; bl != NULL; bl = bl->next) {
+			bl->orig_off += p->loaded_size + idx;
+			if (p->diff != NULL)
+				diffbase_push(p->diff, bl->orig_off, string_as_str(bl->string));
+		}
+		p->win_nlines += bufline_list_len(head, &tail);
+		pane_link_lines(p, p->_priv_last_line, head, tail);
+	}
+
+	p->last_line_open = text.ptr[text.len - 1] != '\n';
+	p->loaded_size += text.len;
+}
+
+// the diff gutter compares against the lines as they are now, which have to be the file's
+static void pane_start_diff(struct pane *p) {
+	p->diff = malloc(sizeof(struct diffbase));
+	diffbase_init(p->diff);
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next)
+		diffbase_push(p->diff, bl->orig_off, string_as_str(bl->string));
+}
+
+// the file was replaced (or truncated) and `text` is all of it now: start over, like
+// pane_reopen_pager() does in paged mode. changes made to the old contents are lost.
+static void pane_reload(struct pane *p, str_t text) {
+	pane_clear_undo(p);
+	p->ncursors = 0;
+	if (p->words != NULL) {
+		wordindex_free(p->words);
+		free(p->words);
+		p->words = NULL;
+		p->words_next = NULL;
+	}
+	if (p->diff != NULL) {
+		diffbase_free(p->diff);
+		free(p->diff);
+	}
+
+	free_bufline_list(p->_priv_first_line);
+	p->_priv_first_line = str_to_buflines(text);
+	p->_priv_last_line = p->_priv_first_line;
+	while (p->_priv_last_line->next != NULL)
+		p->_priv_last_line = p->_priv_last_line->next;
+	p->_priv_cursor_line = p->_priv_first_line;
+	p->screen_top_line = p->_priv_cursor_line;
+	p->_priv_cursor_line_no = 1;
+	p->cursor_line_idx = 0;
+	p->left_col = 0;
+	p->last_line_open = text.len == 0 || text.ptr[text.len - 1] != '\n';
+	p->loaded_size = text.len;
+	pane_start_diff(p);
+}
+
+// paged mode: the file grew to `size`
+static void pane_window_grow_file(struct pane *p, off_t size) {
+	struct bufline *last = p->_priv_last_line;
+	// a partial last line has to be read again, even with the cursor on it. left in the
+	// window, it would be handed back to the pager as a change that ends the line early.
+	int reread = p->win_end == p->pager->size
+		&& !last->dirty
+		&& last->orig_off >= 0
+		&& last->orig_off + (off_t) last->string.len == p->win_end;
+	int had_cursor = reread && last == p->_priv_cursor_line;
+	int had_top = reread && last == p->screen_top_line;
+	if (reread) {
+		p->win_end = last->orig_off;
+		pane_unlink_lines(p, last, last);
+		p->win_nlines -= 1;
+		bufline_free(last);
+	}
+
+	pager_set_size(p->pager, size);
+	p->loaded_size = size;
+
+	if (reread) {
+		pane_window_extend_down(p, 1);
+		if (p->_priv_first_line == NULL) {
+			struct bufline *bl = bufline_new_with_string(string_new());
+			pane_link_lines(p, NULL, bl, bl);
+		}
+		// the line only got longer, so the cursor's column is still on it
+		if (had_cursor)
+			p->_priv_cursor_line = p->_priv_last_line;
+		if (had_top)
+			p->screen_top_line = p->_priv_last_line;
+	}
+}
+
+// paged mode: the file was replaced, start over
+static void pane_reopen_pager(struct pane *p) {
+	struct pager *pg = malloc(sizeof(struct pager));
+	if (pager_open(pg, p->path.ptr)) {
+		free(pg);
+		return;
+	}
+
+	free_bufline_list(p->_priv_first_line);
+	p->_priv_first_line = NULL;
+	p->_priv_last_line = NULL;
+	pager_close(p->pager);
+	free(p->pager);
+	(void) idxcache_load(pg);
+
+	p->pager = pg;
+	p->win_start = 0;
+	p->win_end = 0;
+	p->win_nlines = 0;
+	pane_window_extend_down(p, PAGER_WINDOW_LINES);
+	if (p->_priv_first_line == NULL) {
+		struct bufline *bl = bufline_new_with_string(string_new());
+		pane_link_lines(p, NULL, bl, bl);
+	}
+	p->_priv_cursor_line = p->_priv_first_line;
+	p->screen_top_line = p->_priv_cursor_line;
+	p->_priv_cursor_line_no = 1;
+	p->cursor_line_idx = 0;
+	p->loaded_size = pg->size;
+}
+
+// index of the first of the other cursors that is on line `lineno` or later
+static size_t pane_first_cursor_from(struct pane *p, size_t lineno) {
+	size_t lo = 0;
+	size_t hi = p->ncursors;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (p->cursors[mid].lineno < lineno)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// `col` is where the cursor is in `line_area`
+static void render_extra_cursor(struct framebuf *fb, struct rect line_area, str_t line, size_t idx, size_t col) {
+	if (col >= (size_t) line_area.width)
+		return;
+	struct rect cell = {
+		.x = line_area.x + col,
+		.y = line_area.y,
+		.width = 1,
+		.height = 1,
+	};
+
+	char ch = idx < line.len && isprint((unsigned char) line.ptr[idx]) ? line.ptr[idx] : ' ';
+	render_str(fb, cell, (str_t) { .ptr = &ch, .len = 1 }, EXTRA_CURSOR_STYLE);
+}
+
+// draws `bl` with its first `left_col` columns scrolled off. only the part that is on
+// screen is looked at. a tab or <XX> cut by the left edge is left out.
+static void render_line_from_col(struct framebuf *fb, struct rect area, struct bufline *bl, size_t left_col) {
+	str_t line = string_as_str(bl->string);
+	size_t col;
+	size_t idx = colindex_idx_at_col(bl, left_col, &col);
+	// the whole line is scrolled off
+	if (idx == line.len)
+		return;
+	if (col < left_col) {
+		col += wrap_char_width(line.ptr[idx]);
+		idx++;
+		if (col - left_col >= (size_t) area.width)
+			return;
+		area.x += col - left_col;
+		area.width -= col - left_col;
+	}
+	render_str(fb, area, (str_t) { .ptr = line.ptr + idx, .len = line.len - idx }, NORMAL_STYLE);
+}
+
+// the diff gutter: the index in the diff base of the file line that `bl` still is, or -1
+// if it has changed (or isn't from the file)
+static ssize_t pane_diff_base_index(struct pane *p, struct bufline *bl) {
+	if (bl->dirty || bl->orig_off < 0)
+		return -1;
+	return diffbase_find(p->diff, bl->orig_off);
+}
+
+// sets the marks for the lines `seg[from..to)`, which are all changed (or new), and stand
+// where the file had the lines between `prev` and `next` (indexes in the diff base;
+// `prev` is -1 at the start of the file, and `next` the number of lines at its end).
+// `known` is 0 if where they stand couldn't be found.
+static void pane_diff_gap(struct pane *p, struct bufline **seg, unsigned char *marks, size_t from, size_t to, ssize_t prev, ssize_t next, int known) {
+	if (!known) {
+		for (size_t i = from; i < to; i++)
+			marks[i] = DIFF_MODIFIED;
+		return;
+	}
+
+	size_t na = next - prev - 1, nb = to - from;
+	const uint64_t *a = p->diff->hashes + prev + 1;
+	uint64_t *b = malloc(sizeof(b[0]) * MAX(nb, (size_t) 1));
+	for (size_t i = 0; i < nb; i++)
+		b[i] = str_hash(string_as_str(seg[from + i]->string));
+	unsigned char *a_kept = malloc(MAX(na, (size_t) 1));
+	unsigned char *b_kept = malloc(MAX(nb, (size_t) 1));
+	if (linediff_diff(a, na, b, nb, DIFF_MAX_EDITS, a_kept, b_kept)) {
+		// too different to be worth diffing: line for line, whatever isn't the same is changed
+		for (size_t i = 0; i < MIN(na, nb); i++)
+			a_kept[i] = b_kept[i] = a[i] == b[i];
+		memset(a_kept + MIN(na, nb), 0, na - MIN(na, nb));
+		memset(b_kept + MIN(na, nb), 0, nb - MIN(na, nb));
+	}
+
+	// in each stretch that differs, lines that took the place of removed ones are
+	// modified, and the rest are added
+	size_t x = 0, y = 0;
+	while (x < na || y < nb) {
+		if (x < na && y < nb && a_kept[x] && b_kept[y]) {
+			x++, y++;
+			continue;
+		}
+		size_t nremoved = 0, start = y;
+		for (; x < na && !a_kept[x]; x++)
+			nremoved++;
+		for (; y < nb && !b_kept[y]; y++)
+			marks[from + y] = y - start < nremoved ? DIFF_MODIFIED : DIFF_ADDED;
+		if (nremoved <= y - start)
+			continue;
+		// marked on the line above where they were, or on the first line
+		size_t at = from + y > 0 ? from + y - 1 : 0;
+		if (marks[at] == DIFF_NONE)
+			marks[at] = DIFF_REMOVED;
+	}
+	free(b);
+	free(a_kept);
+	free(b_kept);
+}
+
+// the diff gutter's marks for the `n` lines from `top` down. lines that haven't changed
+// line the buffer up with the file, so only the changed stretches around the screen have
+// to be diffed: this costs about as much as the screen and the edits next to it, however
+// long the file is.
+static void pane_diff_marks(struct pane *p, struct bufline *top, size_t n, unsigned char *out) {
+	// the lines on screen, and around them up to the nearest unchanged ones
+	size_t cap = n + 2 * DIFF_MAX_GAP + 2;
+	struct bufline **seg = malloc(sizeof(seg[0]) * cap);
+	ssize_t *idx = malloc(sizeof(idx[0]) * cap);
+	size_t nback = 0;
+	struct bufline *first = top;
+	while (first->prev != NULL && nback < DIFF_MAX_GAP && pane_diff_base_index(p, first) < 0) {
+		first = first->prev;
+		nback++;
+	}
+	size_t nseg = 0;
+	ssize_t last_anchor = -1;
+	for (struct bufline *bl = first; bl != NULL && nseg < cap; bl = bl->next) {
+		seg[nseg] = bl;
+		idx[nseg] = pane_diff_base_index(p, bl);
+		// an unchanged line out of order (e.g. after the lines were moved around) can't
+		// be lined up with the file
+		if (idx[nseg] >= 0 && idx[nseg] <= last_anchor)
+			idx[nseg] = -1;
+		if (idx[nseg] >= 0)
+			last_anchor = idx[nseg];
+		nseg++;
+		if (nseg >= nback + n && (idx[nseg - 1] >= 0 || nseg >= nback + n + DIFF_MAX_GAP))
+			break;
+	}
+
+	unsigned char *marks = calloc(nseg, 1);
+	size_t i = 0;
+	ssize_t prev = -1;
+	int prev_known = first->prev == NULL;
+	if (idx[0] >= 0) {
+		prev = idx[0];
+		prev_known = 1;
+		i = 1;
+	}
+	while (i <= nseg) {
+		size_t j = i;
+		while (j < nseg && idx[j] < 0)
+			j++;
+		ssize_t next = j < nseg ? idx[j] : (ssize_t) p->diff->n;
+		int next_known = j < nseg || seg[nseg - 1]->next == NULL;
+		if (j > i || next > prev + 1)
+			pane_diff_gap(p, seg, marks, i, j, prev, next, prev_known && next_known);
+		if (j == nseg)
+			break;
+		prev = idx[j];
+		prev_known = 1;
+		i = j + 1;
+	}
+
+	memset(out, DIFF_NONE, n);
+	memcpy(out, marks + nback, MIN(n, nseg - nback));
+	free(marks);
+	free(seg);
+	free(idx);
+}
+
+static void pane_render(struct pane *p, struct framebuf *fb, struct rect area) {
+	area = framebuf_intersect(fb, area);
+	if (rect_empty(area))
+		return;
+
+	// TODO: proper viewport scrolling
+	p->screen_top_line = pane_get_cursor_line(p);
+	p->last_height = area.height;
+
+	if (p->pager != NULL) {
+		int n = 1;
+		for (struct bufline *bl = p->screen_top_line; bl->next != NULL && n < area.height; bl = bl->next)
+			n++;
+		if (n < area.height)
+			pane_window_extend_down(p, area.height - n);
+		pane_resolve_line_no(p);
+	}
+
+	struct rect gutter_area = { .x = area.x, .y = area.y };
+	struct rect content_area = area;
+	// with a diff base, the gutter starts with a column for the diff marks
+	int sign_width = p->diff != NULL ? 1 : 0;
+	unsigned char *marks = NULL;
+	if (p->show_line_nums) {
+		gutter_area.height = area.height;
+		gutter_area.width = 4 + sign_width;
+		content_area.width -= gutter_area.width;
+		content_area.x += gutter_area.width;
+		if (sign_width > 0) {
+			marks = malloc(area.height);
+			pane_diff_marks(p, p->screen_top_line, area.height, marks);
+		}
+	}
+	p->text_width = content_area.width;
+
+	// with soft wrap, the cursor line starts at the top unless that would put the cursor
+	// below the bottom
+	size_t top_row = 0;
+	int cursor_col;
+	{
+		struct bufline *curlin = pane_get_cursor_line(p);
+		str_t str = string_as_str(curlin->string);
+		if (p->soft_wrap && content_area.width > 0) {
+			const struct wraplayout *l = wrap_layout(curlin, content_area.width);
+			size_t row = wrap_row_of(l, p->cursor_line_idx);
+			if (row >= (size_t) content_area.height)
+				top_row = row - content_area.height + 1;
+			cursor_col = cursor_idx_to_col(wrap_row_str(l, str, row), p->cursor_line_idx - l->starts[row]);
+			fb->cursory = content_area.y + row - top_row;
+		} else {
+			// scrolled sideways just enough to keep the cursor on screen. the column is
+			// looked up from the line's index, so a huge line costs no more than a short one.
+			size_t col = colindex_col(curlin, p->cursor_line_idx);
+			if (col < p->left_col)
+				p->left_col = col;
+			else if (content_area.width > 0 && col >= p->left_col + content_area.width)
+				p->left_col = col - content_area.width + 1;
+			cursor_col = col - p->left_col;
+			fb->cursory = content_area.y;
+		}
+		fb->cursorx = content_area.x + cursor_col;
+	}
+
+	// other cursors that are on screen, found by their line number
+	size_t lineno = pane_get_cursor_line_no(p);
+	size_t next_cursor = pane_first_cursor_from(p, lineno);
+
+	struct rect line_area = content_area;
+	line_area.height = 1;
+	struct rect line_num_area = gutter_area;
+	line_num_area.height = 1;
+	line_num_area.x += sign_width;
+	line_num_area.width -= sign_width;
+	int relative_no = 0;
+	for (struct bufline *bl = p->screen_top_line; bl != NULL; bl = bl->next, lineno++) {
+		if (line_area.y >= content_area.y + content_area.height)
+			break;
+
+		if (marks != NULL) {
+			static const char signs[] = { [DIFF_NONE] = ' ', [DIFF_ADDED] = '+', [DIFF_MODIFIED] = '~', [DIFF_REMOVED] = '_' };
+			static const struct style styles[] = {
+				[DIFF_NONE] = GUTTER_STYLE,
+				[DIFF_ADDED] = DIFF_ADDED_STYLE,
+				[DIFF_MODIFIED] = DIFF_MODIFIED_STYLE,
+				[DIFF_REMOVED] = DIFF_REMOVED_STYLE,
+			};
+			struct rect sign_area = { .x = gutter_area.x, .y = line_num_area.y, .width = 1, .height = 1 };
+			render_str(fb, sign_area, (str_t) { .ptr = &signs[marks[relative_no]], .len = 1 }, styles[marks[relative_no]]);
+		}
+
+		char linenum[10];
+		if (bl == pane_get_cursor_line(p) && pane_get_cursor_line_no(p) == 0)
+			snprintf(linenum, sizeof(linenum), "?   ");
+		else if (bl == pane_get_cursor_line(p))
+			snprintf(linenum, sizeof(linenum), "%-3zu ", pane_get_cursor_line_no(p));
+		else
+			snprintf(linenum, sizeof(linenum), "%3d ", relative_no + 1);
+		relative_no += 1;
+		str_t linenum_str = { .ptr = linenum, .len = strlen(linenum) };
+		render_flowed_text(fb, line_num_area, linenum_str, GUTTER_STYLE);
+
+		str_t line = string_as_str(bl->string);
+		size_t cursors_end = next_cursor;
+		while (cursors_end < p->ncursors && p->cursors[cursors_end].lineno == lineno)
+			cursors_end++;
+		if (!p->soft_wrap || content_area.width <= 0) {
+			render_line_from_col(fb, line_area, bl, p->left_col);
+			for (; next_cursor < cursors_end; next_cursor++) {
+				size_t idx = p->cursors[next_cursor].idx;
+				size_t col = colindex_col(bl, idx);
+				if (col >= p->left_col)
+					render_extra_cursor(fb, line_area, line, idx, col - p->left_col);
+			}
+			line_area.y += 1;
+			line_num_area.y += 1;
+			continue;
+		}
+
+		// only the rows on screen are looked at, and the layout is reused from the last frame
+		const struct wraplayout *l = wrap_layout(bl, content_area.width);
+		for (size_t row = top_row; row < l->nrows && line_area.y < content_area.y + content_area.height; row++) {
+			str_t rowstr = wrap_row_str(l, line, row);
+			render_str(fb, line_area, rowstr, NORMAL_STYLE);
+			for (size_t i = next_cursor; i < cursors_end; i++) {
+				size_t idx = p->cursors[i].idx;
+				if (wrap_row_of(l, idx) == row)
+					render_extra_cursor(fb, line_area, rowstr, idx - l->starts[row], cursor_idx_to_col(rowstr, idx - l->starts[row]));
+			}
+			line_area.y += 1;
+		}
+		next_cursor = cursors_end;
+		top_row = 0;
+		line_num_area.y = line_area.y;
+	}
+	free(marks);
+}
+
+// the query on the first line, then the best matches below it
+static void editor_render_picker(struct editor *e, struct framebuf *fb, struct rect area) {
+	area = framebuf_intersect(fb, area);
+	if (rect_empty(area))
+		return;
+
+	struct picker *pk = e->picker;
+	str_t prompt = STR("open: ");
+	struct rect line_area = { .x = area.x, .y = area.y, .width = area.width, .height = 1 };
+	render_str(fb, line_area, prompt, GUTTER_STYLE);
+	struct rect query_area = { .x = area.x + prompt.len, .y = area.y, .width = area.width - prompt.len, .height = 1 };
+	render_str(fb, query_area, string_as_str(pk->query), NORMAL_STYLE);
+	fb->cursorx = query_area.x + pk->query.len;
+	fb->cursory = query_area.y;
+
+	char count[64];
+	snprintf(count, sizeof(count), "%zu/%zu%s", pk->nmatches, pk->ncands, pk->walk_done ? "" : " walking");
+	int count_width = strlen(count);
+	if (query_area.x + (int) pk->query.len + 1 + count_width < area.x + area.width) {
+		struct rect count_area = { .x = area.x + area.width - count_width, .y = area.y, .width = count_width, .height = 1 };
+		render_str(fb, count_area, cstr_as_str(count), GUTTER_STYLE);
+	}
+
+	size_t n = picker_rank(pk, area.height - 1);
+	for (size_t i = 0; i < n; i++) {
+		struct rect row = { .x = area.x, .y = area.y + 1 + i, .width = area.width, .height = 1 };
+		struct style sty = i == pk->selected ? STATUSLINE_SECONDARY_STYLE : NORMAL_STYLE;
+		render_solid_color(fb, row, sty.bg);
+		row.x += 2;
+		row.width -= 2;
+		render_str(fb, row, pk->cands[pk->top[i].cand], sty);
+	}
+}
+
+// the rows from the top one down, each formatted from the bytes at its offset alone, and the
+// cursor on the hex digits of its byte, with the byte's character marked too
+static void editor_render_hex(struct editor *e, struct framebuf *fb, struct rect area) {
+	area = framebuf_intersect(fb, area);
+	if (rect_empty(area))
+		return;
+
+	struct hexview *hv = e->hex;
+	hv->last_height = area.height;
+	hexview_scroll_to_cursor(hv, area.height);
+	char row[HEXVIEW_ROW_MAX];
+	for (int y = 0; y < area.height; y++) {
+		off_t off = hv->top + (off_t) y * HEXVIEW_ROW_BYTES;
+		if (off >= hv->size)
+			break;
+		size_t len = hexview_format_row(hv, off, row);
+		struct rect offset_area = { .x = area.x, .y = area.y + y, .width = hv->offset_digits, .height = 1 };
+		render_str(fb, offset_area, (str_t) { .ptr = row, .len = hv->offset_digits }, GUTTER_STYLE);
+		struct rect bytes_area = { .x = area.x + hv->offset_digits, .y = area.y + y, .width = area.width - hv->offset_digits, .height = 1 };
+		render_str(fb, bytes_area, (str_t) { .ptr = row + hv->offset_digits, .len = len - hv->offset_digits }, NORMAL_STYLE);
+	}
+
+	size_t i = hv->cursor % HEXVIEW_ROW_BYTES;
+	fb->cursorx = MIN(area.x + hexview_hex_col(hv, i), area.x + area.width - 1);
+	fb->cursory = area.y + (hv->cursor - hv->top) / HEXVIEW_ROW_BYTES;
+	int textx = area.x + hexview_text_col(hv, i);
+	if (hv->size > 0 && textx < area.x + area.width)
+		fb->buf[fb->cursory * fb->width + textx].style = EXTRA_CURSOR_STYLE;
+}
+
+static void render_statusline(struct editor *e, struct framebuf *fb, struct rect area) {
+	area = framebuf_intersect(fb, area);
+	if (rect_empty(area))
+		return;
+
+	render_solid_color(fb, area, LIGHTBG_COLOR);
+
+	struct style modestyle;
+	str_t modestr;
+
+	switch (e->mode) {
+	case MODE_NORMAL:
+		modestyle = STATUSLINE_NORMAL_MODE_STYLE;
+		modestr = STR(" NORMAL ");
+		break;
+	case MODE_COMMAND:
+		modestyle = STATUSLINE_COMMAND_MODE_STYLE;
+		modestr = STR(" COMMAND ");
+		break;
+	case MODE_INSERT:
+		modestyle = STATUSLINE_INSERT_MODE_STYLE;
+		modestr = STR(" INSERT ");
+		break;
+	}
+
+	struct rect mode_area = { .x = area.x, .y = area.y, .width = modestr.len, .height = 1 };
+	render_str(fb, mode_area, modestr, modestyle);
+
+	struct pane *curp = editor_get_focused_pane(e);
+	str_t name = e->hex != NULL ? cstr_as_str(e->hex->path) : string_as_str(curp->name);
+
+	struct rect name_area = {
+		.x = area.x + mode_area.width,
+		.y = area.y,
+		// +2 for an extra ' ' on both sides
+		.width = name.len + 2,
+		.height = 1,
+	};
+	render_solid_color(fb, name_area, STATUSLINE_SECONDARY_STYLE.bg);
+	name_area.x += 1;
+	render_str(fb, name_area, name, STATUSLINE_SECONDARY_STYLE);
+
+	char info[128] = "";
+	if (e->hex != NULL) {
+		char pos[64];
+		snprintf(pos, sizeof(pos), " hex 0x%llx/0x%llx (%d%%)", (unsigned long long) e->hex->cursor,
+			(unsigned long long) e->hex->size, (int) (e->hex->cursor * 100 / MAX(e->hex->size, (off_t) 1)));
+		strcat(info, pos);
+	}
+	if (curp->follow != NULL)
+		strcat(info, " following");
+	if (curp->stream_fd != -1)
+		strcat(info, " reading");
+	if (e->recording != 0) {
+		char recording[32];
+		snprintf(recording, sizeof(recording), " recording @%c", e->recording);
+		strcat(info, recording);
+	}
+	if (curp->ncursors > 0) {
+		char ncursors[32];
+		snprintf(ncursors, sizeof(ncursors), " %zu cursors", curp->ncursors + 1);
+		strcat(info, ncursors);
+	}
+	if (curp->pager != NULL && !curp->pager->index_complete) {
+		char progress[32];
+		snprintf(progress, sizeof(progress), " indexing %d%%", (int) (curp->pager->indexed_off * 100 / curp->pager->size));
+		strcat(info, progress);
+	}
+	if (curp->filter != NULL) {
+		char progress[48];
+		snprintf(progress, sizeof(progress), " filtering: %zu lines out (Esc cancels)", curp->filter->nlines_out);
+		strcat(info, progress);
+	}
+	if (curp->subst != NULL) {
+		char progress[48];
+		snprintf(progress, sizeof(progress), " substituting %d%% (Esc cancels)", (int) (atomic_load(&curp->subst->done) * 100 / MAX(curp->subst->nlines, (size_t) 1)));
+		strcat(info, progress);
+	}
+	struct rect info_area = {
+		.x = name_area.x + name_area.width,
+		.y = area.y,
+		.width = strlen(info),
+		.height = 1,
+	};
+	render_str(fb, info_area, cstr_as_str(info), STATUSLINE_INFO_STYLE);
+}
+
+// the words Ctrl-N and Ctrl-P go through, in a popup under the word being completed (or
+// above it, if there is more room there)
+static void editor_render_completion(struct editor *e, struct framebuf *fb, struct rect area) {
+	struct pane *p = editor_get_focused_pane(e);
+	int width = 0;
+	for (size_t i = 0; i < e->ncompl; i++)
+		width = MAX(width, (int) e->compl_words[i].len + 2);
+	width = MIN(width, area.width);
+	int height = (int) e->ncompl;
+	int below = area.y + area.height - (fb->cursory + 1);
+	int above = fb->cursory - area.y;
+	int y = fb->cursory + 1;
+	if (below < height && above > below) {
+		height = MIN(height, above);
+		y = fb->cursory - height;
+	} else {
+		height = MIN(height, below);
+	}
+	int x = fb->cursorx - (int) (p->cursor_line_idx - e->compl_idx) - 1;
+	x = MAX(MIN(x, area.x + area.width - width), area.x);
+
+	// the selected word is kept in view if there are more than fit
+	size_t first = e->compl_sel >= (size_t) height ? e->compl_sel - height + 1 : 0;
+	string_t row = string_new();
+	for (int i = 0; i < height; i++) {
+		size_t w = first + i;
+		string_clear(&row);
+		string_push(&row, ' ');
+		string_append(&row, string_as_str(e->compl_words[w]));
+		while (row.len < (size_t) width)
+			string_push(&row, ' ');
+		struct rect r = { .x = x, .y = y + i, .width = width, .height = 1 };
+		render_str(fb, r, string_as_str(row), w == e->compl_sel ? COMPL_SELECTED_STYLE : COMPL_STYLE);
+	}
+	string_free(row);
+}
+
+void editor_render(struct editor *e, struct framebuf *fb, struct rect area) {
+	e->screen_bytes = fb->bufcap * sizeof(fb->buf[0]);
+	area = framebuf_intersect(fb, area);
+	if (rect_empty(area))
+		return;
+
+	int commandline_line_used = e->mode == MODE_COMMAND || e->errormsg.len > 0;
+
+	int statusline_y = area.height - (commandline_line_used ? 2 : 1);
+	struct rect statusline_area = {
+		.x = area.x,
+		.y = statusline_y,
+		.width = area.width,
+		.height = 1,
+	};
+	render_statusline(e, fb, statusline_area);
+
+	struct rect cmdline_area = {
+		.x = area.x,
+		.y = area.y + area.height - 1,
+		.width = area.width,
+		.height = 1
+	};
+	if (e->mode == MODE_COMMAND) {
+		render_str(fb, cmdline_area, commandline_prompt, GUTTER_STYLE);
+		cmdline_area.x += commandline_prompt.len;
+		cmdline_area.width = e->commandline.len;
+		render_str(fb, cmdline_area, string_as_str(e->commandline), NORMAL_STYLE);
+	} else if (e->errormsg.len > 0) {
+		render_str(fb, cmdline_area, string_as_str(e->errormsg), e->msg_is_info ? NORMAL_STYLE : ERRORMSG_STYLE);
+	}
+
+	struct rect mainview_area = {
+		.x = area.x,
+		.y = area.y,
+		.width = area.width,
+		.height = area.height - (commandline_line_used ? 2 : 1),
+	};
+	if (e->picker != NULL)
+		editor_render_picker(e, fb, mainview_area);
+	else if (e->hex != NULL)
+		editor_render_hex(e, fb, mainview_area);
+	else
+		pane_render(&e->foobar123lol, fb, mainview_area);
+	if (e->mode == MODE_INSERT && e->ncompl > 0)
+		editor_render_completion(e, fb, mainview_area);
+
+	// render cursor last, because pane_render() can set cursorx/cursory for e.g. normal mode.
+	// it doesn't matter that the cursor gets moved during rendering; fb->cursor(x|y) just stores
+	// the position and then actually moves the cursor as the final step of rendering in
+	// framebuf_display().
+	editor_render_cursor(e, fb, area);
+}
+
+static void editor_error(struct editor *e, const char *fmt, ...) {
+	char errmsg[1000];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(errmsg, sizeof(errmsg), fmt, ap);
+	va_end(ap);
+	string_clear(&e->errormsg);
+	string_append(&e->errormsg, cstr_as_str(errmsg));
+	e->msg_is_info = 0;
+	e->cmd_failed = 1;
+}
+
+// like editor_error(), but for output that isn't a failure
+static void editor_message(struct editor *e, const char *fmt, ...) {
+	char msg[1000];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	string_clear(&e->errormsg);
+	string_append(&e->errormsg, cstr_as_str(msg));
+	e->msg_is_info = 1;
+}
+
+// motions and operators. an operator (d, c, y, >, <) first works out the range of the
+// buffer its motion covers, then changes the whole range at once.
+
+// paged mode: loads more of the file if `bl` is the last line of the window
+static struct bufline *pane_line_after(struct pane *p, struct bufline *bl) {
+	if (bl->next == NULL && p->pager != NULL)
+		pane_window_extend_down(p, PAGER_WINDOW_LINES / 4);
+	return bl->next;
+}
+
+static struct bufline *pane_line_before(struct pane *p, struct bufline *bl) {
+	if (bl->prev == NULL && p->pager != NULL)
+		pane_window_extend_up(p, PAGER_WINDOW_LINES / 4);
+	return bl->prev;
+}
+
+static void cursor_next_line(struct cursor *c, struct bufline *next) {
+	c->line = next;
+	c->lineno = c->lineno != 0 ? c->lineno + 1 : 0;
+	c->idx = 0;
+}
+
+static void cursor_prev_line(struct cursor *c, struct bufline *prev) {
+	c->line = prev;
+	c->lineno = c->lineno > 1 ? c->lineno - 1 : 0;
+	c->idx = 0;
+}
+
+// 0 for whitespace, 1 for word characters, 2 for other punctuation
+static int char_class(char ch) {
+	if (isspace((unsigned char) ch))
+		return 0;
+	if (isalnum((unsigned char) ch) || ch == '_')
+		return 1;
+	return 2;
+}
+
+static size_t first_nonblank(str_t line) {
+	size_t idx = 0;
+	while (idx < line.len && isspace((unsigned char) line.ptr[idx]))
+		idx++;
+	return idx;
+}
+
+// moves `c` to the start of the next word; an empty line counts as a word too.
+// with `stay_on_line`, stops at the end of the line rather than going on to the next one.
+static void pane_word_forward(struct pane *p, struct cursor *c, int stay_on_line) {
+	str_t line = string_as_str(c->line->string);
+	size_t idx = c->idx;
+	if (idx < line.len && char_class(line.ptr[idx]) != 0) {
+		int cls = char_class(line.ptr[idx]);
+		while (idx < line.len && char_class(line.ptr[idx]) == cls)
+			idx++;
+	}
+
+	for (;;) {
+		while (idx < line.len && char_class(line.ptr[idx]) == 0)
+			idx++;
+		struct bufline *next;
+		if (idx < line.len || stay_on_line || (next = pane_line_after(p, c->line)) == NULL)
+			break;
+		cursor_next_line(c, next);
+		line = string_as_str(c->line->string);
+		idx = 0;
+		if (line.len == 0)
+			break;
+	}
+	c->idx = idx;
+}
+
+// moves `c` just past the end of the word it is on (or of the whitespace, if it's on some)
+static void word_end(struct cursor *c) {
+	str_t line = string_as_str(c->line->string);
+	if (c->idx >= line.len)
+		return;
+	int cls = char_class(line.ptr[c->idx]);
+	while (c->idx < line.len && char_class(line.ptr[c->idx]) == cls)
+		c->idx++;
+}
+
+// moves `c` to the next empty line after the current paragraph, or the last line
+static void pane_paragraph_forward(struct pane *p, struct cursor *c) {
+	struct bufline *next;
+	while (c->line->string.len == 0 && (next = pane_line_after(p, c->line)) != NULL)
+		cursor_next_line(c, next);
+	while (c->line->string.len != 0 && (next = pane_line_after(p, c->line)) != NULL)
+		cursor_next_line(c, next);
+}
+
+static void pane_paragraph_backward(struct pane *p, struct cursor *c) {
+	struct bufline *prev;
+	while (c->line->string.len == 0 && (prev = pane_line_before(p, c->line)) != NULL)
+		cursor_prev_line(c, prev);
+	while (c->line->string.len != 0 && (prev = pane_line_before(p, c->line)) != NULL)
+		cursor_prev_line(c, prev);
+}
+
+static void pane_set_cursor(struct pane *p, struct cursor c) {
+	p->_priv_cursor_line = c.line;
+	p->_priv_cursor_line_no = c.lineno;
+	p->cursor_line_idx = c.idx;
+}
+
+// part of the buffer an operator applies to
+struct range {
+	struct bufline *start;
+	// 0 if not known (paged mode)
+	size_t start_lineno;
+	size_t start_idx;
+	struct bufline *end;
+	// exclusive. only used for charwise ranges.
+	size_t end_idx;
+	// number of lines from `start` to `end`, inclusive
+	size_t nlines;
+	unsigned linewise : 1;
+};
+
+// the lines from the cursor's to `n` lines below it, inclusive (fewer if the buffer ends first)
+static struct range pane_lines_down(struct pane *p, size_t n) {
+	struct range r = {
+		.start = pane_get_cursor_line(p),
+		.start_lineno = pane_get_cursor_line_no(p),
+		.end = pane_get_cursor_line(p),
+		.nlines = 1,
+		.linewise = 1,
+	};
+	struct bufline *next;
+	for (; n > 0 && (next = pane_line_after(p, r.end)) != NULL; n--) {
+		r.end = next;
+		r.nlines++;
+	}
+	return r;
+}
+
+// works out what `motion` (repeated `count` times) covers, starting from the cursor.
+// `op` is the operator it is for. returns -1 if it isn't a motion, or doesn't move.
+static int pane_motion_range(struct pane *p, char op, struct keyevt motion, size_t count, int has_count, struct range *r) {
+	if (motion.kind != KEYKIND_CHAR || motion.ctrl)
+		return -1;
+
+	struct cursor cur = pane_main_cursor(p);
+	struct cursor c = cur;
+	struct bufline *bl;
+	char key = motion.kchar;
+
+	// `dd`, `yy`, `>>` etc. act on whole lines
+	if (key == op) {
+		*r = pane_lines_down(p, count - 1);
+		return 0;
+	}
+
+	switch (key) {
+	case 'j':
+		*r = pane_lines_down(p, count);
+		return r->nlines > 1 ? 0 : -1;
+	case 'k':
+		*r = (struct range) { .end = cur.line, .nlines = 1, .linewise = 1 };
+		for (; count > 0 && (bl = pane_line_before(p, c.line)) != NULL; count--) {
+			cursor_prev_line(&c, bl);
+			r->nlines++;
+		}
+		r->start = c.line;
+		r->start_lineno = c.lineno;
+		return r->nlines > 1 ? 0 : -1;
+	case 'G': {
+		// in paged mode, the end of the file might be gigabytes away
+		if (p->pager != NULL)
+			return -1;
+		size_t target = has_count ? count : SIZE_MAX;
+		*r = (struct range) { .start = cur.line, .start_lineno = cur.lineno, .end = cur.line, .nlines = 1, .linewise = 1 };
+		while (r->start_lineno > target && r->start->prev != NULL) {
+			r->start = r->start->prev;
+			r->start_lineno--;
+			r->nlines++;
+		}
+		for (size_t n = cur.lineno; n < target && r->end->next != NULL; n++) {
+			r->end = r->end->next;
+			r->nlines++;
+		}
+		return 0;
+	}
+	case '}':
+		// from the cursor's line up to the end of the paragraph
+		*r = (struct range) { .start = cur.line, .start_lineno = cur.lineno, .linewise = 1 };
+		for (; count > 0; count--)
+			pane_paragraph_forward(p, &c);
+		if (c.line != cur.line && c.line->string.len == 0)
+			cursor_prev_line(&c, c.line->prev);
+		r->end = c.line;
+		r->nlines = 1;
+		for (bl = r->start; bl != r->end; bl = bl->next)
+			r->nlines++;
+		return 0;
+	case 'w':
+		for (size_t i = 0; i < count; i++) {
+			int last = i + 1 == count;
+			// `cw` changes to the end of the word, like `ce`. `dw` on the last word
+			// of a line doesn't delete the line break.
+			if (last && op == 'c')
+				word_end(&c);
+			else
+				pane_word_forward(p, &c, last);
+		}
+		break;
+	case 'l':
+		c.idx = MIN(c.idx + count, c.line->string.len);
+		break;
+	case 'h':
+		c.idx -= MIN(count, c.idx);
+		break;
+	case '0':
+		c.idx = 0;
+		break;
+	default:
+		return -1;
+	}
+
+	// charwise
+	if (cursor_cmp(c, cur) < 0) {
+		struct cursor tmp = c;
+		c = cur;
+		cur = tmp;
+	}
+	if (cursor_cmp(c, cur) == 0)
+		return -1;
+	*r = (struct range) {
+		.start = cur.line,
+		.start_lineno = cur.lineno,
+		.start_idx = cur.idx,
+		.end = c.line,
+		.end_idx = c.idx,
+		.nlines = 1,
+	};
+	for (bl = cur.line; bl != c.line; bl = bl->next)
+		r->nlines++;
+	return 0;
+}
+
+static size_t range_end_lineno(struct range r) {
+	return r.start_lineno != 0 ? r.start_lineno + r.nlines - 1 : 0;
+}
+
+// removes a charwise range: what's left of its first and last lines are joined
+static void pane_delete_charwise(struct pane *p, struct range r) {
+	if (r.start == r.end) {
+		pane_delete_chars(p, r.start, r.start_lineno, r.start_idx, r.end_idx - r.start_idx);
+		return;
+	}
+
+	pane_delete_chars(p, r.end, range_end_lineno(r), 0, r.end_idx);
+	if (r.nlines > 2)
+		pane_delete_lines(p, r.start->next, r.end->prev, r.start_lineno != 0 ? r.start_lineno + 1 : 0, r.nlines - 2);
+	pane_truncate_line(p, r.start, r.start_lineno, r.start_idx);
+	pane_join_next_line(p, r.start, r.start_lineno);
+}
+
+// > and <: by one tab
+static void pane_shift_lines(struct pane *p, struct range r, int right) {
+	size_t lineno = r.start_lineno;
+	for (struct bufline *bl = r.start; ; bl = bl->next) {
+		str_t line = string_as_str(bl->string);
+		if (right && line.len > 0) {
+			pane_insert_char(p, bl, lineno, 0, '\t');
+		} else if (!right && line.len > 0 && line.ptr[0] == '\t') {
+			pane_remove_char(p, bl, lineno, 0);
+		} else if (!right) {
+			size_t n = 0;
+			while (n < line.len && n < TAB_WIDTH && line.ptr[n] == ' ')
+				n++;
+			if (n > 0)
+				pane_delete_chars(p, bl, lineno, 0, n);
+		}
+		if (bl == r.end)
+			break;
+		lineno = lineno != 0 ? lineno + 1 : 0;
+	}
+}
+
+// registers[] index of register `name` ('a'..'z', or 0 for the unnamed one)
+static size_t register_index(char name) {
+	return name == 0 ? 0 : (size_t) (name - 'a') + 1;
+}
+
+// stores `rt` (taking over the reference) in the selected register and the unnamed one
+static void editor_set_register(struct editor *e, struct regtext *rt) {
+	size_t i = register_index(e->selected_reg);
+	regtext_release(e->registers[i]);
+	e->registers[i] = rt;
+	if (i != 0) {
+		regtext_release(e->registers[0]);
+		e->registers[0] = regtext_ref(rt);
+	}
+}
+
+static void editor_apply_operator(struct editor *e, char op, struct range r) {
+	struct pane *p = editor_get_focused_pane(e);
+
+	// the register takes references to the lines' text rather than a copy of it
+	if (op == 'd' || op == 'c' || op == 'y')
+		editor_set_register(e, regtext_from_lines(r.start, r.start_idx, r.end, r.end_idx, r.nlines, r.linewise));
+
+	struct cursor c = { .line = r.start, .lineno = r.start_lineno, .idx = r.start_idx };
+	switch (op) {
+	case 'y':
+		if (r.linewise)
+			c.idx = MIN(p->cursor_line_idx, r.start->string.len);
+		pane_set_cursor(p, c);
+		pane_clamp_cursor_idx(p);
+		break;
+	case 'd':
+		if (r.linewise) {
+			c = pane_delete_lines(p, r.start, r.end, r.start_lineno, r.nlines);
+			c.idx = first_nonblank(string_as_str(c.line->string));
+		} else {
+			pane_delete_charwise(p, r);
+		}
+		pane_set_cursor(p, c);
+		pane_clamp_cursor_idx(p);
+		break;
+	case 'c':
+		if (r.linewise) {
+			if (r.nlines > 1)
+				pane_delete_lines(p, r.start->next, r.end, r.start_lineno != 0 ? r.start_lineno + 1 : 0, r.nlines - 1);
+			pane_truncate_line(p, r.start, r.start_lineno, 0);
+		} else {
+			pane_delete_charwise(p, r);
+		}
+		pane_set_cursor(p, c);
+		e->mode = MODE_INSERT;
+		break;
+	case '>':
+	case '<':
+		pane_shift_lines(p, r, op == '>');
+		c.idx = first_nonblank(string_as_str(r.start->string));
+		pane_set_cursor(p, c);
+		pane_clamp_cursor_idx(p);
+		break;
+	}
+
+	if (p->pager != NULL)
+		pane_window_trim(p);
+}
+
+// new lines that share the text of `lines`, linked together. returns the first one.
+static struct bufline *buflines_from_reglines(struct regline *lines, size_t n, struct bufline **tail) {
+	struct bufline *head = NULL;
+	*tail = NULL;
+	for (size_t i = 0; i < n; i++) {
+		lines[i].text->refcount += 1;
+		struct bufline *newl = bufline_new_shared(lines[i].text);
+		newl->prev = *tail;
+		if (*tail != NULL)
+			(*tail)->next = newl;
+		else
+			head = newl;
+		*tail = newl;
+	}
+	return head;
+}
+
+// p and P: puts the selected register after or before the cursor. whole lines in the
+// register become buffer lines that share its text, so nothing is copied.
+static void editor_put(struct editor *e, int after) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct regtext *rt = e->registers[register_index(e->selected_reg)];
+	if (rt == NULL) {
+		editor_error(e, "register is empty");
+		return;
+	}
+
+	// the lines it adds would move the other cursors' lines out from under them
+	if (p->ncursors > 0) {
+		editor_error(e, "put doesn't work with multiple cursors yet");
+		return;
+	}
+
+	struct bufline *bl = pane_get_cursor_line(p);
+	size_t lineno = pane_get_cursor_line_no(p);
+	struct bufline *tail;
+
+	if (!rt->linewise) {
+		size_t idx = after ? MIN(p->cursor_line_idx + 1, bl->string.len) : p->cursor_line_idx;
+		struct cursor end;
+		if (rt->nlines == 1) {
+			end = pane_insert_text(p, bl, lineno, idx, regline_str(rt->lines[0]));
+		} else {
+			// the first and last pieces are partial lines, and are copied into the lines
+			// around the put. only the ones in between are shared.
+			struct bufline *rest = pane_split_line(p, bl, lineno, idx);
+			pane_insert_text(p, bl, lineno, idx, regline_str(rt->lines[0]));
+			if (rt->nlines > 2) {
+				struct bufline *head = buflines_from_reglines(rt->lines + 1, rt->nlines - 2, &tail);
+				pane_insert_lines(p, bl, lineno, head, tail, rt->nlines - 2);
+			}
+			end = pane_insert_text(p, rest, lineno != 0 ? lineno + rt->nlines - 1 : 0, 0, regline_str(rt->lines[rt->nlines - 1]));
+		}
+		end.idx = end.idx > 0 ? end.idx - 1 : 0;
+		pane_set_cursor(p, end);
+		return;
+	}
+
+	struct bufline *head = buflines_from_reglines(rt->lines, rt->nlines, &tail);
+	struct cursor c = { .line = head };
+	if (after) {
+		pane_insert_lines(p, bl, lineno, head, tail, rt->nlines);
+		c.lineno = lineno != 0 ? lineno + 1 : 0;
+	} else {
+		struct bufline *before = pane_line_before(p, bl);
+		pane_insert_lines(p, before, lineno > 1 ? lineno - 1 : 0, head, tail, rt->nlines);
+		c.lineno = lineno;
+	}
+	c.idx = first_nonblank(string_as_str(c.line->string));
+	pane_set_cursor(p, c);
+	pane_clamp_cursor_idx(p);
+}
+
+// the motion key that completes a pending operator
+static void editor_operator_motion(struct editor *e, char op, struct keyevt motion, size_t count, int has_count) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct range r;
+	if (pane_motion_range(p, op, motion, count, has_count, &r)) {
+		e->cmd_failed = 1;
+		return;
+	}
+	editor_apply_operator(e, op, r);
+}
+
+// :s. the lines are split between worker threads, which compute the new lines without
+// touching the buffer. once they are all done, the new lines go into the buffer in one
+// step, which `u` can undo. meanwhile, Escape cancels it.
+
+static size_t pane_count_lines(struct pane *p) {
+	size_t n = 0;
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next)
+		n++;
+	return n;
+}
+
+// a line number, "." or "$" at `*i`
+static int parse_lineno(struct pane *p, str_t s, size_t *i, size_t *out) {
+	if (*i < s.len && (s.ptr[*i] == '.' || s.ptr[*i] == '$')) {
+		*out = s.ptr[*i] == '.' ? pane_get_cursor_line_no(p) : pane_count_lines(p);
+		*i += 1;
+		return 0;
+	}
+	size_t start = *i;
+	while (*i < s.len && isdigit((unsigned char) s.ptr[*i]))
+		*i += 1;
+	return str_parse_size((str_t) { .ptr = s.ptr + start, .len = *i - start }, out);
+}
+
+// length of the range ("%", "N" or "N,M") that `cmd` starts with
+static size_t range_prefix_len(str_t cmd) {
+	size_t i = 0;
+	while (i < cmd.len && cmd.ptr[i] != '\0' && strchr("%0123456789.$,", cmd.ptr[i]) != NULL)
+		i++;
+	return i;
+}
+
+// parses the first `len` bytes of `cmd` as a range of lines. without one, it's just the
+// cursor's line.
+static int pane_parse_range(struct pane *p, str_t cmd, size_t len, size_t *first, size_t *last) {
+	size_t nlines = pane_count_lines(p);
+	*first = pane_get_cursor_line_no(p);
+	*last = *first;
+	if (len == 1 && cmd.ptr[0] == '%') {
+		*first = 1;
+		*last = nlines;
+	} else if (len > 0) {
+		size_t pos = 0;
+		if (parse_lineno(p, cmd, &pos, first))
+			return -1;
+		*last = *first;
+		if (pos < len && cmd.ptr[pos] == ',') {
+			pos++;
+			if (parse_lineno(p, cmd, &pos, last))
+				return -1;
+		}
+		if (pos != len)
+			return -1;
+	}
+	return *first == 0 || *first > *last || *last > nlines ? -1 : 0;
+}
+
+// commits a finished :s to the buffer
+static void editor_finish_substitute(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct subst_job *j = p->subst;
+	subst_job_wait(j);
+
+	size_t nchanged = 0;
+	for (size_t i = 0; i < j->nlines; i++)
+		nchanged += j->changed[i];
+	if (nchanged == 0) {
+		pane_cancel_substitute(p);
+		editor_error(e, "s: pattern not found");
+		return;
+	}
+
+	pane_clear_undo(p);
+	pane_clear_cursors(p);
+	p->undo = malloc(sizeof(p->undo[0]) * nchanged);
+	struct cursor last;
+	for (size_t i = 0; i < j->nlines; i++) {
+		if (!j->changed[i])
+			continue;
+		struct bufline *bl = p->subst_lines[i];
+		size_t lineno = p->subst_lineno + i;
+		// the old text is kept for undo without copying it
+		p->undo[p->nundo++] = (struct undo_line) { .line = bl, .lineno = lineno, .text = bufline_share(bl) };
+		pane_replace_line(p, bl, lineno, j->out[i]);
+		j->changed[i] = 0;
+		last = (struct cursor) { .line = bl, .lineno = lineno };
+	}
+	p->undo_seq = p->change_seq;
+
+	size_t nsubs = atomic_load(&j->nsubs);
+	pane_cancel_substitute(p);
+	last.idx = first_nonblank(string_as_str(last.line->string));
+	pane_set_cursor(p, last);
+	pane_clamp_cursor_idx(p);
+	editor_message(e, "%zu substitution%s on %zu line%s", nsubs, nsubs == 1 ? "" : "s", nchanged, nchanged == 1 ? "" : "s");
+}
+
+// [range]s/pattern/replacement/[g], where range is "%", "N" or "N,M". N and M can be
+// "." and "$". returns 0 if `cmd` isn't a :s command.
+static int editor_try_substitute(struct editor *e, str_t cmd) {
+	struct pane *p = editor_get_focused_pane(e);
+	size_t i = range_prefix_len(cmd);
+	str_t rest = { .ptr = cmd.ptr + i, .len = cmd.len - i };
+	if (rest.len < 2 || rest.ptr[0] != 's' || !ispunct((unsigned char) rest.ptr[1]))
+		return 0;
+
+	if (p->pager != NULL) {
+		editor_error(e, "s: not available in paged mode");
+		return 1;
+	}
+	size_t first;
+	size_t last;
+	if (pane_parse_range(p, cmd, i, &first, &last)) {
+		editor_error(e, "s: bad range");
+		return 1;
+	}
+
+	struct subst_cmd sc;
+	const char *errmsg;
+	if (subst_parse(rest, &sc, &errmsg)) {
+		editor_error(e, "s: %s", errmsg);
+		return 1;
+	}
+	regex_t re;
+	char errbuf[200];
+	if (subst_compile(&sc, &re, errbuf, sizeof(errbuf))) {
+		editor_error(e, "s: %s", errbuf);
+		subst_cmd_free(&sc);
+		return 1;
+	}
+	regfree(&re);
+
+	size_t n = last - first + 1;
+	p->subst_lines = malloc(sizeof(p->subst_lines[0]) * n);
+	p->subst_strs = malloc(sizeof(p->subst_strs[0]) * n);
+	p->subst_lineno = first;
+	struct bufline *bl = p->_priv_first_line;
+	for (size_t k = 1; k < first; k++)
+		bl = bl->next;
+	// the lines on screen are done first
+	size_t visible_start = n;
+	for (size_t k = 0; k < n; k++, bl = bl->next) {
+		p->subst_lines[k] = bl;
+		p->subst_strs[k] = string_as_str(bl->string);
+		if (bl == p->screen_top_line)
+			visible_start = k;
+	}
+
+	// small ranges are done right here, big ones in the background, so that the editor
+	// stays responsive (and Escape works) meanwhile
+	struct pool *pool = n >= SUBST_BACKGROUND_MIN_LINES ? &e->pool : NULL;
+	p->subst = malloc(sizeof(struct subst_job));
+	subst_job_start(p->subst, &sc, p->subst_strs, n, pool, visible_start, visible_start + MAX(p->last_height, 1));
+	if (subst_job_done(p->subst))
+		editor_finish_substitute(e);
+	return 1;
+}
+
+// :[range]!cmd. the lines are piped through a shell command, and replaced by its output as
+// that comes in. both pipes are serviced from the main loop, so neither side can block
+// the other. lines are taken out of the buffer as soon as they are sent, so it never holds
+// both the whole input and the whole output. they are kept, without copying them, so that
+// the range can be put back if the command fails, and by `u`.
+
+static void pane_filter_set_cursor(struct pane *p) {
+	struct pane_filter *f = p->filter;
+	if (f->out != NULL)
+		pane_set_cursor(p, (struct cursor) { .line = f->out, .lineno = f->out_lineno });
+	else
+		pane_set_cursor(p, (struct cursor) { .line = p->_priv_first_line, .lineno = 1 });
+}
+
+// moves the `n` lines after the output, up to `last`, onto the sent list
+static void pane_filter_take(struct pane *p, struct bufline *last, size_t n) {
+	struct pane_filter *f = p->filter;
+	struct bufline *first = f->out != NULL ? f->out->next : p->_priv_first_line;
+	pane_take_lines(p, first, last, f->out_lineno + 1, n);
+	if (f->sent_tail != NULL) {
+		f->sent_tail->next = first;
+		first->prev = f->sent_tail;
+	} else {
+		f->sent_head = first;
+	}
+	f->sent_tail = last;
+	f->nsent += n;
+}
+
+// takes out `n` lines that were sent to the command: the ones after the output, up to `last`
+static void pane_filter_drop_sent(struct pane *p, struct bufline *last, size_t n) {
+	struct pane_filter *f = p->filter;
+	struct bufline *first = f->out != NULL ? f->out->next : p->_priv_first_line;
+	f->nkept = 0;
+	if (first->prev == NULL && last->next == NULL) {
+		f->nkept = 1;
+		last = last->prev;
+		n--;
+	}
+	if (n > 0)
+		pane_filter_take(p, last, n);
+	pane_filter_set_cursor(p);
+}
+
+// links in `text` as new lines after the output so far
+static void pane_filter_add_output(struct pane *p, str_t text) {
+	struct pane_filter *f = p->filter;
+	struct bufline *head = NULL;
+	struct bufline *tail = NULL;
+	size_t n = 0;
+	for (size_t pos = 0; pos < text.len; ) {
+		str_t seg = str_slice_idx_to_eol(text, pos);
+		struct bufline *newl = bufline_new_with_string(str_to_string(seg));
+		newl->prev = tail;
+		if (tail != NULL)
+			tail->next = newl;
+		else
+			head = newl;
+		tail = newl;
+		n++;
+		pos += seg.len + 1;
+	}
+	if (n == 0)
+		return;
+
+	pane_insert_lines(p, f->out, f->out_lineno, head, tail, n);
+	f->out = tail;
+	f->out_lineno += n;
+	f->nlines_out += n;
+	// now the kept line isn't needed to keep the buffer from being empty
+	if (f->nkept > 0) {
+		pane_delete_lines(p, tail->next, tail->next, f->out_lineno + 1, 1);
+		f->nkept = 0;
+	}
+	pane_filter_set_cursor(p);
+}
+
+// `status` is the command's exit status, unless it was cancelled. the unread rest of the
+// range is only dropped if the command succeeded, and without any output, the whole range
+// is put back. otherwise, `u` can put it back.
+static void editor_finish_filter(struct editor *e, int cancel, int status) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct pane_filter *f = p->filter;
+
+	// output that didn't end in a newline
+	if (!cancel && f->partial.len > 0) {
+		string_push(&f->partial, '\n');
+		pane_filter_add_output(p, string_as_str(f->partial));
+	}
+	// the lines the command didn't read are part of the range too
+	size_t n = f->nkept + f->nin;
+	int emptied = 0;
+	if (!cancel && status == 0 && n > 0) {
+		struct bufline *first = f->out != NULL ? f->out->next : p->_priv_first_line;
+		struct bufline *last = first;
+		for (size_t i = 1; i < n; i++)
+			last = last->next;
+		emptied = first->prev == NULL && last->next == NULL;
+		pane_filter_take(p, last, n);
+	}
+
+	pane_clear_undo(p);
+	if (f->sent_head != NULL && f->nlines_out == 0 && (cancel || status != 0)) {
+		pane_insert_lines(p, f->before, f->before_lineno, f->sent_head, f->sent_tail, f->nsent);
+	} else if (f->sent_head != NULL) {
+		p->undo_range = (struct undo_range) {
+			.head = f->sent_head,
+			.tail = f->sent_tail,
+			.n = f->nsent,
+			.before = f->before,
+			.before_lineno = f->before_lineno,
+			// the line that keeps the buffer from being empty stands in for the output
+			.nout = f->nlines_out + emptied,
+		};
+		p->undo_seq = p->change_seq;
+	}
+	pane_filter_set_cursor(p);
+	pane_clamp_cursor_idx(p);
+
+	if (cancel)
+		filter_abandon(&f->proc);
+	else
+		filter_close(&f->proc);
+	size_t nlines = f->nlines_out;
+	string_free(f->inbuf);
+	string_free(f->partial);
+	free(f);
+	p->filter = NULL;
+
+	if (cancel && nlines == 0)
+		editor_message(e, "!: cancelled, the lines are left as they were");
+	else if (cancel)
+		editor_message(e, "!: cancelled, with %zu line%s of output in", nlines, nlines == 1 ? "" : "s");
+	else if (status != 0 && nlines == 0)
+		editor_error(e, "!: command exited with status %d, the lines are left as they were", status);
+	else if (status != 0)
+		editor_error(e, "!: command exited with status %d", status);
+	else
+		editor_message(e, "!: %zu line%s", nlines, nlines == 1 ? "" : "s");
+}
+
+// the output has ended. the range is dealt with once the command has exited too.
+static void editor_filter_output_done(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	int status;
+	filter_close(&p->filter->proc);
+	p->filter->eof = 1;
+	if (filter_reap(&p->filter->proc, &status))
+		editor_finish_filter(e, 0, status);
+}
+
+// writes more of the range to the command
+static void editor_filter_send(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct pane_filter *f = p->filter;
+
+	if (f->inbuf_off == f->inbuf.len) {
+		string_clear(&f->inbuf);
+		f->inbuf_off = 0;
+		struct bufline *last = NULL;
+		size_t n = f->nkept;
+		while (f->nin > 0 && f->inbuf.len < FILTER_CHUNK_SIZE) {
+			string_append(&f->inbuf, string_as_str(f->in->string));
+			string_push(&f->inbuf, '\n');
+			last = f->in;
+			f->in = f->in->next;
+			f->nin--;
+			n++;
+		}
+		if (last == NULL) {
+			filter_close_input(&f->proc);
+			return;
+		}
+		pane_filter_drop_sent(p, last, n);
+	}
+
+	ssize_t nwritten = write(f->proc.in_fd, f->inbuf.ptr + f->inbuf_off, f->inbuf.len - f->inbuf_off);
+	if (nwritten > 0) {
+		f->inbuf_off += nwritten;
+	} else if (nwritten == -1 && errno != EAGAIN && errno != EINTR) {
+		// it stopped reading (e.g. head). the rest of the range is dropped at the end.
+		filter_close_input(&f->proc);
+		string_clear(&f->inbuf);
+		f->inbuf_off = 0;
+	}
+}
+
+// takes in what the command has written
+static void editor_filter_receive(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct pane_filter *f = p->filter;
+	char buf[1 << 16];
+	size_t total = 0;
+	int eof = 0;
+
+	// don't hog the loop, as with streamed input
+	while (total < STREAM_READ_BUDGET) {
+		ssize_t nread = read(f->proc.out_fd, buf, sizeof(buf));
+		if (nread > 0) {
+			string_append(&f->partial, (str_t) { .ptr = buf, .len = nread });
+			total += nread;
+			continue;
+		}
+		if (nread == -1 && (errno == EAGAIN || errno == EINTR))
+			break;
+		eof = 1;
+		break;
+	}
+
+	// whole lines go into the buffer, the rest waits for its newline
+	char *nl = f->partial.len > 0 ? memrchr(f->partial.ptr, '\n', f->partial.len) : NULL;
+	if (nl != NULL) {
+		size_t len = nl - f->partial.ptr + 1;
+		pane_filter_add_output(p, (str_t) { .ptr = f->partial.ptr, .len = len });
+		memmove(f->partial.ptr, f->partial.ptr + len, f->partial.len - len);
+		f->partial.len -= len;
+	}
+	if (eof)
+		editor_filter_output_done(e);
+}
+
+// returns 0 if `cmd` isn't a :! command
+static int editor_try_filter(struct editor *e, str_t cmd) {
+	struct pane *p = editor_get_focused_pane(e);
+	size_t i = range_prefix_len(cmd);
+	str_t rest = { .ptr = cmd.ptr + i, .len = cmd.len - i };
+	if (rest.len == 0 || rest.ptr[0] != '!')
+		return 0;
+
+	size_t first;
+	size_t last;
+	if (p->pager != NULL) {
+		editor_error(e, "!: not available in paged mode");
+		return 1;
+	}
+	if (i == 0) {
+		editor_error(e, "!: needs a range, e.g. %%!sort");
+		return 1;
+	}
+	if (pane_parse_range(p, cmd, i, &first, &last)) {
+		editor_error(e, "!: bad range");
+		return 1;
+	}
+	if (rest.len == 1) {
+		editor_error(e, "!: no command");
+		return 1;
+	}
+
+	string_t shcmd = str_to_string((str_t) { .ptr = rest.ptr + 1, .len = rest.len - 1 });
+	string_push(&shcmd, '\0');
+	struct pane_filter *f = malloc(sizeof(struct pane_filter));
+	int ret = filter_start(&f->proc, shcmd.ptr);
+	string_free(shcmd);
+	if (ret) {
+		editor_error(e, "!: %s", strerror(errno));
+		free(f);
+		return 1;
+	}
+
+	pane_clear_cursors(p);
+	f->in = p->_priv_first_line;
+	for (size_t k = 1; k < first; k++)
+		f->in = f->in->next;
+	f->before = f->in->prev;
+	f->before_lineno = first - 1;
+	f->out = f->before;
+	f->out_lineno = f->before_lineno;
+	f->nkept = 0;
+	f->nin = last - first + 1;
+	f->inbuf = string_new();
+	f->inbuf_off = 0;
+	f->partial = string_new();
+	f->nlines_out = 0;
+	f->sent_head = NULL;
+	f->sent_tail = NULL;
+	f->nsent = 0;
+	f->eof = 0;
+	p->filter = f;
+	return 1;
+}
+
+// u: only the last :s or :!cmd can be undone, and only until the buffer is changed some
+// other way
+static void editor_undo(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	if ((p->nundo == 0 && p->undo_range.head == NULL) || p->undo_seq != p->change_seq) {
+		pane_clear_undo(p);
+		editor_error(e, "nothing to undo");
+		return;
+	}
+
+	pane_clear_cursors(p);
+	if (p->undo_range.head != NULL) {
+		// the range goes back in front of the output first, so that the buffer is never empty
+		struct undo_range u = p->undo_range;
+		p->undo_range = (struct undo_range) { 0 };
+		pane_insert_lines(p, u.before, u.before_lineno, u.head, u.tail, u.n);
+		if (u.nout > 0) {
+			struct bufline *last = u.tail;
+			for (size_t i = 0; i < u.nout; i++)
+				last = last->next;
+			pane_delete_lines(p, u.tail->next, last, u.before_lineno + u.n + 1, u.nout);
+		}
+		pane_set_cursor(p, (struct cursor) { .line = u.head, .lineno = u.before_lineno + 1 });
+		pane_clamp_cursor_idx(p);
+		pane_clear_undo(p);
+		return;
+	}
+
+	for (size_t i = 0; i < p->nundo; i++) {
+		struct undo_line u = p->undo[i];
+		pane_replace_line(p, u.line, u.lineno, str_to_string((str_t) { .ptr = u.text->ptr, .len = u.text->len }));
+	}
+	struct cursor c = { .line = p->undo[0].line, .lineno = p->undo[0].lineno };
+	c.idx = first_nonblank(string_as_str(c.line->string));
+	pane_set_cursor(p, c);
+	pane_clamp_cursor_idx(p);
+	pane_clear_undo(p);
+}
+
+static void editor_do_normal_mode_keyevt(struct editor *e, struct keyevt evt) {
+	struct pane *curp = editor_get_focused_pane(e);
+
+	if (EVT_IS_CHAR(evt, ' ')) {
+		string_clear(&e->commandline);
+		string_clear(&e->errormsg);
+		e->mode = MODE_COMMAND;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'i')) {
+		e->mode = MODE_INSERT;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'u')) {
+		editor_undo(e);
+		return;
+	}
+
+	if (evt.kind == KEYKIND_ESCAPE) {
+		pane_clear_cursors(curp);
+		return;
+	}
+
+	if (evt.ctrl && EVT_IS_CHAR(evt, 'j')) {
+		if (curp->pager != NULL)
+			editor_error(e, "multiple cursors aren't supported in paged mode");
+		else
+			pane_add_cursor_below(curp);
+		return;
+	}
+
+	if (evt.ctrl && EVT_IS_CHAR(evt, 'n')) {
+		if (curp->pager != NULL)
+			editor_error(e, "multiple cursors aren't supported in paged mode");
+		else if (pane_add_cursor_at_next_match(curp))
+			editor_error(e, "no more matches");
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'x') && curp->ncursors > 0) {
+		pane_edit_at_cursors(curp, CURSOR_DELETE, 0);
+		pane_clamp_cursor_idx(curp);
+		pane_move_cursors(curp, CURSOR_CLAMP);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'x')) {
+		struct bufline *curlin = pane_get_cursor_line(curp);
+		if (curlin->string.len == 0) {
+			e->cmd_failed = 1;
+			return;
+		}
+
+		pane_remove_char(curp, curlin, pane_get_cursor_line_no(curp), curp->cursor_line_idx);
+		curp->cursor_line_idx = MIN(curlin->string.len - 1, curp->cursor_line_idx);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, '0')) {
+		curp->cursor_line_idx = 0;
+		pane_move_cursors(curp, CURSOR_LINE_START);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'a')) {
+		curp->cursor_line_idx = MIN(pane_get_cursor_line(curp)->string.len, curp->cursor_line_idx + 1);
+		pane_move_cursors(curp, CURSOR_APPEND);
+		e->mode = MODE_INSERT;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'h')) {
+		if (curp->cursor_line_idx == 0)
+			e->cmd_failed = 1;
+		curp->cursor_line_idx = curp->cursor_line_idx > 0 ? curp->cursor_line_idx - 1 : 0;
+		pane_move_cursors(curp, CURSOR_LEFT);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'j')) {
+		if (!(pane_moves_by_row(curp) ? pane_row_down(curp) : pane_line_down(curp)))
+			e->cmd_failed = 1;
+		pane_move_cursors(curp, CURSOR_DOWN);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'k')) {
+		if (!(pane_moves_by_row(curp) ? pane_row_up(curp) : pane_line_up(curp)))
+			e->cmd_failed = 1;
+		pane_move_cursors(curp, CURSOR_UP);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'l')) {
+		struct bufline *curlin = pane_get_cursor_line(curp);
+		if (curp->cursor_line_idx + 1 >= curlin->string.len)
+			e->cmd_failed = 1;
+		else
+			curp->cursor_line_idx += 1;
+		pane_move_cursors(curp, CURSOR_RIGHT);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'A')) {
+		curp->cursor_line_idx = pane_get_cursor_line(curp)->string.len;
+		pane_move_cursors(curp, CURSOR_LINE_END);
+		e->mode = MODE_INSERT;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'D') || EVT_IS_CHAR(evt, 'C')) {
+		if (curp->ncursors > 0)
+			pane_edit_at_cursors(curp, CURSOR_TRUNCATE, 0);
+		else
+			pane_truncate_line(curp, pane_get_cursor_line(curp), pane_get_cursor_line_no(curp), curp->cursor_line_idx);
+		if (EVT_IS_CHAR(evt, 'C'))
+			e->mode = MODE_INSERT;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'G')) {
+		pane_goto_last_line(curp);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'w') || EVT_IS_CHAR(evt, '}') || EVT_IS_CHAR(evt, '{')) {
+		struct cursor c = pane_main_cursor(curp);
+		if (evt.kchar == 'w')
+			pane_word_forward(curp, &c, 0);
+		else if (evt.kchar == '}')
+			pane_paragraph_forward(curp, &c);
+		else
+			pane_paragraph_backward(curp, &c);
+		if (c.line == pane_get_cursor_line(curp) && c.idx == curp->cursor_line_idx)
+			e->cmd_failed = 1;
+		pane_set_cursor(curp, c);
+		pane_clamp_cursor_idx(curp);
+		if (curp->pager != NULL)
+			pane_window_trim(curp);
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'p') || EVT_IS_CHAR(evt, 'P')) {
+		editor_put(e, evt.kchar == 'p');
+		return;
+	}
+
+	if (evt.ctrl && EVT_IS_CHAR(evt, 'f')) {
+		for (int i = 0; i < curp->last_height && pane_line_down(curp); i++)
+			;
+		return;
+	}
+
+	if (evt.ctrl && EVT_IS_CHAR(evt, 'b')) {
+		for (int i = 0; i < curp->last_height && pane_line_up(curp); i++)
+			;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'o') && curp->ncursors > 0) {
+		curp->cursor_line_idx = pane_get_cursor_line(curp)->string.len;
+		pane_move_cursors(curp, CURSOR_LINE_END);
+		pane_edit_at_cursors(curp, CURSOR_NEWLINE, 0);
+		e->mode = MODE_INSERT;
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'o')) {
+		struct bufline *cur = pane_get_cursor_line(curp);
+		pane_split_line(curp, cur, pane_get_cursor_line_no(curp), cur->string.len);
+		curp->cursor_line_idx = 0;
+		pane_line_down(curp);
+		e->mode = MODE_INSERT;
+	}
+}
+
+// keys came in that haven't been handled yet
+static int editor_input_pending(struct editor *e) {
+	if (e->input_fd == -1)
+		return 0;
+	struct pollfd pfd = { .fd = e->input_fd, .events = POLLIN };
+	return poll(&pfd, 1, 0) > 0;
+}
+
+static void macro_push(struct macro *m, struct keyevt evt) {
+	if (m->len == m->cap) {
+		m->cap = MAX(m->cap * 2, 16);
+		m->keys = realloc(m->keys, sizeof(m->keys[0]) * m->cap);
+	}
+	m->keys[m->len++] = evt;
+}
+
+// replays register `reg` `count` times. nothing is drawn in between: the key handlers
+// are just called in a loop, and the main loop redraws once afterwards. a key typed in
+// the meantime (e.g. Esc) stops it.
+static void editor_replay_macro(struct editor *e, char reg, size_t count) {
+	if (reg == '@')
+		reg = e->last_macro;
+	if (reg < 'a' || reg > 'z') {
+		editor_error(e, "not a macro register");
+		return;
+	}
+	if (e->replay_depth >= MACRO_MAX_DEPTH) {
+		editor_error(e, "macro recursion too deep");
+		return;
+	}
+	e->last_macro = reg;
+
+	// the register may be recorded into while it is being replayed
+	struct macro *m = &e->macros[reg - 'a'];
+	size_t len = m->len;
+	struct keyevt *keys = malloc(sizeof(keys[0]) * MAX(len, 1));
+	memcpy(keys, m->keys, sizeof(keys[0]) * len);
+
+	e->replay_depth += 1;
+	for (size_t n = 0; n < count && !e->cmd_failed && !e->should_exit && (n == 0 || !editor_input_pending(e)); n++) {
+		for (size_t i = 0; i < len && !e->cmd_failed && !e->should_exit; i++)
+			editor_handle_keyevt(e, keys[i]);
+	}
+	e->replay_depth -= 1;
+	free(keys);
+}
+
+static void editor_handle_normal_mode_keyevt(struct editor *e, struct keyevt evt) {
+	struct pane *curp = editor_get_focused_pane(e);
+
+	if (e->pending_reg_key != 0) {
+		char key = e->pending_reg_key;
+		size_t count = MAX(e->count, 1);
+		e->pending_reg_key = 0;
+		if (evt.kind != KEYKIND_CHAR || evt.ctrl) {
+			e->count = 0;
+			return;
+		}
+
+		if (key == '"') {
+			// the count typed before "x still applies to the command after it
+			if (evt.kchar >= 'a' && evt.kchar <= 'z')
+				e->selected_reg = evt.kchar;
+			else
+				editor_error(e, "not a register: %c", evt.kchar);
+			return;
+		}
+
+		e->count = 0;
+		if (key == '@') {
+			editor_replay_macro(e, evt.kchar, count);
+		} else if (evt.kchar >= 'a' && evt.kchar <= 'z') {
+			e->macros[evt.kchar - 'a'].len = 0;
+			e->recording = evt.kchar;
+		} else if (evt.kchar >= 'A' && evt.kchar <= 'Z') {
+			// appends to the register
+			e->recording = evt.kchar - 'A' + 'a';
+		} else {
+			editor_error(e, "not a macro register");
+		}
+		return;
+	}
+
+	if (evt.kind == KEYKIND_CHAR && !evt.ctrl && isdigit((unsigned char) evt.kchar) && (evt.kchar != '0' || e->count > 0)) {
+		e->count = MIN(e->count * 10 + (evt.kchar - '0'), (size_t) 999999999);
+		return;
+	}
+
+	if (evt.kind == KEYKIND_ESCAPE && (e->count > 0 || e->pending_op != 0 || e->selected_reg != 0)) {
+		e->count = 0;
+		e->pending_op = 0;
+		e->selected_reg = 0;
+		return;
+	}
+
+	if (e->pending_op != 0) {
+		char op = e->pending_op;
+		size_t count = MAX(e->op_count, 1) * MAX(e->count, 1);
+		int has_count = e->op_count > 0 || e->count > 0;
+		e->pending_op = 0;
+		e->count = 0;
+		editor_operator_motion(e, op, evt, count, has_count);
+		e->selected_reg = 0;
+		return;
+	}
+
+	if (evt.kind == KEYKIND_CHAR && !evt.ctrl && evt.kchar != '\0' && strchr("dcy<>", evt.kchar) != NULL) {
+		if (curp->ncursors > 0) {
+			editor_error(e, "operators don't work with multiple cursors yet");
+			e->count = 0;
+			return;
+		}
+		e->pending_op = evt.kchar;
+		e->op_count = e->count;
+		e->count = 0;
+		return;
+	}
+
+	if ((EVT_IS_CHAR(evt, '@') || EVT_IS_CHAR(evt, '"')) && !evt.ctrl) {
+		e->pending_reg_key = evt.kchar;
+		return;
+	}
+
+	size_t count = e->count;
+	e->count = 0;
+
+	if (EVT_IS_CHAR(evt, 'q') && !evt.ctrl) {
+		if (e->recording != 0) {
+			// the 'q' that ended the recording was recorded too
+			if (e->replay_depth == 0)
+				e->macros[e->recording - 'a'].len -= 1;
+			e->recording = 0;
+		} else {
+			e->pending_reg_key = 'q';
+		}
+		return;
+	}
+
+	if (EVT_IS_CHAR(evt, 'G') && count > 0) {
+		pane_goto_line(curp, count);
+		return;
+	}
+
+	// the characters are deleted in one go
+	if (EVT_IS_CHAR(evt, 'x') && !evt.ctrl && count > 1 && curp->ncursors == 0) {
+		struct bufline *curlin = pane_get_cursor_line(curp);
+		size_t n = MIN(count, curlin->string.len - MIN(curp->cursor_line_idx, curlin->string.len));
+		if (n == 0)
+			e->cmd_failed = 1;
+		else
+			pane_delete_chars(curp, curlin, pane_get_cursor_line_no(curp), curp->cursor_line_idx, n);
 		curp->cursor_line_idx = MIN(curlin->string.len - 1, curp->cursor_line_idx);
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, '0')) {
-		curp->cursor_line_idx = 0;
+	// anything else is just repeated, until it fails or a key comes in. commands that
+	// leave normal mode only run once.
+	for (size_t n = 0; n < MAX(count, 1) && !e->cmd_failed && e->mode == MODE_NORMAL; n++) {
+		if (n % REPEAT_INPUT_CHECK_EVERY == REPEAT_INPUT_CHECK_EVERY - 1 && editor_input_pending(e))
+			break;
+		editor_do_normal_mode_keyevt(e, evt);
+	}
+	e->selected_reg = 0;
+}
+
+// e.g. "1.5M"
+static void format_size(char *buf, size_t bufsize, size_t n) {
+	const char *units = "KMGT";
+	if (n < 1024) {
+		snprintf(buf, bufsize, "%zuB", n);
+		return;
+	}
+	double size = n / 1024.0;
+	while (size >= 1024 && units[1] != '\0') {
+		size /= 1024;
+		units++;
+	}
+	snprintf(buf, bufsize, "%.1f%c", size, *units);
+}
+
+// :registers. for each register: its size, and how much memory only that register keeps
+// alive (because the lines it came from were changed or deleted).
+static void editor_show_registers(struct editor *e) {
+	string_t msg = string_new();
+	for (size_t i = 0; i < 27; i++) {
+		struct regtext *rt = e->registers[i];
+		if (rt == NULL)
+			continue;
+		char size[16];
+		char unshared[16];
+		char entry[100];
+		format_size(size, sizeof(size), regtext_size(rt));
+		format_size(unshared, sizeof(unshared), regtext_unshared_size(rt));
+		snprintf(entry, sizeof(entry), "%s\"%c %zu line%s, %s (%s own)", msg.len > 0 ? "  " : "",
+			i == 0 ? '"' : (char) ('a' + i - 1), rt->nlines, rt->nlines == 1 ? "" : "s", size, unshared);
+		string_append(&msg, cstr_as_str(entry));
+	}
+	if (msg.len == 0)
+		editor_message(e, "registers are empty");
+	else
+		editor_message(e, "%.*s", (int) msg.len, msg.ptr);
+	string_free(msg);
+}
+
+// memory held by each part of the editor, found by walking its data structures. text
+// that is shared is counted with the lines that point at it; registers and undo only
+// count the text that nothing else keeps alive.
+struct mem_usage {
+	size_t nlines;
+	// a struct bufline per line
+	size_t line_nodes;
+	size_t line_text;
+	// capacity that lines' text was given beyond its length
+	size_t line_slack;
+	size_t undo;
+	// the diff gutter's hashes of the file's lines
+	size_t diff;
+	// the completion index
+	size_t words;
+	// and macros
+	size_t registers;
+	// what is rebuilt as needed: soft wrap layouts, column indexes, the paged mode line
+	// index, and journal records not written out yet
+	size_t caches;
+	size_t screen;
+};
+
+static void mem_count_line(struct mem_usage *u, struct bufline *bl) {
+	u->nlines++;
+	u->line_nodes += sizeof(*bl);
+	u->line_text += bl->string.len;
+	if (bl->shared == NULL)
+		u->line_slack += bl->string.cap - bl->string.len;
+	if (bl->layout != NULL)
+		u->caches += sizeof(*bl->layout) + sizeof(bl->layout->starts[0]) * bl->layout->nrows;
+	if (bl->colindex != NULL)
+		u->caches += sizeof(*bl->colindex) + sizeof(bl->colindex->pts[0]) * bl->colindex->cap;
+}
+
+static struct mem_usage editor_mem_usage(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct mem_usage u = { .screen = e->screen_bytes };
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next)
+		mem_count_line(&u, bl);
+	if (p->pager != NULL) {
+		// edited lines that were moved out of the window
+		for (size_t i = 0; i < p->pager->nedits; i++) {
+			for (struct bufline *bl = p->pager->edits[i].lines; bl != NULL; bl = bl->next)
+				mem_count_line(&u, bl);
+		}
+		if (p->pager->idx_map == NULL)
+			u.caches += sizeof(p->pager->idx[0]) * p->pager->idx_cap;
+	}
+	if (p->journal != NULL)
+		u.caches += p->journal->pending.cap;
+
+	if (p->diff != NULL)
+		u.diff += sizeof(*p->diff) + (sizeof(p->diff->hashes[0]) + sizeof(p->diff->offs[0])) * p->diff->cap;
+	if (p->words != NULL)
+		u.words += sizeof(*p->words) + wordindex_mem_usage(p->words);
+	u.undo += sizeof(p->undo[0]) * p->nundo;
+	for (size_t i = 0; i < p->nundo; i++) {
+		if (p->undo[i].text->refcount == 1)
+			u.undo += p->undo[i].text->len;
+	}
+	for (struct bufline *bl = p->undo_range.head; bl != NULL; bl = bl->next)
+		u.undo += sizeof(*bl) + bl->string.len;
+	for (size_t i = 0; i < 27; i++) {
+		struct regtext *rt = e->registers[i];
+		if (rt != NULL)
+			u.registers += sizeof(*rt) + sizeof(rt->lines[0]) * rt->nlines + regtext_unshared_size(rt);
+	}
+	for (size_t i = 0; i < 26; i++)
+		u.registers += sizeof(e->macros[i].keys[0]) * e->macros[i].cap;
+	return u;
+}
+
+// resident set size from /proc, or 0 if it can't be read
+static size_t mem_rss(void) {
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	size_t size, resident;
+	int n = fscanf(f, "%zu %zu", &size, &resident);
+	fclose(f);
+	return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// the :mem breakdown on one line, also printed on exit with -m
+void editor_mem_report(struct editor *e, string_t *out) {
+	struct mem_usage u = editor_mem_usage(e);
+	struct mallinfo2 mi = mallinfo2();
+	size_t sizes[] = {
+		u.line_nodes, u.line_text, u.line_slack, u.undo, u.diff, u.words, u.registers, u.caches, u.screen,
+		mi.uordblks + mi.hblkhd, mi.fordblks, mem_rss(),
+	};
+	char sz[12][16];
+	for (size_t i = 0; i < 12; i++)
+		format_size(sz[i], sizeof(sz[i]), sizes[i]);
+	char msg[400];
+	snprintf(msg, sizeof(msg), "%zu lines: %s nodes, %s text, %s slack  undo %s  diff %s  words %s  registers %s  caches %s  screen %s  heap %s (%s free)  rss %s",
+		u.nlines, sz[0], sz[1], sz[2], sz[3], sz[4], sz[5], sz[6], sz[7], sz[8], sz[9], sz[10], sz[11]);
+	string_append(out, cstr_as_str(msg));
+}
+
+// :compact. lines' text gets shrunk to its length, the caches are dropped (they are
+// rebuilt for what is looked at next), and free heap memory goes back to the OS.
+static void editor_compact(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	struct mallinfo2 before = mallinfo2();
+	size_t rss_before = mem_rss();
+	size_t slack = 0;
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next) {
+		wrap_invalidate(bl);
+		colindex_drop(bl);
+		if (bl->shared != NULL || bl->string.cap == bl->string.len)
+			continue;
+		slack += bl->string.cap - bl->string.len;
+		if (bl->string.len == 0) {
+			string_free(bl->string);
+			bl->string = string_new();
+		} else {
+			bl->string.ptr = realloc(bl->string.ptr, bl->string.len);
+			bl->string.cap = bl->string.len;
+		}
+	}
+	malloc_trim(0);
+	struct mallinfo2 after = mallinfo2();
+
+	size_t sizes[] = {
+		slack,
+		before.uordblks + before.hblkhd + before.fordblks, after.uordblks + after.hblkhd + after.fordblks,
+		rss_before, mem_rss(),
+	};
+	char sz[5][16];
+	for (size_t i = 0; i < 5; i++)
+		format_size(sz[i], sizeof(sz[i]), sizes[i]);
+	editor_message(e, "compact: %s of slack given back, heap %s -> %s, rss %s -> %s", sz[0], sz[1], sz[2], sz[3], sz[4]);
+}
+
+// replaces the buffer with the file at `path`, loaded the same way as a file given on the
+// command line. like on quitting, the old buffer's changes are gone.
+void editor_open_file(struct editor *e, const char *path) {
+	struct pane *curp = editor_get_focused_pane(e);
+	struct stat st;
+	if (stat(path, &st) == -1) {
+		editor_error(e, "open: %s: %s", path, strerror(errno));
+		return;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		editor_error(e, "open: %s: not a regular file", path);
+		return;
+	}
+
+	// the old buffer is only let go of once the new one is there
+	struct pager *pg = NULL;
+	string_t filecont = string_new();
+	if (st.st_size > LARGEFILE_THRESHOLD) {
+		pg = malloc(sizeof(struct pager));
+		if (pager_open(pg, path)) {
+			editor_error(e, "open: %s: %s", path, strerror(errno));
+			free(pg);
+			string_free(filecont);
+			return;
+		}
+	} else if (read_file_to_string((char *) path, &filecont)) {
+		editor_error(e, "open: %s: %s", path, strerror(errno));
+		string_free(filecont);
+		return;
+	}
+
+	pane_free(curp);
+	if (pg != NULL)
+		pane_new_paged(curp, pg);
+	else
+		pane_new(curp, string_as_str(filecont));
+	editor_set_path(e, cstr_as_str((char *) path), pg != NULL ? pg->size : (off_t) filecont.len);
+	string_free(filecont);
+	e->mode = MODE_NORMAL;
+
+	// a journal left behind by a crash is only replayed from the command line, where
+	// there is a prompt for it. it mustn't be overwritten here either.
+	if (journal_check(path))
+		editor_message(e, "%s has a recovery journal: run `mf %s` to replay it", path, path);
+	else if (journal_exists(path))
+		editor_message(e, "%s has a recovery journal that doesn't match it anymore: kept, and not journaling", path);
+	else if (editor_start_journal(e, 0))
+		editor_error(e, "can't create recovery journal: %s", strerror(errno));
+}
+
+// :mksession: saves the buffer, with the cursors, the view and what `u` would undo, so
+// that `mf -r` can pick up where this left off
+static void editor_make_session(struct editor *e, const char *path) {
+	struct pane *p = editor_get_focused_pane(e);
+	if (p->pager != NULL) {
+		editor_error(e, "mksession: not supported in paged mode");
+		return;
+	}
+	if (p->stream_fd != -1) {
+		editor_error(e, "mksession: the buffer is still being read");
+		return;
+	}
+
+	size_t nundo = p->undo_seq == p->change_seq ? p->nundo : 0;
+	struct snapshot_pos *cursors = malloc(sizeof(cursors[0]) * MAX(p->ncursors, (size_t) 1));
+	for (size_t i = 0; i < p->ncursors; i++)
+		cursors[i] = (struct snapshot_pos) { .lineno = p->cursors[i].lineno, .idx = p->cursors[i].idx };
+	struct snapshot_undo *undo = malloc(sizeof(undo[0]) * MAX(nundo, (size_t) 1));
+	str_t *undo_text = malloc(sizeof(undo_text[0]) * MAX(nundo, (size_t) 1));
+	for (size_t i = 0; i < nundo; i++) {
+		undo[i] = (struct snapshot_undo) { .lineno = p->undo[i].lineno };
+		undo_text[i] = (str_t) { .ptr = p->undo[i].text->ptr, .len = p->undo[i].text->len };
+	}
+
+	struct snapshot s = {
+		.hdr = {
+			.flags = (p->soft_wrap ? SNAPSHOT_SOFT_WRAP : 0)
+				| (p->show_line_nums ? SNAPSHOT_LINE_NUMS : 0)
+				| (p->last_line_open ? SNAPSHOT_LAST_LINE_OPEN : 0),
+			.loaded_size = p->loaded_size,
+			.change_seq = p->change_seq,
+			.cursor = { .lineno = pane_get_cursor_line_no(p), .idx = p->cursor_line_idx },
+			.left_col = p->left_col,
+			.ncursors = p->ncursors,
+			.nundo = nundo,
+		},
+		.first = p->_priv_first_line,
+		.cursors = cursors,
+		.undo = undo,
+		.undo_text = undo_text,
+		.path = string_as_str(p->path),
+		.name = string_as_str(p->name),
+	};
+	if (snapshot_write(path, &s))
+		editor_error(e, "mksession: %s: %s", path, strerror(errno));
+	else
+		editor_message(e, "mksession: wrote %zu lines to %s", (size_t) s.hdr.nlines, path);
+	free(cursors);
+	free(undo);
+	free(undo_text);
+}
+
+// moves `c` forward to line `lineno`, or as far as the buffer goes
+static void cursor_walk_to(struct cursor *c, size_t lineno) {
+	while (c->lineno < lineno && c->line->next != NULL)
+		cursor_next_line(c, c->line->next);
+}
+
+// replaces the buffer with the session saved at `path` by :mksession. the lines are used
+// where they are in the mapped file: nothing is read or copied until it's looked at or
+// changed. fails if the file can't be mapped or isn't a snapshot (EINVAL).
+int editor_resume_session(struct editor *e, const char *path) {
+	struct snapshot s;
+	if (snapshot_load(path, &s))
+		return -1;
+
+	struct pane *p = editor_get_focused_pane(e);
+	pane_free(p);
+	pane_init(p);
+	p->_priv_first_line = s.first;
+	p->_priv_last_line = s.last;
+	s.first = NULL;
+	s.last = NULL;
+	p->soft_wrap = (s.hdr.flags & SNAPSHOT_SOFT_WRAP) != 0;
+	p->show_line_nums = (s.hdr.flags & SNAPSHOT_LINE_NUMS) != 0;
+	p->last_line_open = (s.hdr.flags & SNAPSHOT_LAST_LINE_OPEN) != 0;
+	p->left_col = p->soft_wrap ? 0 : s.hdr.left_col;
+	if (s.path.len > 0)
+		editor_set_path(e, s.path, s.hdr.loaded_size);
+	string_clear(&p->name);
+	string_append(&p->name, s.name);
+	p->change_seq = s.hdr.change_seq;
+
+	struct cursor c = { .line = p->_priv_first_line, .lineno = 1 };
+	cursor_walk_to(&c, s.hdr.cursor.lineno);
+	c.idx = s.hdr.cursor.idx;
+	pane_set_cursor(p, c);
+	pane_clamp_cursor_idx(p);
+	p->screen_top_line = c.line;
+
+	// cursors and undo records are in buffer order, so a single walk finds all their lines
+	struct cursor *add = malloc(sizeof(add[0]) * MAX(s.hdr.ncursors, (uint64_t) 1));
+	size_t nadd = 0;
+	struct cursor at = { .line = p->_priv_first_line, .lineno = 1 };
+	for (size_t i = 0; i < s.hdr.ncursors; i++) {
+		cursor_walk_to(&at, s.cursors[i].lineno);
+		struct cursor ci = at;
+		ci.idx = MIN((size_t) s.cursors[i].idx, at.line->string.len);
+		if (nadd == 0 || cursor_cmp(add[nadd - 1], ci) < 0)
+			add[nadd++] = ci;
+	}
+	pane_add_cursors(p, add, nadd);
+	free(add);
+
+	if (s.hdr.nundo > 0) {
+		p->undo = malloc(sizeof(p->undo[0]) * s.hdr.nundo);
+		at = (struct cursor) { .line = p->_priv_first_line, .lineno = 1 };
+		for (size_t i = 0; i < s.hdr.nundo; i++) {
+			cursor_walk_to(&at, s.undo[i].lineno);
+			if (at.lineno != s.undo[i].lineno || (p->nundo > 0 && p->undo[p->nundo - 1].line == at.line))
+				continue;
+			string_t old = str_to_string(s.undo_text[i]);
+			struct sharedtext *st = malloc(sizeof(struct sharedtext));
+			*st = (struct sharedtext) { .refcount = 1, .ptr = old.ptr, .len = old.len };
+			p->undo[p->nundo++] = (struct undo_line) { .line = at.line, .lineno = at.lineno, .text = st };
+		}
+		p->undo_seq = p->change_seq;
+	}
+	snapshot_release(&s);
+	e->mode = MODE_NORMAL;
+
+	struct stat st;
+	if (p->path.len > 0 && (stat(p->path.ptr, &st) == -1 || st.st_size != p->loaded_size))
+		editor_message(e, "%s has changed since the session was saved", p->path.ptr);
+	return 0;
+}
+
+static void editor_open_picker(struct editor *e) {
+	// reading directories mostly waits on the disk, hence more threads than CPUs
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = MIN((size_t) MAX(ncpu, 1L) * 2, (size_t) PICKER_MAX_THREADS);
+	struct picker *pk = malloc(sizeof(struct picker));
+	if (picker_start(pk, ".", nthreads)) {
+		editor_error(e, "open: %s", strerror(errno));
+		free(pk);
+		return;
+	}
+	e->picker = pk;
+}
+
+static void editor_close_picker(struct editor *e) {
+	picker_free(e->picker);
+	free(e->picker);
+	e->picker = NULL;
+}
+
+// typing narrows down the list, ctrl+n/ctrl+p (or tab) move the highlight, enter opens
+// the highlighted file and escape closes the picker
+static void editor_handle_picker_keyevt(struct editor *e, struct keyevt evt) {
+	struct picker *pk = e->picker;
+	string_t query = str_to_string(string_as_str(pk->query));
+
+	if (evt.kind == KEYKIND_ESCAPE) {
+		editor_close_picker(e);
+	} else if (evt.kind == KEYKIND_ENTER) {
+		if (picker_rank(pk, MAX(pk->topcap, (size_t) 1)) > 0) {
+			string_t path = str_to_string(pk->cands[pk->top[pk->selected].cand]);
+			string_push(&path, '\0');
+			editor_close_picker(e);
+			editor_open_file(e, path.ptr);
+			string_free(path);
+		}
+	} else if (evt.kind == KEYKIND_TAB || (evt.kind == KEYKIND_CHAR && evt.ctrl && evt.kchar == 'n')) {
+		if (pk->selected + 1 < picker_rank(pk, MAX(pk->topcap, (size_t) 1)))
+			pk->selected++;
+	} else if (evt.kind == KEYKIND_CHAR && evt.ctrl && evt.kchar == 'p') {
+		if (pk->selected > 0)
+			pk->selected--;
+	} else if (evt.kind == KEYKIND_BACKSPACE) {
+		string_pop(&query);
+		picker_set_query(pk, string_as_str(query));
+	} else if (evt.kind == KEYKIND_CHAR && !evt.ctrl) {
+		string_push(&query, evt.kchar);
+		picker_set_query(pk, string_as_str(query));
+	}
+	string_free(query);
+}
+
+// shows the file at `path` (as it is on disk, not the buffer) in the hex view, until it
+// is closed
+int editor_open_hex(struct editor *e, const char *path) {
+	struct hexview *hv = malloc(sizeof(struct hexview));
+	if (hexview_open(hv, path)) {
+		free(hv);
+		return -1;
+	}
+	if (e->hex != NULL) {
+		hexview_close(e->hex);
+		free(e->hex);
+	}
+	e->hex = hv;
+	return 0;
+}
+
+static void editor_close_hex(struct editor *e) {
+	hexview_close(e->hex);
+	free(e->hex);
+	e->hex = NULL;
+}
+
+// h/l move a byte, j/k a row and ctrl+f/ctrl+b a screen, 0 and $ go to the start and end
+// of the row and G to the end of the file. space opens the command line as usual and
+// escape goes back to the buffer.
+static void editor_handle_hex_keyevt(struct editor *e, struct keyevt evt) {
+	struct hexview *hv = e->hex;
+	off_t page = (off_t) MAX(hv->last_height, 1) * HEXVIEW_ROW_BYTES;
+	off_t col = hv->cursor % HEXVIEW_ROW_BYTES;
+
+	if (evt.kind == KEYKIND_ESCAPE) {
+		editor_close_hex(e);
+	} else if (EVT_IS_CHAR(evt, ' ')) {
+		string_clear(&e->commandline);
+		string_clear(&e->errormsg);
+		e->mode = MODE_COMMAND;
+	} else if (evt.ctrl && EVT_IS_CHAR(evt, 'f')) {
+		hexview_move(hv, page);
+	} else if (evt.ctrl && EVT_IS_CHAR(evt, 'b')) {
+		hexview_move(hv, -page);
+	} else if (EVT_IS_CHAR(evt, 'h')) {
+		hexview_move(hv, -1);
+	} else if (EVT_IS_CHAR(evt, 'l')) {
+		hexview_move(hv, 1);
+	} else if (EVT_IS_CHAR(evt, 'j')) {
+		hexview_move(hv, HEXVIEW_ROW_BYTES);
+	} else if (EVT_IS_CHAR(evt, 'k')) {
+		hexview_move(hv, -HEXVIEW_ROW_BYTES);
+	} else if (EVT_IS_CHAR(evt, '0') || evt.kind == KEYKIND_HOME) {
+		hexview_move(hv, -col);
+	} else if (EVT_IS_CHAR(evt, '$') || evt.kind == KEYKIND_END) {
+		hexview_move(hv, HEXVIEW_ROW_BYTES - 1 - col);
+	} else if (EVT_IS_CHAR(evt, 'G')) {
+		hexview_move(hv, hv->size);
+	}
+}
+
+static void editor_eval_commandline(struct editor *e, str_t cmd) {
+	if (str_eq(cmd, STR("q"))) {
+		e->should_exit = 1;
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'a')) {
-		curp->cursor_line_idx = MIN(pane_get_cursor_line(curp)->string.len, curp->cursor_line_idx + 1);
-		e->mode = MODE_INSERT;
+	if (str_eq(cmd, STR("detach"))) {
+		if (!e->on_server)
+			editor_error(e, "detach: not running on a server (start with -c)");
+		else
+			e->should_detach = 1;
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'h')) {
-		curp->cursor_line_idx = curp->cursor_line_idx > 0 ? curp->cursor_line_idx - 1 : 0;
+	if (str_eq(cmd, STR("follow"))) {
+		struct pane *curp = editor_get_focused_pane(e);
+		if (curp->follow != NULL) {
+			follow_stop(curp->follow);
+			free(curp->follow);
+			curp->follow = NULL;
+		} else if (curp->path.len == 0) {
+			editor_error(e, "follow: buffer has no file");
+		} else if (editor_start_follow(e)) {
+			editor_error(e, "follow: %s", strerror(errno));
+		}
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'j')) {
-		pane_line_down(curp);
+	if (str_eq(cmd, STR("wrap"))) {
+		struct pane *curp = editor_get_focused_pane(e);
+		curp->soft_wrap = !curp->soft_wrap;
+		curp->left_col = 0;
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'k')) {
-		pane_line_up(curp);
+	if (str_eq(cmd, STR("registers"))) {
+		editor_show_registers(e);
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'l')) {
-		struct bufline *curlin = pane_get_cursor_line(curp);
-		if (curlin->string.len > 0)
-			curp->cursor_line_idx = MIN(curlin->string.len - 1, curp->cursor_line_idx + 1);
+	if (str_eq(cmd, STR("mem"))) {
+		string_t msg = string_new();
+		editor_mem_report(e, &msg);
+		editor_message(e, "%.*s", (int) msg.len, msg.ptr);
+		string_free(msg);
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'A')) {
-		curp->cursor_line_idx = pane_get_cursor_line(curp)->string.len;
-		e->mode = MODE_INSERT;
+	if (str_eq(cmd, STR("compact"))) {
+		editor_compact(e);
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'D')) {
-		pane_get_cursor_line(curp)->string.len = curp->cursor_line_idx;
+	if (str_eq(cmd, STR("open"))) {
+		editor_open_picker(e);
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'C')) {
-		pane_get_cursor_line(curp)->string.len = curp->cursor_line_idx;
-		e->mode = MODE_INSERT;
+	if (str_eq(cmd, STR("hex"))) {
+		struct pane *curp = editor_get_focused_pane(e);
+		if (e->hex != NULL)
+			editor_close_hex(e);
+		else if (curp->path.len == 0)
+			editor_error(e, "hex: buffer has no file");
+		else if (editor_open_hex(e, curp->path.ptr))
+			editor_error(e, "hex: %s: %s", curp->path.ptr, strerror(errno));
 		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'G')) {
-		struct bufline *l = pane_get_cursor_line(curp);
+	str_t arg;
+	if (str_strip_prefix(cmd, STR("hex "), &arg)) {
+		// an offset, in decimal or with 0x for hex
+		string_t num = str_to_string(arg);
+		string_push(&num, '\0');
+		char *end;
+		errno = 0;
+		unsigned long long off = strtoull(num.ptr, &end, 0);
+		int bad = num.len == 1 || *end != '\0' || errno != 0;
+		string_free(num);
+		struct pane *curp = editor_get_focused_pane(e);
+		if (bad)
+			editor_error(e, "hex: not an offset: %.*s", (int) arg.len, arg.ptr);
+		else if (e->hex == NULL && curp->path.len == 0)
+			editor_error(e, "hex: buffer has no file");
+		else if (e->hex == NULL && editor_open_hex(e, curp->path.ptr))
+			editor_error(e, "hex: %s: %s", curp->path.ptr, strerror(errno));
+		else if (off >= (unsigned long long) MAX(e->hex->size, (off_t) 1))
+			editor_error(e, "hex: past the end of the file (0x%llx bytes)", (unsigned long long) e->hex->size);
+		else
+			e->hex->cursor = off;
+		return;
+	}
 
-		while (l->next != NULL) {
-			pane_line_down(curp);
-			l = pane_get_cursor_line(curp);
-		}
+	if (str_strip_prefix(cmd, STR("mksession "), &arg)) {
+		string_t path = str_to_string(arg);
+		string_push(&path, '\0');
+		editor_make_session(e, path.ptr);
+		string_free(path);
+		return;
+	}
 
-		curp->cursor_line_idx = MIN(curp->cursor_line_idx, l->string.len - 1);
+	if (str_strip_prefix(cmd, STR("open "), &arg)) {
+		string_t path = str_to_string(arg);
+		string_push(&path, '\0');
+		editor_open_file(e, path.ptr);
+		string_free(path);
+		return;
 	}
 
-	if (EVT_IS_CHAR(evt, 'o')) {
-		struct bufline *cur = pane_get_cursor_line(curp);
-		struct bufline *new = bufline_new_with_string(string_new());
-		new->next = cur->next;
-		new->prev = cur;
-		cur->next = new;
-		curp->cursor_line_idx = 0;
-		pane_line_down(curp);
-		e->mode = MODE_INSERT;
+	if (str_strip_prefix(cmd, STR("match "), &arg)) {
+		struct pane *curp = editor_get_focused_pane(e);
+		if (curp->pager != NULL)
+			editor_error(e, "multiple cursors aren't supported in paged mode");
+		else if (pane_add_cursors_at_matches(curp, arg) == 0)
+			editor_error(e, "match: not found: %.*s", (int) arg.len, arg.ptr);
+		return;
 	}
+
+	if (str_strip_prefix(cmd, STR("cursors "), &arg)) {
+		struct pane *curp = editor_get_focused_pane(e);
+		size_t n;
+		if (curp->pager != NULL)
+			editor_error(e, "multiple cursors aren't supported in paged mode");
+		else if (str_parse_size(arg, &n))
+			editor_error(e, "cursors: not a number: %.*s", (int) arg.len, arg.ptr);
+		else if (pane_add_cursor_column(curp, n))
+			editor_error(e, "cursors: %s", strerror(errno));
+		return;
+	}
+
+	if (editor_try_substitute(e, cmd) || editor_try_filter(e, cmd))
+		return;
+
+	size_t lineno;
+	if (str_parse_size(cmd, &lineno) == 0) {
+		pane_goto_line(editor_get_focused_pane(e), lineno);
+		return;
+	}
+
+	editor_error(e, "Invalid command: %.*s", (int) cmd.len, cmd.ptr);
 }
 
-static void editor_eval_commandline(struct editor *e, str_t cmd) {
-	if (str_eq(cmd, STR("q"))) {
-		e->should_exit = 1;
+static void editor_close_completion(struct editor *e) {
+	for (size_t i = 0; i < e->ncompl; i++)
+		string_free(e->compl_words[i]);
+	free(e->compl_words);
+	e->compl_words = NULL;
+	e->ncompl = 0;
+}
+
+// Ctrl-N and Ctrl-P: the first press offers the words of the buffer that start with the
+// one before the cursor, most common first, and puts in the first (or last) one. the
+// presses after it go on to the next (or previous) one.
+static void editor_complete(struct editor *e, int dir) {
+	struct pane *p = editor_get_focused_pane(e);
+	if (p->ncursors > 0 || p->pager != NULL) {
+		editor_error(e, "completion: not available here");
 		return;
 	}
+	struct bufline *bl = pane_get_cursor_line(p);
+	size_t lineno = pane_get_cursor_line_no(p);
 
-	char errmsg[1000];
-	snprintf(errmsg, sizeof(errmsg), "Invalid command: %.*s", (int) cmd.len, cmd.ptr);
-	assert(strlen(errmsg) < sizeof(errmsg));
-	string_clear(&e->errormsg);
-	string_append(&e->errormsg, cstr_as_str(errmsg));
+	if (e->ncompl == 0) {
+		// the words are normally counted by now. if not, the lines counted so far do.
+		if (p->words == NULL)
+			(void) pane_index_words(p);
+		size_t start = p->cursor_line_idx;
+		while (start > 0 && wordindex_is_word_char(bl->string.ptr[start - 1]))
+			start--;
+		str_t prefix = { .ptr = bl->string.ptr + start, .len = p->cursor_line_idx - start };
+		e->compl_words = malloc(sizeof(e->compl_words[0]) * COMPL_MAX_CANDIDATES);
+		e->ncompl = wordindex_complete(p->words, prefix, e->compl_words, COMPL_MAX_CANDIDATES);
+		if (e->ncompl == 0) {
+			editor_close_completion(e);
+			editor_error(e, "completion: no matches");
+			return;
+		}
+		e->compl_idx = start;
+		e->compl_sel = dir > 0 ? 0 : e->ncompl - 1;
+	} else {
+		e->compl_sel = (e->compl_sel + e->ncompl + dir) % e->ncompl;
+	}
+
+	str_t word = string_as_str(e->compl_words[e->compl_sel]);
+	if (p->cursor_line_idx > e->compl_idx)
+		pane_delete_chars(p, bl, lineno, e->compl_idx, p->cursor_line_idx - e->compl_idx);
+	pane_insert_text(p, bl, lineno, e->compl_idx, word);
+	p->cursor_line_idx = e->compl_idx + word.len;
 }
 
 static void editor_handle_insert_mode_keyevt(struct editor *e, struct keyevt evt) {
 	struct pane *curp = editor_get_focused_pane(e);
 
+	if (evt.kind == KEYKIND_CHAR && evt.ctrl && (evt.kchar == 'n' || evt.kchar == 'p')) {
+		editor_complete(e, evt.kchar == 'n' ? 1 : -1);
+		return;
+	}
+	// any other key takes the word that was picked
+	editor_close_completion(e);
+
 	if (evt.kind == KEYKIND_ESCAPE) {
 		curp->cursor_line_idx = curp->cursor_line_idx > 0 ? curp->cursor_line_idx - 1 : 0;
+		pane_move_cursors(curp, CURSOR_LEFT);
 		e->mode = MODE_NORMAL;
+		return;
+	}
+
+	if (curp->ncursors > 0) {
+		switch (evt.kind) {
+		case KEYKIND_CHAR:
+			pane_edit_at_cursors(curp, CURSOR_INSERT_CHAR, evt.kchar);
+			break;
+		case KEYKIND_DELETE:
+			pane_edit_at_cursors(curp, CURSOR_DELETE, 0);
+			break;
+		case KEYKIND_BACKSPACE:
+			pane_edit_at_cursors(curp, CURSOR_BACKSPACE, 0);
+			break;
+		case KEYKIND_ENTER:
+			pane_edit_at_cursors(curp, CURSOR_NEWLINE, 0);
+			break;
+		default:
+			break;
+		}
+		return;
 	}
 
 	if (evt.kind == KEYKIND_CHAR) {
 		struct bufline *curlin = pane_get_cursor_line(curp);
-		string_insert(&curlin->string, curp->cursor_line_idx, evt.kchar);
+		pane_insert_char(curp, curlin, pane_get_cursor_line_no(curp), curp->cursor_line_idx, evt.kchar);
 		curp->cursor_line_idx += 1;
 	}
 
@@ -398,40 +3937,25 @@ static void editor_handle_insert_mode_keyevt(struct editor *e, struct keyevt evt
 		if (curp->cursor_line_idx == pane_get_cursor_line(curp)->string.len)
 			return;
 
-		string_remove(&pane_get_cursor_line(curp)->string, curp->cursor_line_idx);
+		pane_remove_char(curp, pane_get_cursor_line(curp), pane_get_cursor_line_no(curp), curp->cursor_line_idx);
 	}
 
 	if (evt.kind == KEYKIND_BACKSPACE) {
 		if (curp->cursor_line_idx == 0) {
-			struct bufline *origcurlin = pane_get_cursor_line(curp);
-			struct bufline *origprev = origcurlin->prev;
-			if (origprev == NULL)
+			if (!pane_line_up(curp))
 				return;
-			size_t origlen = origprev->string.len;
-			string_append(&origprev->string, string_as_str(origcurlin->string));
-			pane_line_up(curp);
-			origprev->next = origcurlin->next;
-			origcurlin->next->prev = origprev;
-			bufline_free(origcurlin);
+			struct bufline *prev = pane_get_cursor_line(curp);
+			size_t origlen = prev->string.len;
+			pane_join_next_line(curp, prev, pane_get_cursor_line_no(curp));
 			curp->cursor_line_idx = origlen;
 		} else {
-			string_remove(&pane_get_cursor_line(curp)->string, curp->cursor_line_idx - 1);
+			pane_remove_char(curp, pane_get_cursor_line(curp), pane_get_cursor_line_no(curp), curp->cursor_line_idx - 1);
 			curp->cursor_line_idx -= 1;
 		}
 	}
 
 	if (evt.kind == KEYKIND_ENTER) {
-		struct bufline *curlin = pane_get_cursor_line(curp);
-		string_t tail = str_to_string(
-			str_slice_idx_to_eol(string_as_str(curlin->string), curp->cursor_line_idx)
-		);
-		curlin->string.len = curp->cursor_line_idx;
-		struct bufline *newl = bufline_new_with_string(tail);
-		newl->prev = curlin;
-		newl->next = curlin->next;
-		if (curlin->next)
-			curlin->next->prev = newl;
-		curlin->next = newl;
+		pane_split_line(curp, pane_get_cursor_line(curp), pane_get_cursor_line_no(curp), curp->cursor_line_idx);
 		pane_line_down(curp);
 		curp->cursor_line_idx = 0;
 	}
@@ -458,6 +3982,32 @@ static void editor_handle_command_mode_keyevt(struct editor *e, struct keyevt ev
 }
 
 void editor_handle_keyevt(struct editor *e, struct keyevt evt) {
+	// while a :s or :! is running, Escape cancels it and other keys are dropped
+	struct pane *curp = editor_get_focused_pane(e);
+	if (curp->subst != NULL || curp->filter != NULL) {
+		if (evt.kind == KEYKIND_ESCAPE && curp->subst != NULL) {
+			pane_cancel_substitute(curp);
+			editor_message(e, "s: cancelled");
+		} else if (evt.kind == KEYKIND_ESCAPE) {
+			editor_finish_filter(e, 1, 0);
+		}
+		return;
+	}
+	if (e->picker != NULL) {
+		editor_handle_picker_keyevt(e, evt);
+		return;
+	}
+	if (e->hex != NULL && e->mode == MODE_NORMAL) {
+		editor_handle_hex_keyevt(e, evt);
+		return;
+	}
+
+	if (e->replay_depth == 0) {
+		e->cmd_failed = 0;
+		if (e->recording != 0)
+			macro_push(&e->macros[e->recording - 'a'], evt);
+	}
+
 	switch (e->mode) {
 	case MODE_NORMAL:
 		editor_handle_normal_mode_keyevt(e, evt);
@@ -470,3 +4020,1079 @@ void editor_handle_keyevt(struct editor *e, struct keyevt evt) {
 		break;
 	}
 }
+
+// `path` is the file the buffer was loaded from, of which `loaded_size` bytes were read
+void editor_set_path(struct editor *e, str_t path, off_t loaded_size) {
+	struct pane *curp = editor_get_focused_pane(e);
+	string_clear(&curp->name);
+	string_append(&curp->name, path);
+	string_clear(&curp->path);
+	string_append(&curp->path, path);
+	// NUL-terminated so it can be passed to syscalls
+	string_push(&curp->path, '\0');
+	curp->path.len -= 1;
+	curp->loaded_size = loaded_size;
+
+	// if the buffer holds the file as it was read, its lines are what the diff gutter
+	// compares against
+	if (curp->diff == NULL && curp->pager == NULL && curp->change_seq == 0 && curp->_priv_first_line->orig_off == 0)
+		pane_start_diff(curp);
+}
+
+int editor_start_follow(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	struct follow *f = malloc(sizeof(struct follow));
+	if (follow_start(f, curp->path.ptr, curp->loaded_size)) {
+		free(f);
+		return -1;
+	}
+	curp->follow = f;
+	return 0;
+}
+
+static int pane_cursor_at_eof(struct pane *p) {
+	return pane_get_cursor_line(p) == p->_priv_last_line
+		&& (p->pager == NULL || p->win_end == p->pager->size);
+}
+
+static void editor_follow_update(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	int at_eof = pane_cursor_at_eof(curp);
+
+	string_t tail = string_new();
+	enum follow_event ev = follow_poll(curp->follow, curp->pager == NULL ? &tail : NULL);
+	if (ev == FOLLOW_NONE) {
+		string_free(tail);
+		return;
+	}
+
+	if (ev == FOLLOW_TRUNCATED)
+		editor_error(e, "follow: file was truncated");
+	else if (ev == FOLLOW_ROTATED)
+		editor_error(e, "follow: file was replaced");
+
+	if (curp->pager == NULL && ev == FOLLOW_APPENDED) {
+		pane_append_text(curp, string_as_str(tail));
+	} else if (curp->pager == NULL) {
+		editor_close_completion(e);
+		pane_reload(curp, string_as_str(tail));
+	} else if (ev == FOLLOW_APPENDED) {
+		pane_window_grow_file(curp, curp->follow->off);
+	} else {
+		pane_reopen_pager(curp);
+	}
+	string_free(tail);
+
+	// what the journal has still applies to the file with more added to it, but not to
+	// a new one
+	if (curp->journal != NULL && ev == FOLLOW_APPENDED) {
+		if (journal_restamp(curp->journal, curp->path.ptr))
+			editor_error(e, "journal: %s", strerror(errno));
+	} else if (curp->journal != NULL) {
+		journal_close(curp->journal, 1);
+		free(curp->journal);
+		curp->journal = NULL;
+		if (editor_start_journal(e, 0))
+			editor_error(e, "can't create recovery journal: %s", strerror(errno));
+	}
+
+	// keep scrolling along while the cursor is at the end
+	if (at_eof) {
+		if (curp->pager == NULL) {
+			while (pane_line_down(curp))
+				;
+		} else {
+			pane_goto_last_line(curp);
+		}
+	}
+	e->needs_redraw = 1;
+}
+
+// the buffer is read from `fd` (a pipe or similar) as data arrives, instead of all at once.
+// takes ownership of `fd`.
+void editor_start_stream(struct editor *e, int fd, str_t name) {
+	struct pane *curp = editor_get_focused_pane(e);
+	string_clear(&curp->name);
+	string_append(&curp->name, name);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	curp->stream_fd = fd;
+}
+
+static void editor_stream_update(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	char buf[1 << 16];
+	string_t chunk = string_new();
+
+	// don't hog the loop: leave the rest for the next wakeup so the screen keeps updating
+	while (chunk.len < STREAM_READ_BUDGET) {
+		ssize_t nread = read(curp->stream_fd, buf, sizeof(buf));
+		if (nread > 0) {
+			string_append(&chunk, (str_t) { .ptr = buf, .len = nread });
+			continue;
+		}
+		if (nread == -1 && (errno == EAGAIN || errno == EINTR))
+			break;
+
+		if (nread == -1)
+			editor_error(e, "read: %s", strerror(errno));
+		close(curp->stream_fd);
+		curp->stream_fd = -1;
+		break;
+	}
+
+	pane_append_text(curp, string_as_str(chunk));
+	string_free(chunk);
+	e->needs_redraw = 1;
+}
+
+// fills `fds` with file descriptors that the main loop should wait on
+// besides the terminal. returns how many were filled.
+size_t editor_get_pollfds(struct editor *e, struct pollfd *fds, size_t nfds) {
+	size_t n = 0;
+	struct pane *curp = editor_get_focused_pane(e);
+	if (e->pool.outstanding > 0 && n < nfds)
+		fds[n++] = (struct pollfd) { .fd = e->pool.notify_fd, .events = POLLIN };
+	if (e->picker != NULL && !e->picker->walk_done && n < nfds)
+		fds[n++] = (struct pollfd) { .fd = e->picker->notify_fd, .events = POLLIN };
+	// the buffer is left alone (so a followed file isn't read) while a :s is running
+	if (curp->subst != NULL)
+		return n;
+	if (curp->filter != NULL) {
+		if (curp->filter->proc.in_fd != -1 && n < nfds)
+			fds[n++] = (struct pollfd) { .fd = curp->filter->proc.in_fd, .events = POLLOUT };
+		if (curp->filter->proc.out_fd != -1 && n < nfds)
+			fds[n++] = (struct pollfd) { .fd = curp->filter->proc.out_fd, .events = POLLIN };
+		return n;
+	}
+	if (curp->follow != NULL && n < nfds)
+		fds[n++] = (struct pollfd) { .fd = curp->follow->inotify_fd, .events = POLLIN };
+	if (curp->stream_fd != -1 && n < nfds)
+		fds[n++] = (struct pollfd) { .fd = curp->stream_fd, .events = POLLIN };
+	return n;
+}
+
+// calls back into whatever is waiting for background jobs that have finished. the main
+// loop does this before every redraw.
+void editor_drain_jobs(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	if (e->pool.outstanding == 0 || pool_drain(&e->pool) == 0)
+		return;
+	e->needs_redraw = 1;
+	if (curp->subst != NULL && subst_job_done(curp->subst))
+		editor_finish_substitute(e);
+}
+
+void editor_handle_pollfd(struct editor *e, struct pollfd pfd) {
+	struct pane *curp = editor_get_focused_pane(e);
+	if (pfd.fd == e->pool.notify_fd) {
+		editor_drain_jobs(e);
+		return;
+	}
+	if (e->picker != NULL && pfd.fd == e->picker->notify_fd) {
+		picker_collect(e->picker);
+		e->needs_redraw = 1;
+		return;
+	}
+	if (curp->subst != NULL)
+		return;
+	if (curp->filter != NULL) {
+		if (pfd.fd == curp->filter->proc.in_fd)
+			editor_filter_send(e);
+		else if (pfd.fd == curp->filter->proc.out_fd)
+			editor_filter_receive(e);
+		e->needs_redraw = 1;
+		return;
+	}
+	if (curp->follow != NULL && pfd.fd == curp->follow->inotify_fd)
+		editor_follow_update(e);
+	if (curp->stream_fd != -1 && pfd.fd == curp->stream_fd)
+		editor_stream_update(e);
+}
+
+// streamed buffers aren't journaled: a pipe has nothing on disk to replay against
+int editor_start_journal(struct editor *e, int append) {
+	struct pane *curp = editor_get_focused_pane(e);
+	if (curp->path.len == 0 || curp->stream_fd != -1)
+		return 0;
+
+	struct journal *j = malloc(sizeof(struct journal));
+	if (journal_open(j, curp->path.ptr, append)) {
+		free(j);
+		return -1;
+	}
+	curp->journal = j;
+	return 0;
+}
+
+static void pane_apply_journal_record(void *ctx, struct journal_record rec) {
+	struct pane *p = ctx;
+	// only a paged buffer writes records by file offset, and a file that big is paged
+	// again when it is replayed
+	if (rec.lineno == 0 && p->pager != NULL) {
+		while (p->pager->indexed_off < rec.line_off && pager_index_step(p->pager, PAGER_CHUNK_SIZE))
+			;
+		size_t first_no = pager_offset_line_no(p->pager, rec.line_off);
+		if (first_no != 0 && rec.line_skip > -(long) first_no)
+			rec.lineno = first_no + rec.line_skip;
+	}
+	if (rec.lineno == 0)
+		return;
+	pane_goto_line(p, rec.lineno);
+	if (pane_get_cursor_line_no(p) != rec.lineno)
+		return;
+
+	struct bufline *bl = pane_get_cursor_line(p);
+	switch (rec.op) {
+	case JOP_INSERT_CHAR:
+		if (rec.arg <= bl->string.len)
+			pane_insert_char(p, bl, rec.lineno, rec.arg, rec.ch);
+		break;
+	case JOP_REMOVE_CHAR:
+		if (rec.arg < bl->string.len)
+			pane_remove_char(p, bl, rec.lineno, rec.arg);
+		break;
+	case JOP_TRUNCATE:
+		if (rec.arg <= bl->string.len)
+			pane_truncate_line(p, bl, rec.lineno, rec.arg);
+		break;
+	case JOP_SPLIT:
+		if (rec.arg <= bl->string.len)
+			pane_split_line(p, bl, rec.lineno, rec.arg);
+		break;
+	case JOP_JOIN:
+		if (bl->next != NULL)
+			pane_join_next_line(p, bl, rec.lineno);
+		break;
+	case JOP_DELETE_LINES: {
+		struct bufline *last = bl;
+		size_t n = 1;
+		for (; n < rec.arg && last->next != NULL; n++)
+			last = last->next;
+		if (rec.arg > 0 && n == rec.arg)
+			pane_set_cursor(p, pane_delete_lines(p, bl, last, rec.lineno, rec.arg));
+		break;
+	}
+	case JOP_DELETE_CHARS:
+		if (rec.arg <= bl->string.len && rec.count <= bl->string.len - rec.arg)
+			pane_delete_chars(p, bl, rec.lineno, rec.arg, rec.count);
+		break;
+	case JOP_INSERT_TEXT:
+		if (rec.arg <= bl->string.len)
+			pane_insert_text(p, bl, rec.lineno, rec.arg, rec.text);
+		break;
+	case JOP_REPLACE_LINE:
+		pane_replace_line(p, bl, rec.lineno, str_to_string(rec.text));
+		break;
+	}
+	pane_clamp_cursor_idx(p);
+}
+
+// applies the edits from a previous session's journal. must be called before editor_start_journal().
+int editor_replay_journal(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	return journal_replay(curp->path.ptr, pane_apply_journal_record, curp);
+}
+
+// ms until editor_run_timers() has something to do, or -1
+int editor_poll_timeout(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	int timeout = curp->journal != NULL ? journal_ms_until_flush(curp->journal) : -1;
+	// keeps the progress of a running :s up to date
+	if (curp->subst != NULL && (timeout == -1 || timeout > SUBST_REDRAW_INTERVAL_MS))
+		timeout = SUBST_REDRAW_INTERVAL_MS;
+	// a :!cmd that closed its output, or one that was cancelled, may not have exited yet
+	if (((curp->filter != NULL && curp->filter->eof) || filter_reap_abandoned()) && (timeout == -1 || timeout > FILTER_REAP_INTERVAL_MS))
+		timeout = FILTER_REAP_INTERVAL_MS;
+	return timeout;
+}
+
+void editor_run_timers(struct editor *e) {
+	struct pane *curp = editor_get_focused_pane(e);
+	if (curp->journal != NULL && journal_ms_until_flush(curp->journal) == 0 && journal_flush(curp->journal))
+		editor_error(e, "journal: %s", strerror(errno));
+	if (curp->subst != NULL)
+		e->needs_redraw = 1;
+	int status;
+	if (curp->filter != NULL && curp->filter->eof && filter_reap(&curp->filter->proc, &status)) {
+		editor_finish_filter(e, 0, status);
+		e->needs_redraw = 1;
+	}
+	filter_reap_abandoned();
+}
+
+#ifdef MF_BUILD_TESTS
+// '\n' is enter, '\b' backspace and '\x1b' escape
+static void editor_type(struct editor *e, const char *keys) {
+	for (; *keys; keys++) {
+		struct keyevt evt = { .kind = KEYKIND_CHAR, .kchar = *keys };
+		if (*keys == '\n')
+			evt.kind = KEYKIND_ENTER;
+		else if (*keys == '\b')
+			evt.kind = KEYKIND_BACKSPACE;
+		else if (*keys == '\x1b')
+			evt.kind = KEYKIND_ESCAPE;
+		editor_handle_keyevt(e, evt);
+	}
+}
+
+// does the main loop's work until a :! is done
+static void editor_run_filter(struct editor *e) {
+	struct pane *p = editor_get_focused_pane(e);
+	while (p->filter != NULL) {
+		struct pollfd fds[4];
+		size_t n = editor_get_pollfds(e, fds, 4);
+		int timeout = editor_poll_timeout(e);
+		assert(poll(fds, n, timeout == -1 ? 5000 : timeout) > 0 || timeout != -1);
+		for (size_t i = 0; i < n; i++) {
+			if (fds[i].revents)
+				editor_handle_pollfd(e, fds[i]);
+		}
+		editor_run_timers(e);
+	}
+}
+
+// does the main loop's work until the :open picker has seen the whole tree
+static void editor_run_picker(struct editor *e) {
+	while (!e->picker->walk_done) {
+		struct pollfd fds[4];
+		size_t n = editor_get_pollfds(e, fds, 4);
+		assert(poll(fds, n, 5000) > 0);
+		for (size_t i = 0; i < n; i++) {
+			if (fds[i].revents)
+				editor_handle_pollfd(e, fds[i]);
+		}
+	}
+}
+
+static void write_test_file(const char *dir, const char *name, const char *contents) {
+	char path[64];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen(path, "w");
+	assert(f != NULL);
+	fputs(contents, f);
+	fclose(f);
+}
+
+static int pane_contents_eq(struct pane *p, const char *expect) {
+	string_t s = string_new();
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next) {
+		string_append(&s, string_as_str(bl->string));
+		if (bl->next != NULL)
+			string_push(&s, '\n');
+	}
+	int ret = str_eq(string_as_str(s), cstr_as_str((char *) expect));
+	string_free(s);
+	return ret;
+}
+
+// the completion index has counted every line, and counts the words they have now
+static int pane_words_match(struct pane *p) {
+	struct wordindex fresh;
+	wordindex_init(&fresh);
+	int ok = p->words != NULL && p->words_next == NULL;
+	for (struct bufline *bl = p->_priv_first_line; bl != NULL; bl = bl->next) {
+		ok = ok && bl->indexed;
+		wordindex_update(&fresh, string_as_str(bl->string), 0, bl->string.len, 1);
+	}
+	ok = ok && fresh.nwords == p->words->nwords;
+	for (struct bufline *bl = p->_priv_first_line; ok && bl != NULL; bl = bl->next) {
+		str_t line = string_as_str(bl->string);
+		for (size_t i = 0, start = 0; i <= line.len; i++) {
+			if (i < line.len && wordindex_is_word_char(line.ptr[i]))
+				continue;
+			str_t word = { .ptr = line.ptr + start, .len = i - start };
+			ok = ok && wordindex_count(&fresh, word) == wordindex_count(p->words, word);
+			start = i + 1;
+		}
+	}
+	wordindex_free(&fresh);
+	return ok;
+}
+
+void editor_run_tests(void) {
+	struct editor e;
+	editor_new(&e, STR("foo\nfoo bar foo\nbaz\nfoo"));
+	struct pane *p = editor_get_focused_pane(&e);
+
+	editor_eval_commandline(&e, STR("match foo"));
+	assert(p->ncursors == 3);
+	editor_type(&e, "iX");
+	assert(pane_contents_eq(p, "Xfoo\nXfoo bar Xfoo\nbaz\nXfoo"));
+	editor_type(&e, "\n");
+	assert(pane_contents_eq(p, "X\nfoo\nX\nfoo bar X\nfoo\nbaz\nX\nfoo"));
+	assert(pane_get_cursor_line_no(p) == 2);
+	assert(p->cursors[0].lineno == 4 && p->cursors[1].lineno == 5 && p->cursors[2].lineno == 8);
+	editor_type(&e, "\b\b");
+	assert(pane_contents_eq(p, "foo\nfoo bar foo\nbaz\nfoo"));
+	editor_type(&e, "\x1b\x1b");
+	assert(p->ncursors == 0);
+	editor_free(&e);
+
+	editor_new(&e, STR("ab\ncd\nef\ng"));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("cursors 2"));
+	editor_type(&e, "lD");
+	assert(pane_contents_eq(p, "a\nc\ne\ng"));
+	editor_type(&e, "A!");
+	assert(pane_contents_eq(p, "a!\nc!\ne!\ng"));
+	editor_type(&e, "\x1b");
+	// all cursors move together, and merge when they run into each other
+	editor_type(&e, "k");
+	assert(p->ncursors == 1);
+	editor_type(&e, "k");
+	assert(p->ncursors == 0);
+	// a count past the end of the buffer stops at the last line
+	editor_eval_commandline(&e, STR("cursors 100000000000"));
+	assert(pane_get_cursor_line_no(p) == 1 && p->ncursors == 3);
+	editor_type(&e, "\x1b");
+	editor_eval_commandline(&e, STR("cursors 100000000000000000000"));
+	assert(e.errormsg.len > 0 && p->ncursors == 0);
+	editor_free(&e);
+
+	// neither does put, which adds lines
+	editor_new(&e, STR("X\n\nabcdef\nabcdef"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "yy");
+	editor_eval_commandline(&e, STR("match c"));
+	assert(p->ncursors > 0);
+	editor_type(&e, "p");
+	assert(e.cmd_failed && pane_contents_eq(p, "X\n\nabcdef\nabcdef"));
+	editor_free(&e);
+
+	editor_new(&e, STR("a\nb\nc\nd\nefgh"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "qqA;\x1bjq");
+	assert(e.recording == 0 && e.macros['q' - 'a'].len == 4);
+	editor_type(&e, "2@q");
+	assert(pane_contents_eq(p, "a;\nb;\nc;\nd\nefgh"));
+	// stops once `j` can't move anymore
+	editor_type(&e, "100@q");
+	assert(pane_contents_eq(p, "a;\nb;\nc;\nd;\nefgh;"));
+	editor_type(&e, "0" "3x");
+	assert(pane_contents_eq(p, "a;\nb;\nc;\nd;\nh;"));
+	editor_type(&e, "2G");
+	assert(pane_get_cursor_line_no(p) == 2);
+	// a huge count is one deletion, and edits or motions that can't be done fail
+	editor_type(&e, "999999999x");
+	assert(pane_contents_eq(p, "a;\n\nc;\nd;\nh;") && !e.cmd_failed);
+	editor_type(&e, "x");
+	assert(e.cmd_failed);
+	editor_type(&e, "j5l");
+	assert(e.cmd_failed && p->cursor_line_idx == 1);
+	editor_type(&e, "h");
+	assert(!e.cmd_failed && p->cursor_line_idx == 0);
+	editor_type(&e, "h");
+	assert(e.cmd_failed);
+	// a key that comes in stops a repeat that would otherwise go on and on
+	int keys[2];
+	assert(pipe(keys) == 0 && write(keys[1], "\x1b", 1) == 1);
+	e.input_fd = keys[0];
+	editor_type(&e, "qwjkq");
+	editor_type(&e, "999999999@w");
+	assert(pane_get_cursor_line_no(p) == 3);
+	editor_type(&e, "999999999");
+	editor_handle_keyevt(&e, (struct keyevt) { .kind = KEYKIND_CHAR, .kchar = 'f', .ctrl = 1 });
+	e.input_fd = -1;
+	close(keys[0]);
+	close(keys[1]);
+	editor_free(&e);
+
+	editor_new(&e, STR("one two three\nfour\n\nfive six\nseven"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "dw");
+	assert(pane_contents_eq(p, "two three\nfour\n\nfive six\nseven"));
+	string_t reg = string_new();
+	regtext_to_string(e.registers[0], &reg);
+	assert(!e.registers[0]->linewise && str_eq(string_as_str(reg), STR("one ")));
+	editor_type(&e, "wdw");
+	assert(pane_contents_eq(p, "two \nfour\n\nfive six\nseven"));
+	editor_type(&e, "0d2w");
+	assert(pane_contents_eq(p, "\n\nfive six\nseven"));
+	editor_type(&e, "P");
+	assert(pane_contents_eq(p, "two \nfour\n\nfive six\nseven"));
+	editor_type(&e, "kd}");
+	assert(pane_contents_eq(p, "\nfive six\nseven"));
+	regtext_to_string(e.registers[0], &reg);
+	assert(e.registers[0]->linewise && str_eq(string_as_str(reg), STR("two \nfour\n")));
+	editor_type(&e, "jp");
+	assert(pane_contents_eq(p, "\nfive six\ntwo \nfour\nseven"));
+	assert(pane_get_cursor_line_no(p) == 3);
+	editor_type(&e, "2>>");
+	assert(pane_contents_eq(p, "\nfive six\n\ttwo \n\tfour\nseven"));
+	editor_type(&e, "<j");
+	assert(pane_contents_eq(p, "\nfive six\ntwo \nfour\nseven"));
+	editor_type(&e, "kcwsix\x1b");
+	assert(pane_contents_eq(p, "\nsix six\ntwo \nfour\nseven"));
+	editor_type(&e, "yjGp");
+	assert(pane_contents_eq(p, "\nsix six\ntwo \nfour\nseven\nsix six\ntwo "));
+	editor_type(&e, "2GdG");
+	assert(pane_contents_eq(p, ""));
+	assert(p->_priv_first_line == p->_priv_last_line);
+	editor_free(&e);
+
+	// registers share the lines' text instead of copying it
+	editor_new(&e, STR("one\ntwo\nthree\nfour"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "\"ayj");
+	assert(e.registers['a' - 'a' + 1] == e.registers[0] && e.registers[0]->refcount == 2);
+	assert(e.registers[0]->lines[0].text->ptr == p->_priv_first_line->string.ptr);
+	assert(regtext_unshared_size(e.registers[0]) == 0);
+	editor_type(&e, "dd");
+	assert(pane_contents_eq(p, "two\nthree\nfour"));
+	// "a still has "one", which the unnamed register shares until the next yank
+	assert(regtext_unshared_size(e.registers[1]) == 0);
+	editor_type(&e, "yy");
+	assert(regtext_unshared_size(e.registers[1]) == 3);
+	editor_type(&e, "G\"ap");
+	assert(pane_contents_eq(p, "two\nthree\nfour\none\ntwo"));
+	assert(pane_get_cursor_line(p)->shared != NULL);
+	editor_type(&e, "x");
+	assert(pane_contents_eq(p, "two\nthree\nfour\nne\ntwo"));
+	assert(pane_get_cursor_line(p)->shared == NULL && p->_priv_last_line->shared != NULL);
+	regtext_to_string(e.registers[1], &reg);
+	assert(str_eq(string_as_str(reg), STR("one\ntwo\n")));
+	// charwise, across lines
+	editor_type(&e, "1G" "ld3w");
+	assert(pane_contents_eq(p, "t\nne\ntwo"));
+	regtext_to_string(e.registers[0], &reg);
+	assert(str_eq(string_as_str(reg), STR("wo\nthree\nfour")));
+	editor_type(&e, "p");
+	assert(p->_priv_first_line->next->shared != NULL);
+	assert(pane_contents_eq(p, "two\nthree\nfour\nne\ntwo"));
+	editor_eval_commandline(&e, STR("registers"));
+	assert(e.msg_is_info && !e.cmd_failed);
+	string_free(reg);
+	editor_free(&e);
+
+	editor_new(&e, STR("foo bar\nbar foo foo\nbaz"));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("%s/foo/x/"));
+	assert(pane_contents_eq(p, "x bar\nbar x foo\nbaz"));
+	assert(pane_get_cursor_line_no(p) == 2 && e.msg_is_info);
+	editor_type(&e, "u");
+	assert(pane_contents_eq(p, "foo bar\nbar foo foo\nbaz"));
+	editor_eval_commandline(&e, STR("2,$s/o+|a/[&]/g"));
+	assert(pane_contents_eq(p, "foo bar\nb[a]r f[oo] f[oo]\nb[a]z"));
+	editor_eval_commandline(&e, STR(".s/z/Z/"));
+	assert(pane_contents_eq(p, "foo bar\nb[a]r f[oo] f[oo]\nb[a]Z"));
+	// undo only covers the last :s, and only while nothing else has changed
+	editor_type(&e, "x");
+	e.cmd_failed = 0;
+	editor_type(&e, "u");
+	assert(e.cmd_failed);
+	editor_eval_commandline(&e, STR("1s/nothing/x/"));
+	assert(e.cmd_failed && !e.msg_is_info);
+	editor_free(&e);
+
+	// a buffer big enough to be split between threads
+	string_t big = string_new();
+	for (int i = 0; i < 4 * SUBST_BACKGROUND_MIN_LINES; i++)
+		string_append(&big, STR("a line\n"));
+	editor_new(&e, string_as_str(big));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("%s/line/LINE/"));
+	if (p->subst != NULL) {
+		// keys other than Escape wait
+		editor_type(&e, "x");
+		subst_job_wait(p->subst);
+		editor_finish_substitute(&e);
+	}
+	assert(p->subst == NULL);
+	assert(str_eq(string_as_str(p->_priv_first_line->string), STR("a LINE")));
+	assert(str_eq(string_as_str(p->_priv_last_line->prev->string), STR("a LINE")));
+	editor_type(&e, "u");
+	assert(str_eq(string_as_str(p->_priv_last_line->prev->string), STR("a line")));
+	editor_eval_commandline(&e, STR("%s/line/LINE/"));
+	editor_type(&e, "\x1b");
+	assert(p->subst == NULL);
+	editor_free(&e);
+
+	editor_new(&e, STR("b\nc\na\nz"));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("1,3!sort"));
+	editor_run_filter(&e);
+	assert(pane_contents_eq(p, "a\nb\nc\nz") && !e.cmd_failed);
+	editor_type(&e, "u");
+	assert(pane_contents_eq(p, "b\nc\na\nz") && !e.cmd_failed);
+	editor_eval_commandline(&e, STR("1,3!sort"));
+	editor_run_filter(&e);
+	assert(pane_contents_eq(p, "a\nb\nc\nz"));
+	// output that comes in before all input is sent, and a command that stops reading
+	editor_eval_commandline(&e, STR("%!head -n 2"));
+	editor_run_filter(&e);
+	assert(pane_contents_eq(p, "a\nb"));
+	editor_eval_commandline(&e, STR("2!printf 'x\\ny'"));
+	editor_run_filter(&e);
+	assert(pane_contents_eq(p, "a\nx\ny"));
+	editor_eval_commandline(&e, STR("%!true"));
+	editor_run_filter(&e);
+	assert(pane_contents_eq(p, ""));
+	editor_type(&e, "u");
+	assert(pane_contents_eq(p, "a\nx\ny"));
+	// a failed command without output changes nothing, and one with output can be undone
+	editor_eval_commandline(&e, STR("%!exit 3"));
+	editor_run_filter(&e);
+	assert(e.cmd_failed && pane_contents_eq(p, "a\nx\ny"));
+	editor_eval_commandline(&e, STR("2,3!echo out; exit 1"));
+	editor_run_filter(&e);
+	assert(e.cmd_failed && pane_contents_eq(p, "a\nout"));
+	editor_type(&e, "u");
+	assert(pane_contents_eq(p, "a\nx\ny"));
+	editor_free(&e);
+
+	// more than fits in the pipes at once, both ways
+	editor_new(&e, string_as_str(big));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("1,$!tr a A"));
+	editor_run_filter(&e);
+	assert(str_eq(string_as_str(p->_priv_first_line->string), STR("A line")));
+	assert(str_eq(string_as_str(p->_priv_last_line->prev->string), STR("A line")));
+	assert(pane_count_lines(p) == 4 * SUBST_BACKGROUND_MIN_LINES);
+	editor_eval_commandline(&e, STR("%!srot"));
+	editor_run_filter(&e);
+	assert(e.cmd_failed && pane_count_lines(p) == 4 * SUBST_BACKGROUND_MIN_LINES);
+	assert(str_eq(string_as_str(p->_priv_last_line->prev->string), STR("A line")));
+	editor_free(&e);
+	string_free(big);
+
+	// :open, with a path or through the picker
+	char dir[] = "/tmp/mf-open-XXXXXX";
+	test_tmpdir_create(dir);
+	char subdir[64];
+	snprintf(subdir, sizeof(subdir), "%s/src", dir);
+	assert(mkdir(subdir, 0700) == 0);
+	write_test_file(dir, "notes.txt", "hello\nworld\n");
+	write_test_file(dir, "src/main.c", "int main;\n");
+	int cwd = open(".", O_RDONLY | O_DIRECTORY);
+	assert(cwd != -1 && chdir(dir) == 0);
+	editor_new(&e, STR("scratch"));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("open notes.txt"));
+	assert(pane_contents_eq(p, "hello\nworld") && str_eq(string_as_str(p->name), STR("notes.txt")));
+	// the journal file is only created by the first edit
+	assert(p->journal != NULL && access(".notes.txt.mfj", F_OK) == -1);
+	editor_eval_commandline(&e, STR("open nope"));
+	assert(e.cmd_failed && pane_contents_eq(p, "hello\nworld"));
+	editor_type(&e, " open\n");
+	assert(e.picker != NULL);
+	editor_run_picker(&e);
+	assert(e.picker->ncands == 2);
+	editor_type(&e, "mc\n");
+	assert(e.picker == NULL);
+	assert(pane_contents_eq(p, "int main;") && str_eq(string_as_str(p->name), STR("src/main.c")));
+	editor_type(&e, " open\nzzz\n\x1b");
+	assert(e.picker == NULL && pane_contents_eq(p, "int main;"));
+	editor_type(&e, "x");
+	assert(journal_flush(p->journal) == 0 && access("src/.main.c.mfj", F_OK) == 0);
+	editor_free(&e);
+	assert(access("src/.main.c.mfj", F_OK) == -1);
+	assert(fchdir(cwd) == 0);
+	close(cwd);
+	test_tmpdir_remove(dir);
+
+	// a session comes back with its changes, cursors and undo
+	char sdir[] = "/tmp/mf-session-XXXXXX";
+	test_tmpdir_create(sdir);
+	write_test_file(sdir, "f.txt", "one\ntwo foo\nthree foo\nfour");
+	char spath[64], snap[64];
+	snprintf(spath, sizeof(spath), "%s/f.txt", sdir);
+	snprintf(snap, sizeof(snap), "mksession %s/snap", sdir);
+	editor_new(&e, STR(""));
+	p = editor_get_focused_pane(&e);
+	editor_open_file(&e, spath);
+	editor_type(&e, "x");
+	editor_eval_commandline(&e, STR("%s/foo/bar/"));
+	editor_type(&e, "l");
+	pane_add_cursor_column(p, 2);
+	size_t seq = p->change_seq;
+	editor_eval_commandline(&e, str_slice_idx_to_eol(cstr_as_str(snap), 0));
+	assert(e.msg_is_info);
+	editor_free(&e);
+
+	editor_new(&e, STR("scratch"));
+	p = editor_get_focused_pane(&e);
+	assert(editor_resume_session(&e, snap + strlen("mksession ")) == 0);
+	assert(pane_contents_eq(p, "ne\ntwo bar\nthree bar\nfour") && p->last_line_open);
+	assert(str_eq(string_as_str(p->path), cstr_as_str(spath)) && p->change_seq == seq);
+	assert(pane_get_cursor_line_no(p) == 3 && p->cursor_line_idx == 1);
+	assert(p->ncursors == 1 && p->cursors[0].lineno == 4 && p->cursors[0].line == p->_priv_last_line);
+	assert(p->_priv_first_line->shared != NULL && p->_priv_first_line->shared->map_len > 0);
+	editor_type(&e, "u");
+	assert(pane_contents_eq(p, "ne\ntwo foo\nthree foo\nfour"));
+	editor_free(&e);
+
+	editor_new(&e, STR("scratch"));
+	assert(editor_resume_session(&e, spath) == -1 && errno == EINVAL);
+	editor_free(&e);
+	test_tmpdir_remove(sdir);
+
+	// the diff gutter marks what changed since the file was loaded
+	char ddir[] = "/tmp/mf-diff-XXXXXX";
+	test_tmpdir_create(ddir);
+	write_test_file(ddir, "d.txt", "a\nb\nc\nd\ne\n");
+	char dpath[64];
+	snprintf(dpath, sizeof(dpath), "%s/d.txt", ddir);
+	editor_new(&e, STR(""));
+	p = editor_get_focused_pane(&e);
+	editor_open_file(&e, dpath);
+	assert(p->diff != NULL && p->diff->n == 5);
+	struct framebuf dfb;
+	framebuf_new(&dfb, 20, 8);
+	editor_render(&e, &dfb, (struct rect) { .width = 20, .height = 8 });
+	for (int y = 0; y < 5; y++)
+		assert(dfb.buf[y * 20].ch == ' ' && dfb.buf[y * 20 + 5].ch == 'a' + y);
+	editor_type(&e, "xjonew\x1bjjdd");
+	assert(pane_contents_eq(p, "\nb\nnew\nc\ne"));
+	pane_goto_line(p, 1);
+	framebuf_reset(&dfb, 20, 8);
+	editor_render(&e, &dfb, (struct rect) { .width = 20, .height = 8 });
+	const char *want_marks = "~ +_ ";
+	for (int y = 0; y < 5; y++)
+		assert(dfb.buf[y * 20].ch == want_marks[y]);
+	// a line changed back is the same as the file's again
+	editor_type(&e, "ia\x1b");
+	unsigned char dmarks[5];
+	pane_diff_marks(p, p->_priv_first_line, 5, dmarks);
+	assert(dmarks[0] == DIFF_NONE && dmarks[2] == DIFF_ADDED && dmarks[3] == DIFF_REMOVED);
+	// lines that the file grew by (e.g. in follow mode) are the file's
+	pane_append_text(p, STR("f\ng\n"));
+	assert(p->diff->n == 7);
+	pane_diff_marks(p, p->_priv_first_line->next->next->next->next, 3, dmarks);
+	assert(dmarks[0] == DIFF_NONE && dmarks[1] == DIFF_NONE && dmarks[2] == DIFF_NONE);
+	framebuf_free(&dfb);
+	editor_free(&e);
+	test_tmpdir_remove(ddir);
+
+	// :hex shows the buffer's file by offset, and goes back to the buffer on escape
+	char xdir[] = "/tmp/mf-hex-XXXXXX";
+	test_tmpdir_create(xdir);
+	write_test_file(xdir, "x.bin", "0123456789abcdefghijklmnopqrstuvwxyz\n");
+	char xpath[64];
+	snprintf(xpath, sizeof(xpath), "%s/x.bin", xdir);
+	editor_new(&e, STR(""));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("hex"));
+	assert(e.cmd_failed && e.hex == NULL);
+	editor_open_file(&e, xpath);
+	editor_type(&e, " hex\n");
+	assert(e.hex != NULL && e.hex->size == 37);
+	editor_type(&e, "jll");
+	assert(e.hex->cursor == 18);
+	framebuf_new(&dfb, 80, 6);
+	framebuf_reset(&dfb, 80, 6);
+	editor_render(&e, &dfb, (struct rect) { .width = 80, .height = 6 });
+	const char *xrow = "00000010  6768 696a 6b6c 6d6e  6f70 7172 7374 7576  ghijklmnopqrstuv";
+	for (int x = 0; xrow[x] != '\0'; x++)
+		assert(dfb.buf[80 + x].ch == xrow[x]);
+	assert(dfb.cursory == 1 && dfb.cursorx == hexview_hex_col(e.hex, 2));
+	assert(dfb.buf[80 + hexview_text_col(e.hex, 2)].style.bg == EXTRA_CURSOR_STYLE.bg);
+	// a row past the end of the file is left empty
+	assert(dfb.buf[3 * 80].ch == ' ');
+	editor_type(&e, "G");
+	assert(e.hex->cursor == 36);
+	editor_type(&e, " hex 0x10\n");
+	assert(!e.cmd_failed && e.hex->cursor == 16);
+	editor_type(&e, " hex 37\n");
+	assert(e.cmd_failed && e.hex->cursor == 16);
+	// normal mode keys don't reach the buffer
+	editor_type(&e, "dd\x1b");
+	assert(e.hex == NULL && pane_contents_eq(p, "0123456789abcdefghijklmnopqrstuvwxyz"));
+	framebuf_free(&dfb);
+	editor_free(&e);
+	test_tmpdir_remove(xdir);
+
+	// a long stretch of changes is marked without diffing all of it
+	string_t many = string_new();
+	for (int i = 0; i < 3 * DIFF_MAX_GAP; i++)
+		string_append(&many, STR("x\n"));
+	editor_new(&e, string_as_str(many));
+	p = editor_get_focused_pane(&e);
+	editor_set_path(&e, STR("many"), many.len);
+	assert(p->diff != NULL);
+	editor_eval_commandline(&e, STR("%s/x/y/"));
+	pane_goto_line(p, 2 * DIFF_MAX_GAP);
+	pane_diff_marks(p, pane_get_cursor_line(p), 5, dmarks);
+	for (int i = 0; i < 5; i++)
+		assert(dmarks[i] == DIFF_MODIFIED);
+	editor_free(&e);
+	string_free(many);
+
+	// insert mode completion offers the buffer's words, most common first
+	editor_new(&e, STR("alpha beta\nalphabet alpha\nalpine"));
+	p = editor_get_focused_pane(&e);
+	while (editor_idle_work(&e))
+		;
+	assert(pane_words_match(p));
+	struct keyevt ctrl_n = { .kind = KEYKIND_CHAR, .kchar = 'n', .ctrl = 1 };
+	struct keyevt ctrl_p = { .kind = KEYKIND_CHAR, .kchar = 'p', .ctrl = 1 };
+	editor_type(&e, "Go al");
+	editor_handle_keyevt(&e, ctrl_n);
+	assert(e.ncompl == 3 && e.compl_sel == 0);
+	assert(pane_contents_eq(p, "alpha beta\nalphabet alpha\nalpine\n alpha"));
+	assert(p->cursor_line_idx == 6);
+	// drawn under the word, with the one picked highlighted
+	framebuf_new(&dfb, 20, 8);
+	framebuf_reset(&dfb, 20, 8);
+	editor_render(&e, &dfb, (struct rect) { .width = 20, .height = 8 });
+	assert(dfb.buf[20 + 5].ch == 'a' && dfb.buf[20 + 5].style.bg == BLUE_COLOR);
+	assert(dfb.buf[2 * 20 + 5].ch == 'a' && dfb.buf[2 * 20 + 5].style.bg == LIGHTERBG_COLOR);
+	editor_handle_keyevt(&e, ctrl_n);
+	editor_handle_keyevt(&e, ctrl_p);
+	editor_handle_keyevt(&e, ctrl_p);
+	assert(e.compl_sel == 2 && p->cursor_line_idx == 1 + e.compl_words[2].len);
+	editor_handle_keyevt(&e, ctrl_n);
+	assert(pane_contents_eq(p, "alpha beta\nalphabet alpha\nalpine\n alpha"));
+	// the next key takes it
+	editor_type(&e, "s");
+	assert(e.ncompl == 0 && pane_contents_eq(p, "alpha beta\nalphabet alpha\nalpine\n alphas"));
+	editor_type(&e, " zz");
+	editor_handle_keyevt(&e, ctrl_n);
+	assert(e.ncompl == 0 && e.errormsg.len > 0);
+	editor_type(&e, "\x1b");
+	assert(pane_words_match(p));
+	// lines the file grows by are counted as they come in
+	pane_append_text(p, STR("alpha omega\n"));
+	assert(pane_words_match(p) && wordindex_count(p->words, STR("omega")) == 1);
+	framebuf_free(&dfb);
+	editor_free(&e);
+
+	// the index stays right through edits of every kind, also while it is still being built
+	string_t wlines = string_new();
+	for (int i = 0; i < COMPL_INDEX_CHUNK_LINES + 2; i++)
+		string_append(&wlines, STR("one two\n"));
+	string_append(&wlines, STR("three four"));
+	editor_new(&e, string_as_str(wlines));
+	string_free(wlines);
+	p = editor_get_focused_pane(&e);
+	assert(editor_idle_work(&e));
+	pane_goto_line(p, COMPL_INDEX_CHUNK_LINES + 1);
+	assert(p->words_next == pane_get_cursor_line(p));
+	// joins the first line still to be counted onto the last one that is
+	editor_type(&e, "0i\bxy\nz\x1bjddGkox\x1b");
+	editor_eval_commandline(&e, STR("1,3s/two/five/"));
+	pane_goto_line(p, 1);
+	editor_type(&e, "yyGpkkdd");
+	while (editor_idle_work(&e))
+		;
+	assert(pane_words_match(p));
+	pane_goto_line(p, 2);
+	editor_type(&e, "xxxiabc\n\x1bGo\x1b" "3kdd");
+	editor_eval_commandline(&e, STR("%s/one/six/"));
+	assert(pane_words_match(p) && wordindex_count(p->words, STR("six")) > 0);
+	editor_type(&e, "u");
+	assert(pane_words_match(p) && wordindex_count(p->words, STR("six")) == 0);
+	editor_free(&e);
+
+	// the journal's records for spans are replayed the same way
+	editor_new(&e, STR("a\nb\nc\nd"));
+	p = editor_get_focused_pane(&e);
+	pane_apply_journal_record(p, (struct journal_record) { .op = JOP_DELETE_LINES, .lineno = 2, .arg = 2 });
+	assert(pane_contents_eq(p, "a\nd"));
+	pane_apply_journal_record(p, (struct journal_record) { .op = JOP_INSERT_TEXT, .lineno = 1, .arg = 1, .text = STR("x\ny") });
+	assert(pane_contents_eq(p, "ax\ny\nd"));
+	pane_apply_journal_record(p, (struct journal_record) { .op = JOP_DELETE_CHARS, .lineno = 1, .arg = 0, .count = 2 });
+	assert(pane_contents_eq(p, "\ny\nd"));
+	editor_free(&e);
+
+	// soft wrap: 6 columns are left for the text next to the line numbers
+	editor_new(&e, STR("abcdefghijklm\nxy\nz"));
+	p = editor_get_focused_pane(&e);
+	editor_eval_commandline(&e, STR("wrap"));
+	struct framebuf fb;
+	framebuf_new(&fb, 10, 6);
+	framebuf_reset(&fb, 10, 6);
+	editor_render(&e, &fb, (struct rect) { .width = 10, .height = 6 });
+	assert(fb.buf[4].ch == 'a' && fb.buf[10 + 4].ch == 'g' && fb.buf[20 + 4].ch == 'm');
+	assert(fb.buf[30].ch == ' ' && fb.buf[30 + 2].ch == '2' && fb.buf[30 + 4].ch == 'x');
+	// the gutter is blank on the rows a line continues on
+	assert(fb.buf[10 + 2].ch == ' ');
+	editor_type(&e, "llj");
+	assert(pane_get_cursor_line_no(p) == 1 && p->cursor_line_idx == 8);
+	// the short last row takes the column down to 0
+	editor_type(&e, "jj");
+	assert(pane_get_cursor_line_no(p) == 2 && p->cursor_line_idx == 0);
+	editor_type(&e, "l");
+	editor_type(&e, "k");
+	assert(pane_get_cursor_line_no(p) == 1 && p->cursor_line_idx == 12);
+	editor_type(&e, "k");
+	assert(pane_get_cursor_line_no(p) == 1 && p->cursor_line_idx == 6);
+	// an edit lays the line out again, and so does a different width
+	editor_type(&e, "x");
+	assert(p->_priv_first_line->layout == NULL);
+	framebuf_reset(&fb, 8, 6);
+	editor_render(&e, &fb, (struct rect) { .width = 8, .height = 6 });
+	assert(p->_priv_first_line->layout->width == 4 && p->_priv_first_line->layout->nrows == 3);
+	assert(fb.cursorx == 4 + 2 && fb.cursory == 1);
+	editor_eval_commandline(&e, STR("wrap"));
+	editor_type(&e, "k");
+	assert(pane_get_cursor_line_no(p) == 1);
+	editor_free(&e);
+
+	// without soft wrap, the lines scroll sideways to keep the cursor on screen. the tab
+	// that is cut by the left edge is left out.
+	editor_new(&e, STR("a\tbcdefgh\nxy"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "lllll");
+	framebuf_reset(&fb, 10, 6);
+	editor_render(&e, &fb, (struct rect) { .width = 10, .height = 6 });
+	assert(p->left_col == 7 && fb.cursorx == 4 + 5 && fb.buf[9].ch == 'e');
+	assert(fb.buf[4].ch == ' ' && fb.buf[5].ch == ' ' && fb.buf[6].ch == 'b');
+	assert(fb.buf[10 + 4].ch == ' ');
+	editor_type(&e, "0");
+	framebuf_reset(&fb, 10, 6);
+	editor_render(&e, &fb, (struct rect) { .width = 10, .height = 6 });
+	assert(p->left_col == 0 && fb.buf[4].ch == 'a' && fb.buf[10 + 4].ch == 'x');
+	framebuf_free(&fb);
+	editor_free(&e);
+
+	// deleting leaves the line's capacity as it was, until :compact
+	editor_new(&e, STR("hello world\nab"));
+	p = editor_get_focused_pane(&e);
+	editor_type(&e, "xxxx");
+	struct mem_usage u = editor_mem_usage(&e);
+	assert(u.nlines == 2 && u.line_text == 9 && u.line_slack == 4);
+	assert(u.line_nodes == 2 * sizeof(struct bufline) && u.undo == 0 && u.registers == 0);
+	editor_eval_commandline(&e, STR("compact"));
+	assert(p->_priv_first_line->string.cap == 7 && str_eq(string_as_str(p->_priv_first_line->string), STR("o world")));
+	assert(editor_mem_usage(&e).line_slack == 0);
+	editor_eval_commandline(&e, STR("mem"));
+	str_t rest;
+	assert(e.msg_is_info && str_strip_prefix(string_as_str(e.errormsg), STR("2 lines: "), &rest));
+	editor_free(&e);
+
+	// paged mode: a partial last line is read again once the file grows, also with the
+	// cursor on it, and isn't left behind as a change that splits the line
+	char fdir[] = "/tmp/mf-follow-XXXXXX";
+	test_tmpdir_create(fdir);
+	write_test_file(fdir, "log", "one\ntwo\nthr");
+	char fpath[64];
+	snprintf(fpath, sizeof(fpath), "%s/log", fdir);
+	struct pager *fpg = malloc(sizeof(struct pager));
+	assert(pager_open(fpg, fpath) == 0);
+	editor_new_paged(&e, fpg);
+	p = editor_get_focused_pane(&e);
+	pane_goto_last_line(p);
+	p->cursor_line_idx = 2;
+	FILE *ff = fopen(fpath, "a");
+	assert(ff != NULL);
+	fputs("ee\nfour\n", ff);
+	fclose(ff);
+	pane_window_grow_file(p, 19);
+	assert(str_eq(string_as_str(pane_get_cursor_line(p)->string), STR("three")) && p->cursor_line_idx == 2);
+	pane_goto_last_line(p);
+	pane_window_reload(p, 0);
+	pane_window_extend_down(p, 10);
+	p->_priv_cursor_line = p->_priv_first_line;
+	p->_priv_cursor_line_no = 1;
+	assert(pane_contents_eq(p, "one\ntwo\nthree\nfour"));
+	editor_free(&e);
+
+	// a followed file that is truncated or replaced is read again, not added after what
+	// the buffer had
+	write_test_file(fdir, "small", "a\nb\n");
+	snprintf(fpath, sizeof(fpath), "%s/small", fdir);
+	editor_new(&e, STR("a\nb\n"));
+	editor_set_path(&e, cstr_as_str(fpath), 4);
+	p = editor_get_focused_pane(&e);
+	assert(editor_start_follow(&e) == 0);
+	write_test_file(fdir, "small", "c\n");
+	editor_follow_update(&e);
+	assert(pane_contents_eq(p, "c"));
+	write_test_file(fdir, "new", "d\ne\n");
+	char newpath[64];
+	snprintf(newpath, sizeof(newpath), "%s/new", fdir);
+	assert(rename(newpath, fpath) == 0);
+	editor_follow_update(&e);
+	assert(pane_contents_eq(p, "d\ne"));
+	ff = fopen(fpath, "a");
+	fputs("f\n", ff);
+	fclose(ff);
+	editor_follow_update(&e);
+	assert(pane_contents_eq(p, "d\ne\nf"));
+	editor_free(&e);
+
+	// the journal file is only created by the first edit. appends don't make it stale: its
+	// header follows the file, and the edits are replayed onto the file with the appended
+	// lines.
+	write_test_file(fdir, "grow", "a\nb\n");
+	snprintf(fpath, sizeof(fpath), "%s/grow", fdir);
+	char jfile[64];
+	snprintf(jfile, sizeof(jfile), "%s/.grow.mfj", fdir);
+	editor_new(&e, STR("a\nb\n"));
+	editor_set_path(&e, cstr_as_str(fpath), 4);
+	p = editor_get_focused_pane(&e);
+	assert(editor_start_journal(&e, 0) == 0 && editor_start_follow(&e) == 0);
+	assert(p->journal != NULL && access(jfile, F_OK) == -1);
+	editor_type(&e, "x");
+	assert(journal_flush(p->journal) == 0 && journal_check(fpath));
+	ff = fopen(fpath, "a");
+	fputs("c\n", ff);
+	fclose(ff);
+	assert(!journal_check(fpath));
+	editor_follow_update(&e);
+	assert(journal_ms_until_flush(p->journal) >= 0 && journal_flush(p->journal) == 0 && journal_check(fpath));
+	struct editor er;
+	string_t grown = string_new();
+	assert(read_file_to_string(fpath, &grown) == 0);
+	editor_new(&er, string_as_str(grown));
+	editor_set_path(&er, cstr_as_str(fpath), grown.len);
+	string_free(grown);
+	assert(editor_replay_journal(&er) == 0 && pane_contents_eq(editor_get_focused_pane(&er), "\nb\nc"));
+	editor_free(&er);
+	// one that doesn't match anymore is still there, to be kept
+	ff = fopen(fpath, "a");
+	fputs("d\n", ff);
+	fclose(ff);
+	assert(!journal_check(fpath) && journal_exists(fpath));
+	editor_free(&e);
+	assert(access(jfile, F_OK) == -1);
+	test_tmpdir_remove(fdir);
+
+	// paged mode: edits are journaled by where they are in the file, and replayed onto
+	// the file paged again
+	char jdir[] = "/tmp/mf-pjournal-XXXXXX";
+	test_tmpdir_create(jdir);
+	string_t jbig = string_new();
+	for (int i = 1; i <= 9000; i++) {
+		char num[16];
+		snprintf(num, sizeof(num), "l%d\n", i);
+		string_append(&jbig, cstr_as_str(num));
+	}
+	string_push(&jbig, '\0');
+	write_test_file(jdir, "big", jbig.ptr);
+	string_free(jbig);
+	char jpath[64];
+	snprintf(jpath, sizeof(jpath), "%s/big", jdir);
+	struct pager *jpg = malloc(sizeof(struct pager));
+	assert(pager_open(jpg, jpath) == 0);
+	editor_new_paged(&e, jpg);
+	editor_set_path(&e, cstr_as_str(jpath), jpg->size);
+	p = editor_get_focused_pane(&e);
+	assert(editor_start_journal(&e, 0) == 0 && p->journal != NULL);
+	pane_goto_line(p, 2);
+	editor_type(&e, "i\n\x1b");
+	// far off, so the line numbers come from the pager, with the added line counted
+	pane_goto_line(p, 8000);
+	assert(str_eq(string_as_str(pane_get_cursor_line(p)->string), STR("l7999")));
+	editor_type(&e, "x");
+	pane_goto_line(p, 1);
+	editor_type(&e, "iA\x1b");
+	assert(journal_flush(p->journal) == 0);
+
+	struct editor e2;
+	struct pager *jpg2 = malloc(sizeof(struct pager));
+	assert(pager_open(jpg2, jpath) == 0);
+	editor_new_paged(&e2, jpg2);
+	editor_set_path(&e2, cstr_as_str(jpath), jpg2->size);
+	struct pane *p2 = editor_get_focused_pane(&e2);
+	assert(editor_replay_journal(&e2) == 0);
+	const char *jwant[][2] = { { "1", "Al1" }, { "2", "" }, { "3", "l2" }, { "7999", "l7998" }, { "8000", "7999" }, { "9001", "l9000" } };
+	for (size_t i = 0; i < sizeof(jwant) / sizeof(jwant[0]); i++) {
+		pane_goto_line(p2, atoi(jwant[i][0]));
+		assert(str_eq(string_as_str(pane_get_cursor_line(p2)->string), cstr_as_str((char *) jwant[i][1])));
+	}
+	editor_free(&e2);
+	editor_free(&e);
+	test_tmpdir_remove(jdir);
+}
+#endif
@@ -1,10 +1,22 @@
 #ifndef __HAVE_EDITOR_H
 #define __HAVE_EDITOR_H
 
+#include <poll.h>
 #include "bufline.h"
+#include "filter.h"
+#include "follow.h"
+#include "hexview.h"
 #include "input.h"
+#include "journal.h"
+#include "linediff.h"
 #include "mf_string.h"
+#include "pager.h"
+#include "picker.h"
+#include "pool.h"
 #include "render.h"
+#include "subst.h"
+#include "textreg.h"
+#include "wordindex.h"
 
 enum editor_mode {
 	MODE_NORMAL,
@@ -12,30 +24,220 @@ enum editor_mode {
 	MODE_INSERT,
 };
 
+// a cursor besides the pane's main one
+struct cursor {
+	struct bufline *line;
+	size_t lineno;
+	size_t idx;
+};
+
+// a line changed by :s, and what it was before
+struct undo_line {
+	struct bufline *line;
+	size_t lineno;
+	struct sharedtext *text;
+};
+
+// what `u` puts back after a :!cmd: the lines of its range, in place of the `nout` lines
+// of output after `before` (line `before_lineno`, or at the start of the buffer if NULL)
+struct undo_range {
+	// NULL if there is nothing to put back
+	struct bufline *head;
+	struct bufline *tail;
+	size_t n;
+	struct bufline *before;
+	size_t before_lineno;
+	size_t nout;
+};
+
+// a running :!cmd. its output goes after `out` (at the start of the buffer if NULL), and
+// the lines still to be sent to it start at `in`. lines are taken out of the buffer as
+// they are sent, onto the `sent` list, except that `nkept` (0 or 1) of them stay between
+// the output and `in` while the buffer would be empty otherwise.
+struct pane_filter {
+	struct filter proc;
+	// the line the range came after, which the output starts after too
+	struct bufline *before;
+	size_t before_lineno;
+	struct bufline *out;
+	size_t out_lineno;
+	size_t nkept;
+	struct bufline *in;
+	size_t nin;
+	struct bufline *sent_head;
+	struct bufline *sent_tail;
+	size_t nsent;
+	// the output has ended, and the command's exit is waited for
+	unsigned eof : 1;
+	// sent lines that haven't been written to the command yet
+	string_t inbuf;
+	size_t inbuf_off;
+	// output after the last newline
+	string_t partial;
+	size_t nlines_out;
+};
+
 struct pane {
 	// line the cursor is on
 	struct bufline *_priv_cursor_line;
 	struct bufline *screen_top_line;
+	struct bufline *_priv_first_line;
+	struct bufline *_priv_last_line;
 	// index into `cursor_line->string` of the cursor
 	size_t cursor_line_idx;
+	// 0 if not known yet (paged mode)
 	size_t _priv_cursor_line_no;
 	unsigned show_line_nums : 1;
+	// multi-cursor editing: the other cursors, sorted by position. never includes
+	// the main cursor's position. always empty in paged mode.
+	struct cursor *cursors;
+	size_t ncursors;
+	size_t cursorcap;
 	// name displayed in statusline
 	string_t name;
+	// file the buffer was loaded from (empty if none)
+	string_t path;
+	// bytes of the file that have been loaded
+	off_t loaded_size;
+	// the last line of the file didn't end in a newline (yet)
+	unsigned last_line_open : 1;
+	// non-NULL in follow mode
+	struct follow *follow;
+	// pipe the buffer is still being read from, or -1
+	int stream_fd;
+	// crash recovery journal, or NULL
+	struct journal *journal;
+	// height the pane was last rendered at
+	int last_height;
+	// columns that were left for the text (besides the line numbers), 0 if not rendered yet
+	int text_width;
+	// long lines are broken into several screen rows instead of being cut off
+	unsigned soft_wrap : 1;
+	// without soft wrap: how many columns of every line are scrolled off to the left
+	size_t left_col;
+	// the file's lines as they were loaded, for the diff gutter. NULL if the buffer
+	// wasn't loaded from a file as a whole (e.g. paged mode).
+	struct diffbase *diff;
+	// insert mode completion: how often each word is in the buffer, or NULL until the
+	// lines start being counted (never in paged mode). the lines before `words_next` are
+	// counted, and the ones from it on are still to be, in the background. NULL once
+	// they all are.
+	struct wordindex *words;
+	struct bufline *words_next;
+
+	// paged mode: if non-NULL, the buffer only holds a window of the file
+	struct pager *pager;
+	// byte range [win_start, win_end) of the file that is loaded in the buffer
+	off_t win_start;
+	off_t win_end;
+	size_t win_nlines;
+
+	// counts changes to the buffer's contents
+	size_t change_seq;
+	// :s that is still running, or NULL. the buffer can't be changed until it's done.
+	struct subst_job *subst;
+	// the lines it works on, and the line number of the first one
+	struct bufline **subst_lines;
+	str_t *subst_strs;
+	size_t subst_lineno;
+	// :!cmd that is still running, or NULL. like with :s, the buffer can't be changed
+	// some other way meanwhile.
+	struct pane_filter *filter;
+	// what `u` puts back: the lines the last :s changed, or the range of the last :!cmd.
+	// only valid as long as `change_seq` is still `undo_seq`.
+	struct undo_line *undo;
+	size_t nundo;
+	struct undo_range undo_range;
+	size_t undo_seq;
+};
+
+// recorded key events, replayed with @{reg}
+struct macro {
+	struct keyevt *keys;
+	size_t len;
+	size_t cap;
 };
 
 struct editor {
 	enum editor_mode mode;
 	string_t commandline;
 	unsigned should_exit : 1;
+	// the editor is one of a server's, and is drawn for the clients attached to it
+	unsigned on_server : 1;
+	// :detach was run. the server lets go of the clients, and keeps the editor.
+	unsigned should_detach : 1;
 	struct pane foobar123lol; // temporary :-)
 	string_t errormsg;
+	// `errormsg` is just information (e.g. command output), not an error
+	unsigned msg_is_info : 1;
+	// something changed outside of a keypress that needs to be drawn
+	unsigned needs_redraw : 1;
+
+	// normal mode: count typed in front of a command so far, or 0
+	size_t count;
+	// normal mode: 'q', '@' or '"' if the next key names a register, else 0
+	char pending_reg_key;
+	// register ('a'..'z') being recorded into, or 0
+	char recording;
+	// register replayed last, for @@
+	char last_macro;
+	struct macro macros[26];
+	// how many macro replays are running (they can nest)
+	int replay_depth;
+	// normal mode: operator waiting for a motion ('d', 'c', 'y', '>' or '<'), or 0
+	char pending_op;
+	// count typed in front of the pending operator
+	size_t op_count;
+	// what yanks and deletes put into registers, and puts take out of them: the unnamed
+	// register first, then 'a'..'z'. NULL if empty.
+	struct regtext *registers[27];
+	// register picked with "{a-z} for the next command, or 0 for just the unnamed one
+	char selected_reg;
+
+	// the last command failed (e.g. a motion that couldn't move), which ends a
+	// replay or a counted repeat early
+	unsigned cmd_failed : 1;
+	// where keys come from, or -1. a replay or a counted repeat stops when there are
+	// more waiting, so that a huge count can be interrupted.
+	int input_fd;
+
+	// insert mode: the words Ctrl-N and Ctrl-P go through, shown in a popup while there
+	// are any. the one picked is in the buffer, from `compl_idx` up to the cursor.
+	string_t *compl_words;
+	size_t ncompl;
+	size_t compl_sel;
+	size_t compl_idx;
+
+	// :open file picker, shown instead of the buffer while it is open, or NULL
+	struct picker *picker;
+	// :hex view of the buffer's file, shown instead of the buffer while it is open, or NULL
+	struct hexview *hex;
+	// worker threads for background jobs, e.g. :s
+	struct pool pool;
+	// memory taken by the screen contents, as of the last render (for :mem)
+	size_t screen_bytes;
 };
 
 void editor_new(struct editor *e, str_t initial_contents);
+void editor_new_paged(struct editor *e, struct pager *pg);
+int editor_idle_work(struct editor *e);
+void editor_set_path(struct editor *e, str_t path, off_t loaded_size);
+[[nodiscard]] int editor_start_follow(struct editor *e);
+void editor_start_stream(struct editor *e, int fd, str_t name);
+[[nodiscard]] int editor_start_journal(struct editor *e, int append);
+[[nodiscard]] int editor_replay_journal(struct editor *e);
+int editor_poll_timeout(struct editor *e);
+void editor_run_timers(struct editor *e);
+size_t editor_get_pollfds(struct editor *e, struct pollfd *fds, size_t nfds);
+void editor_handle_pollfd(struct editor *e, struct pollfd pfd);
+void editor_drain_jobs(struct editor *e);
 void editor_free(struct editor *e);
 void editor_render(struct editor *e, struct framebuf *fb, struct rect area);
 void editor_handle_keyevt(struct editor *e, struct keyevt evt);
 struct pane *editor_get_focused_pane(struct editor *e);
+void editor_mem_report(struct editor *e, string_t *out);
+void editor_open_file(struct editor *e, const char *path);
+[[nodiscard]] int editor_resume_session(struct editor *e, const char *path);
+[[nodiscard]] int editor_open_hex(struct editor *e, const char *path);
 
 #endif
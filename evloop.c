@@ -0,0 +1,402 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "config.h"
+#include "evloop.h"
+
+enum watch_kind {
+	WATCH_FD,
+	// the fd is a timerfd (owned by the watch)
+	WATCH_TIMER,
+	// the fd is a signalfd (owned by the watch)
+	WATCH_SIGNAL,
+};
+
+struct evloop_watch {
+	enum watch_kind kind;
+	int fd;
+	evloop_fd_cb fd_cb;
+	evloop_cb cb;
+	void *ctx;
+	unsigned dead : 1;
+	struct evloop_watch *prev;
+	struct evloop_watch *next;
+};
+
+int evloop_init(struct evloop *l) {
+	l->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (l->epfd == -1)
+		return -1;
+	l->watches = NULL;
+	l->dead = NULL;
+	l->dispatching = 0;
+	return 0;
+}
+
+static void free_watch(struct evloop_watch *w) {
+	if (w->kind != WATCH_FD)
+		close(w->fd);
+	free(w);
+}
+
+void evloop_free(struct evloop *l) {
+	while (l->watches != NULL)
+		evloop_del(l, l->watches);
+	close(l->epfd);
+}
+
+static struct evloop_watch *add_watch(struct evloop *l, enum watch_kind kind, int fd, uint32_t events) {
+	struct evloop_watch *w = calloc(1, sizeof(struct evloop_watch));
+	w->kind = kind;
+	w->fd = fd;
+	struct epoll_event ev = { .events = events, .data.ptr = w };
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		free(w);
+		return NULL;
+	}
+	w->next = l->watches;
+	if (l->watches != NULL)
+		l->watches->prev = w;
+	l->watches = w;
+	return w;
+}
+
+// `events` are EPOLLIN, EPOLLOUT etc. returns NULL (with errno set) if `fd` can't be watched.
+struct evloop_watch *evloop_add_fd(struct evloop *l, int fd, uint32_t events, evloop_fd_cb cb, void *ctx) {
+	struct evloop_watch *w = add_watch(l, WATCH_FD, fd, events);
+	if (w != NULL) {
+		w->fd_cb = cb;
+		w->ctx = ctx;
+	}
+	return w;
+}
+
+// if the watched fd has been closed in the meantime and its number reused, the new fd
+// is watched instead
+int evloop_mod_fd(struct evloop *l, struct evloop_watch *w, uint32_t events) {
+	struct epoll_event ev = { .events = events, .data.ptr = w };
+	if (epoll_ctl(l->epfd, EPOLL_CTL_MOD, w->fd, &ev) == 0)
+		return 0;
+	if (errno != ENOENT)
+		return -1;
+	return epoll_ctl(l->epfd, EPOLL_CTL_ADD, w->fd, &ev);
+}
+
+// the timer starts out disarmed
+struct evloop_watch *evloop_add_timer(struct evloop *l, evloop_cb cb, void *ctx) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	struct evloop_watch *w = add_watch(l, WATCH_TIMER, fd, EPOLLIN);
+	if (w == NULL) {
+		close(fd);
+		return NULL;
+	}
+	w->cb = cb;
+	w->ctx = ctx;
+	return w;
+}
+
+// fires the timer once in `ms` ms, replacing whatever it was set to before. a negative
+// `ms` disarms it.
+int evloop_arm_timer(struct evloop_watch *w, int ms) {
+	struct itimerspec its = { 0 };
+	if (ms > 0) {
+		its.it_value.tv_sec = ms / 1000;
+		its.it_value.tv_nsec = (long) (ms % 1000) * 1000000;
+	} else if (ms == 0) {
+		// an all-zero time would disarm it
+		its.it_value.tv_nsec = 1;
+	}
+	return timerfd_settime(w->fd, 0, &its, NULL);
+}
+
+// `signo` is blocked, and delivered through the loop instead of to a handler. threads and
+// child processes started afterwards inherit the blocked signal.
+struct evloop_watch *evloop_add_signal(struct evloop *l, int signo, evloop_cb cb, void *ctx) {
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, signo);
+	if (sigprocmask(SIG_BLOCK, &set, NULL) == -1)
+		return NULL;
+	int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	struct evloop_watch *w = add_watch(l, WATCH_SIGNAL, fd, EPOLLIN);
+	if (w == NULL) {
+		close(fd);
+		return NULL;
+	}
+	w->cb = cb;
+	w->ctx = ctx;
+	return w;
+}
+
+// the watch's callback won't be called anymore, even for events that already came in.
+// an fd being watched isn't closed, and it's fine if it was closed already.
+void evloop_del(struct evloop *l, struct evloop_watch *w) {
+	(void) epoll_ctl(l->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+	if (w->prev != NULL)
+		w->prev->next = w->next;
+	else
+		l->watches = w->next;
+	if (w->next != NULL)
+		w->next->prev = w->prev;
+
+	if (l->dispatching) {
+		w->dead = 1;
+		w->next = l->dead;
+		l->dead = w;
+	} else {
+		free_watch(w);
+	}
+}
+
+// waits for up to `timeout_ms` (forever if -1) for something to happen, and runs the
+// callbacks of the watches that fired. returns how many events came in, or -1 on error.
+int evloop_run_once(struct evloop *l, int timeout_ms) {
+	struct epoll_event evs[EVLOOP_MAX_EVENTS];
+	int n = epoll_wait(l->epfd, evs, EVLOOP_MAX_EVENTS, timeout_ms);
+	if (n == -1)
+		return errno == EINTR ? 0 : -1;
+
+	l->dispatching = 1;
+	for (int i = 0; i < n; i++) {
+		struct evloop_watch *w = evs[i].data.ptr;
+		if (w->dead)
+			continue;
+
+		switch (w->kind) {
+		case WATCH_FD:
+			w->fd_cb(w->ctx, w->fd, evs[i].events);
+			break;
+		case WATCH_TIMER: {
+			uint64_t expirations;
+			if (read(w->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+				w->cb(w->ctx);
+			break;
+		}
+		case WATCH_SIGNAL: {
+			// several deliveries of the signal are handled as one
+			struct signalfd_siginfo si;
+			int got = 0;
+			while (read(w->fd, &si, sizeof(si)) == sizeof(si))
+				got = 1;
+			if (got)
+				w->cb(w->ctx);
+			break;
+		}
+		}
+	}
+	l->dispatching = 0;
+
+	while (l->dead != NULL) {
+		struct evloop_watch *w = l->dead;
+		l->dead = w->next;
+		free_watch(w);
+	}
+	return n;
+}
+
+// watches the `n` (up to EVLOOP_FDSET_SIZE) `fds`, and stops watching the ones in `set`
+// that aren't among them anymore. the ones still wanted are registered again each time,
+// since one may have been closed and its number reused in the meantime.
+int evloop_sync_fds(struct evloop *l, struct evloop_fdset *set, struct pollfd *fds, size_t n, evloop_fd_cb cb, void *ctx) {
+	struct evloop_watch *watches[EVLOOP_FDSET_SIZE];
+	for (size_t i = 0; i < n; i++) {
+		watches[i] = NULL;
+		for (size_t j = 0; j < set->n; j++) {
+			if (set->watches[j] != NULL && set->fds[j].fd == fds[i].fd) {
+				watches[i] = set->watches[j];
+				set->watches[j] = NULL;
+				break;
+			}
+		}
+		if (watches[i] != NULL) {
+			if (evloop_mod_fd(l, watches[i], fds[i].events))
+				return -1;
+		} else {
+			watches[i] = evloop_add_fd(l, fds[i].fd, fds[i].events, cb, ctx);
+			if (watches[i] == NULL)
+				return -1;
+		}
+	}
+	for (size_t j = 0; j < set->n; j++) {
+		if (set->watches[j] != NULL)
+			evloop_del(l, set->watches[j]);
+	}
+	if (n > 0) {
+		memcpy(set->fds, fds, sizeof(fds[0]) * n);
+		memcpy(set->watches, watches, sizeof(watches[0]) * n);
+	}
+	set->n = n;
+	return 0;
+}
+
+// writes as much of `o->buf` as the fd takes without blocking. returns -1 (with errno
+// set) if writing fails.
+int evloop_out_flush(struct evloop *l, struct evloop_out *o) {
+	while (o->off < o->buf.len) {
+		ssize_t n = write(o->fd, o->buf.ptr + o->off, o->buf.len - o->off);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n == -1)
+			return -1;
+		o->off += n;
+	}
+	if (o->off == o->buf.len) {
+		string_clear(&o->buf);
+		o->off = 0;
+	}
+	int waiting = o->buf.len > 0;
+	if (waiting != o->waiting) {
+		if (evloop_mod_fd(l, o->watch, o->events | (waiting ? EPOLLOUT : 0)))
+			return -1;
+		o->waiting = waiting;
+	}
+	return 0;
+}
+
+// writes all of `o->buf`, waiting for the fd as long as it takes
+int evloop_out_drain(struct evloop *l, struct evloop_out *o) {
+	while (o->buf.len > 0) {
+		struct pollfd pfd = { .fd = o->fd, .events = POLLOUT };
+		if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+			return -1;
+		if (evloop_out_flush(l, o))
+			return -1;
+	}
+	return 0;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+#include <fcntl.h>
+
+struct evloop_test {
+	struct evloop *loop;
+	int nfd;
+	int ntimer;
+	int nsignal;
+	// two watches on pipes. the first callback removes the other one.
+	struct evloop_watch *w[2];
+	int fds[2];
+	int removed;
+	struct evloop_out *out;
+};
+
+static void test_fd_cb(void *ctx, int fd, uint32_t events) {
+	struct evloop_test *t = ctx;
+	char buf[16];
+	assert(events & EPOLLIN);
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	t->nfd++;
+	// removing another watch whose event came in at the same time
+	if (!t->removed) {
+		evloop_del(t->loop, t->w[fd == t->fds[0]]);
+		t->removed = 1;
+	}
+}
+
+static void test_timer_cb(void *ctx) {
+	((struct evloop_test *) ctx)->ntimer++;
+}
+
+static void test_signal_cb(void *ctx) {
+	((struct evloop_test *) ctx)->nsignal++;
+}
+
+static void test_out_cb(void *ctx, int fd, uint32_t events) {
+	struct evloop_test *t = ctx;
+	assert(events & EPOLLOUT);
+	assert(evloop_out_flush(t->loop, t->out) == 0);
+}
+
+void evloop_run_tests(void) {
+	struct evloop l;
+	assert(evloop_init(&l) == 0);
+	struct evloop_test t = { .loop = &l };
+
+	// nothing to do
+	assert(evloop_run_once(&l, 0) == 0);
+
+	int p1[2];
+	int p2[2];
+	assert(pipe2(p1, O_NONBLOCK) == 0 && pipe2(p2, O_NONBLOCK) == 0);
+	t.fds[0] = p1[0];
+	t.fds[1] = p2[0];
+	t.w[0] = evloop_add_fd(&l, p1[0], EPOLLIN, test_fd_cb, &t);
+	t.w[1] = evloop_add_fd(&l, p2[0], EPOLLIN, test_fd_cb, &t);
+	assert(t.w[0] != NULL && t.w[1] != NULL);
+	assert(write(p1[1], "x", 1) == 1 && write(p2[1], "y", 1) == 1);
+	// whichever runs first removes the other, which then isn't called
+	assert(evloop_run_once(&l, 1000) == 2);
+	assert(t.nfd == 1);
+	assert(write(p1[1], "x", 1) == 1 && write(p2[1], "y", 1) == 1);
+	assert(evloop_run_once(&l, 1000) == 1);
+	assert(t.nfd == 2);
+
+	struct evloop_watch *timer = evloop_add_timer(&l, test_timer_cb, &t);
+	assert(timer != NULL);
+	assert(evloop_run_once(&l, 20) == 0 && t.ntimer == 0);
+	assert(evloop_arm_timer(timer, 10) == 0);
+	assert(evloop_run_once(&l, 1000) == 1 && t.ntimer == 1);
+	assert(evloop_arm_timer(timer, 0) == 0);
+	assert(evloop_run_once(&l, 1000) == 1 && t.ntimer == 2);
+	assert(evloop_arm_timer(timer, 10) == 0 && evloop_arm_timer(timer, -1) == 0);
+	assert(evloop_run_once(&l, 30) == 0 && t.ntimer == 2);
+
+	sigset_t old;
+	sigprocmask(SIG_SETMASK, NULL, &old);
+	assert(evloop_add_signal(&l, SIGUSR1, test_signal_cb, &t) != NULL);
+	raise(SIGUSR1);
+	raise(SIGUSR1);
+	assert(evloop_run_once(&l, 1000) == 1 && t.nsignal == 1);
+
+	// output that doesn't fit into the pipe waits until it is read
+	int p3[2];
+	assert(pipe2(p3, O_NONBLOCK) == 0);
+	struct evloop_out o = { .fd = p3[1], .buf = string_new() };
+	t.out = &o;
+	o.watch = evloop_add_fd(&l, o.fd, 0, test_out_cb, &t);
+	assert(o.watch != NULL);
+	for (int i = 0; i < 1024 * 1024; i++)
+		string_push(&o.buf, 'a' + i % 26);
+	assert(evloop_out_flush(&l, &o) == 0);
+	assert(o.waiting && o.off > 0 && o.off < o.buf.len);
+	assert(evloop_run_once(&l, 0) == 0);
+	size_t got = 0;
+	for (;;) {
+		char buf[4096];
+		ssize_t n;
+		while ((n = read(p3[0], buf, sizeof(buf))) > 0) {
+			assert(buf[0] == 'a' + got % 26);
+			got += n;
+		}
+		if (o.buf.len == 0)
+			break;
+		assert(evloop_run_once(&l, 1000) == 1);
+	}
+	assert(got == 1024 * 1024 && !o.waiting && o.off == 0);
+	string_free(o.buf);
+
+	evloop_free(&l);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	close(p1[0]);
+	close(p1[1]);
+	close(p2[0]);
+	close(p2[1]);
+	close(p3[0]);
+	close(p3[1]);
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef __HAVE_EVLOOP_H
+#define __HAVE_EVLOOP_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mf_string.h"
+
+// the main loop, on top of epoll. fds, timers (timerfd) and signals (signalfd) are all
+// registered as watches with a callback, which evloop_run_once() calls when they fire.
+// the process sleeps in epoll_wait() until one of them does.
+
+typedef void (*evloop_fd_cb)(void *ctx, int fd, uint32_t events);
+typedef void (*evloop_cb)(void *ctx);
+
+struct evloop_watch;
+
+struct evloop {
+	int epfd;
+	// every watch, so that evloop_free() can get rid of them
+	struct evloop_watch *watches;
+	// watches removed while callbacks were running. their events may still be among the
+	// ones being handled, so they are only freed afterwards.
+	struct evloop_watch *dead;
+	int dispatching;
+};
+
+// bytes on their way out to a non-blocking fd, written as it takes them. while some are
+// left, the fd's watch also waits for EPOLLOUT, and its callback should flush again.
+struct evloop_out {
+	int fd;
+	struct evloop_watch *watch;
+	// what the watch waits for besides EPOLLOUT
+	uint32_t events;
+	string_t buf;
+	// how much of `buf` has been written
+	size_t off;
+	// the watch is waiting for EPOLLOUT
+	int waiting;
+};
+
+#define EVLOOP_FDSET_SIZE 8
+
+// fds that come and go, like the ones the editor's background work waits on. they are
+// given as pollfds each time, and watched with the same callback.
+struct evloop_fdset {
+	struct pollfd fds[EVLOOP_FDSET_SIZE];
+	struct evloop_watch *watches[EVLOOP_FDSET_SIZE];
+	size_t n;
+};
+
+[[nodiscard]] int evloop_init(struct evloop *l);
+void evloop_free(struct evloop *l);
+struct evloop_watch *evloop_add_fd(struct evloop *l, int fd, uint32_t events, evloop_fd_cb cb, void *ctx);
+[[nodiscard]] int evloop_mod_fd(struct evloop *l, struct evloop_watch *w, uint32_t events);
+struct evloop_watch *evloop_add_timer(struct evloop *l, evloop_cb cb, void *ctx);
+[[nodiscard]] int evloop_arm_timer(struct evloop_watch *w, int ms);
+struct evloop_watch *evloop_add_signal(struct evloop *l, int signo, evloop_cb cb, void *ctx);
+void evloop_del(struct evloop *l, struct evloop_watch *w);
+int evloop_run_once(struct evloop *l, int timeout_ms);
+[[nodiscard]] int evloop_sync_fds(struct evloop *l, struct evloop_fdset *set, struct pollfd *fds, size_t n, evloop_fd_cb cb, void *ctx);
+[[nodiscard]] int evloop_out_flush(struct evloop *l, struct evloop_out *o);
+[[nodiscard]] int evloop_out_drain(struct evloop *l, struct evloop_out *o);
+
+#endif
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "filter.h"
+
+// runs `cmd` with sh. its stderr goes nowhere, since the terminal is in use.
+int filter_start(struct filter *f, const char *cmd) {
+	int in[2];
+	int out[2];
+	if (pipe2(in, O_CLOEXEC) == -1)
+		return -1;
+	if (pipe2(out, O_CLOEXEC) == -1) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+
+	// writing to a command that exited without reading everything shouldn't kill us
+	signal(SIGPIPE, SIG_IGN);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if (dup2(in[0], STDIN_FILENO) == -1 || dup2(out[1], STDOUT_FILENO) == -1 || (null != -1 && dup2(null, STDERR_FILENO) == -1))
+			_exit(127);
+		signal(SIGPIPE, SIG_DFL);
+		// signals the editor takes through its event loop are blocked, which the
+		// command would otherwise inherit
+		sigset_t none;
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	if (pid == -1) {
+		close(in[1]);
+		close(out[0]);
+		return -1;
+	}
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+	f->pid = pid;
+	f->in_fd = in[1];
+	f->out_fd = out[0];
+	return 0;
+}
+
+// lets the command know there is no more input
+void filter_close_input(struct filter *f) {
+	if (f->in_fd != -1)
+		close(f->in_fd);
+	f->in_fd = -1;
+}
+
+// closes both pipes
+void filter_close(struct filter *f) {
+	filter_close_input(f);
+	if (f->out_fd != -1)
+		close(f->out_fd);
+	f->out_fd = -1;
+}
+
+static int reap(pid_t pid, int *status) {
+	int st;
+	pid_t ret;
+	while ((ret = waitpid(pid, &st, WNOHANG)) == -1 && errno == EINTR)
+		;
+	if (ret == 0)
+		return 0;
+	if (ret == -1)
+		*status = -1;
+	else
+		*status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+	return 1;
+}
+
+// returns nonzero once the command has exited, with its exit status (or 128 + the signal
+// that ended it) in `*status`. doesn't wait for it.
+int filter_reap(struct filter *f, int *status) {
+	return reap(f->pid, status);
+}
+
+// commands that were given up on, and haven't exited yet
+static pid_t *abandoned;
+static size_t nabandoned;
+
+// kills the command and closes the pipes. it is reaped by filter_reap_abandoned() later.
+void filter_abandon(struct filter *f) {
+	filter_close(f);
+	kill(f->pid, SIGTERM);
+	int status;
+	if (filter_reap(f, &status))
+		return;
+	abandoned = realloc(abandoned, sizeof(abandoned[0]) * (nabandoned + 1));
+	abandoned[nabandoned++] = f->pid;
+}
+
+// reaps the abandoned commands that have exited. returns nonzero while some haven't.
+int filter_reap_abandoned(void) {
+	for (size_t i = 0; i < nabandoned; ) {
+		int status;
+		if (reap(abandoned[i], &status))
+			abandoned[i] = abandoned[--nabandoned];
+		else
+			i++;
+	}
+	return nabandoned > 0;
+}
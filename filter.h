@@ -0,0 +1,21 @@
+#ifndef __HAVE_FILTER_H
+#define __HAVE_FILTER_H
+
+#include <sys/types.h>
+
+// a shell command that text is piped through
+struct filter {
+	pid_t pid;
+	// the command's stdin (-1 once closed) and stdout (-1 at EOF). both are non-blocking.
+	int in_fd;
+	int out_fd;
+};
+
+[[nodiscard]] int filter_start(struct filter *f, const char *cmd);
+void filter_close_input(struct filter *f);
+void filter_close(struct filter *f);
+int filter_reap(struct filter *f, int *status);
+void filter_abandon(struct filter *f);
+int filter_reap_abandoned(void);
+
+#endif
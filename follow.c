@@ -0,0 +1,142 @@
+#include <err.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "follow.h"
+
+#define FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIR_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+int follow_start(struct follow *f, const char *path, off_t off) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ifd == -1) {
+		close(fd);
+		return -1;
+	}
+
+	char *dircopy = strdup(path);
+	f->file_wd = inotify_add_watch(ifd, path, FILE_EVENTS);
+	f->dir_wd = inotify_add_watch(ifd, dirname(dircopy), DIR_EVENTS);
+	free(dircopy);
+	if (f->file_wd == -1 || f->dir_wd == -1) {
+		close(ifd);
+		close(fd);
+		return -1;
+	}
+
+	f->path = strdup(path);
+	f->fd = fd;
+	f->ino = st.st_ino;
+	f->off = off;
+	f->inotify_fd = ifd;
+	f->rotated = 0;
+	return 0;
+}
+
+void follow_stop(struct follow *f) {
+	close(f->inotify_fd);
+	close(f->fd);
+	free(f->path);
+}
+
+// reads [f->off, size) into `out` (if non-NULL). returns nonzero if there was anything new.
+static int follow_read_tail(struct follow *f, string_t *out, off_t size) {
+	if (size <= f->off)
+		return 0;
+
+	if (out == NULL) {
+		f->off = size;
+		return 1;
+	}
+
+	char buf[1 << 16];
+	while (f->off < size) {
+		size_t want = sizeof(buf);
+		if (size - f->off < (off_t) want)
+			want = size - f->off;
+		ssize_t nread = pread(f->fd, buf, want, f->off);
+		if (nread == -1)
+			err(1, "pread");
+		if (nread == 0)
+			break;
+		string_append(out, (str_t) { .ptr = buf, .len = nread });
+		f->off += nread;
+	}
+	return 1;
+}
+
+// drains pending inotify events and appends whatever was added to the file to `out`, or
+// all of it if the file was truncated or replaced. `out` may be NULL if the caller reads
+// the file itself and only wants `f->off` updated.
+enum follow_event follow_poll(struct follow *f, string_t *out) {
+	size_t out_start = out != NULL ? out->len : 0;
+	char *base = strrchr(f->path, '/');
+	base = base != NULL ? base + 1 : f->path;
+
+	char evbuf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t n;
+	while ((n = read(f->inotify_fd, evbuf, sizeof(evbuf))) > 0) {
+		struct inotify_event *ev;
+		for (char *p = evbuf; p < evbuf + n; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (struct inotify_event *) p;
+			if (ev->wd == f->file_wd && (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)))
+				f->rotated = 1;
+			if (ev->wd == f->dir_wd && ev->len > 0 && !strcmp(ev->name, base))
+				f->rotated = 1;
+		}
+	}
+
+	enum follow_event ret = FOLLOW_NONE;
+
+	struct stat st;
+	if (fstat(f->fd, &st) == -1)
+		err(1, "fstat");
+	if (st.st_nlink == 0)
+		f->rotated = 1;
+	if (st.st_size < f->off) {
+		f->off = 0;
+		ret = FOLLOW_TRUNCATED;
+	}
+	if (follow_read_tail(f, out, st.st_size) && ret == FOLLOW_NONE)
+		ret = FOLLOW_APPENDED;
+
+	if (!f->rotated)
+		return ret;
+
+	// if the new file doesn't exist yet, try again on the next directory event
+	int fd = open(f->path, O_RDONLY);
+	if (fd == -1)
+		return ret;
+	if (fstat(fd, &st) == -1 || st.st_ino == f->ino) {
+		close(fd);
+		f->rotated = 0;
+		return ret;
+	}
+
+	inotify_rm_watch(f->inotify_fd, f->file_wd);
+	f->file_wd = inotify_add_watch(f->inotify_fd, f->path, FILE_EVENTS);
+	close(f->fd);
+	f->fd = fd;
+	f->ino = st.st_ino;
+	f->off = 0;
+	f->rotated = 0;
+	// the new file takes the old one's place, so what was read from the old one goes
+	if (out != NULL)
+		out->len = out_start;
+	follow_read_tail(f, out, st.st_size);
+	return FOLLOW_ROTATED;
+}
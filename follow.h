@@ -0,0 +1,34 @@
+#ifndef __HAVE_FOLLOW_H
+#define __HAVE_FOLLOW_H
+
+#include <sys/types.h>
+#include "mf_string.h"
+
+enum follow_event {
+	FOLLOW_NONE,
+	FOLLOW_APPENDED,
+	// the file shrank; reading starts over from the beginning
+	FOLLOW_TRUNCATED,
+	// the path now refers to a different file (e.g. logrotate)
+	FOLLOW_ROTATED,
+};
+
+// watches a file that is being appended to
+struct follow {
+	char *path;
+	int fd;
+	ino_t ino;
+	// how much of the file has been read so far
+	off_t off;
+	int inotify_fd;
+	int file_wd;
+	// the parent directory is watched so that a new file showing up at `path` is noticed
+	int dir_wd;
+	unsigned rotated : 1;
+};
+
+[[nodiscard]] int follow_start(struct follow *f, const char *path, off_t off);
+void follow_stop(struct follow *f);
+enum follow_event follow_poll(struct follow *f, string_t *out);
+
+#endif
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "hexview.h"
+
+int hexview_open(struct hexview *hv, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	// only a regular file can be mapped wherever the screen is
+	if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+		return -1;
+	}
+
+	char *abspath = realpath(path, NULL);
+	*hv = (struct hexview) {
+		.fd = fd,
+		.size = st.st_size,
+		.path = abspath != NULL ? abspath : strdup(path),
+		.offset_digits = 8,
+	};
+	for (off_t last = hv->size - 1; hv->offset_digits < 16 && last >> (4 * hv->offset_digits) != 0; hv->offset_digits++)
+		;
+	return 0;
+}
+
+void hexview_close(struct hexview *hv) {
+	if (hv->map != NULL)
+		munmap((void *) hv->map, hv->map_len);
+	free(hv->path);
+	close(hv->fd);
+}
+
+// the row starting at `off`, mapping the part of the file around it if needed.
+// the returned pointer is only valid until the next call.
+static const unsigned char *hexview_row_bytes(struct hexview *hv, off_t off) {
+	off_t end = MIN(off + HEXVIEW_ROW_BYTES, hv->size);
+	if (hv->map != NULL && off >= hv->map_off && end <= hv->map_off + (off_t) hv->map_len)
+		return hv->map + (off - hv->map_off);
+
+	if (hv->map != NULL)
+		munmap((void *) hv->map, hv->map_len);
+	// two chunks, so the screen rarely straddles the end of the mapping
+	off_t chunk_off = off - off % HEXVIEW_MAP_CHUNK;
+	size_t len = MIN((off_t) (2 * HEXVIEW_MAP_CHUNK), hv->size - chunk_off);
+	void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, hv->fd, chunk_off);
+	if (data == MAP_FAILED)
+		err(1, "mmap");
+	hv->map = data;
+	hv->map_off = chunk_off;
+	hv->map_len = len;
+	return hv->map + (off - hv->map_off);
+}
+
+// writes the HEXVIEW_ROW_BYTES bytes at `in` as 2 * HEXVIEW_ROW_BYTES lowercase hex digits.
+// four bytes at a time: each byte is spread over two bytes of a word, one nibble in each,
+// and every nibble is turned into its digit at once, with 'a'-'9'-1 added to those above 9.
+void hexview_format_hex(const unsigned char *in, char *out) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (size_t i = 0; i < HEXVIEW_ROW_BYTES; i += 4) {
+		uint32_t v;
+		memcpy(&v, in + i, 4);
+		uint64_t x = v;
+		x = (x | x << 16) & 0x0000ffff0000ffffULL;
+		x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+		// the high nibble of byte i goes first, as byte 2i
+		x = ((x >> 4) & 0x000f000f000f000fULL) | ((x & 0x000f000f000f000fULL) << 8);
+		x += 0x3030303030303030ULL + (((x + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL) * ('a' - '9' - 1);
+		memcpy(out + 2 * i, &x, 8);
+	}
+#else
+	static const char digits[] = "0123456789abcdef";
+	for (size_t i = 0; i < HEXVIEW_ROW_BYTES; i++) {
+		out[2 * i] = digits[in[i] >> 4];
+		out[2 * i + 1] = digits[in[i] & 0xf];
+	}
+#endif
+}
+
+// column of the hex digits of the i-th byte of a row: pairs of bytes, with a wider gap
+// in the middle of the row
+int hexview_hex_col(const struct hexview *hv, size_t i) {
+	return hv->offset_digits + 2 + (i / 2) * 5 + (i % 2) * 2 + (i >= HEXVIEW_ROW_BYTES / 2);
+}
+
+int hexview_text_col(const struct hexview *hv, size_t i) {
+	return hexview_hex_col(hv, HEXVIEW_ROW_BYTES) + 1 + i;
+}
+
+// formats the row starting at `off` (a multiple of HEXVIEW_ROW_BYTES) into `out`, which
+// has room for HEXVIEW_ROW_MAX bytes. the bytes past the end of the file are left blank.
+size_t hexview_format_row(struct hexview *hv, off_t off, char *out) {
+	size_t n = MIN((off_t) HEXVIEW_ROW_BYTES, hv->size - off);
+	unsigned char bytes[HEXVIEW_ROW_BYTES] = { 0 };
+	if (n > 0)
+		memcpy(bytes, hexview_row_bytes(hv, off), n);
+
+	char hex[2 * HEXVIEW_ROW_BYTES];
+	hexview_format_hex(bytes, hex);
+
+	size_t len = hexview_text_col(hv, HEXVIEW_ROW_BYTES);
+	memset(out, ' ', len);
+	char digits[24];
+	snprintf(digits, sizeof(digits), "%0*llx", hv->offset_digits, (unsigned long long) off);
+	memcpy(out, digits, hv->offset_digits);
+	for (size_t i = 0; i < n; i++) {
+		memcpy(out + hexview_hex_col(hv, i), hex + 2 * i, 2);
+		out[hexview_text_col(hv, i)] = bytes[i] >= 0x20 && bytes[i] < 0x7f ? bytes[i] : '.';
+	}
+	return len;
+}
+
+void hexview_move(struct hexview *hv, off_t delta) {
+	off_t last = MAX(hv->size - 1, (off_t) 0);
+	if (delta < 0 && -delta > hv->cursor)
+		hv->cursor = 0;
+	else if (delta > 0 && delta > last - hv->cursor)
+		hv->cursor = last;
+	else
+		hv->cursor += delta;
+}
+
+// moves the top row as little as possible for the cursor to be on one of `height` rows
+void hexview_scroll_to_cursor(struct hexview *hv, int height) {
+	off_t row = hv->cursor - hv->cursor % HEXVIEW_ROW_BYTES;
+	off_t span = (off_t) MAX(height - 1, 0) * HEXVIEW_ROW_BYTES;
+	if (row < hv->top)
+		hv->top = row;
+	else if (row > hv->top + span)
+		hv->top = row - span;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void hexview_run_tests(void) {
+	// same digits as printf, for every byte value
+	unsigned char bytes[256];
+	for (int i = 0; i < 256; i++)
+		bytes[i] = (i * 151 + 7) & 0xff;
+	for (int i = 0; i < 256; i += HEXVIEW_ROW_BYTES) {
+		char hex[2 * HEXVIEW_ROW_BYTES], want[2 * HEXVIEW_ROW_BYTES + 1];
+		hexview_format_hex(bytes + i, hex);
+		for (int j = 0; j < HEXVIEW_ROW_BYTES; j++)
+			snprintf(want + 2 * j, 3, "%02x", bytes[i + j]);
+		assert(!memcmp(hex, want, sizeof(hex)));
+	}
+
+	char dir[] = "/tmp/mf-hexview-XXXXXX";
+	test_tmpdir_create(dir);
+	char file[sizeof(dir) + 16];
+	snprintf(file, sizeof(file), "%s/file", dir);
+	FILE *f = fopen(file, "w");
+	assert(f != NULL);
+	// past the first mapping, ending in a partial row
+	off_t size = 2 * HEXVIEW_MAP_CHUNK + 2 * HEXVIEW_ROW_BYTES + 3;
+	for (off_t i = 0; i < size; i++)
+		fputc(i < 20 ? "hello\0world\n\x7f\xff-binary"[i] : (int) (i % 251), f);
+	fclose(f);
+
+	struct hexview hv;
+	assert(hexview_open(&hv, file) == 0);
+	assert(hv.size == size && hv.offset_digits == 8);
+	char row[HEXVIEW_ROW_MAX];
+	size_t len = hexview_format_row(&hv, 0, row);
+	assert(len == (size_t) hexview_text_col(&hv, HEXVIEW_ROW_BYTES) && len <= HEXVIEW_ROW_MAX);
+	const char *want = "00000000  6865 6c6c 6f00 776f  726c 640a 7fff 2d62  hello.world...-b";
+	assert(len == strlen(want) && !memcmp(row, want, len));
+
+	// the last row, from a mapping of its own
+	off_t last = size - size % HEXVIEW_ROW_BYTES;
+	len = hexview_format_row(&hv, last, row);
+	assert(hv.map_off == 2 * HEXVIEW_MAP_CHUNK);
+	char wantlast[HEXVIEW_ROW_MAX];
+	snprintf(wantlast, sizeof(wantlast), "%08llx  %02x%02x %02x", (unsigned long long) last,
+		(int) (last % 251), (int) ((last + 1) % 251), (int) ((last + 2) % 251));
+	assert(!memcmp(row, wantlast, strlen(wantlast)));
+	for (size_t i = strlen(wantlast); i < (size_t) hexview_text_col(&hv, 0); i++)
+		assert(row[i] == ' ');
+	assert(row[hexview_text_col(&hv, 3)] == ' ');
+
+	// the cursor stays in the file and the screen follows it
+	hexview_move(&hv, size * 2);
+	assert(hv.cursor == size - 1);
+	hexview_scroll_to_cursor(&hv, 10);
+	assert(hv.top == last - 9 * HEXVIEW_ROW_BYTES);
+	hexview_move(&hv, -size * 2);
+	assert(hv.cursor == 0);
+	hexview_scroll_to_cursor(&hv, 10);
+	assert(hv.top == 0);
+	hexview_move(&hv, 10 * HEXVIEW_ROW_BYTES);
+	hexview_scroll_to_cursor(&hv, 10);
+	assert(hv.top == HEXVIEW_ROW_BYTES);
+	hexview_close(&hv);
+
+	test_tmpdir_remove(dir);
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef __HAVE_HEXVIEW_H
+#define __HAVE_HEXVIEW_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "mf_string.h"
+
+#define HEXVIEW_ROW_BYTES 16
+// a formatted row is never longer than this
+#define HEXVIEW_ROW_MAX 80
+
+// read-only view of a file's bytes as rows of offset, hex and text columns. every row is
+// HEXVIEW_ROW_BYTES of the file, so which rows are on screen follows from the offset alone,
+// however big the file. only the part of the file around the screen is mapped.
+struct hexview {
+	int fd;
+	off_t size;
+	char *path;
+	// the mapped part of the file: [map_off, map_off + map_len)
+	const unsigned char *map;
+	off_t map_off;
+	size_t map_len;
+	// offset of the top row, and of the byte under the cursor
+	off_t top;
+	off_t cursor;
+	// how many hex digits the offsets are shown with
+	int offset_digits;
+	// rows shown at the last render, for paging
+	int last_height;
+};
+
+[[nodiscard]] int hexview_open(struct hexview *hv, const char *path);
+void hexview_close(struct hexview *hv);
+void hexview_format_hex(const unsigned char *in, char *out);
+size_t hexview_format_row(struct hexview *hv, off_t off, char *out);
+int hexview_hex_col(const struct hexview *hv, size_t i);
+int hexview_text_col(const struct hexview *hv, size_t i);
+void hexview_move(struct hexview *hv, off_t delta);
+void hexview_scroll_to_cursor(struct hexview *hv, int height);
+
+#endif
@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "idxcache.h"
+
+#define IDXCACHE_MAGIC "MFX1"
+
+// followed by the file's path (`path_len` bytes, padded to 8) and then `idx_len` offsets
+struct idxcache_header {
+	char magic[4];
+	uint32_t stride;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t indexed_lines;
+	uint64_t idx_len;
+	uint64_t path_len;
+};
+
+static size_t idx_data_offset(size_t path_len) {
+	return (sizeof(struct idxcache_header) + path_len + 7) & ~(size_t) 7;
+}
+
+// $XDG_CACHE_HOME/mf, or ~/.cache/mf. returns -1 if neither is set.
+static int cache_dir(string_t *out) {
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+
+	string_clear(out);
+	if (xdg != NULL && *xdg != '\0') {
+		string_append(out, cstr_as_str((char *) xdg));
+	} else if (home != NULL && *home != '\0') {
+		string_append(out, cstr_as_str((char *) home));
+		string_append(out, STR("/.cache"));
+	} else {
+		return -1;
+	}
+	string_append(out, STR("/mf"));
+	string_push(out, '\0');
+	return 0;
+}
+
+static int cache_path_for(const char *file_path, string_t *out) {
+	if (cache_dir(out))
+		return -1;
+
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.idx", (unsigned long long) str_hash(cstr_as_str((char *) file_path)));
+	out->len -= 1;
+	string_append(out, cstr_as_str(name));
+	string_push(out, '\0');
+	return 0;
+}
+
+static int header_matches(struct idxcache_header *hdr, struct pager *pg) {
+	return !memcmp(hdr->magic, IDXCACHE_MAGIC, sizeof(hdr->magic))
+		&& hdr->stride == PAGER_INDEX_STRIDE
+		&& hdr->dev == (uint64_t) pg->dev
+		&& hdr->ino == (uint64_t) pg->ino
+		&& hdr->size == (uint64_t) pg->size
+		&& hdr->mtime_sec == pg->mtime.tv_sec
+		&& hdr->mtime_nsec == pg->mtime.tv_nsec
+		&& hdr->path_len == strlen(pg->path);
+}
+
+// replaces `pg`'s index with the cached one, if there is a cache entry for this exact
+// version of the file. the cache is mapped, not read, so this is cheap even for huge files.
+int idxcache_load(struct pager *pg) {
+	string_t path = string_new();
+	if (cache_path_for(pg->path, &path)) {
+		string_free(path);
+		return -1;
+	}
+	int fd = open(path.ptr, O_RDONLY | O_CLOEXEC);
+	string_free(path);
+	if (fd == -1)
+		return -1;
+
+	struct idxcache_header hdr;
+	struct stat st;
+	if (
+		fstat(fd, &st) == -1
+		|| read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+		|| !header_matches(&hdr, pg)
+		|| hdr.idx_len == 0
+		|| (uint64_t) st.st_size != idx_data_offset(hdr.path_len) + hdr.idx_len * sizeof(off_t)
+	) {
+		close(fd);
+		return -1;
+	}
+
+	char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	// two files can hash to the same cache entry
+	if (memcmp(map + sizeof(hdr), pg->path, hdr.path_len)) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	if (pg->idx_map != NULL)
+		munmap(pg->idx_map, pg->idx_map_len);
+	else
+		free(pg->idx);
+	pg->idx_map = map;
+	pg->idx_map_len = st.st_size;
+	pg->idx = (off_t *) (map + idx_data_offset(hdr.path_len));
+	pg->idx_len = hdr.idx_len;
+	pg->idx_cap = hdr.idx_len;
+	pg->indexed_off = pg->size;
+	pg->indexed_lines = hdr.indexed_lines;
+	pg->index_complete = 1;
+	pg->index_cached = 1;
+	return 0;
+}
+
+// stores `pg`'s (fully built) index. does nothing if the file changed since it was opened,
+// since the index wouldn't describe what's on disk anymore.
+int idxcache_save(struct pager *pg) {
+	struct stat st;
+	if (
+		!pg->index_complete
+		|| pg->indexed_off != pg->size
+		|| fstat(pg->fd, &st) == -1
+		|| st.st_size != pg->size
+		|| st.st_ino != pg->ino
+		|| st.st_mtim.tv_sec != pg->mtime.tv_sec
+		|| st.st_mtim.tv_nsec != pg->mtime.tv_nsec
+	)
+		return -1;
+
+	string_t path = string_new();
+	if (cache_dir(&path)) {
+		string_free(path);
+		return -1;
+	}
+	// the parent (~/.cache) may not exist either
+	char *slash = strrchr(path.ptr, '/');
+	*slash = '\0';
+	mkdir(path.ptr, 0700);
+	*slash = '/';
+	if (mkdir(path.ptr, 0700) == -1 && errno != EEXIST) {
+		string_free(path);
+		return -1;
+	}
+
+	(void) cache_path_for(pg->path, &path);
+	string_t tmp = string_new();
+	string_append(&tmp, (str_t) { .ptr = path.ptr, .len = path.len - 1 });
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+	string_append(&tmp, cstr_as_str(suffix));
+	string_push(&tmp, '\0');
+
+	struct idxcache_header hdr = {
+		.magic = IDXCACHE_MAGIC,
+		.stride = PAGER_INDEX_STRIDE,
+		.dev = pg->dev,
+		.ino = pg->ino,
+		.size = pg->size,
+		.mtime_sec = pg->mtime.tv_sec,
+		.mtime_nsec = pg->mtime.tv_nsec,
+		.indexed_lines = pg->indexed_lines,
+		.idx_len = pg->idx_len,
+		.path_len = strlen(pg->path),
+	};
+	static const char zeros[8];
+	size_t pad = idx_data_offset(hdr.path_len) - sizeof(hdr) - hdr.path_len;
+
+	int ret = -1;
+	int fd = open(tmp.ptr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd != -1) {
+		ret = write_all(fd, &hdr, sizeof(hdr))
+			|| write_all(fd, pg->path, hdr.path_len)
+			|| write_all(fd, zeros, pad)
+			|| write_all(fd, pg->idx, sizeof(pg->idx[0]) * pg->idx_len);
+		close(fd);
+		// readers only ever see a complete file
+		if (ret == 0 && rename(tmp.ptr, path.ptr) == -1)
+			ret = -1;
+		if (ret)
+			unlink(tmp.ptr);
+		ret = ret ? -1 : 0;
+	}
+
+	string_free(tmp);
+	string_free(path);
+	if (ret == 0)
+		pg->index_cached = 1;
+	return ret;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void idxcache_run_tests(void) {
+	char dir[] = "/tmp/mf-idxcache-XXXXXX";
+	test_tmpdir_create(dir);
+	char *old_xdg = getenv("XDG_CACHE_HOME");
+	old_xdg = old_xdg != NULL ? strdup(old_xdg) : NULL;
+	setenv("XDG_CACHE_HOME", dir, 1);
+
+	char file[sizeof(dir) + 16];
+	snprintf(file, sizeof(file), "%s/file", dir);
+	FILE *f = fopen(file, "w");
+	assert(f != NULL);
+	for (int i = 0; i < 3 * PAGER_INDEX_STRIDE + 5; i++)
+		fprintf(f, "line %d\n", i + 1);
+	fclose(f);
+
+	struct pager pg;
+	assert(pager_open(&pg, file) == 0);
+	assert(idxcache_load(&pg) == -1);
+	while (pager_index_step(&pg, 1 << 20))
+		;
+	assert(idxcache_save(&pg) == 0);
+
+	struct pager cached;
+	assert(pager_open(&cached, file) == 0);
+	assert(idxcache_load(&cached) == 0);
+	assert(cached.idx_map != NULL);
+	assert(cached.index_complete);
+	assert(cached.indexed_lines == pg.indexed_lines);
+	assert(cached.idx_len == pg.idx_len);
+	assert(!memcmp(cached.idx, pg.idx, sizeof(pg.idx[0]) * pg.idx_len));
+	assert(pager_line_offset(&cached, 2 * PAGER_INDEX_STRIDE + 3) == pager_line_offset(&pg, 2 * PAGER_INDEX_STRIDE + 3));
+	pager_close(&cached);
+	pager_close(&pg);
+
+	// a changed file doesn't match its old cache entry
+	f = fopen(file, "a");
+	fputs("more\n", f);
+	fclose(f);
+	assert(pager_open(&pg, file) == 0);
+	assert(idxcache_load(&pg) == -1);
+	pager_close(&pg);
+
+	test_tmpdir_remove(dir);
+	if (old_xdg != NULL)
+		setenv("XDG_CACHE_HOME", old_xdg, 1);
+	else
+		unsetenv("XDG_CACHE_HOME");
+	free(old_xdg);
+}
+#endif
@@ -0,0 +1,12 @@
+#ifndef __HAVE_IDXCACHE_H
+#define __HAVE_IDXCACHE_H
+
+#include "pager.h"
+
+// on-disk cache of a pager's line index, stored in $XDG_CACHE_HOME/mf (or ~/.cache/mf)
+// and keyed by the file's path, inode, size and mtime.
+
+[[nodiscard]] int idxcache_load(struct pager *pg);
+[[nodiscard]] int idxcache_save(struct pager *pg);
+
+#endif
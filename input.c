@@ -1,6 +1,7 @@
 #include <err.h>
 #include <errno.h>
 #include <ctype.h>
+#include <poll.h>
 #include <unistd.h>
 #include "input.h"
 
@@ -19,8 +20,11 @@ static int try_readone(void) {
 
 static char readone(void) {
 	int ret;
-	while ((ret = try_readone()) == -1)
-		;
+	while ((ret = try_readone()) == -1) {
+		// VMIN is 0, so read() doesn't wait for the byte: poll() does instead
+		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+		(void) poll(&pfd, 1, -1);
+	}
 	return ret;
 }
 
@@ -29,6 +33,7 @@ int input_try_get_keyevt(struct keyevt *ret) {
 	if (r == -1)
 		return -1;
 	char firstbyte = r;
+	*ret = (struct keyevt) { 0 };
 
 	// <ESC> or escape sequence
 	if (firstbyte == 27) {
@@ -0,0 +1,314 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC "MFJ1"
+
+// identifies the version of the file that the journal's records apply to
+struct journal_header {
+	char magic[4];
+	uint64_t file_size;
+	int64_t file_mtime_sec;
+	int64_t file_mtime_nsec;
+};
+
+static int64_t monotonic_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// dir/name -> dir/.name.mfj
+static void journal_path_for(const char *file_path, string_t *out) {
+	const char *slash = strrchr(file_path, '/');
+	const char *base = slash != NULL ? slash + 1 : file_path;
+
+	string_clear(out);
+	string_append(out, (str_t) { .ptr = file_path, .len = base - file_path });
+	string_push(out, '.');
+	string_append(out, cstr_as_str((char *) base));
+	string_append(out, STR(".mfj"));
+	string_push(out, '\0');
+}
+
+static struct journal_header journal_header_for(struct journal *j) {
+	return (struct journal_header) {
+		.magic = JOURNAL_MAGIC,
+		.file_size = j->file_size,
+		.file_mtime_sec = j->file_mtime.tv_sec,
+		.file_mtime_nsec = j->file_mtime.tv_nsec,
+	};
+}
+
+// starts journaling edits to `file_path`. the journal file is only created once the
+// first records are written out, and unless `append` is set, any existing journal is
+// thrown away then.
+int journal_open(struct journal *j, const char *file_path, int append) {
+	struct stat st;
+	if (stat(file_path, &st) == -1)
+		return -1;
+
+	j->fd = -1;
+	j->append = append;
+	j->header_stale = 0;
+	j->file_size = st.st_size;
+	j->file_mtime = st.st_mtim;
+	j->path = string_new();
+	j->pending = string_new();
+	j->flush_deadline = 0;
+	journal_path_for(file_path, &j->path);
+	return 0;
+}
+
+static int journal_create(struct journal *j) {
+	// not O_APPEND: the header is rewritten in place by journal_restamp()
+	if (j->append) {
+		j->fd = open(j->path.ptr, O_WRONLY | O_CLOEXEC);
+		if (j->fd != -1 && lseek(j->fd, 0, SEEK_END) != -1)
+			return 0;
+		if (j->fd != -1)
+			close(j->fd);
+	}
+
+	j->fd = open(j->path.ptr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (j->fd == -1)
+		return -1;
+
+	struct journal_header hdr = journal_header_for(j);
+	if (write_all(j->fd, &hdr, sizeof(hdr))) {
+		close(j->fd);
+		j->fd = -1;
+		return -1;
+	}
+	j->header_stale = 0;
+	return 0;
+}
+
+// the file grew (follow mode), and the records apply to it as it is now. the header
+// on disk is brought up to date with the next flush.
+int journal_restamp(struct journal *j, const char *file_path) {
+	struct stat st;
+	if (stat(file_path, &st) == -1)
+		return -1;
+
+	j->file_size = st.st_size;
+	j->file_mtime = st.st_mtim;
+	if (j->fd != -1 && !j->header_stale) {
+		j->header_stale = 1;
+		if (j->pending.len == 0)
+			j->flush_deadline = monotonic_ms() + JOURNAL_SYNC_INTERVAL_MS;
+	}
+	return 0;
+}
+
+// `remove`: the session ended normally, so the journal isn't needed anymore
+void journal_close(struct journal *j, int remove) {
+	if (remove)
+		unlink(j->path.ptr);
+	else
+		(void) journal_flush(j);
+	if (j->fd != -1)
+		close(j->fd);
+	string_free(j->path);
+	string_free(j->pending);
+}
+
+static void push_varint(string_t *s, size_t n) {
+	while (n >= 0x80) {
+		string_push(s, (n & 0x7f) | 0x80);
+		n >>= 7;
+	}
+	string_push(s, n);
+}
+
+// returns -1 if `buf` ends in the middle of the varint
+static int read_varint(str_t buf, size_t *idx, size_t *ret) {
+	size_t n = 0;
+	for (int shift = 0; *idx < buf.len && shift < 64; shift += 7) {
+		unsigned char byte = buf.ptr[(*idx)++];
+		n |= (size_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*ret = n;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void journal_record(struct journal *j, struct journal_record rec) {
+	if (j->pending.len == 0)
+		j->flush_deadline = monotonic_ms() + JOURNAL_SYNC_INTERVAL_MS;
+
+	string_push(&j->pending, rec.op);
+	push_varint(&j->pending, rec.lineno);
+	if (rec.lineno == 0) {
+		push_varint(&j->pending, rec.line_off);
+		// zigzag: small negative numbers stay short too
+		push_varint(&j->pending, ((size_t) rec.line_skip << 1) ^ (size_t) (rec.line_skip >> (sizeof(long) * 8 - 1)));
+	}
+	push_varint(&j->pending, rec.arg);
+	if (rec.op == JOP_INSERT_CHAR)
+		string_push(&j->pending, rec.ch);
+	if (rec.op == JOP_DELETE_CHARS)
+		push_varint(&j->pending, rec.count);
+	if (rec.op == JOP_INSERT_TEXT || rec.op == JOP_REPLACE_LINE) {
+		push_varint(&j->pending, rec.text.len);
+		string_append(&j->pending, rec.text);
+	}
+}
+
+// writes out buffered records and waits for them to reach the disk
+int journal_flush(struct journal *j) {
+	if (j->pending.len == 0 && !j->header_stale)
+		return 0;
+
+	int ret = j->fd == -1 ? journal_create(j) : 0;
+	if (ret == 0 && j->header_stale) {
+		struct journal_header hdr = journal_header_for(j);
+		if (pwrite(j->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			ret = -1;
+		j->header_stale = 0;
+	}
+	if (ret == 0)
+		ret = write_all(j->fd, j->pending.ptr, j->pending.len);
+	if (ret == 0)
+		ret = fdatasync(j->fd);
+	string_clear(&j->pending);
+	return ret;
+}
+
+// how long until journal_flush() should be called, or -1 if nothing is buffered
+int journal_ms_until_flush(struct journal *j) {
+	if (j->pending.len == 0 && !j->header_stale)
+		return -1;
+	return MAX(j->flush_deadline - monotonic_ms(), 0);
+}
+
+// returns nonzero if there is a journal for `file_path` with edits that can be replayed
+// onto the file as it is on disk now.
+int journal_check(const char *file_path) {
+	string_t path = string_new();
+	journal_path_for(file_path, &path);
+
+	struct stat file_st;
+	struct stat journal_st;
+	struct journal_header hdr;
+	int ret = 0;
+	int fd = open(path.ptr, O_RDONLY | O_CLOEXEC);
+	if (
+		fd != -1
+		&& stat(file_path, &file_st) == 0
+		&& fstat(fd, &journal_st) == 0
+		&& journal_st.st_size > (off_t) sizeof(hdr)
+		&& read(fd, &hdr, sizeof(hdr)) == sizeof(hdr)
+	) {
+		ret = !memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic))
+			&& hdr.file_size == file_st.st_size
+			&& hdr.file_mtime_sec == file_st.st_mtim.tv_sec
+			&& hdr.file_mtime_nsec == file_st.st_mtim.tv_nsec
+			&& (journal_st.st_mtim.tv_sec > file_st.st_mtim.tv_sec
+				|| (journal_st.st_mtim.tv_sec == file_st.st_mtim.tv_sec
+					&& journal_st.st_mtim.tv_nsec >= file_st.st_mtim.tv_nsec));
+	}
+
+	if (fd != -1)
+		close(fd);
+	string_free(path);
+	return ret;
+}
+
+// returns nonzero if there is a journal for `file_path` with edits in it, whether or not
+// they can be replayed onto the file anymore
+int journal_exists(const char *file_path) {
+	string_t path = string_new();
+	journal_path_for(file_path, &path);
+	struct stat st;
+	int ret = stat(path.ptr, &st) == 0 && st.st_size > (off_t) sizeof(struct journal_header);
+	string_free(path);
+	return ret;
+}
+
+// calls `apply` for each record in the journal of `file_path`, in order.
+// a record cut short by a crash ends the replay.
+int journal_replay(const char *file_path, void (*apply)(void *ctx, struct journal_record rec), void *ctx) {
+	string_t path = string_new();
+	journal_path_for(file_path, &path);
+	string_t contents = string_new();
+	int ret = read_file_to_string(path.ptr, &contents);
+	string_free(path);
+	if (ret) {
+		string_free(contents);
+		return -1;
+	}
+
+	str_t buf = string_as_str(contents);
+	size_t idx = sizeof(struct journal_header);
+	while (idx < buf.len) {
+		struct journal_record rec = { .op = (unsigned char) buf.ptr[idx++] };
+		if (read_varint(buf, &idx, &rec.lineno))
+			break;
+		if (rec.lineno == 0) {
+			size_t off, skip;
+			if (read_varint(buf, &idx, &off) || read_varint(buf, &idx, &skip))
+				break;
+			rec.line_off = off;
+			rec.line_skip = (long) (skip >> 1) ^ -(long) (skip & 1);
+		}
+		if (read_varint(buf, &idx, &rec.arg))
+			break;
+		if (rec.op == JOP_INSERT_CHAR) {
+			if (idx >= buf.len)
+				break;
+			rec.ch = buf.ptr[idx++];
+		}
+		if (rec.op == JOP_DELETE_CHARS && read_varint(buf, &idx, &rec.count))
+			break;
+		if (rec.op == JOP_INSERT_TEXT || rec.op == JOP_REPLACE_LINE) {
+			if (read_varint(buf, &idx, &rec.text.len) || rec.text.len > buf.len - idx)
+				break;
+			rec.text.ptr = buf.ptr + idx;
+			idx += rec.text.len;
+		}
+		apply(ctx, rec);
+	}
+
+	string_free(contents);
+	return 0;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void journal_run_tests(void) {
+	string_t s = string_new();
+	size_t values[] = { 0, 1, 127, 128, 300, 1 << 20, (size_t) 1 << 40 };
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		push_varint(&s, values[i]);
+
+	size_t idx = 0;
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		size_t n;
+		assert(read_varint(string_as_str(s), &idx, &n) == 0);
+		assert(n == values[i]);
+	}
+	assert(idx == s.len);
+
+	// truncated varint
+	size_t n;
+	idx = 0;
+	assert(read_varint((str_t) { .ptr = "\x80\x80", .len = 2 }, &idx, &n) == -1);
+	string_free(s);
+
+	string_t path = string_new();
+	journal_path_for("dir/sub/file.txt", &path);
+	assert(!strcmp(path.ptr, "dir/sub/.file.txt.mfj"));
+	journal_path_for("file.txt", &path);
+	assert(!strcmp(path.ptr, ".file.txt.mfj"));
+	string_free(path);
+}
+#endif
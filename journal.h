@@ -0,0 +1,74 @@
+#ifndef __HAVE_JOURNAL_H
+#define __HAVE_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include "mf_string.h"
+
+enum journal_op {
+	JOP_INSERT_CHAR = 1,
+	JOP_REMOVE_CHAR,
+	JOP_TRUNCATE,
+	JOP_SPLIT,
+	JOP_JOIN,
+	// `count` lines starting at `lineno` are removed
+	JOP_DELETE_LINES,
+	// `count` bytes starting at `arg` are removed from the line
+	JOP_DELETE_CHARS,
+	// `text` (which may contain newlines) is inserted at `arg`
+	JOP_INSERT_TEXT,
+	// the line's contents are replaced with `text`
+	JOP_REPLACE_LINE,
+};
+
+// one buffer mutation. on disk: op byte, then `lineno` (followed by `line_off` and
+// `line_skip` if it is 0) and `arg` as varints, then `ch` for JOP_INSERT_CHAR, `count`
+// as a varint for JOP_DELETE_CHARS, or the length of `text` as a varint followed by
+// `text` for JOP_INSERT_TEXT and JOP_REPLACE_LINE.
+struct journal_record {
+	enum journal_op op;
+	// 1-based line the change was made on, or 0 if the line is given by its place in
+	// the original file instead (paged mode, where line numbers aren't always known):
+	// `line_skip` lines after the one starting at byte `line_off`. `line_skip` is negative
+	// if more lines before it were deleted than added.
+	size_t lineno;
+	off_t line_off;
+	long line_skip;
+	// byte index into the line (or the new length, for JOP_TRUNCATE, or the
+	// number of lines, for JOP_DELETE_LINES)
+	size_t arg;
+	char ch;
+	size_t count;
+	str_t text;
+};
+
+// append-only log of edits, kept next to the file as `.<name>.mfj`.
+// records are buffered and synced to disk in groups, not one at a time.
+struct journal {
+	// -1 until there is something to write
+	int fd;
+	unsigned append : 1;
+	// the file changed since the header was written (see journal_restamp())
+	unsigned header_stale : 1;
+	// the file as it was when the journal was started, for the header
+	off_t file_size;
+	struct timespec file_mtime;
+	string_t path;
+	string_t pending;
+	// CLOCK_MONOTONIC ms by which `pending` has to be on disk
+	int64_t flush_deadline;
+};
+
+[[nodiscard]] int journal_open(struct journal *j, const char *file_path, int append);
+void journal_close(struct journal *j, int remove);
+[[nodiscard]] int journal_restamp(struct journal *j, const char *file_path);
+void journal_record(struct journal *j, struct journal_record rec);
+[[nodiscard]] int journal_flush(struct journal *j);
+int journal_ms_until_flush(struct journal *j);
+int journal_check(const char *file_path);
+int journal_exists(const char *file_path);
+[[nodiscard]] int journal_replay(const char *file_path, void (*apply)(void *ctx, struct journal_record rec), void *ctx);
+
+#endif
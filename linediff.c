@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include "linediff.h"
+#include "render.h"
+
+void diffbase_init(struct diffbase *b) {
+	b->hashes = NULL;
+	b->offs = NULL;
+	b->n = 0;
+	b->cap = 0;
+}
+
+void diffbase_free(struct diffbase *b) {
+	free(b->hashes);
+	free(b->offs);
+}
+
+// adds the file's next line, which starts at `off`
+void diffbase_push(struct diffbase *b, off_t off, str_t line) {
+	if (b->n == b->cap) {
+		b->cap = MAX(b->cap * 2, (size_t) 1024);
+		b->hashes = realloc(b->hashes, sizeof(b->hashes[0]) * b->cap);
+		b->offs = realloc(b->offs, sizeof(b->offs[0]) * b->cap);
+	}
+	b->hashes[b->n] = str_hash(line);
+	b->offs[b->n] = off;
+	b->n++;
+}
+
+// index of the line that starts at `off`, or -1
+ssize_t diffbase_find(const struct diffbase *b, off_t off) {
+	size_t lo = 0, hi = b->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (b->offs[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < b->n && b->offs[lo] == off ? (ssize_t) lo : -1;
+}
+
+// marks the lines of `a` and `b` (given by their hashes) that are in a longest common
+// subsequence of the two, with Myers' O(ND) algorithm. a common start and end are taken
+// off first, so that a few edits cost about as much as the lines around them. gives up
+// (returning -1, with only the common start and end marked) if more than `max_edits`
+// lines would have to be added or taken out.
+int linediff_diff(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, size_t max_edits, unsigned char *a_kept, unsigned char *b_kept) {
+	memset(a_kept, 0, na);
+	memset(b_kept, 0, nb);
+	size_t pre = 0;
+	while (pre < na && pre < nb && a[pre] == b[pre]) {
+		a_kept[pre] = b_kept[pre] = 1;
+		pre++;
+	}
+	size_t suf = 0;
+	while (suf < na - pre && suf < nb - pre && a[na - 1 - suf] == b[nb - 1 - suf]) {
+		a_kept[na - 1 - suf] = b_kept[nb - 1 - suf] = 1;
+		suf++;
+	}
+	a += pre;
+	b += pre;
+	a_kept += pre;
+	b_kept += pre;
+	na -= pre + suf;
+	nb -= pre + suf;
+	if (na == 0 || nb == 0)
+		return 0;
+
+	// v[mid + k] is how far along `a` the furthest reaching path on diagonal k (x - y)
+	// gets. a copy is kept for each number of edits, to trace the path back.
+	long max = MIN(na + nb, max_edits);
+	long mid = max + 1;
+	size_t width = 2 * max + 3;
+	long *trace = malloc(sizeof(trace[0]) * width * (max + 1));
+	long *v = calloc(width, sizeof(v[0]));
+	long d;
+	for (d = 0; d <= max; d++) {
+		int done = 0;
+		for (long k = -d; k <= d; k += 2) {
+			long x = k == -d || (k != d && v[mid + k - 1] < v[mid + k + 1]) ? v[mid + k + 1] : v[mid + k - 1] + 1;
+			long y = x - k;
+			while (x < (long) na && y < (long) nb && a[x] == b[y])
+				x++, y++;
+			v[mid + k] = x;
+			if (x >= (long) na && y >= (long) nb) {
+				done = 1;
+				break;
+			}
+		}
+		memcpy(trace + d * width, v, sizeof(v[0]) * width);
+		if (done)
+			break;
+	}
+	free(v);
+	if (d > max) {
+		free(trace);
+		return -1;
+	}
+
+	long x = na, y = nb;
+	for (; d > 0; d--) {
+		const long *pv = trace + (d - 1) * width;
+		long k = x - y;
+		long pk = k == -d || (k != d && pv[mid + k - 1] < pv[mid + k + 1]) ? k + 1 : k - 1;
+		long px = pv[mid + pk];
+		long py = px - pk;
+		// the lines both have, from where the edit got to
+		while (x > px && y > py) {
+			x--, y--;
+			a_kept[x] = b_kept[y] = 1;
+		}
+		x = px;
+		y = py;
+	}
+	while (x > 0 && y > 0) {
+		x--, y--;
+		a_kept[x] = b_kept[y] = 1;
+	}
+	free(trace);
+	return 0;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+// diffs two strings with a character per line
+static int diff_chars(const char *a, const char *b, size_t max_edits, char *a_out, char *b_out) {
+	size_t na = strlen(a), nb = strlen(b);
+	uint64_t ha[64], hb[64];
+	for (size_t i = 0; i < na; i++)
+		ha[i] = str_hash((str_t) { .ptr = a + i, .len = 1 });
+	for (size_t i = 0; i < nb; i++)
+		hb[i] = str_hash((str_t) { .ptr = b + i, .len = 1 });
+	unsigned char ak[64], bk[64];
+	int ret = linediff_diff(ha, na, hb, nb, max_edits, ak, bk);
+	for (size_t i = 0; i < na; i++)
+		a_out[i] = ak[i] ? a[i] : '-';
+	for (size_t i = 0; i < nb; i++)
+		b_out[i] = bk[i] ? b[i] : '+';
+	a_out[na] = b_out[nb] = '\0';
+	return ret;
+}
+
+void linediff_run_tests(void) {
+	char a[64], b[64];
+	assert(diff_chars("abcdef", "abcdef", 0, a, b) == 0);
+	assert(!strcmp(a, "abcdef") && !strcmp(b, "abcdef"));
+	assert(diff_chars("abcdef", "abXdef", 10, a, b) == 0);
+	assert(!strcmp(a, "ab-def") && !strcmp(b, "ab+def"));
+	assert(diff_chars("abcabba", "cbabac", 10, a, b) == 0);
+	// a longest common subsequence is 4 long
+	size_t kept = 0;
+	for (size_t i = 0; a[i]; i++)
+		kept += a[i] != '-';
+	assert(kept == 4);
+	assert(diff_chars("", "xyz", 10, a, b) == 0 && !strcmp(b, "+++"));
+	assert(diff_chars("xyz", "", 10, a, b) == 0 && !strcmp(a, "---"));
+	assert(diff_chars("axbxc", "ab", 10, a, b) == 0 && !strcmp(a, "a-b--") && !strcmp(b, "ab"));
+	// too many edits: only the common start and end are found
+	assert(diff_chars("aqwertyz", "auiopz", 3, a, b) == -1);
+	assert(!strcmp(a, "a------z") && !strcmp(b, "a++++z"));
+
+	struct diffbase base;
+	diffbase_init(&base);
+	for (size_t i = 0; i < 3000; i++)
+		diffbase_push(&base, i * 10, STR("line"));
+	assert(base.n == 3000 && base.hashes[2999] == str_hash(STR("line")));
+	assert(diffbase_find(&base, 0) == 0);
+	assert(diffbase_find(&base, 12340) == 1234);
+	assert(diffbase_find(&base, 12345) == -1);
+	assert(diffbase_find(&base, 30000) == -1);
+	diffbase_free(&base);
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef __HAVE_LINEDIFF_H
+#define __HAVE_LINEDIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "mf_string.h"
+
+// the diff gutter: what the file's lines were when it was loaded, kept as a hash per line
+// so that the buffer can be diffed against it without keeping the text around
+struct diffbase {
+	uint64_t *hashes;
+	// where each line starts in the file. a line that hasn't changed since it was loaded
+	// is found from its `orig_off`.
+	off_t *offs;
+	size_t n;
+	size_t cap;
+};
+
+// what the gutter shows next to a line
+enum diff_mark {
+	DIFF_NONE,
+	DIFF_ADDED,
+	DIFF_MODIFIED,
+	// lines were taken out next to this one (below it, or above the first line)
+	DIFF_REMOVED,
+};
+
+void diffbase_init(struct diffbase *b);
+void diffbase_free(struct diffbase *b);
+void diffbase_push(struct diffbase *b, off_t off, str_t line);
+ssize_t diffbase_find(const struct diffbase *b, off_t off);
+int linediff_diff(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, size_t max_edits, unsigned char *a_kept, unsigned char *b_kept);
+
+#endif
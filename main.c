@@ -1,25 +1,61 @@
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
+#include "config.h"
 #include "editor.h"
+#include "evloop.h"
 #include "render.h"
 #include "input.h"
+#include "journal.h"
+#include "server.h"
 
 #ifdef MF_BUILD_TESTS
-#include <string.h>
-
 void render_run_tests(void);
 void mf_string_run_tests(void);
+void journal_run_tests(void);
+void evloop_run_tests(void);
+void pool_run_tests(void);
+void wrap_run_tests(void);
+void colindex_run_tests(void);
+void idxcache_run_tests(void);
+void textreg_run_tests(void);
+void subst_run_tests(void);
+void picker_run_tests(void);
+void server_run_tests(void);
+void snapshot_run_tests(void);
+void linediff_run_tests(void);
+void wordindex_run_tests(void);
+void hexview_run_tests(void);
+void editor_run_tests(void);
 
 void mf_run_tests(void) {
 	render_run_tests();
 	mf_string_run_tests();
+	journal_run_tests();
+	evloop_run_tests();
+	pool_run_tests();
+	wrap_run_tests();
+	colindex_run_tests();
+	idxcache_run_tests();
+	textreg_run_tests();
+	subst_run_tests();
+	picker_run_tests();
+	server_run_tests();
+	snapshot_run_tests();
+	linediff_run_tests();
+	wordindex_run_tests();
+	hexview_run_tests();
+	editor_run_tests();
 }
 #endif
 
@@ -57,17 +93,232 @@ static struct winsize get_term_size(void) {
 	return ws;
 }
 
-static int resized_flag;
-static void sigwinch_handler(int signo) {
-	resized_flag = 1;
+// the terminal is opened again for writing frames, since O_NONBLOCK on stdout would
+// also apply to stdin and stderr (and to the shell, after exiting) if they share it. if
+// that can't be done, writes just block.
+static int open_term_out(void) {
+	const char *tty = ttyname(STDOUT_FILENO);
+	int fd = tty != NULL ? open(tty, O_WRONLY | O_NONBLOCK | O_CLOEXEC) : -1;
+	return fd != -1 ? fd : STDOUT_FILENO;
 }
 
-int main(int argc, char **argv) {
-	int stdoutbufsize = 100000;
-	char *stdoutbuf = malloc(stdoutbufsize);
-	if (setvbuf(stdout, stdoutbuf, _IOFBF, stdoutbufsize))
-		err(1, "setvbuf");
+// leave alt screen. do this at the end of main() instead of in term_cleanup(), otherwise
+// err/errx messages won't be visible because they'll be printed on the alternate screen.
+static void leave_alt_screen(void) {
+#define LEAVE_ALT "\033[?1049l"
+	fwrite(LEAVE_ALT, 1, strlen(LEAVE_ALT), stdout);
+	render_restore_cursor_style();
+	fflush(stdout);
+}
+
+// what the main loop's callbacks work on
+struct mainloop {
+	struct evloop loop;
+	struct editor *editor;
+	int term_width;
+	int term_height;
+	int redraw;
+	// the editor has background work to get on with, so the loop shouldn't block
+	int idle_pending;
+	// the editor's fds that are being watched
+	struct evloop_fdset editor_fds;
+
+	// frames are written to the terminal without blocking. while one hasn't all been
+	// taken yet, no other one is drawn.
+	struct evloop_out out;
+};
+
+static void on_writable(void *ctx, int fd, uint32_t events) {
+	struct mainloop *m = ctx;
+	if (evloop_out_flush(&m->loop, &m->out))
+		err(1, "write");
+}
+
+static void on_stdin(void *ctx, int fd, uint32_t events) {
+	struct mainloop *m = ctx;
+	struct keyevt kevt;
+	if (input_try_get_keyevt(&kevt) != 0)
+		errx(1, "poll returned but no data read");
+	editor_handle_keyevt(m->editor, kevt);
+	m->redraw = 1;
+	m->idle_pending = 1;
+}
+
+static void on_sigwinch(void *ctx) {
+	struct mainloop *m = ctx;
+	struct winsize ws = get_term_size();
+	m->term_width = ws.ws_col;
+	m->term_height = ws.ws_row;
+	m->redraw = 1;
+}
+
+static void on_timer(void *ctx) {
+	struct mainloop *m = ctx;
+	editor_run_timers(m->editor);
+}
+
+static void on_editor_fd(void *ctx, int fd, uint32_t events) {
+	struct mainloop *m = ctx;
+	// EPOLLIN etc. have the same values as POLLIN etc.
+	editor_handle_pollfd(m->editor, (struct pollfd) { .fd = fd, .revents = events });
+	m->idle_pending = 1;
+}
+
+// the editor's fds come and go as it starts and finishes background work
+static void sync_editor_watches(struct mainloop *m) {
+	struct pollfd fds[EVLOOP_FDSET_SIZE];
+	size_t n = editor_get_pollfds(m->editor, fds, EVLOOP_FDSET_SIZE);
+	if (evloop_sync_fds(&m->loop, &m->editor_fds, fds, n, on_editor_fd, m))
+		err(1, "epoll_ctl");
+}
+
+// what the main loop's callbacks work on with -c. keys go to the server, and the frames
+// that come back go to the terminal.
+struct clientloop {
+	struct evloop loop;
+	// frames on their way to the terminal. while they are, nothing more is read from
+	// the server, so that it skips frames instead of sending them all.
+	struct evloop_out out;
+	// messages on their way to the server
+	struct evloop_out sock;
+	// what came from the server that isn't a whole message yet
+	string_t in;
+	// the server is done with the client. `error` says why, if it wasn't a clean exit.
+	int done;
+	string_t error;
+};
+
+static void client_flush(struct clientloop *c) {
+	if (evloop_out_flush(&c->loop, &c->out) || evloop_out_flush(&c->loop, &c->sock))
+		err(1, "write");
+	uint32_t events = c->out.buf.len > 0 ? 0 : EPOLLIN;
+	if (events != c->sock.events) {
+		c->sock.events = events;
+		if (evloop_mod_fd(&c->loop, c->sock.watch, events | (c->sock.waiting ? EPOLLOUT : 0)))
+			err(1, "epoll_ctl");
+	}
+}
+
+static void on_client_stdin(void *ctx, int fd, uint32_t events) {
+	struct clientloop *c = ctx;
+	struct keyevt kevt;
+	if (input_try_get_keyevt(&kevt) != 0)
+		errx(1, "poll returned but no data read");
+	msg_key(&c->sock.buf, kevt);
+	client_flush(c);
+}
+
+static void on_client_sigwinch(void *ctx) {
+	struct clientloop *c = ctx;
+	struct winsize ws = get_term_size();
+	msg_resize(&c->sock.buf, ws.ws_col, ws.ws_row);
+	client_flush(c);
+}
+
+static void on_client_writable(void *ctx, int fd, uint32_t events) {
+	client_flush(ctx);
+}
+
+static void on_server(void *ctx, int fd, uint32_t events) {
+	struct clientloop *c = ctx;
+	int open = 1;
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		open = msg_read(fd, &c->in);
+	size_t off = 0;
+	enum msg_type type;
+	str_t payload;
+	while (!c->done && msg_next(&c->in, &off, &type, &payload)) {
+		if (type == MSG_FRAME) {
+			string_append(&c->out.buf, payload);
+		} else if (type == MSG_ERROR) {
+			string_append(&c->error, payload);
+			c->done = 1;
+		} else if (type == MSG_EXIT) {
+			c->done = 1;
+		}
+	}
+	msg_consumed(&c->in, off);
+	if (open <= 0 && !c->done) {
+		string_append(&c->error, STR("the server went away"));
+		c->done = 1;
+	}
+	client_flush(c);
+}
+
+// -c: `path` is opened on the server (started if there isn't one yet), and this process
+// only passes keys to it and the frames it draws to the terminal
+static int run_client(const char *path, int follow) {
+	struct stat st;
+	if (stat(path, &st) == -1)
+		err(1, "%s", path);
+	if (!S_ISREG(st.st_mode))
+		errx(1, "%s: only regular files can be opened on the server", path);
+	// the server has its own working directory
+	char *abspath = realpath(path, NULL);
+	if (abspath == NULL)
+		err(1, "%s", path);
+
+	int sock = server_connect();
+	if (sock == -1)
+		err(1, "connect to the server");
+	if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1)
+		err(1, "fcntl");
+
+	enum color_depth depth = render_detect_color_depth();
+	if (term_init())
+		err(1, "enable raw mode");
+	if (atexit(term_cleanup))
+		err(1, "atexit handler");
+	if (fflush(stdout))
+		err(1, "fflush");
+
+	struct clientloop c = { .in = string_new(), .error = string_new() };
+	if (evloop_init(&c.loop))
+		err(1, "epoll_create");
+	c.out = (struct evloop_out) { .fd = open_term_out(), .buf = string_new() };
+	c.out.watch = evloop_add_fd(&c.loop, c.out.fd, 0, on_client_writable, &c);
+	c.sock = (struct evloop_out) { .fd = sock, .events = EPOLLIN, .buf = string_new() };
+	c.sock.watch = evloop_add_fd(&c.loop, sock, EPOLLIN, on_server, &c);
+	if (
+		c.out.watch == NULL
+		|| c.sock.watch == NULL
+		|| evloop_add_fd(&c.loop, STDIN_FILENO, EPOLLIN, on_client_stdin, &c) == NULL
+		|| evloop_add_signal(&c.loop, SIGWINCH, on_client_sigwinch, &c) == NULL
+	)
+		err(1, "event loop");
+	// a server that is gone is noticed from the write failing
+	signal(SIGPIPE, SIG_IGN);
 
+	struct winsize ws = get_term_size();
+	msg_open(&c.sock.buf, ws.ws_col, ws.ws_row, depth, follow, cstr_as_str(abspath));
+	free(abspath);
+	client_flush(&c);
+	while (!c.done) {
+		if (evloop_run_once(&c.loop, -1) == -1)
+			err(1, "epoll_wait");
+	}
+
+	if (evloop_out_drain(&c.loop, &c.out))
+		err(1, "write");
+	string_free(c.out.buf);
+	if (c.out.fd != STDOUT_FILENO)
+		close(c.out.fd);
+	string_free(c.sock.buf);
+	string_free(c.in);
+	evloop_free(&c.loop);
+	close(sock);
+
+	leave_alt_screen();
+	int ret = 0;
+	if (c.error.len > 0) {
+		fprintf(stderr, "mf: %.*s\n", (int) c.error.len, c.error.ptr);
+		ret = 1;
+	}
+	string_free(c.error);
+	return ret;
+}
+
+int main(int argc, char **argv) {
 #ifdef MF_BUILD_TESTS
 	if (argc == 2 && !strcmp(argv[1], "--test")) {
 		mf_run_tests();
@@ -75,86 +326,192 @@ int main(int argc, char **argv) {
 	}
 #endif
 
-	if (argc > 2)
+	int follow = 0;
+	// -m: print where the memory went on exit
+	int mem_report = 0;
+	// -c: open the file on the server
+	int attach = 0;
+	// -r: pick up a session saved with :mksession
+	const char *session = NULL;
+	// -x: show the file in the hex view, without reading it into the buffer
+	int hex = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "cfmr:x")) != -1) {
+		switch (opt) {
+		case 'c':
+			attach = 1;
+			break;
+		case 'r':
+			session = optarg;
+			break;
+		case 'f':
+			follow = 1;
+			break;
+		case 'm':
+			mem_report = 1;
+			break;
+		case 'x':
+			hex = 1;
+			break;
+		default:
+			errx(1, "usage: %s [-c] [-f] [-m] [file]\n       %s [-m] -r session\n       %s [-m] -x file", argv[0], argv[0], argv[0]);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (
+		argc > 1
+		|| (follow && argc == 0 && session == NULL)
+		|| (attach && (argc == 0 || !strcmp(argv[0], "-")))
+		|| (session != NULL && (argc > 0 || attach || follow))
+		|| (hex && (argc == 0 || !strcmp(argv[0], "-") || attach || follow || session != NULL))
+	)
 		errx(1, "bad arguments");
+	if (attach)
+		return run_client(argv[0], follow);
 
 	struct editor editor;
-	if (argc == 2) {
+	struct stat st;
+	if (session != NULL) {
+		editor_new(&editor, STR(""));
+		if (editor_resume_session(&editor, session))
+			err(1, "%s", session);
+	} else if (hex) {
+		editor_new(&editor, STR(""));
+		if (editor_open_hex(&editor, argv[0]))
+			err(1, "%s", argv[0]);
+	} else if (argc == 1 && (!strcmp(argv[0], "-") || (stat(argv[0], &st) == 0 && !S_ISREG(st.st_mode)))) {
+		// a pipe or the like: read it while the editor is already up
+		int fd = !strcmp(argv[0], "-") ? dup(STDIN_FILENO) : open(argv[0], O_RDONLY);
+		if (fd == -1)
+			err(1, "open %s", argv[0]);
+		editor_new(&editor, STR(""));
+		editor_start_stream(&editor, fd, !strcmp(argv[0], "-") ? STR("[stdin]") : cstr_as_str(argv[0]));
+	} else if (argc == 1 && stat(argv[0], &st) == 0 && S_ISREG(st.st_mode) && st.st_size > LARGEFILE_THRESHOLD) {
+		struct pager *pg = malloc(sizeof(struct pager));
+		if (pager_open(pg, argv[0]))
+			err(1, "pager_open");
+		editor_new_paged(&editor, pg);
+		editor_set_path(&editor, cstr_as_str(argv[0]), pg->size);
+	} else if (argc == 1) {
 		string_t filecont = string_new();
-		if (read_file_to_string(argv[1], &filecont))
+		if (read_file_to_string(argv[0], &filecont))
 			err(1, "read_file_to_string");
 		editor_new(&editor, string_as_str(filecont));
+		editor_set_path(&editor, cstr_as_str(argv[0]), filecont.len);
 		string_free(filecont);
-
-		struct pane *curp = editor_get_focused_pane(&editor);
-		string_clear(&curp->name);
-		string_append(&curp->name, cstr_as_str(argv[1]));
 	} else {
 		editor_new(&editor, STR(""));
 	}
 
+	if (follow && editor_start_follow(&editor))
+		err(1, "follow %s", argv[0]);
+
+	// the terminal has to come from somewhere else if stdin is the data
+	if (!isatty(STDIN_FILENO)) {
+		int tty = open("/dev/tty", O_RDWR);
+		if (tty == -1)
+			err(1, "open /dev/tty");
+		if (dup2(tty, STDIN_FILENO) == -1)
+			err(1, "dup2");
+		close(tty);
+	}
+	editor.input_fd = STDIN_FILENO;
+
+	int replayed = 0;
+	int stale = 0;
+	if (argc == 1 && !hex && journal_check(argv[0])) {
+		fprintf(stderr, "%s: found a recovery journal from a session that didn't exit cleanly. replay it? [y/N] ", argv[0]);
+		char answer[16];
+		if (fgets(answer, sizeof(answer), stdin) != NULL && (answer[0] == 'y' || answer[0] == 'Y')) {
+			if (editor_replay_journal(&editor))
+				err(1, "replay journal");
+			replayed = 1;
+		}
+	} else if (argc == 1 && !hex && journal_exists(argv[0])) {
+		// the file changed since: the edits can't be replayed, but they aren't thrown
+		// away by a new journal either
+		warnx("%s: recovery journal doesn't match the file anymore. it is kept, and this session isn't journaled", argv[0]);
+		stale = 1;
+	}
+	// a resumed buffer that has changes doesn't match its file, so a journal would have
+	// nothing to be replayed against. one a crash left behind is kept for `mf file`.
+	struct pane *p = editor_get_focused_pane(&editor);
+	int journal = !stale && (session == NULL || (p->change_seq == 0 && p->path.len > 0 && !journal_exists(p->path.ptr)));
+	if (journal && editor_start_journal(&editor, replayed))
+		warn("can't create recovery journal");
+
+	render_set_color_depth(render_detect_color_depth());
 	if (term_init())
 		err(1, "enable raw mode");
 	if (atexit(term_cleanup))
 		err(1, "atexit handler");
+	// the frames go out on their own fd, behind what went through stdout so far
+	if (fflush(stdout))
+		err(1, "fflush");
 
+	struct mainloop m = { .editor = &editor, .redraw = 1, .idle_pending = 1 };
+	if (evloop_init(&m.loop))
+		err(1, "epoll_create");
 	struct winsize ws = get_term_size();
-	int term_width = ws.ws_col;
-	int term_height = ws.ws_row;
-
-	struct sigaction winch_act = { .sa_handler = sigwinch_handler };
-	if (sigaction(SIGWINCH, &winch_act, NULL))
-		err(1, "sigaction");
+	m.term_width = ws.ws_col;
+	m.term_height = ws.ws_row;
+	struct evloop_watch *timer = evloop_add_timer(&m.loop, on_timer, &m);
+	m.out.fd = open_term_out();
+	m.out.buf = string_new();
+	m.out.watch = evloop_add_fd(&m.loop, m.out.fd, 0, on_writable, &m);
+	if (
+		evloop_add_fd(&m.loop, STDIN_FILENO, EPOLLIN, on_stdin, &m) == NULL
+		|| evloop_add_signal(&m.loop, SIGWINCH, on_sigwinch, &m) == NULL
+		|| timer == NULL
+		|| m.out.watch == NULL
+	)
+		err(1, "event loop");
 
 	struct framebuf fb;
-	framebuf_new(&fb, term_width, term_height);
+	framebuf_new(&fb, m.term_width, m.term_height);
 	while (!editor.should_exit) {
-		framebuf_reset(&fb, term_width, term_height);
-		struct rect editor_area = { .width = fb.width, .height = fb.height };
-		editor_render(&editor, &fb, editor_area);
-		framebuf_display(&fb);
-
-		if (fflush(stdout))
-			err(1, "fflush");
-
-		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
-		int pollret = poll(&pfd, 1, -1);
-		// Poll finished. There is either data available on stdin,
-		// or poll was interrupted by a signal.
-		if (pollret == -1) {
-			if (errno == EINTR) {
-				// poll was interrupted, likely by SIGWINCH. Handle resize:
-				if (resized_flag) {
-					ws = get_term_size();
-					term_width = ws.ws_col;
-					term_height = ws.ws_row;
-					resized_flag = 0;
-				}
-			} else {
-				// non-EINTR poll error
-				err(1, "poll");
-			}
-		} else {
-			// pollret != -1, so there is data for reading:
-			struct keyevt kevt;
-			if (input_try_get_keyevt(&kevt) == 0) {
-				editor_handle_keyevt(&editor, kevt);
-			} else {
-				errx(1, "poll returned but no data read");
-			}
+		editor_drain_jobs(&editor);
+		// frames that would come while the last one is still being written out are
+		// skipped. once the terminal has taken it, the latest state is drawn, so a slow
+		// terminal shows fewer frames instead of falling behind the keys.
+		if ((m.redraw || editor.needs_redraw) && m.out.buf.len == 0) {
+			framebuf_reset(&fb, m.term_width, m.term_height);
+			struct rect editor_area = { .width = fb.width, .height = fb.height };
+			editor_render(&editor, &fb, editor_area);
+			framebuf_display(&fb, &m.out.buf);
+			if (evloop_out_flush(&m.loop, &m.out))
+				err(1, "write");
+			m.redraw = 0;
+			editor.needs_redraw = 0;
 		}
+
+		sync_editor_watches(&m);
+		if (evloop_arm_timer(timer, editor_poll_timeout(&editor)))
+			err(1, "timerfd_settime");
+		// sleeps until something happens, unless there is background work to do
+		int nevents = evloop_run_once(&m.loop, m.idle_pending ? 0 : -1);
+		if (nevents == -1)
+			err(1, "epoll_wait");
+		if (nevents == 0 && m.idle_pending)
+			m.idle_pending = editor_idle_work(&editor);
 	}
+	string_t report = string_new();
+	if (mem_report)
+		editor_mem_report(&editor, &report);
+	// the rest of the last frame goes out before the terminal is put back
+	if (evloop_out_drain(&m.loop, &m.out))
+		err(1, "write");
+	string_free(m.out.buf);
+	if (m.out.fd != STDOUT_FILENO)
+		close(m.out.fd);
 	framebuf_free(&fb);
+	evloop_free(&m.loop);
 	editor_free(&editor);
 
-	// leave alt screen. do this here instead of in term_cleanup(),
-	// otherwise err/errx messages won't be visible because they'll
-	// be printed on the alternate screen.
-#define LEAVE_ALT "\033[?1049l"
-	fwrite(LEAVE_ALT, 1, strlen(LEAVE_ALT), stdout);
-	render_restore_cursor_style();
-
-	fflush(stdout);
-	setvbuf(stdout, NULL, _IOFBF, 0);
-	free(stdoutbuf);
+	leave_alt_screen();
+	if (mem_report)
+		fprintf(stderr, "%.*s\n", (int) report.len, report.ptr);
+	string_free(report);
 }
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -68,7 +69,17 @@ int str_eq(str_t a, str_t b) {
 	if (a.len != b.len)
 		return 0;
 
-	return memcmp(a.ptr, b.ptr, a.len) == 0;
+	return a.len == 0 || memcmp(a.ptr, b.ptr, a.len) == 0;
+}
+
+// FNV-1a
+uint64_t str_hash(str_t s) {
+	uint64_t h = 0xcbf29ce484222325;
+	for (size_t i = 0; i < s.len; i++) {
+		h ^= (unsigned char) s.ptr[i];
+		h *= 0x100000001b3;
+	}
+	return h;
 }
 
 string_t str_to_string(str_t s) {
@@ -101,6 +112,15 @@ int str_is_empty(str_t s) {
 	return s.len == 0;
 }
 
+// if `s` starts with `prefix`, sets `rest` to what follows it and returns nonzero
+int str_strip_prefix(str_t s, str_t prefix, str_t *rest) {
+	if (s.len < prefix.len || memcmp(s.ptr, prefix.ptr, prefix.len) != 0)
+		return 0;
+
+	*rest = (str_t) { .ptr = s.ptr + prefix.len, .len = s.len - prefix.len };
+	return 1;
+}
+
 void string_insert(string_t *s, size_t idx, char ch) {
 	assert(idx <= s->len);
 
@@ -125,33 +145,99 @@ void string_remove(string_t *s, size_t idx) {
 		return;
 	}
 
-	memmove(s->ptr + idx, s->ptr + idx + 1, s->len - idx);
+	memmove(s->ptr + idx, s->ptr + idx + 1, s->len - idx - 1);
 	s->len -= 1;
 }
 
-int read_file_to_string(char *path, string_t *s) {
-	struct stat st;
-	if (stat(path, &st) == -1)
+// parses a nonempty string of decimal digits
+int str_parse_size(str_t s, size_t *ret) {
+	if (s.len == 0)
 		return -1;
 
+	size_t n = 0;
+	for (size_t i = 0; i < s.len; i++) {
+		if (s.ptr[i] < '0' || s.ptr[i] > '9')
+			return -1;
+		size_t digit = s.ptr[i] - '0';
+		if (n > (SIZE_MAX - digit) / 10)
+			return -1;
+		n = n * 10 + digit;
+	}
+	*ret = n;
+	return 0;
+}
+
+int read_file_to_string(char *path, string_t *s) {
 	int fd = open(path, O_RDONLY);
 	if (fd == -1)
 		return -1;
-	string_reserve(s, st.st_size);
-	size_t nread;
-	if ((nread = read(fd, s->ptr, st.st_size)) == -1) {
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
 		close(fd);
 		return -1;
 	}
-	s->len = nread;
+
+	// st_size is only a hint: it's 0 for pipes, and stale if the file is being written to.
+	// +1 so that a file of the expected size is read without growing the buffer.
+	s->len = 0;
+	string_reserve(s, (st.st_size > 0 ? st.st_size : 4096) + 1);
+	for (;;) {
+		if (s->len == s->cap)
+			string_reserve(s, s->cap * 2);
+
+		ssize_t nread = read(fd, s->ptr + s->len, s->cap - s->len);
+		if (nread == -1 && errno == EINTR)
+			continue;
+		if (nread == -1) {
+			close(fd);
+			return -1;
+		}
+		if (nread == 0)
+			break;
+		s->len += nread;
+	}
+
 	close(fd);
 	return 0;
 }
 
+// writes all of `buf` to `fd`, however many write()s that takes
+int write_all(int fd, const void *buf, size_t len) {
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
 #ifdef MF_BUILD_TESTS
 #include <assert.h>
 #include <stdio.h>
 
+// tests: creates a fresh directory from `tmpl`, a mkdtemp() template that is
+// overwritten with the directory's path
+void test_tmpdir_create(char *tmpl) {
+	assert(mkdtemp(tmpl) != NULL);
+}
+
+// tests: removes a directory made by test_tmpdir_create(), with everything in it
+void test_tmpdir_remove(const char *dir) {
+	string_t cmd = string_new();
+	string_append(&cmd, STR("rm -rf '"));
+	string_append(&cmd, cstr_as_str((char *) dir));
+	string_append(&cmd, STR("'"));
+	string_push(&cmd, '\0');
+	assert(system(cmd.ptr) == 0);
+	string_free(cmd);
+}
+
 static void str_assert_eq(str_t lhs, str_t rhs) {
 	if (lhs.len != rhs.len || memcmp(lhs.ptr, rhs.ptr, lhs.len) != 0) {
 		printf("assertion `lhs == rhs` failed.\n");
@@ -176,5 +262,32 @@ void mf_string_run_tests(void) {
 	str_assert_eq(string_as_str(insert_into_me), STR("Hpello"));
 	string_remove(&insert_into_me, 0);
 	str_assert_eq(string_as_str(insert_into_me), STR("pello"));
+
+	str_t rest;
+	assert(str_strip_prefix(STR("match foo"), STR("match "), &rest));
+	str_assert_eq(rest, STR("foo"));
+	assert(!str_strip_prefix(STR("mat"), STR("match "), &rest));
+
+	size_t n;
+	assert(str_parse_size(STR("1234"), &n) == 0 && n == 1234);
+	assert(str_parse_size(STR(""), &n) == -1);
+	assert(str_parse_size(STR("12a"), &n) == -1);
+	assert(str_parse_size(STR("18446744073709551615"), &n) == 0 && n == SIZE_MAX);
+	assert(str_parse_size(STR("18446744073709551616"), &n) == -1);
+	assert(str_parse_size(STR("100000000000000000000"), &n) == -1);
+
+	// read_file_to_string() must not trust st_size, which is 0 for a pipe
+	int pipefds[2];
+	assert(pipe(pipefds) == 0);
+	assert(write(pipefds[1], "from a pipe\n", 12) == 12);
+	close(pipefds[1]);
+	char pipepath[64];
+	snprintf(pipepath, sizeof(pipepath), "/dev/fd/%d", pipefds[0]);
+	string_t piped = string_new();
+	assert(read_file_to_string(pipepath, &piped) == 0);
+	str_assert_eq(string_as_str(piped), STR("from a pipe\n"));
+	assert(str_hash(STR("")) == 0xcbf29ce484222325 && str_hash(STR("a")) == 0xaf63dc4c8601ec8c);
+	string_free(piped);
+	close(pipefds[0]);
 }
 #endif
@@ -2,6 +2,7 @@
 #define __HAVE_MF_STRING_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define STR(LIT) (str_t) { .ptr = "" LIT "", .len = sizeof("" LIT "") - 1 }
 #define STRING(LIT) str_to_string(STR(LIT))
@@ -24,13 +25,22 @@ void string_clear(string_t *s);
 void string_pop(string_t *s);
 str_t string_as_str(string_t s);
 int str_eq(str_t a, str_t b);
+uint64_t str_hash(str_t s);
 string_t str_to_string(str_t s);
 str_t str_slice_idx_to_eol(str_t s, size_t idx);
 int str_is_empty(str_t s);
 void string_insert(string_t *s, size_t idx, char ch);
 void string_remove(string_t *s, size_t idx);
 [[nodiscard]] int read_file_to_string(char *path, string_t *s);
+[[nodiscard]] int write_all(int fd, const void *buf, size_t len);
 void string_append(string_t *s, str_t other);
 str_t cstr_as_str(char *cstr);
+[[nodiscard]] int str_parse_size(str_t s, size_t *ret);
+int str_strip_prefix(str_t s, str_t prefix, str_t *rest);
+
+#ifdef MF_BUILD_TESTS
+void test_tmpdir_create(char *tmpl);
+void test_tmpdir_remove(const char *dir);
+#endif
 
 #endif
@@ -0,0 +1,356 @@
+// microbenchmarks for the primitives the editor is built on. built and run by
+// `make microbench`; prints one JSON object, with a result per line so that two runs
+// can be diffed.
+//
+// usage: mf-microbench [-r repetitions] [name filter]
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bufline.h"
+#include "config.h"
+#include "hexview.h"
+#include "mf_string.h"
+#include "render.h"
+#include "wordindex.h"
+
+// each benchmark is run untimed for this long first
+#define WARMUP_NS (20L * 1000 * 1000)
+// a repetition runs enough operations to take about this long
+#define REP_NS (20L * 1000 * 1000)
+#define DEFAULT_REPS 10
+
+struct bench {
+	const char *name;
+	// sizes the benchmark is run at. what the size means is up to the benchmark.
+	size_t sizes[3];
+	// called untimed before each repetition, with how many ops it will run
+	void (*setup)(size_t size, size_t iters);
+	// one operation. returns the bytes of input it went through.
+	size_t (*op)(size_t size, size_t i);
+	// called untimed after each repetition
+	void (*teardown)(void);
+};
+
+// ops write here so that they can't be optimized away
+static volatile size_t sink;
+
+static string_t s;
+static string_t text;
+static struct bufline **lists;
+static size_t nlists;
+static struct framebuf fb;
+static string_t frame;
+static struct wordindex words;
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+// `n` bytes of text with lines `linelen` long (the last one may be shorter)
+static string_t make_text(size_t n, size_t linelen) {
+	string_t t = string_new();
+	for (size_t i = 0; i < n; i++)
+		string_push(&t, (i + 1) % (linelen + 1) == 0 ? '\n' : 'a' + i % 26);
+	return t;
+}
+
+// strings `size` long, each given at most half that many ops, so that they stay about
+// `size` long however many ops a repetition runs
+static string_t *strs;
+static size_t nstrs;
+static size_t ops_per_str;
+
+static void setup_string(size_t size, size_t iters) {
+	ops_per_str = MAX(size / 2, (size_t) 1);
+	nstrs = (iters + ops_per_str - 1) / ops_per_str;
+	strs = calloc(nstrs, sizeof(strs[0]));
+	for (size_t i = 0; i < nstrs; i++)
+		strs[i] = make_text(size, size);
+}
+
+static void teardown_string(void) {
+	for (size_t i = 0; i < nstrs; i++)
+		string_free(strs[i]);
+	free(strs);
+}
+
+static size_t op_insert_start(size_t size, size_t i) {
+	string_insert(&strs[i / ops_per_str], 0, 'x');
+	return 1;
+}
+
+static size_t op_insert_middle(size_t size, size_t i) {
+	string_t *t = &strs[i / ops_per_str];
+	string_insert(t, t->len / 2, 'x');
+	return 1;
+}
+
+static size_t op_insert_end(size_t size, size_t i) {
+	string_t *t = &strs[i / ops_per_str];
+	string_insert(t, t->len, 'x');
+	return 1;
+}
+
+static size_t op_remove_start(size_t size, size_t i) {
+	string_remove(&strs[i / ops_per_str], 0);
+	return 1;
+}
+
+static size_t op_remove_middle(size_t size, size_t i) {
+	string_t *t = &strs[i / ops_per_str];
+	string_remove(t, t->len / 2);
+	return 1;
+}
+
+static size_t op_remove_end(size_t size, size_t i) {
+	string_t *t = &strs[i / ops_per_str];
+	string_remove(t, t->len - 1);
+	return 1;
+}
+
+// 1 MB of lines `size` long
+static void setup_text(size_t size, size_t iters) {
+	text = make_text(1024 * 1024, size);
+}
+
+static void teardown_text(void) {
+	string_free(text);
+}
+
+// slices the lines one after another, starting over at the end
+static size_t op_slice(size_t size, size_t i) {
+	static size_t off;
+	if (off >= text.len)
+		off = 0;
+	str_t line = str_slice_idx_to_eol(string_as_str(text), off);
+	off += line.len + 1;
+	sink += line.len;
+	return line.len + 1;
+}
+
+// 64 KB of lines `size` long, split into lines once per op
+static void setup_buflines(size_t size, size_t iters) {
+	text = make_text(64 * 1024, size);
+	lists = calloc(iters, sizeof(lists[0]));
+	nlists = iters;
+}
+
+static void teardown_buflines(void) {
+	for (size_t i = 0; i < nlists; i++)
+		free_bufline_list(lists[i]);
+	free(lists);
+	string_free(text);
+}
+
+static size_t op_to_buflines(size_t size, size_t i) {
+	lists[i] = str_to_buflines(string_as_str(text));
+	return text.len;
+}
+
+static void setup_free_buflines(size_t size, size_t iters) {
+	setup_buflines(size, iters);
+	for (size_t i = 0; i < iters; i++)
+		lists[i] = str_to_buflines(string_as_str(text));
+}
+
+static size_t op_free_buflines(size_t size, size_t i) {
+	free_bufline_list(lists[i]);
+	lists[i] = NULL;
+	return text.len;
+}
+
+// a line `size` long with some tabs and nonprintable characters, drawn on a 200
+// column screen
+static void setup_render_str(size_t size, size_t iters) {
+	s = string_new();
+	for (size_t i = 0; i < size; i++)
+		string_push(&s, i % 50 == 49 ? '\t' : i % 97 == 96 ? '\x01' : 'a' + i % 26);
+	framebuf_new(&fb, 200, 1);
+}
+
+static void teardown_render_str(void) {
+	string_free(s);
+	framebuf_free(&fb);
+}
+
+static size_t op_render_str(size_t size, size_t i) {
+	render_str(&fb, (struct rect) { .width = 200, .height = 1 }, string_as_str(s), NORMAL_STYLE);
+	return s.len;
+}
+
+// the size is the screen's width; it is a quarter as high
+static void setup_framebuf(size_t size, size_t iters) {
+	framebuf_new(&fb, size, size / 4);
+}
+
+static void teardown_framebuf(void) {
+	framebuf_free(&fb);
+}
+
+static size_t op_framebuf_reset(size_t size, size_t i) {
+	framebuf_reset(&fb, size, size / 4);
+	return fb.width * fb.height * sizeof(fb.buf[0]);
+}
+
+// a screen full of text in a few styles, like the editor draws
+static void setup_display(size_t size, size_t iters) {
+	setup_framebuf(size, iters);
+	string_t line = make_text(size, size);
+	for (int y = 0; y < fb.height; y++) {
+		struct style sty = y % 3 == 0 ? GUTTER_STYLE : y % 3 == 1 ? NORMAL_STYLE : ERRORMSG_STYLE;
+		render_str(&fb, (struct rect) { .y = y, .width = fb.width, .height = 1 }, string_as_str(line), sty);
+	}
+	string_free(line);
+	frame = string_new();
+}
+
+static void teardown_display(void) {
+	teardown_framebuf();
+	string_free(frame);
+}
+
+static size_t op_display(size_t size, size_t i) {
+	string_clear(&frame);
+	framebuf_display(&fb, &frame);
+	return fb.width * fb.height * sizeof(fb.buf[0]);
+}
+
+// `size` distinct made up words, some of them much more common than others
+static void setup_wordindex(size_t size, size_t iters) {
+	wordindex_init(&words);
+	uint32_t x = 1;
+	for (size_t i = 0; i < size; i++) {
+		char word[16];
+		size_t len = 3 + i % 10;
+		for (size_t j = 0; j < len; j++) {
+			x = x * 1103515245 + 12345;
+			word[j] = 'a' + (x >> 16) % 26;
+		}
+		for (size_t j = 0; j < 1 + (i % 97 == 0 ? i % 50 : 0); j++)
+			wordindex_add(&words, (str_t) { .ptr = word, .len = len });
+	}
+}
+
+static void teardown_wordindex(void) {
+	wordindex_free(&words);
+}
+
+// the most common words that start with a letter, as Ctrl-N would offer them
+static size_t op_wordindex_complete(size_t size, size_t i) {
+	string_t out[COMPL_MAX_CANDIDATES];
+	char prefix = 'a' + i % 26;
+	size_t n = wordindex_complete(&words, (str_t) { .ptr = &prefix, .len = 1 }, out, COMPL_MAX_CANDIDATES);
+	for (size_t j = 0; j < n; j++)
+		string_free(out[j]);
+	sink = n;
+	return 1;
+}
+
+// `size` bytes of hex digits for the hex view, a row at a time
+static size_t op_hexview_format_hex(size_t size, size_t i) {
+	char hex[2 * HEXVIEW_ROW_BYTES];
+	for (size_t off = 0; off + HEXVIEW_ROW_BYTES <= size; off += HEXVIEW_ROW_BYTES)
+		hexview_format_hex((const unsigned char *) text.ptr + off, hex);
+	sink = hex[i % sizeof(hex)];
+	return size;
+}
+
+static const struct bench benches[] = {
+	{ "string_insert_start", { 64, 4096, 1024 * 1024 }, setup_string, op_insert_start, teardown_string },
+	{ "string_insert_middle", { 64, 4096, 1024 * 1024 }, setup_string, op_insert_middle, teardown_string },
+	{ "string_insert_end", { 64, 4096, 1024 * 1024 }, setup_string, op_insert_end, teardown_string },
+	{ "string_remove_start", { 64, 4096, 1024 * 1024 }, setup_string, op_remove_start, teardown_string },
+	{ "string_remove_middle", { 64, 4096, 1024 * 1024 }, setup_string, op_remove_middle, teardown_string },
+	{ "string_remove_end", { 64, 4096, 1024 * 1024 }, setup_string, op_remove_end, teardown_string },
+	{ "str_slice_idx_to_eol", { 16, 80, 4096 }, setup_text, op_slice, teardown_text },
+	{ "str_to_buflines", { 8, 80, 1000 }, setup_buflines, op_to_buflines, teardown_buflines },
+	{ "free_bufline_list", { 8, 80, 1000 }, setup_free_buflines, op_free_buflines, teardown_buflines },
+	{ "render_str", { 16, 200, 4096 }, setup_render_str, op_render_str, teardown_render_str },
+	{ "framebuf_reset", { 80, 200, 400 }, setup_framebuf, op_framebuf_reset, teardown_framebuf },
+	{ "framebuf_display", { 80, 200, 400 }, setup_display, op_display, teardown_display },
+	{ "wordindex_complete", { 1000, 10000, 100000 }, setup_wordindex, op_wordindex_complete, teardown_wordindex },
+	{ "hexview_format_hex", { 16, 4096, 1024 * 1024 }, setup_text, op_hexview_format_hex, teardown_text },
+};
+
+// runs `iters` ops in a fresh setup, and returns how long they took
+static int64_t run_rep(const struct bench *b, size_t size, size_t iters, size_t *bytes) {
+	b->setup(size, iters);
+	*bytes = 0;
+	int64_t start = now_ns();
+	for (size_t i = 0; i < iters; i++)
+		*bytes += b->op(size, i);
+	int64_t elapsed = now_ns() - start;
+	b->teardown();
+	return elapsed;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+	int reps = DEFAULT_REPS;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			errx(1, "usage: %s [-r repetitions] [name filter]", argv[0]);
+		}
+	}
+	if (reps < 1)
+		errx(1, "need at least one repetition");
+	const char *filter = optind < argc ? argv[optind] : NULL;
+
+	printf("{\"version\": 1, \"reps\": %d, \"results\": [\n", reps);
+	int first = 1;
+	double *ns = calloc(reps, sizeof(ns[0]));
+	for (size_t bi = 0; bi < sizeof(benches) / sizeof(benches[0]); bi++) {
+		const struct bench *b = &benches[bi];
+		if (filter != NULL && strstr(b->name, filter) == NULL)
+			continue;
+		for (size_t si = 0; si < 3; si++) {
+			size_t size = b->sizes[si];
+
+			// warm up while finding how many ops fill a repetition
+			size_t iters = 1;
+			size_t bytes;
+			int64_t warmed = 0;
+			int64_t elapsed;
+			for (;;) {
+				elapsed = run_rep(b, size, iters, &bytes);
+				warmed += elapsed;
+				if (elapsed >= REP_NS && warmed >= WARMUP_NS)
+					break;
+				if (elapsed < REP_NS)
+					iters *= 2;
+			}
+
+			double bytes_per_op = 0;
+			for (int r = 0; r < reps; r++) {
+				ns[r] = (double) run_rep(b, size, iters, &bytes) / iters;
+				bytes_per_op = (double) bytes / iters;
+			}
+			qsort(ns, reps, sizeof(ns[0]), cmp_double);
+			double median = ns[reps / 2];
+			printf("%s  {\"name\": \"%s\", \"size\": %zu, \"iters\": %zu, \"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"bytes_per_op\": %.1f, \"mb_per_s\": %.1f}",
+				first ? "" : ",\n", b->name, size, iters, median, ns[0], bytes_per_op,
+				median > 0 ? bytes_per_op / median * 1000 : 0.0);
+			fflush(stdout);
+			first = 0;
+		}
+	}
+	printf("\n]}\n");
+	free(ns);
+	return 0;
+}
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "pager.h"
+
+int pager_open(struct pager *pg, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	char *abspath = realpath(path, NULL);
+	*pg = (struct pager) {
+		.fd = fd,
+		.size = st.st_size,
+		.path = abspath != NULL ? abspath : strdup(path),
+		.dev = st.st_dev,
+		.ino = st.st_ino,
+		.mtime = st.st_mtim,
+		.mem_cap = PAGER_MEM_CAP,
+	};
+
+	pg->idx_cap = 64;
+	pg->idx = malloc(sizeof(pg->idx[0]) * pg->idx_cap);
+	// line 1 always starts at offset 0
+	pg->idx[pg->idx_len++] = 0;
+	pg->index_complete = pg->size == 0;
+
+	return 0;
+}
+
+void pager_close(struct pager *pg) {
+	for (size_t i = 0; i < pg->nchunks; i++)
+		munmap(pg->chunks[i].data, pg->chunks[i].len);
+	free(pg->chunks);
+	if (pg->idx_map != NULL)
+		munmap(pg->idx_map, pg->idx_map_len);
+	else
+		free(pg->idx);
+	free(pg->path);
+	for (size_t i = 0; i < pg->nedits; i++)
+		free_bufline_list(pg->edits[i].lines);
+	free(pg->edits);
+	close(pg->fd);
+}
+
+// the file grew (e.g. while following it)
+void pager_set_size(struct pager *pg, off_t size) {
+	// the chunk that used to end at EOF is now too short
+	for (size_t i = 0; i < pg->nchunks; i++) {
+		struct pager_chunk *c = &pg->chunks[i];
+		if (c->off + (off_t) c->len == pg->size && c->len < PAGER_CHUNK_SIZE) {
+			munmap(c->data, c->len);
+			pg->resident -= c->len;
+			pg->chunks[i] = pg->chunks[--pg->nchunks];
+			break;
+		}
+	}
+
+	pg->size = size;
+	if (pg->indexed_off < size)
+		pg->index_complete = 0;
+}
+
+static void pager_evict_lru(struct pager *pg) {
+	size_t lru = 0;
+	for (size_t i = 1; i < pg->nchunks; i++) {
+		if (pg->chunks[i].last_used < pg->chunks[lru].last_used)
+			lru = i;
+	}
+
+	munmap(pg->chunks[lru].data, pg->chunks[lru].len);
+	pg->resident -= pg->chunks[lru].len;
+	pg->chunks[lru] = pg->chunks[--pg->nchunks];
+}
+
+// returns the chunk containing `off`, mapping it if needed.
+// the returned pointer is only valid until the next call.
+static struct pager_chunk *pager_get_chunk(struct pager *pg, off_t off) {
+	off_t chunk_off = off - off % PAGER_CHUNK_SIZE;
+	pg->clock += 1;
+
+	for (size_t i = 0; i < pg->nchunks; i++) {
+		struct pager_chunk *c = &pg->chunks[i];
+		if (c->off == chunk_off && off < c->off + (off_t) c->len) {
+			c->last_used = pg->clock;
+			return c;
+		}
+	}
+
+	size_t len = MIN((off_t) PAGER_CHUNK_SIZE, pg->size - chunk_off);
+	while (pg->nchunks > 0 && pg->resident + len > pg->mem_cap)
+		pager_evict_lru(pg);
+
+	if (pg->nchunks == pg->chunkcap) {
+		pg->chunkcap = pg->chunkcap == 0 ? 8 : pg->chunkcap * 2;
+		pg->chunks = realloc(pg->chunks, sizeof(pg->chunks[0]) * pg->chunkcap);
+	}
+
+	char *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, pg->fd, chunk_off);
+	if (data == MAP_FAILED)
+		err(1, "mmap");
+
+	struct pager_chunk *c = &pg->chunks[pg->nchunks++];
+	*c = (struct pager_chunk) {
+		.off = chunk_off,
+		.len = len,
+		.data = data,
+		.last_used = pg->clock,
+	};
+	pg->resident += len;
+	return c;
+}
+
+static char pager_byte_at(struct pager *pg, off_t off) {
+	struct pager_chunk *c = pager_get_chunk(pg, off);
+	return c->data[off - c->off];
+}
+
+// offset just past the newline that ends the line containing `off`
+static off_t pager_next_line_start(struct pager *pg, off_t off) {
+	while (off < pg->size) {
+		struct pager_chunk *c = pager_get_chunk(pg, off);
+		char *p = c->data + (off - c->off);
+		size_t avail = c->len - (off - c->off);
+		char *nl = memchr(p, '\n', avail);
+		if (nl != NULL)
+			return off + (nl - p) + 1;
+		off += avail;
+	}
+	return pg->size;
+}
+
+// appends the line starting at `off` to `out`, and returns the offset of the next line
+off_t pager_read_line(struct pager *pg, off_t off, string_t *out) {
+	while (off < pg->size) {
+		struct pager_chunk *c = pager_get_chunk(pg, off);
+		char *p = c->data + (off - c->off);
+		size_t avail = c->len - (off - c->off);
+		char *nl = memchr(p, '\n', avail);
+		if (nl != NULL) {
+			string_append(out, (str_t) { .ptr = p, .len = nl - p });
+			return off + (nl - p) + 1;
+		}
+		string_append(out, (str_t) { .ptr = p, .len = avail });
+		off += avail;
+	}
+	return pg->size;
+}
+
+// `off` must be the start of a line (or the end of the file), and not 0
+off_t pager_prev_line_start(struct pager *pg, off_t off) {
+	off_t pos = off - 1;
+	if (pager_byte_at(pg, pos) == '\n')
+		pos -= 1;
+
+	while (pos >= 0) {
+		struct pager_chunk *c = pager_get_chunk(pg, pos);
+		char *nl = memrchr(c->data, '\n', pos - c->off + 1);
+		if (nl != NULL)
+			return c->off + (nl - c->data) + 1;
+		pos = c->off - 1;
+	}
+	return 0;
+}
+
+// the index came from the cache, but has to grow: switch to a private copy
+static void pager_unmap_index(struct pager *pg) {
+	pg->idx_cap = MAX(pg->idx_len * 2, 64);
+	off_t *idx = malloc(sizeof(idx[0]) * pg->idx_cap);
+	memcpy(idx, pg->idx, sizeof(idx[0]) * pg->idx_len);
+	munmap(pg->idx_map, pg->idx_map_len);
+	pg->idx_map = NULL;
+	pg->idx = idx;
+}
+
+// scans up to `budget` more bytes of the file for newlines.
+// returns nonzero if there is still more to index.
+int pager_index_step(struct pager *pg, size_t budget) {
+	static char scratch[1 << 16];
+
+	while (budget > 0 && !pg->index_complete) {
+		size_t want = MIN(sizeof(scratch), budget);
+		ssize_t nread = pread(pg->fd, scratch, want, pg->indexed_off);
+		if (nread == -1)
+			err(1, "pread");
+		if (nread == 0) {
+			// file was truncated under us
+			pg->index_complete = 1;
+			break;
+		}
+
+		char *p = scratch;
+		char *end = scratch + nread;
+		while ((p = memchr(p, '\n', end - p)) != NULL) {
+			p += 1;
+			pg->indexed_lines += 1;
+			off_t line_start = pg->indexed_off + (p - scratch);
+			if (pg->indexed_lines % PAGER_INDEX_STRIDE == 0) {
+				if (pg->idx_map != NULL)
+					pager_unmap_index(pg);
+				if (pg->idx_len == pg->idx_cap) {
+					pg->idx_cap *= 2;
+					pg->idx = realloc(pg->idx, sizeof(pg->idx[0]) * pg->idx_cap);
+				}
+				pg->idx[pg->idx_len++] = line_start;
+			}
+		}
+
+		pg->indexed_off += nread;
+		budget -= nread;
+		if (pg->indexed_off >= pg->size)
+			pg->index_complete = 1;
+	}
+
+	return !pg->index_complete;
+}
+
+// offset of the start of line `lineno` (1-based), or -1 if the file has fewer lines.
+// indexes as much of the file as needed to find out.
+off_t pager_line_offset(struct pager *pg, size_t lineno) {
+	if (lineno <= 1)
+		return 0;
+
+	while (pg->indexed_lines < lineno - 1 && pager_index_step(pg, PAGER_CHUNK_SIZE))
+		;
+
+	size_t k = (lineno - 1) / PAGER_INDEX_STRIDE;
+	if (pg->indexed_lines < lineno - 1 || k >= pg->idx_len)
+		return -1;
+
+	off_t off = pg->idx[k];
+	for (size_t skip = (lineno - 1) % PAGER_INDEX_STRIDE; skip > 0; skip--)
+		off = pager_next_line_start(pg, off);
+
+	return off < pg->size ? off : -1;
+}
+
+static size_t pager_count_newlines(struct pager *pg, off_t start, off_t end) {
+	size_t count = 0;
+	while (start < end) {
+		struct pager_chunk *c = pager_get_chunk(pg, start);
+		char *p = c->data + (start - c->off);
+		char *stop = c->data + MIN((off_t) c->len, end - c->off);
+		while ((p = memchr(p, '\n', stop - p)) != NULL) {
+			p += 1;
+			count += 1;
+		}
+		start = c->off + (stop - c->data);
+	}
+	return count;
+}
+
+// 1-based line number of the line starting at `off`, or 0 if that part
+// of the file hasn't been indexed yet.
+size_t pager_offset_line_no(struct pager *pg, off_t off) {
+	if (off > pg->indexed_off && !pg->index_complete)
+		return 0;
+
+	size_t lo = 0;
+	size_t hi = pg->idx_len;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (pg->idx[mid] <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo * PAGER_INDEX_STRIDE + 1 + pager_count_newlines(pg, pg->idx[lo], off);
+}
+
+// number of lines starting in [start, end). both must be line starts (or the end of the file).
+size_t pager_count_lines(struct pager *pg, off_t start, off_t end) {
+	if (start >= end)
+		return 0;
+
+	size_t n = pager_count_newlines(pg, start, end);
+	if (end == pg->size && pager_byte_at(pg, end - 1) != '\n')
+		n += 1;
+	return n;
+}
+
+void pager_add_edit(struct pager *pg, struct pager_edit edit) {
+	if (pg->nedits == pg->editcap) {
+		pg->editcap = pg->editcap == 0 ? 8 : pg->editcap * 2;
+		pg->edits = realloc(pg->edits, sizeof(pg->edits[0]) * pg->editcap);
+	}
+
+	size_t i = pg->nedits;
+	while (i > 0 && pg->edits[i - 1].start > edit.start) {
+		pg->edits[i] = pg->edits[i - 1];
+		i--;
+	}
+	pg->edits[i] = edit;
+	pg->nedits += 1;
+}
+
+struct pager_edit *pager_edit_starting_at(struct pager *pg, off_t off) {
+	for (size_t i = 0; i < pg->nedits; i++) {
+		if (pg->edits[i].start == off)
+			return &pg->edits[i];
+		if (pg->edits[i].start > off)
+			break;
+	}
+	return NULL;
+}
+
+struct pager_edit *pager_edit_ending_at(struct pager *pg, off_t off) {
+	for (size_t i = 0; i < pg->nedits; i++) {
+		if (pg->edits[i].end == off && pg->edits[i].start < off)
+			return &pg->edits[i];
+		if (pg->edits[i].start >= off)
+			break;
+	}
+	return NULL;
+}
+
+// removes `edit` from the pager. the caller takes ownership of `edit->lines`.
+void pager_take_edit(struct pager *pg, struct pager_edit *edit) {
+	size_t i = edit - pg->edits;
+	memmove(&pg->edits[i], &pg->edits[i + 1], sizeof(pg->edits[0]) * (pg->nedits - i - 1));
+	pg->nedits -= 1;
+}
+
+// how much the edits before `off` have shifted line numbers by
+long pager_line_delta_before(struct pager *pg, off_t off) {
+	long delta = 0;
+	for (size_t i = 0; i < pg->nedits && pg->edits[i].end <= off; i++)
+		delta += pg->edits[i].line_delta;
+	return delta;
+}
+
+// maps line number `lineno` of the edited file back onto the original file.
+// returns the edit whose replacement lines contain that line and sets `*n` to
+// the index into those lines, or returns NULL and sets `*n` to the original line number.
+struct pager_edit *pager_resolve_line(struct pager *pg, size_t lineno, size_t *n) {
+	long cum = 0;
+	for (size_t i = 0; i < pg->nedits; i++) {
+		struct pager_edit *e = &pg->edits[i];
+		size_t orig_first = pager_offset_line_no(pg, e->start);
+		if (orig_first == 0)
+			break;
+		size_t first = orig_first + cum;
+		size_t nrepl = pager_count_lines(pg, e->start, e->end) + e->line_delta;
+		if (lineno < first)
+			break;
+		if (lineno < first + nrepl) {
+			*n = lineno - first;
+			return e;
+		}
+		cum += e->line_delta;
+	}
+	*n = lineno - cum;
+	return NULL;
+}
@@ -0,0 +1,87 @@
+#ifndef __HAVE_PAGER_H
+#define __HAVE_PAGER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#include "bufline.h"
+#include "mf_string.h"
+
+// a PAGER_CHUNK_SIZE-aligned region of the file, mmap'd on demand
+struct pager_chunk {
+	off_t off;
+	size_t len;
+	char *data;
+	// value of pager->clock when this chunk was last touched
+	unsigned long last_used;
+};
+
+// replacement for the original bytes [start, end) of the file. created when
+// edited lines are evicted from a pane's window, and consumed again when the
+// window moves back over that range.
+struct pager_edit {
+	off_t start;
+	off_t end;
+	// replacement lines (may be NULL if the whole range was deleted)
+	struct bufline *lines;
+	// (number of replacement lines) - (number of original lines in range)
+	long line_delta;
+};
+
+// read-only view of a file that is too large to load into memory at once
+struct pager {
+	int fd;
+	off_t size;
+	// absolute path, and the identity of the file at the time it was opened
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+
+	struct pager_chunk *chunks;
+	size_t nchunks;
+	size_t chunkcap;
+	// bytes currently mapped
+	size_t resident;
+	// `resident` is kept below this
+	size_t mem_cap;
+	unsigned long clock;
+
+	// sparse line index: idx[k] is the offset of line number k*PAGER_INDEX_STRIDE + 1
+	off_t *idx;
+	size_t idx_len;
+	size_t idx_cap;
+	// bytes [0, indexed_off) have been scanned for newlines
+	off_t indexed_off;
+	// number of lines that start in [0, indexed_off)
+	size_t indexed_lines;
+	unsigned index_complete : 1;
+	// the complete index came from, or has been written to, the index cache
+	unsigned index_cached : 1;
+	// if `idx` points into a mapping of the index cache: the mapping
+	void *idx_map;
+	size_t idx_map_len;
+
+	// sorted by `start`, non-overlapping
+	struct pager_edit *edits;
+	size_t nedits;
+	size_t editcap;
+};
+
+[[nodiscard]] int pager_open(struct pager *pg, const char *path);
+void pager_close(struct pager *pg);
+void pager_set_size(struct pager *pg, off_t size);
+off_t pager_read_line(struct pager *pg, off_t off, string_t *out);
+off_t pager_prev_line_start(struct pager *pg, off_t off);
+int pager_index_step(struct pager *pg, size_t budget);
+off_t pager_line_offset(struct pager *pg, size_t lineno);
+size_t pager_offset_line_no(struct pager *pg, off_t off);
+size_t pager_count_lines(struct pager *pg, off_t start, off_t end);
+void pager_add_edit(struct pager *pg, struct pager_edit edit);
+struct pager_edit *pager_edit_starting_at(struct pager *pg, off_t off);
+struct pager_edit *pager_edit_ending_at(struct pager *pg, off_t off);
+void pager_take_edit(struct pager *pg, struct pager_edit *edit);
+struct pager_edit *pager_resolve_line(struct pager *pg, size_t lineno, size_t *n);
+long pager_line_delta_before(struct pager *pg, off_t off);
+
+#endif
@@ -0,0 +1,654 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "picker.h"
+
+// one line of a .gitignore
+struct ignore_rule {
+	// NUL-terminated, without the '!', leading '/' or trailing '/'
+	char *pat;
+	unsigned negate : 1;
+	unsigned dir_only : 1;
+	// matched against the path below the .gitignore's directory instead of just the name
+	unsigned anchored : 1;
+	// has a "**", so '*' may match across '/' too
+	unsigned deep : 1;
+};
+
+// the rules of one .gitignore, chained to the ones of the directories above it.
+// shared by all the directories below it, on any thread.
+struct ignore {
+	atomic_size_t refcount;
+	struct ignore *parent;
+	// directory of the .gitignore, relative to the root ("" for the root itself)
+	char *base;
+	size_t baselen;
+	struct ignore_rule *rules;
+	size_t nrules;
+};
+
+struct walk_dir {
+	// relative to the root, "" for the root itself
+	char *path;
+	struct ignore *ign;
+};
+
+static struct ignore *ignore_ref(struct ignore *ig) {
+	if (ig != NULL)
+		atomic_fetch_add(&ig->refcount, 1);
+	return ig;
+}
+
+static void ignore_release(struct ignore *ig) {
+	while (ig != NULL && atomic_fetch_sub(&ig->refcount, 1) == 1) {
+		struct ignore *parent = ig->parent;
+		for (size_t i = 0; i < ig->nrules; i++)
+			free(ig->rules[i].pat);
+		free(ig->rules);
+		free(ig->base);
+		free(ig);
+		ig = parent;
+	}
+}
+
+// returns 0 if the line is empty or a comment
+static int parse_ignore_line(str_t line, struct ignore_rule *out) {
+	while (line.len > 0 && (line.ptr[line.len - 1] == '\r' || line.ptr[line.len - 1] == ' '))
+		line.len--;
+	if (line.len == 0 || line.ptr[0] == '#')
+		return 0;
+
+	*out = (struct ignore_rule) { 0 };
+	if (line.ptr[0] == '!') {
+		out->negate = 1;
+		line.ptr++;
+		line.len--;
+	} else if (line.len > 1 && line.ptr[0] == '\\' && (line.ptr[1] == '!' || line.ptr[1] == '#')) {
+		line.ptr++;
+		line.len--;
+	}
+	if (line.len > 0 && line.ptr[line.len - 1] == '/') {
+		out->dir_only = 1;
+		line.len--;
+	}
+	// "**/x" is just "x" at any depth. "x/**" is everything in x, and since ignored
+	// directories aren't walked, that's the same as ignoring x itself.
+	while (line.len >= 3 && !memcmp(line.ptr, "**/", 3)) {
+		line.ptr += 3;
+		line.len -= 3;
+	}
+	if (line.len >= 3 && !memcmp(line.ptr + line.len - 3, "/**", 3)) {
+		line.len -= 3;
+		out->dir_only = 1;
+		out->anchored = 1;
+	}
+	if (memchr(line.ptr, '/', line.len) != NULL)
+		out->anchored = 1;
+	if (line.len > 0 && line.ptr[0] == '/') {
+		line.ptr++;
+		line.len--;
+	}
+	if (line.len == 0)
+		return 0;
+	out->deep = memmem(line.ptr, line.len, "**", 2) != NULL;
+	out->pat = strndup(line.ptr, line.len);
+	return 1;
+}
+
+// reads `dirfd`'s .gitignore. returns `parent` (with a new reference) if there is none.
+static struct ignore *ignore_load(int dirfd, const char *base, struct ignore *parent) {
+	int fd = openat(dirfd, ".gitignore", O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return ignore_ref(parent);
+	string_t contents = string_new();
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		string_append(&contents, (str_t) { .ptr = buf, .len = n });
+	close(fd);
+
+	struct ignore *ig = malloc(sizeof(struct ignore));
+	atomic_init(&ig->refcount, 1);
+	ig->parent = ignore_ref(parent);
+	ig->base = strdup(base);
+	ig->baselen = strlen(base);
+	ig->rules = NULL;
+	ig->nrules = 0;
+	size_t cap = 0;
+	str_t text = string_as_str(contents);
+	for (size_t pos = 0; pos < text.len; ) {
+		str_t line = str_slice_idx_to_eol(text, pos);
+		pos += line.len + 1;
+		struct ignore_rule rule;
+		if (!parse_ignore_line(line, &rule))
+			continue;
+		if (ig->nrules == cap) {
+			cap = MAX(cap * 2, (size_t) 8);
+			ig->rules = realloc(ig->rules, sizeof(ig->rules[0]) * cap);
+		}
+		ig->rules[ig->nrules++] = rule;
+	}
+	string_free(contents);
+	return ig;
+}
+
+// `path` is relative to the root and ends in `name`. the last rule that matches decides,
+// and the rules of a deeper .gitignore come after those of the ones above it.
+static int ignore_match(struct ignore *ig, const char *path, const char *name, int is_dir) {
+	for (; ig != NULL; ig = ig->parent) {
+		const char *sub = path + ig->baselen + (ig->baselen > 0);
+		for (size_t i = ig->nrules; i-- > 0; ) {
+			struct ignore_rule *r = &ig->rules[i];
+			if (r->dir_only && !is_dir)
+				continue;
+			if (fnmatch(r->pat, r->anchored ? sub : name, r->deep ? 0 : FNM_PATHNAME) == 0)
+				return !r->negate;
+		}
+	}
+	return 0;
+}
+
+// wakes up the main thread
+static void picker_notify(struct picker *pk) {
+	uint64_t one = 1;
+	(void) !write(pk->notify_fd, &one, sizeof(one));
+}
+
+static void picker_hand_over(struct picker *pk, str_t *files, size_t n) {
+	if (n == 0)
+		return;
+	pthread_mutex_lock(&pk->lock);
+	if (pk->nfound + n > pk->foundcap) {
+		pk->foundcap = MAX(pk->foundcap * 2, pk->nfound + n);
+		pk->found = realloc(pk->found, sizeof(pk->found[0]) * pk->foundcap);
+	}
+	memcpy(pk->found + pk->nfound, files, sizeof(files[0]) * n);
+	// the main thread takes everything at once, so one wakeup is enough
+	if (pk->nfound == 0)
+		picker_notify(pk);
+	pk->nfound += n;
+	pthread_mutex_unlock(&pk->lock);
+}
+
+static void picker_push_dirs(struct picker *pk, struct walk_dir *dirs, size_t n) {
+	if (n == 0)
+		return;
+	pthread_mutex_lock(&pk->lock);
+	if (pk->queuelen + n > pk->queuecap) {
+		pk->queuecap = MAX(pk->queuecap * 2, pk->queuelen + n);
+		pk->queue = realloc(pk->queue, sizeof(pk->queue[0]) * pk->queuecap);
+	}
+	memcpy(pk->queue + pk->queuelen, dirs, sizeof(dirs[0]) * n);
+	pk->queuelen += n;
+	pthread_cond_broadcast(&pk->cond);
+	pthread_mutex_unlock(&pk->lock);
+}
+
+static char *join_path(const char *dir, const char *name) {
+	size_t dirlen = strlen(dir);
+	size_t namelen = strlen(name);
+	char *ret = malloc(dirlen + namelen + 2);
+	if (dirlen > 0) {
+		memcpy(ret, dir, dirlen);
+		ret[dirlen++] = '/';
+	}
+	memcpy(ret + dirlen, name, namelen + 1);
+	return ret;
+}
+
+// lists one directory: its files go to the main thread, its subdirectories to the queue
+static void walk_one(struct picker *pk, struct walk_dir d) {
+	int fd = openat(pk->rootfd, d.path[0] != '\0' ? d.path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *dir = fd != -1 ? fdopendir(fd) : NULL;
+	if (dir == NULL) {
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+	struct ignore *ign = ignore_load(fd, d.path, d.ign);
+
+	str_t files[PICKER_BATCH_SIZE];
+	size_t nfiles = 0;
+	struct walk_dir *dirs = NULL;
+	size_t ndirs = 0;
+	size_t dircap = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL && !atomic_load(&pk->cancel)) {
+		const char *name = ent->d_name;
+		if (!strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, ".git"))
+			continue;
+
+		// symlinks are followed to files, but not to directories, which could loop
+		int is_dir = ent->d_type == DT_DIR;
+		int is_file = ent->d_type == DT_REG;
+		struct stat st;
+		if ((ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN) && fstatat(fd, name, &st, 0) == 0) {
+			is_file = S_ISREG(st.st_mode);
+			is_dir = ent->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+		}
+		if (!is_dir && !is_file)
+			continue;
+
+		char *path = join_path(d.path, name);
+		if (ignore_match(ign, path, name, is_dir)) {
+			free(path);
+			continue;
+		}
+		if (is_dir) {
+			if (ndirs == dircap) {
+				dircap = MAX(dircap * 2, (size_t) 16);
+				dirs = realloc(dirs, sizeof(dirs[0]) * dircap);
+			}
+			dirs[ndirs++] = (struct walk_dir) { .path = path, .ign = ignore_ref(ign) };
+			continue;
+		}
+		files[nfiles++] = (str_t) { .ptr = path, .len = strlen(path) };
+		if (nfiles == PICKER_BATCH_SIZE) {
+			picker_hand_over(pk, files, nfiles);
+			nfiles = 0;
+		}
+	}
+	closedir(dir);
+	picker_hand_over(pk, files, nfiles);
+	picker_push_dirs(pk, dirs, ndirs);
+	free(dirs);
+	ignore_release(ign);
+}
+
+static void *walker_main(void *arg) {
+	struct picker *pk = arg;
+	pthread_mutex_lock(&pk->lock);
+	for (;;) {
+		// the walk is over once the queue is empty and nobody is adding to it anymore
+		while (pk->queuelen == 0 && pk->busy > 0 && !atomic_load(&pk->cancel))
+			pthread_cond_wait(&pk->cond, &pk->lock);
+		if (pk->queuelen == 0 || atomic_load(&pk->cancel))
+			break;
+		struct walk_dir d = pk->queue[--pk->queuelen];
+		pk->busy++;
+		pthread_mutex_unlock(&pk->lock);
+
+		walk_one(pk, d);
+		free(d.path);
+		ignore_release(d.ign);
+
+		pthread_mutex_lock(&pk->lock);
+		pk->busy--;
+	}
+	pthread_cond_broadcast(&pk->cond);
+	pthread_mutex_unlock(&pk->lock);
+
+	if (atomic_fetch_sub(&pk->running, 1) == 1)
+		picker_notify(pk);
+	return NULL;
+}
+
+static int is_word_start(str_t s, size_t i) {
+	return i == 0 || strchr("/_-. ", s.ptr[i - 1]) != NULL;
+}
+
+// how well `query` fuzzy-matches `cand`: its characters have to appear in `cand` in
+// order (ignoring case). returns -1 if they don't, else a score that favors matches that
+// are close together, start words and are in the file name rather than the directory.
+int picker_score(str_t query, str_t cand) {
+	if (query.len == 0)
+		return 0;
+
+	// the first place the whole query fits...
+	size_t qi = 0;
+	size_t end = 0;
+	for (size_t i = 0; i < cand.len && qi < query.len; i++) {
+		if (tolower((unsigned char) cand.ptr[i]) == tolower((unsigned char) query.ptr[qi])) {
+			qi++;
+			end = i;
+		}
+	}
+	if (qi < query.len)
+		return -1;
+	// ...and then the shortest stretch ending there, found by going back
+	size_t start = end + 1;
+	for (qi = query.len; qi > 0; ) {
+		start--;
+		if (tolower((unsigned char) cand.ptr[start]) == tolower((unsigned char) query.ptr[qi - 1]))
+			qi--;
+	}
+
+	const char *slash = memrchr(cand.ptr, '/', cand.len);
+	size_t basename = slash != NULL ? slash - cand.ptr + 1 : 0;
+	int score = start >= basename ? 24 : 0;
+	size_t prev = start;
+	qi = 0;
+	for (size_t i = start; i <= end && qi < query.len; i++) {
+		if (tolower((unsigned char) cand.ptr[i]) != tolower((unsigned char) query.ptr[qi]))
+			continue;
+		score += 16;
+		if (qi > 0 && i == prev + 1)
+			score += 8;
+		else if (qi > 0)
+			score -= MIN((int) (i - prev - 1), 8);
+		if (is_word_start(cand, i))
+			score += i > 0 && cand.ptr[i - 1] == '/' ? 12 : 8;
+		if (cand.ptr[i] == query.ptr[qi])
+			score += 1;
+		prev = i;
+		qi++;
+	}
+	return MAX(score, 0);
+}
+
+// better matches first: higher score, then shorter path, then found earlier
+static int match_better(struct picker *pk, struct picker_match a, struct picker_match b) {
+	if (a.score != b.score)
+		return a.score > b.score;
+	if (pk->cands[a.cand].len != pk->cands[b.cand].len)
+		return pk->cands[a.cand].len < pk->cands[b.cand].len;
+	return a.cand < b.cand;
+}
+
+static void picker_top_insert(struct picker *pk, struct picker_match m) {
+	size_t n = pk->topcap;
+	if (n == 0 || (pk->ntop == n && !match_better(pk, m, pk->top[n - 1])))
+		return;
+	size_t j = pk->ntop < n ? pk->ntop++ : n - 1;
+	for (; j > 0 && match_better(pk, m, pk->top[j - 1]); j--)
+		pk->top[j] = pk->top[j - 1];
+	pk->top[j] = m;
+}
+
+static void picker_add_match(struct picker *pk, size_t cand, int score) {
+	if (pk->nmatches == pk->matchcap) {
+		pk->matchcap = MAX(pk->matchcap * 2, (size_t) 1024);
+		pk->matches = realloc(pk->matches, sizeof(pk->matches[0]) * pk->matchcap);
+	}
+	struct picker_match m = { .cand = cand, .score = score };
+	pk->matches[pk->nmatches++] = m;
+	if (pk->top_valid)
+		picker_top_insert(pk, m);
+}
+
+// starts walking `root` with `nthreads` threads (or on this thread, before returning,
+// if none can be started)
+int picker_start(struct picker *pk, const char *root, size_t nthreads) {
+	pk->rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (pk->rootfd == -1)
+		return -1;
+	pk->notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pk->notify_fd == -1) {
+		close(pk->rootfd);
+		return -1;
+	}
+	pthread_mutex_init(&pk->lock, NULL);
+	pthread_cond_init(&pk->cond, NULL);
+	pk->queue = malloc(sizeof(pk->queue[0]));
+	pk->queue[0] = (struct walk_dir) { .path = strdup(""), .ign = NULL };
+	pk->queuelen = 1;
+	pk->queuecap = 1;
+	pk->busy = 0;
+	pk->found = NULL;
+	pk->nfound = 0;
+	pk->foundcap = 0;
+	atomic_init(&pk->cancel, 0);
+	pk->cands = NULL;
+	pk->ncands = 0;
+	pk->candcap = 0;
+	pk->walk_done = 0;
+	pk->query = string_new();
+	pk->matches = NULL;
+	pk->nmatches = 0;
+	pk->matchcap = 0;
+	pk->top = NULL;
+	pk->ntop = 0;
+	pk->topcap = 0;
+	pk->top_valid = 0;
+	pk->selected = 0;
+
+	pk->threads = calloc(MAX(nthreads, (size_t) 1), sizeof(pk->threads[0]));
+	pk->nthreads = 0;
+	atomic_init(&pk->running, MAX(nthreads, (size_t) 1));
+	for (size_t i = 0; i < nthreads; i++) {
+		if (pthread_create(&pk->threads[i], NULL, walker_main, pk) != 0) {
+			atomic_fetch_sub(&pk->running, nthreads - i);
+			break;
+		}
+		pk->nthreads++;
+	}
+	if (pk->nthreads == 0) {
+		atomic_store(&pk->running, 1);
+		walker_main(pk);
+	}
+	return 0;
+}
+
+// takes in the files the walkers have found since the last call
+void picker_collect(struct picker *pk) {
+	uint64_t count;
+	(void) !read(pk->notify_fd, &count, sizeof(count));
+	// checked first: once the walkers are all gone, everything they found is in `found`
+	int done = atomic_load(&pk->running) == 0;
+
+	pthread_mutex_lock(&pk->lock);
+	str_t *found = pk->found;
+	size_t nfound = pk->nfound;
+	pk->found = NULL;
+	pk->nfound = 0;
+	pk->foundcap = 0;
+	pthread_mutex_unlock(&pk->lock);
+
+	if (pk->ncands + nfound > pk->candcap) {
+		pk->candcap = MAX(pk->candcap * 2, pk->ncands + nfound);
+		pk->cands = realloc(pk->cands, sizeof(pk->cands[0]) * pk->candcap);
+	}
+	for (size_t i = 0; i < nfound; i++) {
+		pk->cands[pk->ncands] = found[i];
+		int score = picker_score(string_as_str(pk->query), found[i]);
+		if (score >= 0)
+			picker_add_match(pk, pk->ncands, score);
+		pk->ncands++;
+	}
+	free(found);
+	if (done)
+		pk->walk_done = 1;
+}
+
+// whether every string that matches `b` also matches `a`
+static int is_subsequence(str_t a, str_t b) {
+	size_t i = 0;
+	for (size_t j = 0; i < a.len && j < b.len; j++) {
+		if (tolower((unsigned char) a.ptr[i]) == tolower((unsigned char) b.ptr[j]))
+			i++;
+	}
+	return i == a.len;
+}
+
+// when the query only gets narrower (e.g. a character is typed), nothing that didn't
+// match before can match now, so only the current matches are scored again
+void picker_set_query(struct picker *pk, str_t query) {
+	if (str_eq(string_as_str(pk->query), query))
+		return;
+	pk->top_valid = 0;
+
+	if (is_subsequence(string_as_str(pk->query), query)) {
+		size_t n = 0;
+		for (size_t i = 0; i < pk->nmatches; i++) {
+			int score = picker_score(query, pk->cands[pk->matches[i].cand]);
+			if (score >= 0)
+				pk->matches[n++] = (struct picker_match) { .cand = pk->matches[i].cand, .score = score };
+		}
+		pk->nmatches = n;
+	} else {
+		pk->nmatches = 0;
+		for (size_t i = 0; i < pk->ncands; i++) {
+			int score = picker_score(query, pk->cands[i]);
+			if (score >= 0)
+				picker_add_match(pk, i, score);
+		}
+	}
+
+	string_clear(&pk->query);
+	string_append(&pk->query, query);
+	pk->selected = 0;
+}
+
+// puts the best `n` matches into `top`, without sorting all of them. returns how many
+// there are.
+size_t picker_rank(struct picker *pk, size_t n) {
+	if (!pk->top_valid || pk->topcap != n) {
+		pk->top = realloc(pk->top, sizeof(pk->top[0]) * MAX(n, (size_t) 1));
+		pk->topcap = n;
+		pk->ntop = 0;
+		for (size_t i = 0; i < pk->nmatches; i++)
+			picker_top_insert(pk, pk->matches[i]);
+		pk->top_valid = 1;
+	}
+	if (pk->selected >= pk->ntop)
+		pk->selected = pk->ntop > 0 ? pk->ntop - 1 : 0;
+	return pk->ntop;
+}
+
+void picker_free(struct picker *pk) {
+	atomic_store(&pk->cancel, 1);
+	pthread_mutex_lock(&pk->lock);
+	pthread_cond_broadcast(&pk->cond);
+	pthread_mutex_unlock(&pk->lock);
+	for (size_t i = 0; i < pk->nthreads; i++)
+		pthread_join(pk->threads[i], NULL);
+	free(pk->threads);
+
+	for (size_t i = 0; i < pk->queuelen; i++) {
+		free(pk->queue[i].path);
+		ignore_release(pk->queue[i].ign);
+	}
+	free(pk->queue);
+	for (size_t i = 0; i < pk->nfound; i++)
+		free((char *) pk->found[i].ptr);
+	free(pk->found);
+	for (size_t i = 0; i < pk->ncands; i++)
+		free((char *) pk->cands[i].ptr);
+	free(pk->cands);
+	free(pk->matches);
+	free(pk->top);
+	string_free(pk->query);
+	pthread_mutex_destroy(&pk->lock);
+	pthread_cond_destroy(&pk->cond);
+	close(pk->notify_fd);
+	close(pk->rootfd);
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+
+static void write_test_file(const char *dir, const char *name, const char *contents) {
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen(path, "w");
+	assert(f != NULL);
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void picker_walk_all(struct picker *pk) {
+	while (!pk->walk_done) {
+		struct pollfd pfd = { .fd = pk->notify_fd, .events = POLLIN };
+		assert(poll(&pfd, 1, 5000) == 1);
+		picker_collect(pk);
+	}
+}
+
+static int picker_has(struct picker *pk, const char *path) {
+	for (size_t i = 0; i < pk->ncands; i++) {
+		if (str_eq(pk->cands[i], cstr_as_str((char *) path)))
+			return 1;
+	}
+	return 0;
+}
+
+void picker_run_tests(void) {
+	assert(picker_score(STR("abc"), STR("xaxbxc")) > 0);
+	assert(picker_score(STR("abc"), STR("acb")) == -1);
+	assert(picker_score(STR("ABC"), STR("abc")) > 0);
+	assert(picker_score(STR(""), STR("anything")) == 0);
+	// consecutive beats scattered, the file name beats the directory
+	assert(picker_score(STR("edit"), STR("editor.c")) > picker_score(STR("edit"), STR("e_d_i_t.c")));
+	assert(picker_score(STR("main"), STR("src/main.c")) > picker_score(STR("main"), STR("main/x.c")));
+	// the tightest place is scored, not the first one
+	assert(picker_score(STR("ab"), STR("a/x/ab")) == picker_score(STR("ab"), STR("y/x/ab")));
+
+	struct ignore_rule r;
+	assert(!parse_ignore_line(STR("# comment"), &r));
+	assert(!parse_ignore_line(STR("   "), &r));
+	assert(parse_ignore_line(STR("!/build/  "), &r) && r.negate && r.dir_only && r.anchored && !strcmp(r.pat, "build"));
+	free(r.pat);
+	assert(parse_ignore_line(STR("**/*.o"), &r) && !r.anchored && !strcmp(r.pat, "*.o"));
+	free(r.pat);
+	assert(parse_ignore_line(STR("a/**/b"), &r) && r.anchored && r.deep);
+	free(r.pat);
+
+	char dir[] = "/tmp/mf-picker-XXXXXX";
+	test_tmpdir_create(dir);
+	char sub[64];
+	const char *dirs[] = { "build", "sub", "sub/deep", ".git" };
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		snprintf(sub, sizeof(sub), "%s/%s", dir, dirs[i]);
+		assert(mkdir(sub, 0700) == 0);
+	}
+	write_test_file(dir, ".gitignore", "*.o\nbuild/\n/top.txt\n!keep.o\n");
+	write_test_file(dir, "a.c", "");
+	write_test_file(dir, "a.o", "");
+	write_test_file(dir, "keep.o", "");
+	write_test_file(dir, "top.txt", "");
+	write_test_file(dir, "build/x.c", "");
+	write_test_file(dir, "sub/top.txt", "");
+	write_test_file(dir, "sub/b.c", "");
+	write_test_file(dir, "sub/x.o", "");
+	write_test_file(dir, "sub/.gitignore", "b.c\n!x.o\n");
+	write_test_file(dir, "sub/deep/c.c", "");
+	write_test_file(dir, ".git/config", "");
+
+	struct picker pk;
+	assert(picker_start(&pk, dir, 3) == 0);
+	picker_walk_all(&pk);
+	assert(pk.ncands == 7);
+	assert(picker_has(&pk, ".gitignore"));
+	assert(picker_has(&pk, "a.c"));
+	assert(picker_has(&pk, "keep.o"));
+	assert(picker_has(&pk, "sub/top.txt"));
+	assert(picker_has(&pk, "sub/x.o"));
+	assert(picker_has(&pk, "sub/.gitignore"));
+	assert(picker_has(&pk, "sub/deep/c.c"));
+	assert(pk.nmatches == 7);
+
+	// narrowing only looks at what matched before, widening at everything
+	picker_set_query(&pk, STR("c"));
+	assert(pk.nmatches == 2);
+	picker_set_query(&pk, STR("cc"));
+	assert(pk.nmatches == 1);
+	assert(picker_rank(&pk, 10) == 1);
+	assert(str_eq(pk.cands[pk.top[0].cand], STR("sub/deep/c.c")));
+	picker_set_query(&pk, STR("p.o"));
+	assert(pk.nmatches == 1);
+	assert(picker_rank(&pk, 1) == 1);
+	assert(str_eq(pk.cands[pk.top[0].cand], STR("keep.o")));
+	picker_set_query(&pk, STR(""));
+	assert(picker_rank(&pk, 3) == 3);
+	assert(pk.top[0].score == 0 && pk.cands[pk.top[0].cand].len == 3);
+	picker_free(&pk);
+
+	// walking on the calling thread
+	assert(picker_start(&pk, dir, 0) == 0);
+	picker_walk_all(&pk);
+	assert(pk.ncands == 7);
+	picker_free(&pk);
+
+	test_tmpdir_remove(dir);
+}
+#endif
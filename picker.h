@@ -0,0 +1,69 @@
+#ifndef __HAVE_PICKER_H
+#define __HAVE_PICKER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "mf_string.h"
+
+struct walk_dir;
+
+// a candidate that matches the query, and how well
+struct picker_match {
+	size_t cand;
+	int score;
+};
+
+// file picker for :open. the tree under `root` is walked on worker threads, which hand
+// over the files they find in batches; the main thread takes them in with
+// picker_collect() and keeps `matches` up to date with the query as they arrive.
+struct picker {
+	// shared with the walker threads, under `lock`
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// directories still to be read
+	struct walk_dir *queue;
+	size_t queuelen;
+	size_t queuecap;
+	// threads reading a directory right now
+	size_t busy;
+	// files found that haven't been collected yet
+	str_t *found;
+	size_t nfound;
+	size_t foundcap;
+	atomic_int cancel;
+	// eventfd that becomes readable when there are files to collect, or the walk is over
+	int notify_fd;
+	int rootfd;
+	pthread_t *threads;
+	size_t nthreads;
+	atomic_size_t running;
+
+	// main thread only. candidate paths are relative to the root.
+	str_t *cands;
+	size_t ncands;
+	size_t candcap;
+	unsigned walk_done : 1;
+	string_t query;
+	// the candidates that match `query`, unordered
+	struct picker_match *matches;
+	size_t nmatches;
+	size_t matchcap;
+	// the best `topcap` matches, best first. only valid while `top_valid` is set; new
+	// candidates are merged in as they are collected.
+	struct picker_match *top;
+	size_t ntop;
+	size_t topcap;
+	unsigned top_valid : 1;
+	// index into `top` of the highlighted entry
+	size_t selected;
+};
+
+int picker_score(str_t query, str_t cand);
+[[nodiscard]] int picker_start(struct picker *pk, const char *root, size_t nthreads);
+void picker_collect(struct picker *pk);
+void picker_set_query(struct picker *pk, str_t query);
+size_t picker_rank(struct picker *pk, size_t n);
+void picker_free(struct picker *pk);
+
+#endif
@@ -0,0 +1,312 @@
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "config.h"
+#include "pool.h"
+
+// `maxthreads` 0 runs every job right away on the submitting thread
+int pool_init(struct pool *p, size_t maxthreads) {
+	p->notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (p->notify_fd == -1)
+		return -1;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	for (int i = 0; i < POOL_NPRIOS; i++) {
+		p->queue_head[i] = NULL;
+		p->queue_tail[i] = NULL;
+	}
+	p->nqueued = 0;
+	p->stop = 0;
+	p->threads = calloc(MAX(maxthreads, 1), sizeof(p->threads[0]));
+	p->nthreads = 0;
+	p->maxthreads = maxthreads;
+	p->idle = 0;
+	atomic_init(&p->done_stub.done_next, NULL);
+	atomic_init(&p->done_head, &p->done_stub);
+	p->done_tail = &p->done_stub;
+	p->outstanding = 0;
+	return 0;
+}
+
+static void push_done(struct pool *p, struct pool_job *job) {
+	atomic_store_explicit(&job->done_next, NULL, memory_order_relaxed);
+	struct pool_job *prev = atomic_exchange_explicit(&p->done_head, job, memory_order_acq_rel);
+	// until this store, the queue is cut off after `prev`, and pop_done() sees it as
+	// ending there
+	atomic_store_explicit(&prev->done_next, job, memory_order_release);
+}
+
+// main thread only. returns NULL if the queue is empty, or if a worker is in the middle
+// of pushing; that worker's wakeup is still to come then.
+static struct pool_job *pop_done(struct pool *p) {
+	struct pool_job *tail = p->done_tail;
+	struct pool_job *next = atomic_load_explicit(&tail->done_next, memory_order_acquire);
+	if (tail == &p->done_stub) {
+		if (next == NULL)
+			return NULL;
+		p->done_tail = next;
+		tail = next;
+		next = atomic_load_explicit(&tail->done_next, memory_order_acquire);
+	}
+	if (next != NULL) {
+		p->done_tail = next;
+		return tail;
+	}
+	if (tail != atomic_load_explicit(&p->done_head, memory_order_acquire))
+		return NULL;
+	// `tail` is the last job. the stub goes behind it so that it can be taken out.
+	push_done(p, &p->done_stub);
+	next = atomic_load_explicit(&tail->done_next, memory_order_acquire);
+	if (next != NULL) {
+		p->done_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static void finish_job(struct pool *p, struct pool_job *job) {
+	if (!pool_job_cancelled(job))
+		job->run(job);
+	push_done(p, job);
+	uint64_t one = 1;
+	(void) !write(p->notify_fd, &one, sizeof(one));
+}
+
+static void *worker_main(void *arg) {
+	struct pool *p = arg;
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		struct pool_job *job = NULL;
+		for (int prio = 0; prio < POOL_NPRIOS && job == NULL; prio++) {
+			job = p->queue_head[prio];
+			if (job != NULL) {
+				p->queue_head[prio] = job->next;
+				if (job->next == NULL)
+					p->queue_tail[prio] = NULL;
+			}
+		}
+		if (job == NULL) {
+			if (p->stop)
+				break;
+			p->idle++;
+			pthread_cond_wait(&p->cond, &p->lock);
+			p->idle--;
+			continue;
+		}
+		p->nqueued--;
+		pthread_mutex_unlock(&p->lock);
+		finish_job(p, job);
+		pthread_mutex_lock(&p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+// main thread only. the job goes behind the ones of the same priority. threads are
+// started as long as there are more queued jobs than idle threads.
+void pool_submit(struct pool *p, struct pool_job *job) {
+	atomic_init(&job->cancelled, 0);
+	job->next = NULL;
+	p->outstanding++;
+
+	pthread_mutex_lock(&p->lock);
+	if (p->nthreads == 0 && p->maxthreads > 0) {
+		if (pthread_create(&p->threads[0], NULL, worker_main, p) == 0)
+			p->nthreads = 1;
+		else
+			p->maxthreads = 0;
+	}
+	if (p->nthreads == 0) {
+		pthread_mutex_unlock(&p->lock);
+		finish_job(p, job);
+		return;
+	}
+
+	if (p->queue_tail[job->prio] != NULL)
+		p->queue_tail[job->prio]->next = job;
+	else
+		p->queue_head[job->prio] = job;
+	p->queue_tail[job->prio] = job;
+	p->nqueued++;
+	// a thread that can't be started just leaves the job to the others
+	if (p->nqueued > p->idle && p->nthreads < p->maxthreads) {
+		if (pthread_create(&p->threads[p->nthreads], NULL, worker_main, p) == 0)
+			p->nthreads++;
+		else
+			p->maxthreads = p->nthreads;
+	}
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+// the job won't start if it hasn't yet. one that is running goes on until it checks
+// pool_job_cancelled(). either way, its `done` is still called.
+void pool_cancel(struct pool_job *job) {
+	atomic_store(&job->cancelled, 1);
+}
+
+int pool_job_cancelled(struct pool_job *job) {
+	return atomic_load(&job->cancelled);
+}
+
+// main thread only: calls `done` for every job that has finished. returns how many.
+size_t pool_drain(struct pool *p) {
+	uint64_t count;
+	(void) !read(p->notify_fd, &count, sizeof(count));
+	size_t n = 0;
+	struct pool_job *job;
+	while ((job = pop_done(p)) != NULL) {
+		p->outstanding--;
+		job->done(job);
+		n++;
+	}
+	return n;
+}
+
+// main thread only: sleeps until a job finishes, and drains
+void pool_wait(struct pool *p) {
+	while (p->outstanding > 0 && pool_drain(p) == 0) {
+		struct pollfd pfd = { .fd = p->notify_fd, .events = POLLIN };
+		(void) poll(&pfd, 1, -1);
+	}
+}
+
+// jobs that haven't started are cancelled. every `done` is called before this returns.
+void pool_free(struct pool *p) {
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	for (int prio = 0; prio < POOL_NPRIOS; prio++) {
+		for (struct pool_job *job = p->queue_head[prio]; job != NULL; job = job->next)
+			pool_cancel(job);
+	}
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	for (size_t i = 0; i < p->nthreads; i++)
+		pthread_join(p->threads[i], NULL);
+	(void) pool_drain(p);
+
+	free(p->threads);
+	close(p->notify_fd);
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+struct test_job {
+	struct pool_job job;
+	// the order the jobs ran in, shared by all of them
+	int *order;
+	atomic_int *nran;
+	int id;
+	int ran;
+	int done;
+	// a job can hold its thread until this is set
+	atomic_int *gate;
+};
+
+static void test_run(struct pool_job *job) {
+	struct test_job *t = (struct test_job *) job;
+	if (t->gate != NULL) {
+		while (!atomic_load(t->gate))
+			usleep(1000);
+	}
+	t->order[atomic_fetch_add(t->nran, 1)] = t->id;
+	t->ran = 1;
+}
+
+static void test_done(struct pool_job *job) {
+	((struct test_job *) job)->done++;
+}
+
+void pool_run_tests(void) {
+	struct pool p;
+	int order[1000];
+	atomic_int nran;
+	atomic_int gate;
+
+	// one thread: while it is held up, the queue builds up, and the visible job is taken
+	// before the background one submitted before it. the cancelled one never runs.
+	assert(pool_init(&p, 1) == 0);
+	atomic_init(&nran, 0);
+	atomic_init(&gate, 0);
+	struct test_job jobs[4];
+	for (int i = 0; i < 4; i++) {
+		jobs[i] = (struct test_job) {
+			.job = { .run = test_run, .done = test_done, .prio = POOL_PRIO_BACKGROUND },
+			.order = order,
+			.nran = &nran,
+			.id = i,
+		};
+	}
+	jobs[0].gate = &gate;
+	jobs[2].job.prio = POOL_PRIO_VISIBLE;
+	pool_submit(&p, &jobs[0].job);
+	for (;;) {
+		pthread_mutex_lock(&p.lock);
+		size_t nqueued = p.nqueued;
+		pthread_mutex_unlock(&p.lock);
+		if (nqueued == 0)
+			break;
+		usleep(1000);
+	}
+	for (int i = 1; i < 4; i++)
+		pool_submit(&p, &jobs[i].job);
+	pool_cancel(&jobs[3].job);
+	assert(pool_drain(&p) == 0);
+	atomic_store(&gate, 1);
+	while (p.outstanding > 0)
+		pool_wait(&p);
+	assert(atomic_load(&nran) == 3);
+	assert(order[0] == 0 && order[1] == 2 && order[2] == 1);
+	assert(!jobs[3].ran);
+	for (int i = 0; i < 4; i++)
+		assert(jobs[i].done == 1);
+	pool_free(&p);
+
+	// many threads posting back at once
+	assert(pool_init(&p, 8) == 0);
+	atomic_init(&nran, 0);
+	struct test_job *many = calloc(1000, sizeof(many[0]));
+	for (int i = 0; i < 1000; i++) {
+		many[i] = (struct test_job) {
+			.job = { .run = test_run, .done = test_done, .prio = i % POOL_NPRIOS },
+			.order = order,
+			.nran = &nran,
+			.id = i,
+		};
+		pool_submit(&p, &many[i].job);
+	}
+	while (p.outstanding > 0)
+		pool_wait(&p);
+	assert(atomic_load(&nran) == 1000);
+	for (int i = 0; i < 1000; i++)
+		assert(many[i].ran && many[i].done == 1);
+	assert(p.nthreads >= 1 && p.nthreads <= 8);
+
+	// cancelled on the way out
+	atomic_store(&nran, 0);
+	atomic_init(&gate, 0);
+	many[0].gate = &gate;
+	many[0].done = 0;
+	pool_submit(&p, &many[0].job);
+	many[1].done = 0;
+	pool_submit(&p, &many[1].job);
+	atomic_store(&gate, 1);
+	pool_free(&p);
+	assert(many[0].done == 1 && many[1].done == 1);
+	free(many);
+
+	// without threads, jobs run inside pool_submit()
+	assert(pool_init(&p, 0) == 0);
+	atomic_init(&nran, 0);
+	jobs[0].gate = NULL;
+	jobs[0].done = 0;
+	pool_submit(&p, &jobs[0].job);
+	assert(atomic_load(&nran) == 1 && p.outstanding == 1);
+	assert(pool_drain(&p) == 1 && jobs[0].done == 1);
+	pool_free(&p);
+}
+#endif
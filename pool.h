@@ -0,0 +1,67 @@
+#ifndef __HAVE_POOL_H
+#define __HAVE_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// a fixed set of worker threads shared by everything that runs in the background. jobs
+// are queued by priority; when one has run, it is posted back to the main thread through
+// a lock-free queue, and its `done` callback is called from pool_drain().
+
+enum pool_prio {
+	// the result shows up on screen as soon as it's there
+	POOL_PRIO_VISIBLE,
+	POOL_PRIO_BACKGROUND,
+	POOL_NPRIOS,
+};
+
+struct pool_job {
+	// called on a worker thread. long jobs should check pool_job_cancelled() now and then.
+	void (*run)(struct pool_job *job);
+	// called on the main thread once `run` has returned, or instead of it if the job was
+	// cancelled before it started. the job isn't touched by the pool afterwards.
+	void (*done)(struct pool_job *job);
+	enum pool_prio prio;
+	atomic_int cancelled;
+	// the job's next one in the queue of its priority (under the pool's lock)
+	struct pool_job *next;
+	// the job's next one in the queue of finished jobs
+	_Atomic(struct pool_job *) done_next;
+};
+
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// jobs not started yet, oldest first
+	struct pool_job *queue_head[POOL_NPRIOS];
+	struct pool_job *queue_tail[POOL_NPRIOS];
+	size_t nqueued;
+	int stop;
+	// threads are started as jobs come in, up to `maxthreads`
+	pthread_t *threads;
+	size_t nthreads;
+	size_t maxthreads;
+	// threads waiting for a job
+	size_t idle;
+
+	// finished jobs. workers push at `done_head`, the main thread pops at `done_tail`.
+	// `done_stub` keeps the queue from ever being empty, so pushing is a single exchange.
+	_Atomic(struct pool_job *) done_head;
+	struct pool_job *done_tail;
+	struct pool_job done_stub;
+	// eventfd that becomes readable when there are finished jobs
+	int notify_fd;
+	// main thread only: jobs submitted whose `done` hasn't been called yet
+	size_t outstanding;
+};
+
+[[nodiscard]] int pool_init(struct pool *p, size_t maxthreads);
+void pool_free(struct pool *p);
+void pool_submit(struct pool *p, struct pool_job *job);
+void pool_cancel(struct pool_job *job);
+int pool_job_cancelled(struct pool_job *job);
+size_t pool_drain(struct pool *p);
+void pool_wait(struct pool *p);
+
+#endif
@@ -15,44 +15,216 @@
 #define G_BYTE(color) ((color >> 8) & 0xFF)
 #define B_BYTE(color) (color & 0xFF)
 
-void framebuf_display(struct framebuf *fb) {
-	fwrite(RESET_FRAME, 1, strlen(RESET_FRAME), stdout);
+static enum color_depth color_depth = COLOR_DEPTH_TRUE;
 
-	struct pixel prevpx;
+// the 16 colors as xterm shows them by default. other terminals are close enough.
+static const uint32_t ansi_colors[16] = {
+	0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+	0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+};
 
-	for (int y = 0; y < fb->height; y++) {
-		for (int x = 0; x < fb->width; x++) {
-			struct pixel pixel = fb->buf[y * fb->width + x];
-			char colorbuf[sizeof("\033[38;2;XXX;XXX;XXXm")];
+static const uint32_t palette[] = { PALETTE_COLORS };
+// what each of `palette` is sent as at `color_depth` (unused with true color)
+static uint32_t palette_codes[sizeof(palette) / sizeof(palette[0])];
 
-			// foreground
-			if ((x == 0 && y == 0) || prevpx.style.fg != pixel.style.fg) {
-				snprintf(colorbuf, sizeof(colorbuf), "\033[38;2;%d;%d;%dm", R_BYTE(pixel.style.fg), G_BYTE(pixel.style.fg), B_BYTE(pixel.style.fg));
-				fwrite(colorbuf, 1, strlen(colorbuf), stdout);
-			}
+// from $MF_COLORS (16, 256 or truecolor) if it is set to one of those, else from what
+// $COLORTERM and $TERM say. terminals that say nothing get 16 colors.
+enum color_depth render_detect_color_depth(void) {
+	const char *force = getenv("MF_COLORS");
+	if (force != NULL && !strcmp(force, "16"))
+		return COLOR_DEPTH_16;
+	if (force != NULL && !strcmp(force, "256"))
+		return COLOR_DEPTH_256;
+	if (force != NULL && (!strcmp(force, "truecolor") || !strcmp(force, "24bit")))
+		return COLOR_DEPTH_TRUE;
 
-			// background
-			if ((x == 0 && y == 0) || prevpx.style.bg != pixel.style.bg) {
-				snprintf(colorbuf, sizeof(colorbuf), "\033[48;2;%d;%d;%dm", R_BYTE(pixel.style.bg), G_BYTE(pixel.style.bg), B_BYTE(pixel.style.bg));
-				fwrite(colorbuf, 1, strlen(colorbuf), stdout);
-			}
+	const char *colorterm = getenv("COLORTERM");
+	if (colorterm != NULL && (!strcmp(colorterm, "truecolor") || !strcmp(colorterm, "24bit")))
+		return COLOR_DEPTH_TRUE;
+	const char *term = getenv("TERM");
+	if (term == NULL)
+		return COLOR_DEPTH_16;
+	if (strstr(term, "-direct") != NULL)
+		return COLOR_DEPTH_TRUE;
+	if (strstr(term, "256color") != NULL)
+		return COLOR_DEPTH_256;
+	return COLOR_DEPTH_16;
+}
 
-			fwrite(&pixel.ch, 1, 1, stdout);
-			prevpx = pixel;
+// the color at `idx` of the 256 color palette: the 16 colors, a 6x6x6 cube, then 24 grays
+static uint32_t xterm256_color(int idx) {
+	static const uint32_t levels[6] = { 0, 95, 135, 175, 215, 255 };
+	if (idx < 16)
+		return ansi_colors[idx];
+	if (idx < 232) {
+		idx -= 16;
+		return levels[idx / 36] << 16 | levels[idx / 6 % 6] << 8 | levels[idx % 6];
+	}
+	uint32_t v = 8 + 10 * (idx - 232);
+	return v << 16 | v << 8 | v;
+}
+
+static uint32_t color_dist(uint32_t a, uint32_t b) {
+	int dr = (int) R_BYTE(a) - (int) R_BYTE(b);
+	int dg = (int) G_BYTE(a) - (int) G_BYTE(b);
+	int db = (int) B_BYTE(a) - (int) B_BYTE(b);
+	return dr * dr + dg * dg + db * db;
+}
+
+// the index of the color nearest to `rgb` that a terminal with `depth` has. with 256
+// colors, the first 16 are left out, because terminals' color schemes change them.
+static uint32_t nearest_color(uint32_t rgb, enum color_depth depth) {
+	int first = depth == COLOR_DEPTH_256 ? 16 : 0;
+	int end = depth == COLOR_DEPTH_256 ? 256 : 16;
+	int best = first;
+	uint32_t best_dist = UINT32_MAX;
+	for (int i = first; i < end; i++) {
+		uint32_t dist = color_dist(rgb, xterm256_color(i));
+		if (dist < best_dist) {
+			best = i;
+			best_dist = dist;
 		}
 	}
+	return best;
+}
+
+void render_set_color_depth(enum color_depth depth) {
+	color_depth = depth;
+	if (depth == COLOR_DEPTH_TRUE)
+		return;
+	for (size_t i = 0; i < sizeof(palette) / sizeof(palette[0]); i++)
+		palette_codes[i] = nearest_color(palette[i], depth);
+}
+
+// `rgb` as it is sent to the terminal: itself with true color, else a palette index
+static uint32_t color_code(uint32_t rgb) {
+	if (color_depth == COLOR_DEPTH_TRUE)
+		return rgb;
+	for (size_t i = 0; i < sizeof(palette) / sizeof(palette[0]); i++) {
+		if (palette[i] == rgb)
+			return palette_codes[i];
+	}
+	return nearest_color(rgb, color_depth);
+}
 
+// writes the SGR parameters that set the foreground (or the background) to `code`,
+// followed by a ';'
+static int put_color(char *buf, int bg, uint32_t code) {
+	switch (color_depth) {
+	case COLOR_DEPTH_16:
+		return sprintf(buf, "%u;", (bg ? 40 : 30) + (code & 7) + (code >= 8 ? 60 : 0));
+	case COLOR_DEPTH_256:
+		return sprintf(buf, "%d;5;%u;", bg ? 48 : 38, code);
+	case COLOR_DEPTH_TRUE:
+		break;
+	}
+	return sprintf(buf, "%d;2;%u;%u;%u;", bg ? 48 : 38, R_BYTE(code), G_BYTE(code), B_BYTE(code));
+}
+
+// what the terminal was last told to draw with
+struct sgr_state {
+	unsigned valid : 1;
+	// as the framebuffer has it, and as it was sent
+	struct style style;
+	uint32_t fg;
+	uint32_t bg;
+};
+
+// a single SGR sequence for the colors of `style` that the terminal isn't drawing with
+// already. returns its length, which is 0 if nothing changed.
+static size_t style_sgr(char *buf, struct sgr_state *st, struct style style) {
+	size_t len = 2;
+	memcpy(buf, "\033[", len);
+	if (!st->valid || style.fg != st->style.fg) {
+		uint32_t code = color_code(style.fg);
+		if (!st->valid || code != st->fg)
+			len += put_color(buf + len, 0, code);
+		st->fg = code;
+	}
+	if (!st->valid || style.bg != st->style.bg) {
+		uint32_t code = color_code(style.bg);
+		if (!st->valid || code != st->bg)
+			len += put_color(buf + len, 1, code);
+		st->bg = code;
+	}
+	st->valid = 1;
+	st->style = style;
+	if (len == 2)
+		return 0;
+	buf[len - 1] = 'm';
+	return len;
+}
+
+static void display_cursor(struct framebuf *fb, string_t *out) {
 	switch (fb->cursor_style) {
 	case CURSOR_BLOCK:
-		fwrite(BLOCK_CURSOR_ESC, 1, strlen(BLOCK_CURSOR_ESC), stdout);
+		string_append(out, STR(BLOCK_CURSOR_ESC));
 		break;
 	case CURSOR_BAR:
-		fwrite(BAR_CURSOR_ESC, 1, strlen(BAR_CURSOR_ESC), stdout);
+		string_append(out, STR(BAR_CURSOR_ESC));
 		break;
 	}
 	char moveesc[sizeof("\033[XXX;XXXH") - 1] = "";
 	snprintf(moveesc, sizeof(moveesc), "\033[%d;%dH", fb->cursory + 1, fb->cursorx + 1);
-	fwrite(moveesc, 1, strlen(moveesc), stdout);
+	string_append(out, cstr_as_str(moveesc));
+}
+
+// appends the escape sequences that draw the frame to `out`. they are written out by
+// the caller, so that a slow terminal doesn't hold up the one drawing.
+void framebuf_display(struct framebuf *fb, string_t *out) {
+	string_append(out, STR(RESET_FRAME));
+
+	struct sgr_state st = { .valid = 0 };
+	for (int i = 0; i < fb->width * fb->height; i++) {
+		struct pixel pixel = fb->buf[i];
+		char sgr[sizeof("\033[38;2;255;255;255;48;2;255;255;255m")];
+		size_t len = style_sgr(sgr, &st, pixel.style);
+		if (len > 0)
+			string_append(out, (str_t) { .ptr = sgr, .len = len });
+		string_push(out, pixel.ch);
+	}
+
+	display_cursor(fb, out);
+}
+
+static int pixel_eq(struct pixel a, struct pixel b) {
+	return a.ch == b.ch && a.style.fg == b.style.fg && a.style.bg == b.style.bg;
+}
+
+// like framebuf_display(), for a terminal that shows `prev` already: only the cells that
+// differ are drawn, each run of them after a cursor move. if `prev` is NULL or another
+// size, the whole frame is.
+void framebuf_display_diff(struct framebuf *prev, struct framebuf *fb, string_t *out) {
+	if (prev == NULL || prev->width != fb->width || prev->height != fb->height) {
+		framebuf_display(fb, out);
+		return;
+	}
+
+	struct sgr_state st = { .valid = 0 };
+	// where the terminal's cursor is. after the last column, it is nowhere that can be
+	// written at without a move.
+	int curx = -1;
+	int cury = -1;
+	for (int y = 0; y < fb->height; y++) {
+		for (int x = 0; x < fb->width; x++) {
+			struct pixel pixel = fb->buf[y * fb->width + x];
+			if (pixel_eq(pixel, prev->buf[y * fb->width + x]))
+				continue;
+			if (x != curx || y != cury) {
+				char move[32];
+				int len = snprintf(move, sizeof(move), "\033[%d;%dH", y + 1, x + 1);
+				string_append(out, (str_t) { .ptr = move, .len = len });
+			}
+			char sgr[sizeof("\033[38;2;255;255;255;48;2;255;255;255m")];
+			size_t len = style_sgr(sgr, &st, pixel.style);
+			if (len > 0)
+				string_append(out, (str_t) { .ptr = sgr, .len = len });
+			string_push(out, pixel.ch);
+			curx = x + 1 < fb->width ? x + 1 : -1;
+			cury = y;
+		}
+	}
+	display_cursor(fb, out);
 }
 
 void framebuf_new(struct framebuf *fb, int width, int height) {
@@ -205,5 +377,70 @@ void render_run_tests(void) {
 	assert(rect_empty((struct rect) { .x = 12, .y = 1, .width = 0, .height = 0 }));
 	assert(rect_empty((struct rect) { .width = -1, .height = -1 }));
 	assert(rect_empty((struct rect) { 0 }));
+
+	// colors are matched to the cube and the grays, and to the 16 colors
+	assert(nearest_color(0x000000, COLOR_DEPTH_256) == 16 && nearest_color(0xffffff, COLOR_DEPTH_256) == 231);
+	assert(nearest_color(0x808080, COLOR_DEPTH_256) == 244 && nearest_color(0xd70087, COLOR_DEPTH_256) == 162);
+	assert(nearest_color(0xf00000, COLOR_DEPTH_16) == 9 && nearest_color(0x282c34, COLOR_DEPTH_16) == 0);
+
+	// fg and bg go in one sequence, and only what changed is sent again
+	char sgr[64];
+	struct sgr_state st = { .valid = 0 };
+	render_set_color_depth(COLOR_DEPTH_256);
+	size_t len = style_sgr(sgr, &st, (struct style) { .fg = 0xffffff, .bg = 0x000000 });
+	assert(len == strlen("\033[38;5;231;48;5;16m") && !memcmp(sgr, "\033[38;5;231;48;5;16m", len));
+	assert(style_sgr(sgr, &st, (struct style) { .fg = 0xffffff, .bg = 0x000000 }) == 0);
+	// a different color that looks the same on the terminal doesn't need a sequence either
+	assert(style_sgr(sgr, &st, (struct style) { .fg = 0xfefefe, .bg = 0x000000 }) == 0);
+	len = style_sgr(sgr, &st, (struct style) { .fg = 0xfefefe, .bg = 0xffffff });
+	assert(len == strlen("\033[48;5;231m") && !memcmp(sgr, "\033[48;5;231m", len));
+
+	render_set_color_depth(COLOR_DEPTH_16);
+	st.valid = 0;
+	len = style_sgr(sgr, &st, (struct style) { .fg = 0xff0000, .bg = 0x000000 });
+	assert(len == strlen("\033[91;40m") && !memcmp(sgr, "\033[91;40m", len));
+
+	render_set_color_depth(COLOR_DEPTH_TRUE);
+	st.valid = 0;
+	len = style_sgr(sgr, &st, (struct style) { .fg = 0x010203, .bg = 0xabcdef });
+	assert(len == strlen("\033[38;2;1;2;3;48;2;171;205;239m") && !memcmp(sgr, "\033[38;2;1;2;3;48;2;171;205;239m", len));
+
+	// a whole frame goes into a string, to be written out by the caller
+	struct framebuf fb;
+	framebuf_new(&fb, 3, 1);
+	framebuf_reset(&fb, 3, 1);
+	render_str(&fb, (struct rect) { .x = 1, .width = 2, .height = 1 }, STR("ab"), (struct style) { .fg = 0x000001, .bg = BG_COLOR });
+	fb.cursorx = 2;
+	fb.cursor_style = CURSOR_BAR;
+	string_t out = string_new();
+	framebuf_display(&fb, &out);
+	assert(str_eq(string_as_str(out), STR(RESET_FRAME "\033[38;2;171;178;191;48;2;40;44;52m \033[38;2;0;0;1mab" BAR_CURSOR_ESC "\033[1;3H")));
+
+	// against the frame before, only the cells that changed are drawn
+	struct framebuf next;
+	framebuf_new(&next, 3, 2);
+	framebuf_reset(&next, 3, 1);
+	memcpy(next.buf, fb.buf, sizeof(fb.buf[0]) * 3);
+	next.buf[0].ch = 'x';
+	next.buf[2].ch = 'y';
+	next.cursor_style = CURSOR_BLOCK;
+	string_clear(&out);
+	framebuf_display_diff(&fb, &next, &out);
+	assert(str_eq(string_as_str(out), STR("\033[1;1H\033[38;2;171;178;191;48;2;40;44;52mx\033[1;3H\033[38;2;0;0;1my" BLOCK_CURSOR_ESC "\033[1;1H")));
+	// unchanged cells next to each other need no move in between
+	next.buf[1].ch = 'z';
+	next.buf[2].ch = 'w';
+	string_clear(&out);
+	framebuf_display_diff(&fb, &next, &out);
+	assert(str_eq(string_as_str(out), STR("\033[1;1H\033[38;2;171;178;191;48;2;40;44;52mx\033[38;2;0;0;1mzw" BLOCK_CURSOR_ESC "\033[1;1H")));
+	// a frame of another size is drawn whole
+	framebuf_reset(&next, 3, 2);
+	string_clear(&out);
+	framebuf_display_diff(&fb, &next, &out);
+	str_t rest;
+	assert(str_strip_prefix(string_as_str(out), STR(RESET_FRAME), &rest));
+	framebuf_free(&next);
+	string_free(out);
+	framebuf_free(&fb);
 }
 #endif
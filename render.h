@@ -18,6 +18,13 @@ struct pixel {
 	struct style style;
 };
 
+// how many colors the terminal can show
+enum color_depth {
+	COLOR_DEPTH_16,
+	COLOR_DEPTH_256,
+	COLOR_DEPTH_TRUE,
+};
+
 enum cursor_style {
 	CURSOR_BLOCK,
 	CURSOR_BAR,
@@ -42,7 +49,8 @@ struct rect {
 	int height;
 };
 
-void framebuf_display(struct framebuf *fb);
+void framebuf_display(struct framebuf *fb, string_t *out);
+void framebuf_display_diff(struct framebuf *prev, struct framebuf *fb, string_t *out);
 void framebuf_reset(struct framebuf *fb, int width, int height);
 void framebuf_new(struct framebuf *fb, int width, int height);
 void framebuf_free(struct framebuf *fb);
@@ -54,5 +62,7 @@ int rect_empty(struct rect r);
 void render_solid_color(struct framebuf *fb, struct rect area, uint32_t color);
 void render_str(struct framebuf *fb, struct rect area, str_t str, struct style style);
 void render_restore_cursor_style(void);
+enum color_depth render_detect_color_depth(void);
+void render_set_color_depth(enum color_depth depth);
 
 #endif
@@ -0,0 +1,727 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "config.h"
+#include "editor.h"
+#include "evloop.h"
+#include "server.h"
+
+// an editor, and what the server keeps track of for it
+struct session {
+	struct editor editor;
+	// the editor's fds that are being watched
+	struct evloop_fdset fds;
+	// the editor has background work to get on with
+	int idle_pending;
+	struct server *srv;
+	struct session *next;
+};
+
+struct client {
+	// what is on its way to the client. while a frame is, no other one is drawn for it.
+	struct evloop_out out;
+	// what came in that isn't a whole message yet
+	string_t in;
+	// NULL until MSG_OPEN, and after the client was detached
+	struct session *session;
+	int width;
+	int height;
+	enum color_depth depth;
+	// the frame being drawn, and the last one that was sent (if `have_prev`)
+	struct framebuf fb;
+	struct framebuf prev;
+	int have_prev;
+	int redraw;
+	// the client is let go of once what it was sent has gone out
+	int closing;
+	struct server *srv;
+	struct client *next;
+};
+
+struct server {
+	struct evloop loop;
+	// -1 in the tests, where clients are added by hand
+	int listen_fd;
+	struct evloop_watch *timer;
+	struct session *sessions;
+	struct client *clients;
+	// a frame, before it goes into a message
+	string_t frame;
+};
+
+static void put_u16(string_t *out, int n) {
+	uint16_t v = n;
+	string_append(out, (str_t) { .ptr = (char *) &v, .len = sizeof(v) });
+}
+
+static int get_u16(const char *p) {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+void msg_append(string_t *out, enum msg_type type, str_t payload) {
+	uint32_t len = payload.len;
+	string_push(out, type);
+	string_append(out, (str_t) { .ptr = (char *) &len, .len = sizeof(len) });
+	string_append(out, payload);
+}
+
+void msg_open(string_t *out, int width, int height, enum color_depth depth, int follow, str_t path) {
+	string_t payload = string_new();
+	put_u16(&payload, width);
+	put_u16(&payload, height);
+	string_push(&payload, depth);
+	string_push(&payload, follow);
+	string_append(&payload, path);
+	msg_append(out, MSG_OPEN, string_as_str(payload));
+	string_free(payload);
+}
+
+void msg_key(string_t *out, struct keyevt evt) {
+	char payload[3] = { evt.kind, evt.kchar, evt.ctrl };
+	msg_append(out, MSG_KEY, (str_t) { .ptr = payload, .len = sizeof(payload) });
+}
+
+void msg_resize(string_t *out, int width, int height) {
+	string_t payload = string_new();
+	put_u16(&payload, width);
+	put_u16(&payload, height);
+	msg_append(out, MSG_RESIZE, string_as_str(payload));
+	string_free(payload);
+}
+
+// reads what has come in on the non-blocking `fd` onto the end of `in`. returns 0 once the
+// other end has closed the connection, or -1 (with errno set) if reading failed.
+int msg_read(int fd, string_t *in) {
+	for (;;) {
+		char buf[64 * 1024];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (n <= 0)
+			return n;
+		string_append(in, (str_t) { .ptr = buf, .len = n });
+	}
+}
+
+// the message at `*off` in `in`, if all of it has come in. `*off` is moved past it.
+int msg_next(string_t *in, size_t *off, enum msg_type *type, str_t *payload) {
+	if (in->len - *off < MSG_HEADER_SIZE)
+		return 0;
+	uint32_t len;
+	memcpy(&len, in->ptr + *off + 1, sizeof(len));
+	if (in->len - *off - MSG_HEADER_SIZE < len)
+		return 0;
+	*type = (unsigned char) in->ptr[*off];
+	*payload = (str_t) { .ptr = in->ptr + *off + MSG_HEADER_SIZE, .len = len };
+	*off += MSG_HEADER_SIZE + len;
+	return 1;
+}
+
+// drops the messages before `off`, which have been handled, from `in`
+void msg_consumed(string_t *in, size_t off) {
+	if (off == 0)
+		return;
+	memmove(in->ptr, in->ptr + off, in->len - off);
+	in->len -= off;
+}
+
+// $MF_SOCKET if it is set, else mf.sock in $XDG_RUNTIME_DIR, else /tmp/mf-<uid>.sock
+int server_socket_path(string_t *path) {
+	char buf[sizeof(((struct sockaddr_un *) NULL)->sun_path)];
+	const char *env = getenv("MF_SOCKET");
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	int n;
+	if (env != NULL && env[0] != '\0')
+		n = snprintf(buf, sizeof(buf), "%s", env);
+	else if (dir != NULL && dir[0] != '\0')
+		n = snprintf(buf, sizeof(buf), "%s/mf.sock", dir);
+	else
+		n = snprintf(buf, sizeof(buf), "/tmp/mf-%d.sock", (int) getuid());
+	if (n < 0 || (size_t) n >= sizeof(buf)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	string_append(path, cstr_as_str(buf));
+	// `path->ptr` goes to connect_to(), listen_at() and unlink() as is
+	string_push(path, '\0');
+	path->len -= 1;
+	return 0;
+}
+
+// the other end of the socket runs as the same user. anyone could have made a socket at
+// a path in /tmp, and whoever is on the other end sees the keys.
+static int peer_is_us(int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+}
+
+static struct sockaddr_un socket_addr(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	// server_socket_path() made sure it fits
+	memcpy(addr.sun_path, path, strlen(path));
+	return addr;
+}
+
+static int connect_to(const char *path) {
+	struct sockaddr_un addr = socket_addr(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+static int listen_at(const char *path) {
+	struct sockaddr_un addr = socket_addr(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	// only we can connect
+	mode_t mask = umask(077);
+	int ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+	if (ret == -1 || listen(fd, SOMAXCONN) == -1) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+static void drop_client(struct server *srv, struct client *c) {
+	for (struct client **cp = &srv->clients; *cp != NULL; cp = &(*cp)->next) {
+		if (*cp == c) {
+			*cp = c->next;
+			break;
+		}
+	}
+	evloop_del(&srv->loop, c->out.watch);
+	close(c->out.fd);
+	string_free(c->out.buf);
+	string_free(c->in);
+	framebuf_free(&c->fb);
+	framebuf_free(&c->prev);
+	free(c);
+}
+
+// the client is told that it's done, and let go of once that has gone out
+static void detach_client(struct client *c, enum msg_type why, str_t msg) {
+	msg_append(&c->out.buf, why, msg);
+	c->session = NULL;
+	c->closing = 1;
+	if (evloop_out_flush(&c->srv->loop, &c->out))
+		string_clear(&c->out.buf);
+}
+
+// every client of `s` gets a new frame
+static void session_redraw(struct session *s) {
+	for (struct client *c = s->srv->clients; c != NULL; c = c->next) {
+		if (c->session == s)
+			c->redraw = 1;
+	}
+}
+
+static void on_session_fd(void *ctx, int fd, uint32_t events) {
+	struct session *s = ctx;
+	// EPOLLIN etc. have the same values as POLLIN etc.
+	editor_handle_pollfd(&s->editor, (struct pollfd) { .fd = fd, .revents = events });
+	s->idle_pending = 1;
+}
+
+static struct session *find_session(struct server *srv, str_t path) {
+	for (struct session *s = srv->sessions; s != NULL; s = s->next) {
+		if (str_eq(string_as_str(editor_get_focused_pane(&s->editor)->path), path))
+			return s;
+	}
+	return NULL;
+}
+
+// loads the file at `path` into a new session. if it can't be, NULL is returned and
+// `error` says why.
+static struct session *session_new(struct server *srv, const char *path, string_t *error) {
+	struct session *s = calloc(1, sizeof(struct session));
+	editor_new(&s->editor, STR(""));
+	editor_open_file(&s->editor, path);
+	if (editor_get_focused_pane(&s->editor)->path.len == 0) {
+		string_append(error, string_as_str(s->editor.errormsg));
+		editor_free(&s->editor);
+		free(s);
+		return NULL;
+	}
+	s->editor.on_server = 1;
+	s->idle_pending = 1;
+	s->srv = srv;
+	s->next = srv->sessions;
+	srv->sessions = s;
+	return s;
+}
+
+// ends the session, as quitting does without a server
+static void session_end(struct server *srv, struct session *s) {
+	for (struct session **sp = &srv->sessions; *sp != NULL; sp = &(*sp)->next) {
+		if (*sp == s) {
+			*sp = s->next;
+			break;
+		}
+	}
+	for (struct client *c = srv->clients; c != NULL; c = c->next) {
+		if (c->session == s)
+			detach_client(c, MSG_EXIT, STR(""));
+	}
+	(void) evloop_sync_fds(&srv->loop, &s->fds, NULL, 0, on_session_fd, s);
+	editor_free(&s->editor);
+	free(s);
+}
+
+static int client_open(struct client *c, str_t payload) {
+	if (c->session != NULL || payload.len <= 6)
+		return -1;
+	c->width = get_u16(payload.ptr);
+	c->height = get_u16(payload.ptr + 2);
+	c->depth = MIN((unsigned char) payload.ptr[4], (unsigned char) COLOR_DEPTH_TRUE);
+	int follow = payload.ptr[5];
+	str_t path = { .ptr = payload.ptr + 6, .len = payload.len - 6 };
+
+	string_t error = string_new();
+	struct session *s = find_session(c->srv, path);
+	int created = s == NULL;
+	if (s == NULL) {
+		string_t cpath = str_to_string(path);
+		string_push(&cpath, '\0');
+		s = session_new(c->srv, cpath.ptr, &error);
+		string_free(cpath);
+	}
+	if (s != NULL && follow && editor_get_focused_pane(&s->editor)->follow == NULL && editor_start_follow(&s->editor)) {
+		string_append(&error, STR("follow: "));
+		string_append(&error, cstr_as_str(strerror(errno)));
+		if (created)
+			session_end(c->srv, s);
+		s = NULL;
+	}
+	if (s == NULL) {
+		detach_client(c, MSG_ERROR, string_as_str(error));
+	} else {
+		c->session = s;
+		c->redraw = 1;
+	}
+	string_free(error);
+	return 0;
+}
+
+// returns -1 if the client should be let go of right away
+static int client_handle_msg(struct client *c, enum msg_type type, str_t payload) {
+	switch (type) {
+	case MSG_OPEN:
+		return client_open(c, payload);
+	case MSG_KEY: {
+		struct session *s = c->session;
+		if (s == NULL || payload.len != 3 || (unsigned char) payload.ptr[0] > KEYKIND_DELETE)
+			return -1;
+		struct keyevt evt = { .kind = payload.ptr[0], .kchar = payload.ptr[1], .ctrl = payload.ptr[2] != 0 };
+		// a long repeat stops when this client types something else
+		s->editor.input_fd = c->out.fd;
+		editor_handle_keyevt(&s->editor, evt);
+		s->editor.input_fd = -1;
+		session_redraw(s);
+		s->idle_pending = 1;
+		return 0;
+	}
+	case MSG_RESIZE:
+		if (payload.len != 4)
+			return -1;
+		c->width = get_u16(payload.ptr);
+		c->height = get_u16(payload.ptr + 2);
+		c->redraw = 1;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static void on_client(void *ctx, int fd, uint32_t events) {
+	struct client *c = ctx;
+	if ((events & EPOLLOUT) && evloop_out_flush(&c->srv->loop, &c->out)) {
+		drop_client(c->srv, c);
+		return;
+	}
+	if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		return;
+
+	int open = msg_read(fd, &c->in);
+	size_t off = 0;
+	enum msg_type type;
+	str_t payload;
+	while (!c->closing && msg_next(&c->in, &off, &type, &payload)) {
+		if (client_handle_msg(c, type, payload)) {
+			drop_client(c->srv, c);
+			return;
+		}
+	}
+	msg_consumed(&c->in, off);
+	// its terminal went away. the session stays.
+	if (open <= 0)
+		drop_client(c->srv, c);
+}
+
+static int server_add_client(struct server *srv, int fd) {
+	struct client *c = calloc(1, sizeof(struct client));
+	c->out = (struct evloop_out) { .fd = fd, .events = EPOLLIN, .buf = string_new() };
+	c->out.watch = evloop_add_fd(&srv->loop, fd, EPOLLIN, on_client, c);
+	if (c->out.watch == NULL) {
+		string_free(c->out.buf);
+		free(c);
+		return -1;
+	}
+	c->in = string_new();
+	framebuf_new(&c->fb, 0, 0);
+	framebuf_new(&c->prev, 0, 0);
+	c->srv = srv;
+	c->next = srv->clients;
+	srv->clients = c;
+	return 0;
+}
+
+static void on_accept(void *ctx, int fd, uint32_t events) {
+	struct server *srv = ctx;
+	int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (cfd == -1)
+		return;
+	if (!peer_is_us(cfd) || server_add_client(srv, cfd))
+		close(cfd);
+}
+
+static void on_timer(void *ctx) {
+	struct server *srv = ctx;
+	for (struct session *s = srv->sessions; s != NULL; s = s->next)
+		editor_run_timers(&s->editor);
+}
+
+// draws the client's session at its size, and sends what changed since its last frame
+static void client_draw(struct client *c) {
+	struct server *srv = c->srv;
+	render_set_color_depth(c->depth);
+	framebuf_reset(&c->fb, c->width, c->height);
+	editor_render(&c->session->editor, &c->fb, (struct rect) { .width = c->width, .height = c->height });
+	string_clear(&srv->frame);
+	framebuf_display_diff(c->have_prev ? &c->prev : NULL, &c->fb, &srv->frame);
+	msg_append(&c->out.buf, MSG_FRAME, string_as_str(srv->frame));
+	struct framebuf drawn = c->fb;
+	c->fb = c->prev;
+	c->prev = drawn;
+	c->have_prev = 1;
+	c->redraw = 0;
+	if (evloop_out_flush(&srv->loop, &c->out)) {
+		string_clear(&c->out.buf);
+		c->closing = 1;
+	}
+}
+
+static int server_init(struct server *srv, int listen_fd) {
+	*srv = (struct server) { .listen_fd = listen_fd, .frame = string_new() };
+	if (evloop_init(&srv->loop))
+		return -1;
+	srv->timer = evloop_add_timer(&srv->loop, on_timer, srv);
+	if (srv->timer == NULL)
+		return -1;
+	if (listen_fd != -1 && evloop_add_fd(&srv->loop, listen_fd, EPOLLIN, on_accept, srv) == NULL)
+		return -1;
+	// a client that is gone by the time it's written to is noticed from the write failing
+	signal(SIGPIPE, SIG_IGN);
+	return 0;
+}
+
+static void server_free(struct server *srv) {
+	while (srv->sessions != NULL)
+		session_end(srv, srv->sessions);
+	while (srv->clients != NULL)
+		drop_client(srv, srv->clients);
+	evloop_free(&srv->loop);
+	string_free(srv->frame);
+}
+
+// one turn of the server's loop: the sessions' own work, frames for the clients that
+// need one, then waiting (for up to `timeout_ms`) for something to happen
+static int server_step(struct server *srv, int timeout_ms) {
+	int timer_ms = -1;
+	int idle = 0;
+	for (struct session *s = srv->sessions, *next; s != NULL; s = next) {
+		next = s->next;
+		editor_drain_jobs(&s->editor);
+		if (s->editor.should_exit) {
+			session_end(srv, s);
+			continue;
+		}
+		if (s->editor.should_detach) {
+			for (struct client *c = srv->clients; c != NULL; c = c->next) {
+				if (c->session == s)
+					detach_client(c, MSG_EXIT, STR(""));
+			}
+			s->editor.should_detach = 0;
+		}
+		if (s->editor.needs_redraw) {
+			session_redraw(s);
+			s->editor.needs_redraw = 0;
+		}
+
+		struct pollfd fds[EVLOOP_FDSET_SIZE];
+		size_t n = editor_get_pollfds(&s->editor, fds, EVLOOP_FDSET_SIZE);
+		if (evloop_sync_fds(&srv->loop, &s->fds, fds, n, on_session_fd, s))
+			return -1;
+		int ms = editor_poll_timeout(&s->editor);
+		if (ms != -1 && (timer_ms == -1 || ms < timer_ms))
+			timer_ms = ms;
+		idle |= s->idle_pending;
+	}
+
+	for (struct client *c = srv->clients, *next; c != NULL; c = next) {
+		next = c->next;
+		if (c->closing && c->out.buf.len == 0)
+			drop_client(srv, c);
+		else if (c->session != NULL && c->redraw && c->out.buf.len == 0 && c->width > 0 && c->height > 0)
+			client_draw(c);
+	}
+
+	// with nothing left, the caller gets to stop
+	if (srv->sessions == NULL && srv->clients == NULL)
+		timeout_ms = 0;
+	if (evloop_arm_timer(srv->timer, timer_ms))
+		return -1;
+	int nevents = evloop_run_once(&srv->loop, idle ? 0 : timeout_ms);
+	if (nevents == -1)
+		return -1;
+	if (nevents == 0 && idle) {
+		for (struct session *s = srv->sessions; s != NULL; s = s->next) {
+			if (s->idle_pending)
+				s->idle_pending = editor_idle_work(&s->editor);
+		}
+	}
+	return 0;
+}
+
+// runs until the last session has ended and the last client is gone
+static int server_run(int listen_fd, const char *path) {
+	struct server srv;
+	if (server_init(&srv, listen_fd))
+		return 1;
+	// the client that started the server connects right after
+	int ret = evloop_run_once(&srv.loop, -1) == -1;
+	while (!ret && (srv.sessions != NULL || srv.clients != NULL))
+		ret = server_step(&srv, -1) != 0;
+	unlink(path);
+	server_free(&srv);
+	return ret;
+}
+
+// the server is detached from the client's terminal and session, so that it stays when
+// they go. it forks twice, so that it isn't the client's child either.
+static int start_server(int listen_fd, const char *path) {
+	pid_t pid = fork();
+	if (pid == -1)
+		return -1;
+	if (pid == 0) {
+		if (setsid() == -1 || (pid = fork()) == -1)
+			_exit(1);
+		if (pid > 0)
+			_exit(0);
+		int null = open("/dev/null", O_RDWR);
+		if (null != -1) {
+			dup2(null, STDIN_FILENO);
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+			if (null > STDERR_FILENO)
+				close(null);
+		}
+		exit(server_run(listen_fd, path));
+	}
+	int status;
+	if (waitpid(pid, &status, 0) == -1)
+		return -1;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// connects to the server, starting one if none is running. returns the socket, or -1
+// (with errno set). must be called before any threads are started.
+int server_connect(void) {
+	string_t path = string_new();
+	if (server_socket_path(&path)) {
+		string_free(path);
+		return -1;
+	}
+	int fd = -1;
+	for (int tries = 0; tries < 3; tries++) {
+		fd = connect_to(path.ptr);
+		if (fd != -1 || (errno != ENOENT && errno != ECONNREFUSED))
+			break;
+		// nobody is listening. a socket left behind by a server that died goes first.
+		if (errno == ECONNREFUSED)
+			(void) unlink(path.ptr);
+		int lfd = listen_at(path.ptr);
+		// another client may have started one in the meantime
+		if (lfd == -1 && errno == EADDRINUSE)
+			continue;
+		if (lfd == -1)
+			break;
+		int ret = start_server(lfd, path.ptr);
+		close(lfd);
+		if (ret == -1)
+			break;
+	}
+	if (fd != -1 && !peer_is_us(fd)) {
+		close(fd);
+		fd = -1;
+		errno = EPERM;
+	}
+	string_free(path);
+	return fd;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+// turns the server's loop until a message comes in on `fd`. the ones before it in `in`
+// (up to `*off`) are dropped.
+static enum msg_type expect_msg(struct server *srv, int fd, string_t *in, size_t *off, str_t *payload) {
+	msg_consumed(in, *off);
+	*off = 0;
+	enum msg_type type;
+	for (int i = 0; i < 50; i++) {
+		// the server may have hung up after the message
+		(void) msg_read(fd, in);
+		if (msg_next(in, off, &type, payload))
+			return type;
+		assert(server_step(srv, 20) == 0);
+	}
+	assert(0 && "no message from the server");
+}
+
+static int contains(str_t s, const char *needle) {
+	return memmem(s.ptr, s.len, needle, strlen(needle)) != NULL;
+}
+
+void server_run_tests(void) {
+	// messages come out whole, however they were split up
+	string_t buf = string_new();
+	msg_append(&buf, MSG_KEY, STR("abc"));
+	msg_append(&buf, MSG_FRAME, STR(""));
+	string_t in = string_new();
+	size_t off = 0;
+	enum msg_type type;
+	str_t payload;
+	string_append(&in, (str_t) { .ptr = buf.ptr, .len = 4 });
+	assert(!msg_next(&in, &off, &type, &payload));
+	string_append(&in, (str_t) { .ptr = buf.ptr + 4, .len = buf.len - 4 });
+	assert(msg_next(&in, &off, &type, &payload) && type == MSG_KEY && str_eq(payload, STR("abc")));
+	assert(msg_next(&in, &off, &type, &payload) && type == MSG_FRAME && payload.len == 0);
+	assert(!msg_next(&in, &off, &type, &payload));
+	msg_consumed(&in, off);
+	assert(in.len == 0);
+	string_free(buf);
+	string_free(in);
+
+	char dir[] = "/tmp/mf-server-XXXXXX";
+	test_tmpdir_create(dir);
+	char path[64];
+	snprintf(path, sizeof(path), "%s/a.txt", dir);
+	FILE *f = fopen(path, "w");
+	assert(f != NULL);
+	fputs("hello\nworld\n", f);
+	fclose(f);
+
+	struct server srv;
+	assert(server_init(&srv, -1) == 0);
+	int a[2];
+	int b[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, a) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, b) == 0);
+	assert(server_add_client(&srv, a[0]) == 0);
+	assert(server_add_client(&srv, b[0]) == 0);
+
+	// the first frame is drawn whole, at the client's size
+	string_t out = string_new();
+	string_t ain = string_new();
+	string_t bin = string_new();
+	size_t aoff = 0;
+	size_t boff = 0;
+	msg_open(&out, 20, 5, COLOR_DEPTH_16, 0, cstr_as_str(path));
+	assert(write(a[1], out.ptr, out.len) == (ssize_t) out.len);
+	assert(expect_msg(&srv, a[1], &ain, &aoff, &payload) == MSG_FRAME);
+	assert(contains(payload, "\033[2J") && contains(payload, "hello"));
+	size_t full = payload.len;
+	assert(srv.sessions != NULL && srv.sessions->next == NULL);
+
+	// after a key, only what changed
+	string_clear(&out);
+	msg_key(&out, (struct keyevt) { .kind = KEYKIND_CHAR, .kchar = 'x' });
+	assert(write(a[1], out.ptr, out.len) == (ssize_t) out.len);
+	assert(expect_msg(&srv, a[1], &ain, &aoff, &payload) == MSG_FRAME);
+	assert(!contains(payload, "\033[2J") && payload.len < full);
+
+	// a second client on the same file shares the session
+	string_clear(&out);
+	msg_open(&out, 30, 6, COLOR_DEPTH_TRUE, 0, cstr_as_str(path));
+	assert(write(b[1], out.ptr, out.len) == (ssize_t) out.len);
+	assert(expect_msg(&srv, b[1], &bin, &boff, &payload) == MSG_FRAME);
+	assert(contains(payload, "ello") && !contains(payload, "hello"));
+	assert(srv.sessions->next == NULL);
+
+	// one that goes away leaves it be
+	close(a[1]);
+	for (int i = 0; i < 3; i++)
+		assert(server_step(&srv, 20) == 0);
+	assert(srv.clients != NULL && srv.clients->next == NULL && srv.sessions != NULL);
+
+	// a file that can't be opened
+	int c[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, c) == 0);
+	assert(server_add_client(&srv, c[0]) == 0);
+	string_clear(&out);
+	msg_open(&out, 20, 5, COLOR_DEPTH_16, 0, STR("/nonexistent/file"));
+	assert(write(c[1], out.ptr, out.len) == (ssize_t) out.len);
+	string_t cin = string_new();
+	size_t coff = 0;
+	assert(expect_msg(&srv, c[1], &cin, &coff, &payload) == MSG_ERROR && contains(payload, "No such file"));
+	close(c[1]);
+	string_free(cin);
+
+	// :q ends the session for everyone on it
+	string_clear(&out);
+	msg_key(&out, (struct keyevt) { .kind = KEYKIND_CHAR, .kchar = ' ' });
+	msg_key(&out, (struct keyevt) { .kind = KEYKIND_CHAR, .kchar = 'q' });
+	msg_key(&out, (struct keyevt) { .kind = KEYKIND_ENTER });
+	assert(write(b[1], out.ptr, out.len) == (ssize_t) out.len);
+	while ((type = expect_msg(&srv, b[1], &bin, &boff, &payload)) == MSG_FRAME)
+		;
+	assert(type == MSG_EXIT);
+	for (int i = 0; i < 3; i++)
+		assert(server_step(&srv, 20) == 0);
+	assert(srv.sessions == NULL && srv.clients == NULL);
+	close(b[1]);
+
+	server_free(&srv);
+	string_free(out);
+	string_free(ain);
+	string_free(bin);
+	test_tmpdir_remove(dir);
+}
+#endif
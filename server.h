@@ -0,0 +1,44 @@
+#ifndef __HAVE_SERVER_H
+#define __HAVE_SERVER_H
+
+#include <stdint.h>
+#include "input.h"
+#include "mf_string.h"
+#include "render.h"
+
+// client/server mode (mf -c). a server process keeps an editor (a session) for each file
+// that clients have opened, so attaching to one again is instant, and it outlives the
+// terminals of its clients. clients only deal with the terminal: they send keys and its
+// size, and get back the bytes that draw each frame, as a diff against the frame before.
+//
+// on the socket, each message is a type byte and a 32-bit length (in host byte order:
+// both ends are on one machine), then that many bytes of payload.
+enum msg_type {
+	// client: width and height (16 bits each), color depth and follow (a byte each),
+	// then the absolute path of the file
+	MSG_OPEN = 1,
+	// client: key kind, character and ctrl (a byte each)
+	MSG_KEY,
+	// client: width and height
+	MSG_RESIZE,
+	// server: bytes for the terminal
+	MSG_FRAME,
+	// server: the file couldn't be opened. the payload says why.
+	MSG_ERROR,
+	// server: the session has ended, or the client was detached from it
+	MSG_EXIT,
+};
+
+#define MSG_HEADER_SIZE 5
+
+void msg_append(string_t *out, enum msg_type type, str_t payload);
+void msg_open(string_t *out, int width, int height, enum color_depth depth, int follow, str_t path);
+void msg_key(string_t *out, struct keyevt evt);
+void msg_resize(string_t *out, int width, int height);
+int msg_read(int fd, string_t *in);
+int msg_next(string_t *in, size_t *off, enum msg_type *type, str_t *payload);
+void msg_consumed(string_t *in, size_t off);
+[[nodiscard]] int server_socket_path(string_t *path);
+int server_connect(void);
+
+#endif
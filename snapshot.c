@@ -0,0 +1,312 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "mfsnap1\n"
+// writes are gathered up to this much
+#define SNAPSHOT_WRITE_CHUNK (1 << 20)
+
+static uint64_t align8(uint64_t n) {
+	return (n + 7) & ~(uint64_t) 7;
+}
+
+struct snapshot_out {
+	int fd;
+	string_t buf;
+	int failed;
+};
+
+static void out_flush(struct snapshot_out *o) {
+	if (!o->failed && write_all(o->fd, o->buf.ptr, o->buf.len))
+		o->failed = 1;
+	string_clear(&o->buf);
+}
+
+static void out_put(struct snapshot_out *o, const void *p, size_t len) {
+	string_append(&o->buf, (str_t) { .ptr = p, .len = len });
+	if (o->buf.len >= SNAPSHOT_WRITE_CHUNK)
+		out_flush(o);
+}
+
+static void out_u64(struct snapshot_out *o, uint64_t n) {
+	out_put(o, &n, sizeof(n));
+}
+
+static void out_pad(struct snapshot_out *o, uint64_t len) {
+	static const char zeros[8];
+	out_put(o, zeros, align8(len) - len);
+}
+
+// writes `s` to `path`, replacing it only once the whole snapshot is on disk. the
+// header's magic, line count, string lengths and section offsets are filled in here; the
+// rest of it has to be set already, along with the lines, cursors, undo records (with just
+// their line numbers) and undo texts.
+int snapshot_write(const char *path, struct snapshot *s) {
+	struct snapshot_header *hdr = &s->hdr;
+	memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+	hdr->nlines = 0;
+	uint64_t lines_len = 0;
+	for (struct bufline *bl = s->first; bl != NULL; bl = bl->next) {
+		hdr->nlines++;
+		lines_len += bl->string.len;
+	}
+	hdr->text_len = lines_len;
+	for (size_t i = 0; i < hdr->nundo; i++)
+		hdr->text_len += s->undo_text[i].len;
+	hdr->path_len = s->path.len;
+	hdr->name_len = s->name.len;
+	hdr->lines_off = sizeof(*hdr);
+	hdr->cursors_off = hdr->lines_off + (hdr->nlines + 1) * sizeof(uint64_t);
+	hdr->undo_off = hdr->cursors_off + hdr->ncursors * sizeof(struct snapshot_pos);
+	hdr->strings_off = hdr->undo_off + hdr->nundo * sizeof(struct snapshot_undo);
+	hdr->text_off = align8(hdr->strings_off + hdr->path_len + hdr->name_len);
+
+	string_t tmp = str_to_string(cstr_as_str((char *) path));
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+	string_append(&tmp, cstr_as_str(suffix));
+	string_push(&tmp, '\0');
+
+	struct snapshot_out o = { .fd = open(tmp.ptr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600), .buf = string_new() };
+	if (o.fd == -1) {
+		string_free(o.buf);
+		string_free(tmp);
+		return -1;
+	}
+
+	out_put(&o, hdr, sizeof(*hdr));
+	uint64_t off = 0;
+	for (struct bufline *bl = s->first; bl != NULL; bl = bl->next) {
+		out_u64(&o, off);
+		off += bl->string.len;
+	}
+	out_u64(&o, off);
+	out_put(&o, s->cursors, hdr->ncursors * sizeof(struct snapshot_pos));
+	for (size_t i = 0; i < hdr->nundo; i++) {
+		struct snapshot_undo u = { .lineno = s->undo[i].lineno, .off = off, .len = s->undo_text[i].len };
+		out_put(&o, &u, sizeof(u));
+		off += u.len;
+	}
+	out_put(&o, s->path.ptr, s->path.len);
+	out_put(&o, s->name.ptr, s->name.len);
+	out_pad(&o, hdr->strings_off + hdr->path_len + hdr->name_len);
+	for (struct bufline *bl = s->first; bl != NULL; bl = bl->next)
+		out_put(&o, bl->string.ptr, bl->string.len);
+	for (size_t i = 0; i < hdr->nundo; i++)
+		out_put(&o, s->undo_text[i].ptr, s->undo_text[i].len);
+	out_flush(&o);
+
+	if (!o.failed && fsync(o.fd) == -1)
+		o.failed = 1;
+	int saved_errno = errno;
+	close(o.fd);
+	// a snapshot that is there is always a complete one
+	if (!o.failed && rename(tmp.ptr, path) == -1) {
+		o.failed = 1;
+		saved_errno = errno;
+	}
+	if (o.failed) {
+		unlink(tmp.ptr);
+		errno = saved_errno;
+	}
+	string_free(o.buf);
+	string_free(tmp);
+	return o.failed ? -1 : 0;
+}
+
+// whether a section of `n` records of `size` bytes at `off` fits between `start` and `end`
+static int section_fits(uint64_t off, uint64_t n, size_t size, uint64_t start, uint64_t end) {
+	return off % 8 == 0 && off >= start && off <= end && n <= (end - off) / size;
+}
+
+static int header_valid(const struct snapshot_header *hdr, uint64_t file_len) {
+	return !memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic))
+		&& hdr->nlines > 0
+		&& hdr->nlines < file_len / sizeof(uint64_t)
+		&& hdr->text_off % 8 == 0
+		&& hdr->text_off <= file_len
+		&& hdr->text_len <= file_len - hdr->text_off
+		&& section_fits(hdr->lines_off, hdr->nlines + 1, sizeof(uint64_t), sizeof(*hdr), hdr->text_off)
+		&& section_fits(hdr->cursors_off, hdr->ncursors, sizeof(struct snapshot_pos), hdr->lines_off + (hdr->nlines + 1) * sizeof(uint64_t), hdr->text_off)
+		&& section_fits(hdr->undo_off, hdr->nundo, sizeof(struct snapshot_undo), hdr->cursors_off + hdr->ncursors * sizeof(struct snapshot_pos), hdr->text_off)
+		&& hdr->strings_off >= hdr->undo_off + hdr->nundo * sizeof(struct snapshot_undo)
+		&& hdr->strings_off <= hdr->text_off
+		&& hdr->path_len <= hdr->text_off - hdr->strings_off
+		&& hdr->name_len <= hdr->text_off - hdr->strings_off - hdr->path_len;
+}
+
+// maps the snapshot at `path`, and builds its lines. the lines' text isn't copied or
+// scanned: each one points at its place in the mapping, found through the offset table.
+// fails with EINVAL if the file isn't a snapshot, or is damaged.
+int snapshot_load(const char *path, struct snapshot *s) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	if ((uint64_t) st.st_size < sizeof(struct snapshot_header)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	// for the kernel to read ahead: the offset table and the text are gone through in order
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	memcpy(&s->hdr, map, sizeof(s->hdr));
+	const struct snapshot_header *hdr = &s->hdr;
+	if (!header_valid(hdr, st.st_size)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	const uint64_t *offs = (const uint64_t *) (map + hdr->lines_off);
+	s->cursors = (const struct snapshot_pos *) (map + hdr->cursors_off);
+	s->undo = (const struct snapshot_undo *) (map + hdr->undo_off);
+	s->path = (str_t) { .ptr = map + hdr->strings_off, .len = hdr->path_len };
+	s->name = (str_t) { .ptr = map + hdr->strings_off + hdr->path_len, .len = hdr->name_len };
+	for (size_t i = 0; i < hdr->nundo; i++) {
+		if (s->undo[i].off > hdr->text_len || s->undo[i].len > hdr->text_len - s->undo[i].off) {
+			munmap(map, st.st_size);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	// every line holds a reference, and the last one to go unmaps the file
+	s->text = malloc(sizeof(struct sharedtext));
+	*s->text = (struct sharedtext) { .refcount = 1, .ptr = map, .len = st.st_size, .map_len = st.st_size };
+	s->first = NULL;
+	s->last = NULL;
+	s->undo_text = NULL;
+	char *text = map + hdr->text_off;
+	for (uint64_t i = 0; i < hdr->nlines; i++) {
+		if (offs[i] > offs[i + 1] || offs[i + 1] > hdr->text_len) {
+			snapshot_release(s);
+			errno = EINVAL;
+			return -1;
+		}
+		struct bufline *bl = bufline_new_with_string((string_t) { .ptr = text + offs[i], .len = offs[i + 1] - offs[i] });
+		bl->shared = s->text;
+		s->text->refcount++;
+		bl->prev = s->last;
+		if (s->last != NULL)
+			s->last->next = bl;
+		else
+			s->first = bl;
+		s->last = bl;
+	}
+
+	s->undo_text = calloc(hdr->nundo, sizeof(s->undo_text[0]));
+	for (size_t i = 0; i < hdr->nundo; i++)
+		s->undo_text[i] = (str_t) { .ptr = text + s->undo[i].off, .len = s->undo[i].len };
+	return 0;
+}
+
+// lets go of what snapshot_load() made that the caller hasn't taken over. lines that are
+// still in use keep the mapping alive, but the cursors, undo records and strings that
+// point into it are only valid until this is called.
+void snapshot_release(struct snapshot *s) {
+	free_bufline_list(s->first);
+	s->first = NULL;
+	s->last = NULL;
+	free(s->undo_text);
+	s->undo_text = NULL;
+	if (s->text != NULL)
+		sharedtext_release(s->text);
+	s->text = NULL;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void snapshot_run_tests(void) {
+	char dir[] = "/tmp/mf-snapshot-XXXXXX";
+	test_tmpdir_create(dir);
+	char file[sizeof(dir) + 16];
+	snprintf(file, sizeof(file), "%s/snap", dir);
+
+	struct bufline *lines = str_to_buflines(STR("first\n\nthird line\nlast"));
+	struct snapshot_pos cursors[] = { { 3, 2 } };
+	struct snapshot_undo undo[] = { { .lineno = 1 } };
+	str_t undo_text[] = { STR("old first") };
+	struct snapshot s = {
+		.hdr = { .flags = SNAPSHOT_LAST_LINE_OPEN, .change_seq = 7, .cursor = { 4, 1 }, .left_col = 2, .ncursors = 1, .nundo = 1 },
+		.first = lines,
+		.cursors = cursors,
+		.undo = undo,
+		.undo_text = undo_text,
+		.path = STR("some/file"),
+		.name = STR("name"),
+	};
+	assert(snapshot_write(file, &s) == 0);
+	free_bufline_list(lines);
+
+	struct snapshot l;
+	assert(snapshot_load(file, &l) == 0);
+	assert(l.hdr.nlines == 4);
+	assert(l.hdr.flags == SNAPSHOT_LAST_LINE_OPEN);
+	assert(l.hdr.change_seq == 7);
+	assert(l.hdr.cursor.lineno == 4 && l.hdr.cursor.idx == 1);
+	assert(l.hdr.left_col == 2);
+	assert(l.hdr.ncursors == 1 && l.cursors[0].lineno == 3 && l.cursors[0].idx == 2);
+	assert(l.hdr.nundo == 1 && l.undo[0].lineno == 1 && str_eq(l.undo_text[0], STR("old first")));
+	assert(str_eq(l.path, STR("some/file")));
+	assert(str_eq(l.name, STR("name")));
+	const char *want[] = { "first", "", "third line", "last" };
+	struct bufline *bl = l.first;
+	for (size_t i = 0; i < 4; i++, bl = bl->next) {
+		assert(str_eq(string_as_str(bl->string), cstr_as_str((char *) want[i])));
+		assert(bl->shared == l.text && bl->string.cap == 0);
+	}
+	assert(bl == NULL);
+	assert(l.last->prev->prev->prev == l.first);
+	// a line taken out of the snapshot keeps the mapping alive
+	struct bufline *kept = l.last;
+	l.last = kept->prev;
+	l.last->next = NULL;
+	snapshot_release(&l);
+	assert(str_eq(string_as_str(kept->string), STR("last")));
+	bufline_unshare(kept);
+	assert(str_eq(string_as_str(kept->string), STR("last")));
+	bufline_free(kept);
+
+	// truncated or damaged files are refused
+	struct stat st;
+	assert(stat(file, &st) == 0);
+	assert(truncate(file, st.st_size - 1) == 0);
+	assert(snapshot_load(file, &l) == -1 && errno == EINVAL);
+	assert(truncate(file, sizeof(struct snapshot_header) - 1) == 0);
+	assert(snapshot_load(file, &l) == -1 && errno == EINVAL);
+
+	lines = str_to_buflines(STR("a\nb"));
+	s = (struct snapshot) { .first = lines };
+	assert(snapshot_write(file, &s) == 0);
+	free_bufline_list(lines);
+	int fd = open(file, O_RDWR);
+	uint64_t bad = 100;
+	assert(pwrite(fd, &bad, sizeof(bad), s.hdr.lines_off + sizeof(bad)) == sizeof(bad));
+	assert(snapshot_load(file, &l) == -1 && errno == EINVAL);
+	assert(pwrite(fd, "mfsnap0", 7, 0) == 7);
+	assert(snapshot_load(file, &l) == -1 && errno == EINVAL);
+	close(fd);
+
+	assert(snapshot_load("/nonexistent/snap", &l) == -1 && errno == ENOENT);
+
+	test_tmpdir_remove(dir);
+}
+#endif
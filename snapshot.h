@@ -0,0 +1,81 @@
+#ifndef __HAVE_SNAPSHOT_H
+#define __HAVE_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bufline.h"
+#include "mf_string.h"
+
+// a session snapshot (:mksession, mf -r): a buffer, and where the user was in it. the
+// file is laid out to be mmap'd and used in place: lines are found through a table of
+// offsets instead of by looking for newlines, and their text stays in the mapping until
+// they are changed. numbers are 64 bits in host byte order, and every section starts
+// 8-byte aligned.
+
+enum snapshot_flag {
+	SNAPSHOT_SOFT_WRAP = 1,
+	SNAPSHOT_LINE_NUMS = 2,
+	SNAPSHOT_LAST_LINE_OPEN = 4,
+};
+
+struct snapshot_pos {
+	uint64_t lineno;
+	uint64_t idx;
+};
+
+// a line as it was before the last :s, for `u`. its text is `len` bytes at `off` of the
+// text section.
+struct snapshot_undo {
+	uint64_t lineno;
+	uint64_t off;
+	uint64_t len;
+};
+
+struct snapshot_header {
+	char magic[8];
+	uint64_t flags;
+	uint64_t nlines;
+	// how much of the file was loaded, and how many changes were made to the buffer since
+	uint64_t loaded_size;
+	uint64_t change_seq;
+	// the screen follows the main cursor, so this and `left_col` are where it was
+	struct snapshot_pos cursor;
+	uint64_t left_col;
+	uint64_t ncursors;
+	uint64_t nundo;
+	uint64_t path_len;
+	uint64_t name_len;
+	// where each section starts. `lines_off` has nlines + 1 offsets into the text
+	// section: where each line starts, then where the last one ends. `cursors_off` has
+	// the cursors besides the main one, `undo_off` the undo records, and `strings_off` the
+	// path and then the name.
+	uint64_t lines_off;
+	uint64_t cursors_off;
+	uint64_t undo_off;
+	uint64_t strings_off;
+	uint64_t text_off;
+	uint64_t text_len;
+};
+
+// a snapshot's contents. snapshot_write() takes them from here (and fills in the rest of
+// the header); snapshot_load() points them into the mapping.
+struct snapshot {
+	struct snapshot_header hdr;
+	// the buffer. after loading, its lines point into `text`.
+	struct bufline *first;
+	struct bufline *last;
+	const struct snapshot_pos *cursors;
+	const struct snapshot_undo *undo;
+	// the text of each undo record
+	str_t *undo_text;
+	str_t path;
+	str_t name;
+	// after loading: the mapping, which the lines keep alive
+	struct sharedtext *text;
+};
+
+[[nodiscard]] int snapshot_write(const char *path, struct snapshot *s);
+[[nodiscard]] int snapshot_load(const char *path, struct snapshot *s);
+void snapshot_release(struct snapshot *s);
+
+#endif
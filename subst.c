@@ -0,0 +1,322 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include "config.h"
+#include "subst.h"
+
+// reads up to the next unescaped `delim`, starting at `i`. "\<delim>" stands for `delim`;
+// other escapes are kept as they are. returns the index after the delimiter.
+static size_t parse_part(str_t s, size_t i, char delim, string_t *out) {
+	for (; i < s.len && s.ptr[i] != delim; i++) {
+		if (s.ptr[i] == '\\' && i + 1 < s.len) {
+			if (s.ptr[i + 1] != delim)
+				string_push(out, '\\');
+			i++;
+		}
+		string_push(out, s.ptr[i]);
+	}
+	return i < s.len ? i + 1 : i;
+}
+
+// parses "s/pattern/replacement/flags". any punctuation character can stand in for '/',
+// and the trailing delimiter is optional.
+int subst_parse(str_t s, struct subst_cmd *out, const char **errmsg) {
+	if (s.len < 2 || s.ptr[0] != 's' || !ispunct((unsigned char) s.ptr[1]) || s.ptr[1] == '\\') {
+		*errmsg = "expected s/pattern/replacement/";
+		return -1;
+	}
+
+	char delim = s.ptr[1];
+	out->pattern = string_new();
+	out->replacement = string_new();
+	out->global = 0;
+	size_t i = parse_part(s, 2, delim, &out->pattern);
+	// NUL-terminated for regcomp()
+	string_push(&out->pattern, '\0');
+	out->pattern.len -= 1;
+	i = parse_part(s, i, delim, &out->replacement);
+	for (; i < s.len; i++) {
+		if (s.ptr[i] != 'g') {
+			*errmsg = "unknown flag";
+			subst_cmd_free(out);
+			return -1;
+		}
+		out->global = 1;
+	}
+	if (out->pattern.len == 0) {
+		*errmsg = "empty pattern";
+		subst_cmd_free(out);
+		return -1;
+	}
+	return 0;
+}
+
+void subst_cmd_free(struct subst_cmd *cmd) {
+	string_free(cmd->pattern);
+	string_free(cmd->replacement);
+}
+
+int subst_compile(const struct subst_cmd *cmd, regex_t *re, char *errbuf, size_t errbuf_size) {
+	int ret = regcomp(re, cmd->pattern.ptr, REG_EXTENDED);
+	if (ret != 0) {
+		regerror(ret, re, errbuf, errbuf_size);
+		return -1;
+	}
+	return 0;
+}
+
+static void append_group(string_t *out, str_t line, regmatch_t m) {
+	if (m.rm_so != -1)
+		string_append(out, (str_t) { .ptr = line.ptr + m.rm_so, .len = m.rm_eo - m.rm_so });
+}
+
+static void expand_replacement(str_t rep, str_t line, regmatch_t *m, string_t *out) {
+	for (size_t i = 0; i < rep.len; i++) {
+		char c = rep.ptr[i];
+		if (c == '&') {
+			append_group(out, line, m[0]);
+		} else if (c == '\\' && i + 1 < rep.len) {
+			c = rep.ptr[++i];
+			if (c >= '0' && c <= '9')
+				append_group(out, line, m[c - '0']);
+			else
+				string_push(out, c);
+		} else {
+			string_push(out, c);
+		}
+	}
+}
+
+// applies the substitution to `line`. returns the number of replacements made; if that's
+// nonzero, `out` is set to the new line.
+size_t subst_line(regex_t *re, struct subst_cmd *cmd, str_t line, string_t *out) {
+	// REG_STARTEND: lines aren't NUL-terminated, and may contain NULs
+	const char *ptr = line.ptr != NULL ? line.ptr : "";
+	regmatch_t m[10];
+	size_t nsubs = 0;
+	// line[0, copied) has been handled already
+	size_t copied = 0;
+	size_t search = 0;
+	while (search <= line.len) {
+		m[0].rm_so = search;
+		m[0].rm_eo = line.len;
+		if (regexec(re, ptr, 10, m, REG_STARTEND | (search > 0 ? REG_NOTBOL : 0)) != 0)
+			break;
+
+		size_t so = m[0].rm_so;
+		size_t eo = m[0].rm_eo;
+		// an empty match right where the previous match ended isn't another match
+		if (so == eo && nsubs > 0 && so == copied) {
+			if (so >= line.len)
+				break;
+			search = so + 1;
+			continue;
+		}
+
+		if (nsubs == 0)
+			string_clear(out);
+		string_append(out, (str_t) { .ptr = ptr + copied, .len = so - copied });
+		expand_replacement(string_as_str(cmd->replacement), (str_t) { .ptr = ptr, .len = line.len }, m, out);
+		nsubs++;
+		copied = eo;
+		if (!cmd->global)
+			break;
+		search = so == eo ? eo + 1 : eo;
+	}
+	if (nsubs > 0)
+		string_append(out, (str_t) { .ptr = ptr + copied, .len = line.len - copied });
+	return nsubs;
+}
+
+struct subst_chunk {
+	struct pool_job job;
+	struct subst_job *sj;
+	size_t start;
+	size_t end;
+};
+
+static void subst_chunk_run(struct pool_job *job) {
+	struct subst_chunk *c = (struct subst_chunk *) job;
+	struct subst_job *j = c->sj;
+
+	// each chunk has its own copy of the regex: glibc's regexec() takes a lock on it
+	regex_t re;
+	char errbuf[1];
+	if (subst_compile(&j->cmd, &re, errbuf, sizeof(errbuf)))
+		return;
+	size_t nsubs = 0;
+	size_t reported = c->start;
+	for (size_t i = c->start; i < c->end; i++) {
+		size_t n = subst_line(&re, &j->cmd, j->lines[i], &j->out[i]);
+		j->changed[i] = n > 0;
+		nsubs += n;
+		if (i + 1 - reported == SUBST_PROGRESS_LINES) {
+			atomic_fetch_add(&j->done, SUBST_PROGRESS_LINES);
+			reported = i + 1;
+			if (pool_job_cancelled(job))
+				break;
+		}
+	}
+	atomic_fetch_add(&j->nsubs, nsubs);
+	regfree(&re);
+}
+
+static void subst_chunk_done(struct pool_job *job) {
+	struct subst_chunk *c = (struct subst_chunk *) job;
+	c->sj->pending--;
+	if (c->sj->pending == 0)
+		atomic_store(&c->sj->done, c->sj->nlines);
+}
+
+// takes over `cmd`. the lines are split into chunks for `pool`; the ones in
+// [visible_start, visible_end) are on screen, and go first. without a pool, the work is
+// done before this returns.
+void subst_job_start(struct subst_job *j, struct subst_cmd *cmd, const str_t *lines, size_t nlines, struct pool *pool, size_t visible_start, size_t visible_end) {
+	j->cmd = *cmd;
+	j->lines = lines;
+	j->nlines = nlines;
+	j->out = calloc(nlines, sizeof(j->out[0]));
+	j->changed = calloc(nlines, 1);
+	j->pool = pool;
+	atomic_init(&j->done, 0);
+	atomic_init(&j->nsubs, 0);
+
+	size_t chunk_lines = pool != NULL ? SUBST_CHUNK_LINES : MAX(nlines, (size_t) 1);
+	j->nchunks = (nlines + chunk_lines - 1) / chunk_lines;
+	j->chunks = calloc(MAX(j->nchunks, (size_t) 1), sizeof(j->chunks[0]));
+	j->pending = j->nchunks;
+	for (size_t i = 0; i < j->nchunks; i++) {
+		struct subst_chunk *c = &j->chunks[i];
+		c->sj = j;
+		c->start = i * chunk_lines;
+		c->end = MIN(c->start + chunk_lines, nlines);
+		c->job.run = subst_chunk_run;
+		c->job.done = subst_chunk_done;
+		c->job.prio = c->start < visible_end && c->end > visible_start ? POOL_PRIO_VISIBLE : POOL_PRIO_BACKGROUND;
+		if (pool != NULL) {
+			pool_submit(pool, &c->job);
+		} else {
+			subst_chunk_run(&c->job);
+			subst_chunk_done(&c->job);
+		}
+	}
+}
+
+int subst_job_done(struct subst_job *j) {
+	return j->pending == 0;
+}
+
+// the chunks still to come back call their `done` from the pool's drain, so this has to
+// be on the main thread
+void subst_job_wait(struct subst_job *j) {
+	while (j->pending > 0)
+		pool_wait(j->pool);
+}
+
+// chunks that haven't started are dropped, and running ones stop at their next progress
+// report. they still have to be waited for.
+void subst_job_cancel(struct subst_job *j) {
+	for (size_t i = 0; i < j->nchunks; i++)
+		pool_cancel(&j->chunks[i].job);
+}
+
+// frees the results that haven't been taken (by resetting their `changed` flag)
+void subst_job_free(struct subst_job *j) {
+	subst_job_cancel(j);
+	subst_job_wait(j);
+	for (size_t i = 0; i < j->nlines; i++) {
+		if (j->changed[i])
+			string_free(j->out[i]);
+	}
+	free(j->out);
+	free(j->changed);
+	free(j->chunks);
+	subst_cmd_free(&j->cmd);
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+#include <stdio.h>
+
+static int subst_str(const char *cmdstr, const char *line, const char *expect) {
+	struct subst_cmd cmd;
+	const char *errmsg;
+	regex_t re;
+	char errbuf[100];
+	assert(subst_parse(cstr_as_str((char *) cmdstr), &cmd, &errmsg) == 0);
+	assert(subst_compile(&cmd, &re, errbuf, sizeof(errbuf)) == 0);
+	string_t out = string_new();
+	size_t n = subst_line(&re, &cmd, cstr_as_str((char *) line), &out);
+	int ok = n > 0 ? str_eq(string_as_str(out), cstr_as_str((char *) expect)) : expect == NULL;
+	string_free(out);
+	regfree(&re);
+	subst_cmd_free(&cmd);
+	return ok;
+}
+
+static size_t count_char(const char *s, char c) {
+	size_t n = 0;
+	for (; *s != '\0'; s++)
+		n += *s == c;
+	return n;
+}
+
+void subst_run_tests(void) {
+	assert(subst_str("s/o/0/", "foo boo", "f0o boo"));
+	assert(subst_str("s/o/0/g", "foo boo", "f00 b00"));
+	assert(subst_str("s/x/y/g", "foo", NULL));
+	assert(subst_str("s/(b)(o+)/<\\2\\1&>/", "foo boo", "foo <oobboo>"));
+	assert(subst_str("s/o/\\&/g", "oo", "&&"));
+	assert(subst_str("s|/|\\||g", "a/b/c", "a|b|c"));
+	assert(subst_str("s/\\//-/g", "a/b", "a-b"));
+	assert(subst_str("s/^o/x/g", "ooo", "xoo"));
+	assert(subst_str("s/x*/-/g", "abc", "-a-b-c-"));
+	assert(subst_str("s/x*/-/g", "xxa", "-a-"));
+	assert(subst_str("s/$/;/", "", ";"));
+
+	struct subst_cmd cmd;
+	const char *errmsg;
+	assert(subst_parse(STR("s//x/"), &cmd, &errmsg) == -1);
+	assert(subst_parse(STR("s/a/b/q"), &cmd, &errmsg) == -1);
+	assert(subst_parse(STR("sa/b/"), &cmd, &errmsg) == -1);
+
+	// chunks go to the pool, the ones on screen first
+	size_t nlines = 3 * SUBST_CHUNK_LINES + 100;
+	str_t *lines = malloc(sizeof(lines[0]) * nlines);
+	char (*bufs)[16] = malloc(16 * nlines);
+	for (size_t i = 0; i < nlines; i++) {
+		snprintf(bufs[i], 16, "line %zu", i);
+		lines[i] = cstr_as_str(bufs[i]);
+	}
+	assert(subst_parse(STR("s/1/one/g"), &cmd, &errmsg) == 0);
+	struct pool pool;
+	assert(pool_init(&pool, 4) == 0);
+	struct subst_job j;
+	subst_job_start(&j, &cmd, lines, nlines, &pool, 2 * SUBST_CHUNK_LINES, 2 * SUBST_CHUNK_LINES + 10);
+	assert(j.nchunks == 4);
+	assert(j.chunks[2].job.prio == POOL_PRIO_VISIBLE && j.chunks[1].job.prio == POOL_PRIO_BACKGROUND);
+	subst_job_wait(&j);
+	assert(subst_job_done(&j) && atomic_load(&j.done) == nlines);
+	assert(j.changed[1] && str_eq(string_as_str(j.out[1]), STR("line one")));
+	assert(j.changed[9111] && str_eq(string_as_str(j.out[9111]), STR("line 9oneoneone")));
+	assert(!j.changed[9000]);
+	size_t nsubs = 0;
+	for (size_t i = 0; i < nlines; i++)
+		nsubs += count_char(bufs[i], '1');
+	assert(atomic_load(&j.nsubs) == nsubs);
+	subst_job_free(&j);
+
+	// cancelled right away: whatever was done is thrown away
+	assert(subst_parse(STR("s/1/one/g"), &cmd, &errmsg) == 0);
+	subst_job_start(&j, &cmd, lines, nlines, &pool, 0, 0);
+	subst_job_free(&j);
+	pool_free(&pool);
+
+	// without a pool, it's done right away
+	assert(subst_parse(STR("s/1/one/g"), &cmd, &errmsg) == 0);
+	subst_job_start(&j, &cmd, lines, 10000, NULL, 0, 0);
+	assert(subst_job_done(&j) && atomic_load(&j.nsubs) == 4000);
+	subst_job_free(&j);
+	free(bufs);
+	free(lines);
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef __HAVE_SUBST_H
+#define __HAVE_SUBST_H
+
+#include <regex.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "mf_string.h"
+#include "pool.h"
+
+// s/pattern/replacement/flags. the pattern is a POSIX extended regex. in the replacement,
+// & is the whole match and \1..\9 are groups.
+struct subst_cmd {
+	string_t pattern;
+	string_t replacement;
+	// replace every match on a line, not just the first
+	unsigned global : 1;
+};
+
+struct subst_chunk;
+
+// computes the substitution over a set of lines, in chunks that run as jobs on a pool.
+// the lines are only read, so they must not change until the job has finished.
+struct subst_job {
+	struct subst_cmd cmd;
+	const str_t *lines;
+	size_t nlines;
+	// results: for each line, whether it changed and its new contents
+	string_t *out;
+	unsigned char *changed;
+
+	struct pool *pool;
+	struct subst_chunk *chunks;
+	size_t nchunks;
+	// chunks that haven't come back from the pool yet
+	size_t pending;
+	// lines done so far, for showing progress
+	atomic_size_t done;
+	atomic_size_t nsubs;
+};
+
+[[nodiscard]] int subst_parse(str_t s, struct subst_cmd *out, const char **errmsg);
+void subst_cmd_free(struct subst_cmd *cmd);
+[[nodiscard]] int subst_compile(const struct subst_cmd *cmd, regex_t *re, char *errbuf, size_t errbuf_size);
+size_t subst_line(regex_t *re, struct subst_cmd *cmd, str_t line, string_t *out);
+void subst_job_start(struct subst_job *j, struct subst_cmd *cmd, const str_t *lines, size_t nlines, struct pool *pool, size_t visible_start, size_t visible_end);
+int subst_job_done(struct subst_job *j);
+void subst_job_wait(struct subst_job *j);
+void subst_job_cancel(struct subst_job *j);
+void subst_job_free(struct subst_job *j);
+
+#endif
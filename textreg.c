@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "textreg.h"
+
+// takes a reference to the text of the `nlines` lines from `start` to `end`. for a
+// charwise range, only [start_idx, end of line) of `start` and [0, end_idx) of `end`
+// are included. no text is copied.
+struct regtext *regtext_from_lines(struct bufline *start, size_t start_idx, struct bufline *end, size_t end_idx, size_t nlines, int linewise) {
+	struct regtext *rt = malloc(sizeof(struct regtext));
+	*rt = (struct regtext) {
+		.refcount = 1,
+		.lines = malloc(sizeof(rt->lines[0]) * nlines),
+		.nlines = nlines,
+		.linewise = linewise,
+	};
+
+	size_t i = 0;
+	for (struct bufline *bl = start; ; bl = bl->next, i++) {
+		struct sharedtext *st = bufline_share(bl);
+		rt->lines[i] = (struct regline) { .text = st, .start = 0, .len = st->len };
+		if (!linewise && bl == start) {
+			rt->lines[i].start = start_idx;
+			rt->lines[i].len -= start_idx;
+		}
+		if (!linewise && bl == end)
+			rt->lines[i].len = end_idx - rt->lines[i].start;
+		if (bl == end)
+			break;
+	}
+	return rt;
+}
+
+struct regtext *regtext_ref(struct regtext *rt) {
+	rt->refcount += 1;
+	return rt;
+}
+
+void regtext_release(struct regtext *rt) {
+	if (rt == NULL || --rt->refcount > 0)
+		return;
+	for (size_t i = 0; i < rt->nlines; i++)
+		sharedtext_release(rt->lines[i].text);
+	free(rt->lines);
+	free(rt);
+}
+
+str_t regline_str(struct regline l) {
+	// (an empty line's text may have no memory at all)
+	return (str_t) { .ptr = l.len > 0 ? l.text->ptr + l.start : l.text->ptr, .len = l.len };
+}
+
+// the register's contents as one string: lines joined by '\n', plus a final '\n' if linewise
+void regtext_to_string(struct regtext *rt, string_t *out) {
+	string_clear(out);
+	for (size_t i = 0; i < rt->nlines; i++) {
+		string_append(out, regline_str(rt->lines[i]));
+		if (rt->linewise || i + 1 < rt->nlines)
+			string_push(out, '\n');
+	}
+}
+
+// bytes of text in the register
+size_t regtext_size(struct regtext *rt) {
+	size_t n = 0;
+	for (size_t i = 0; i < rt->nlines; i++)
+		n += rt->lines[i].len;
+	return n;
+}
+
+// bytes of memory that only this register keeps alive, because the buffer lines (and
+// other registers) it shared them with have been changed or deleted since
+size_t regtext_unshared_size(struct regtext *rt) {
+	size_t n = 0;
+	for (size_t i = 0; i < rt->nlines; i++) {
+		if (rt->lines[i].text->refcount == 1)
+			n += rt->lines[i].text->len;
+	}
+	return n;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void textreg_run_tests(void) {
+	struct bufline *head = str_to_buflines(STR("one\ntwo\nthree"));
+	struct bufline *two = head->next;
+	struct bufline *three = two->next;
+
+	struct regtext *rt = regtext_from_lines(head, 1, three, 2, 3, 0);
+	string_t s = string_new();
+	regtext_to_string(rt, &s);
+	assert(str_eq(string_as_str(s), STR("ne\ntwo\nth")));
+	// nothing was copied: the register points into the lines' text
+	assert(rt->lines[1].text->ptr == two->string.ptr);
+	assert(two->shared != NULL && two->shared->refcount == 2);
+	assert(regtext_unshared_size(rt) == 0);
+
+	// changing a line gives it its own copy, and the register keeps the old text
+	bufline_unshare(two);
+	string_push(&two->string, '!');
+	assert(two->shared == NULL && rt->lines[1].text->refcount == 1);
+	regtext_to_string(rt, &s);
+	assert(str_eq(string_as_str(s), STR("ne\ntwo\nth")));
+	assert(regtext_unshared_size(rt) == 3);
+
+	free_bufline_list(head);
+	assert(regtext_size(rt) == 7 && regtext_unshared_size(rt) == 3 + 3 + 5);
+
+	struct regtext *again = regtext_ref(rt);
+	regtext_release(rt);
+	regtext_to_string(again, &s);
+	assert(str_eq(string_as_str(s), STR("ne\ntwo\nth")));
+	regtext_release(again);
+	string_free(s);
+}
+#endif
@@ -0,0 +1,34 @@
+#ifndef __HAVE_TEXTREG_H
+#define __HAVE_TEXTREG_H
+
+#include <stddef.h>
+#include "bufline.h"
+#include "mf_string.h"
+
+// a piece of register text: `len` bytes at `start` of `text`
+struct regline {
+	struct sharedtext *text;
+	size_t start;
+	size_t len;
+};
+
+// contents of a register. never changed once made, so registers holding the same
+// contents share one regtext. the text itself is shared with the buffer lines it
+// was yanked from, until those lines are changed.
+struct regtext {
+	size_t refcount;
+	struct regline *lines;
+	size_t nlines;
+	// whole lines, rather than a run of characters (whose first and last lines may be partial)
+	unsigned linewise : 1;
+};
+
+struct regtext *regtext_from_lines(struct bufline *start, size_t start_idx, struct bufline *end, size_t end_idx, size_t nlines, int linewise);
+struct regtext *regtext_ref(struct regtext *rt);
+void regtext_release(struct regtext *rt);
+str_t regline_str(struct regline l);
+void regtext_to_string(struct regtext *rt, string_t *out);
+size_t regtext_size(struct regtext *rt);
+size_t regtext_unshared_size(struct regtext *rt);
+
+#endif
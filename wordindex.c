@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "wordindex.h"
+
+int wordindex_is_word_char(char ch) {
+	unsigned char c = ch;
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+// numbers and words too short or too long to be worth completing aren't counted
+static int worth_indexing(str_t word) {
+	return word.len >= COMPL_MIN_WORD_LEN && word.len <= COMPL_MAX_WORD_LEN && !(word.ptr[0] >= '0' && word.ptr[0] <= '9');
+}
+
+void wordindex_init(struct wordindex *w) {
+	w->cap = 1024;
+	w->nodes = malloc(sizeof(w->nodes[0]) * w->cap);
+	w->nodes[0] = (struct wordindex_node) { 0 };
+	w->n = 1;
+	w->free = 0;
+	w->nfree = 0;
+	w->nwords = 0;
+}
+
+void wordindex_free(struct wordindex *w) {
+	free(w->nodes);
+}
+
+static uint32_t find_child(const struct wordindex *w, uint32_t node, unsigned char ch) {
+	uint32_t c = w->nodes[node].child;
+	while (c != 0 && w->nodes[c].ch != ch)
+		c = w->nodes[c].sibling;
+	return c;
+}
+
+static uint32_t new_child(struct wordindex *w, uint32_t parent, unsigned char ch) {
+	uint32_t i;
+	if (w->free != 0) {
+		i = w->free;
+		w->free = w->nodes[i].sibling;
+		w->nfree--;
+	} else {
+		if (w->n == w->cap) {
+			w->cap *= 2;
+			w->nodes = realloc(w->nodes, sizeof(w->nodes[0]) * w->cap);
+		}
+		i = w->n++;
+	}
+	w->nodes[i] = (struct wordindex_node) { .parent = parent, .sibling = w->nodes[parent].child, .ch = ch };
+	w->nodes[parent].child = i;
+	return i;
+}
+
+// the node `word` ends at, or 0 if there is none
+static uint32_t find_word(const struct wordindex *w, str_t word) {
+	uint32_t node = 0;
+	for (size_t i = 0; i < word.len && (i == 0 || node != 0); i++)
+		node = find_child(w, node, word.ptr[i]);
+	return node;
+}
+
+// how many times `word` is counted
+uint32_t wordindex_count(const struct wordindex *w, str_t word) {
+	uint32_t node = word.len > 0 ? find_word(w, word) : 0;
+	return node != 0 ? w->nodes[node].count : 0;
+}
+
+void wordindex_add(struct wordindex *w, str_t word) {
+	if (!worth_indexing(word))
+		return;
+
+	uint32_t node = 0;
+	for (size_t i = 0; i < word.len; i++) {
+		// a child that is found is moved to the front, so that the common words are
+		// quick to find
+		uint32_t *link = &w->nodes[node].child;
+		while (*link != 0 && w->nodes[*link].ch != (unsigned char) word.ptr[i])
+			link = &w->nodes[*link].sibling;
+		uint32_t c = *link;
+		if (c == 0) {
+			node = new_child(w, node, word.ptr[i]);
+			continue;
+		}
+		if (link != &w->nodes[node].child) {
+			*link = w->nodes[c].sibling;
+			w->nodes[c].sibling = w->nodes[node].child;
+			w->nodes[node].child = c;
+		}
+		node = c;
+	}
+	if (w->nodes[node].count++ == 0)
+		w->nwords++;
+
+	// the nodes above already have a count at least this high once one of them does
+	uint32_t count = w->nodes[node].count;
+	for (;;) {
+		if (w->nodes[node].best >= count)
+			break;
+		w->nodes[node].best = count;
+		if (node == 0)
+			break;
+		node = w->nodes[node].parent;
+	}
+}
+
+void wordindex_remove(struct wordindex *w, str_t word) {
+	if (!worth_indexing(word))
+		return;
+
+	uint32_t node = find_word(w, word);
+	if (node == 0 || w->nodes[node].count == 0)
+		return;
+	if (--w->nodes[node].count == 0)
+		w->nwords--;
+
+	for (;;) {
+		struct wordindex_node *nd = &w->nodes[node];
+		uint32_t parent = nd->parent;
+		// a node that no word goes through anymore is let go of
+		if (node != 0 && nd->count == 0 && nd->child == 0) {
+			uint32_t *link = &w->nodes[parent].child;
+			while (*link != node)
+				link = &w->nodes[*link].sibling;
+			*link = nd->sibling;
+			nd->sibling = w->free;
+			w->free = node;
+			w->nfree++;
+			node = parent;
+			continue;
+		}
+
+		uint32_t best = nd->count;
+		for (uint32_t c = nd->child; c != 0; c = w->nodes[c].sibling)
+			best = MAX(best, w->nodes[c].best);
+		if (best == nd->best || node == 0) {
+			nd->best = best;
+			break;
+		}
+		nd->best = best;
+		node = parent;
+	}
+}
+
+// adds (or removes) the words of `line` that overlap or border on the range [lo, hi].
+// an edit of the range changes no other words, so removing these before it and adding
+// them again after it keeps the index up to date.
+void wordindex_update(struct wordindex *w, str_t line, size_t lo, size_t hi, int add) {
+	lo = MIN(lo, line.len);
+	while (lo > 0 && wordindex_is_word_char(line.ptr[lo - 1]))
+		lo--;
+	for (size_t i = lo; i < line.len && i <= hi; ) {
+		if (!wordindex_is_word_char(line.ptr[i])) {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		while (i < line.len && wordindex_is_word_char(line.ptr[i]))
+			i++;
+		str_t word = { .ptr = line.ptr + start, .len = i - start };
+		if (add)
+			wordindex_add(w, word);
+		else
+			wordindex_remove(w, word);
+	}
+}
+
+struct search_item {
+	uint32_t node;
+	uint32_t prio;
+	// a word rather than a subtree
+	uint32_t is_word : 1;
+	uint32_t depth : 31;
+};
+
+// ties go to words, and then to deeper subtrees, so that a tie is broken by going down to
+// a word instead of opening up every subtree with that count
+static int item_before(struct search_item a, struct search_item b) {
+	if (a.prio != b.prio)
+		return a.prio > b.prio;
+	if (a.is_word != b.is_word)
+		return a.is_word;
+	return a.depth > b.depth;
+}
+
+struct search_heap {
+	struct search_item *items;
+	size_t n;
+	size_t cap;
+};
+
+static void heap_push(struct search_heap *h, struct search_item it) {
+	if (h->n == h->cap) {
+		h->cap = MAX(h->cap * 2, (size_t) 64);
+		h->items = realloc(h->items, sizeof(h->items[0]) * h->cap);
+	}
+	size_t i = h->n++;
+	while (i > 0 && item_before(it, h->items[(i - 1) / 2])) {
+		h->items[i] = h->items[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	h->items[i] = it;
+}
+
+static struct search_item heap_pop(struct search_heap *h) {
+	struct search_item top = h->items[0];
+	struct search_item last = h->items[--h->n];
+	size_t i = 0;
+	for (;;) {
+		size_t c = 2 * i + 1;
+		if (c >= h->n)
+			break;
+		if (c + 1 < h->n && item_before(h->items[c + 1], h->items[c]))
+			c++;
+		if (!item_before(h->items[c], last))
+			break;
+		h->items[i] = h->items[c];
+		i = c;
+	}
+	if (h->n > 0)
+		h->items[i] = last;
+	return top;
+}
+
+// puts up to `k` of the most common words that start with `prefix` (but aren't just
+// `prefix`) into `out`, most common first, and returns how many there are
+size_t wordindex_complete(const struct wordindex *w, str_t prefix, string_t *out, size_t k) {
+	uint32_t start = prefix.len > 0 ? find_word(w, prefix) : 0;
+	if (start == 0 && prefix.len > 0)
+		return 0;
+
+	struct search_heap h = { 0 };
+	size_t found = 0;
+	heap_push(&h, (struct search_item) { .node = start, .prio = w->nodes[start].best });
+	while (found < k && h.n > 0) {
+		struct search_item it = heap_pop(&h);
+		const struct wordindex_node *nd = &w->nodes[it.node];
+		if (it.prio == 0)
+			break;
+		if (it.is_word) {
+			char buf[COMPL_MAX_WORD_LEN];
+			size_t len = 0;
+			for (uint32_t i = it.node; i != 0; i = w->nodes[i].parent)
+				buf[len++] = w->nodes[i].ch;
+			out[found] = string_new();
+			while (len > 0)
+				string_push(&out[found], buf[--len]);
+			found++;
+			continue;
+		}
+		if (nd->count > 0 && it.node != start)
+			heap_push(&h, (struct search_item) { .node = it.node, .prio = nd->count, .is_word = 1, .depth = it.depth });
+		for (uint32_t c = nd->child; c != 0; c = w->nodes[c].sibling)
+			heap_push(&h, (struct search_item) { .node = c, .prio = w->nodes[c].best, .depth = it.depth + 1 });
+	}
+	free(h.items);
+	return found;
+}
+
+size_t wordindex_mem_usage(const struct wordindex *w) {
+	return sizeof(w->nodes[0]) * w->cap;
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+#include <stdio.h>
+
+// completes `prefix` and checks that the words found are `want`, in that order
+static int complete_eq(struct wordindex *w, const char *prefix, const char **want, size_t nwant) {
+	string_t out[8];
+	size_t n = wordindex_complete(w, (str_t) { .ptr = prefix, .len = strlen(prefix) }, out, 8);
+	int ok = n == nwant;
+	for (size_t i = 0; i < n; i++) {
+		if (ok && !str_eq(string_as_str(out[i]), (str_t) { .ptr = want[i], .len = strlen(want[i]) }))
+			ok = 0;
+		string_free(out[i]);
+	}
+	return ok;
+}
+
+void wordindex_run_tests(void) {
+	struct wordindex w;
+	wordindex_init(&w);
+	str_t line = STR("int count = count_max + counter * count_max; // 42 x counter count_max countdown");
+	wordindex_update(&w, line, 0, line.len, 1);
+	// "42" and "x" aren't counted
+	assert(w.nwords == 5);
+	// most common first, without the prefix itself
+	assert(complete_eq(&w, "count", (const char *[]) { "count_max", "counter", "countdown" }, 3));
+	string_t out[5];
+	assert(wordindex_complete(&w, STR("c"), out, 2) == 2);
+	assert(str_eq(string_as_str(out[0]), STR("count_max")) && str_eq(string_as_str(out[1]), STR("counter")));
+	string_free(out[0]);
+	string_free(out[1]);
+	assert(complete_eq(&w, "countdown", NULL, 0));
+	assert(complete_eq(&w, "q", NULL, 0));
+
+	// an edit in the middle of a line only touches the words around it
+	string_t s = str_to_string(line);
+	wordindex_update(&w, string_as_str(s), 24, 24, 0);
+	string_insert(&s, 24, 'x');
+	wordindex_update(&w, string_as_str(s), 24, 25, 1);
+	assert(complete_eq(&w, "xco", (const char *[]) { "xcounter" }, 1));
+	assert(complete_eq(&w, "counte", (const char *[]) { "counter" }, 1));
+	wordindex_update(&w, string_as_str(s), 24, 25, 0);
+	string_remove(&s, 24);
+	wordindex_update(&w, string_as_str(s), 24, 24, 1);
+	assert(complete_eq(&w, "xc", NULL, 0));
+	assert(w.nwords == 5);
+
+	// taking everything out again leaves just the root, with its nodes up for reuse
+	wordindex_update(&w, string_as_str(s), 0, s.len, 0);
+	string_free(s);
+	assert(w.nwords == 0 && w.nodes[0].child == 0 && w.nodes[0].best == 0);
+	assert(w.nfree == w.n - 1);
+	size_t n = w.n;
+	wordindex_add(&w, STR("count"));
+	assert(w.n == n && w.nfree == n - 1 - 5);
+
+	// the highest counts are found without going through all the words
+	for (int i = 0; i < 5000; i++) {
+		char word[16];
+		int len = snprintf(word, sizeof(word), "w%d", i);
+		for (int j = 0; j < (i % 1000 == 7 ? 3 + i / 1000 : 1); j++)
+			wordindex_add(&w, (str_t) { .ptr = word, .len = len });
+	}
+	const char *want[] = { "w4007", "w3007", "w2007", "w1007", "w7" };
+	assert(wordindex_complete(&w, STR("w"), out, 5) == 5);
+	for (int i = 0; i < 5; i++) {
+		assert(str_eq(string_as_str(out[i]), (str_t) { .ptr = want[i], .len = strlen(want[i]) }));
+		string_free(out[i]);
+	}
+	assert(wordindex_complete(&w, STR("w30"), out, 1) == 1 && str_eq(string_as_str(out[0]), STR("w3007")));
+	string_free(out[0]);
+	wordindex_free(&w);
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef __HAVE_WORDINDEX_H
+#define __HAVE_WORDINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mf_string.h"
+
+// insert mode completion: how many times each word is in the buffer, as a trie. every
+// node knows the highest count below it, so the most common words that start with some
+// prefix are found without looking at the others.
+struct wordindex_node {
+	uint32_t parent;
+	// first child and next sibling, or 0 (the root is never either)
+	uint32_t child;
+	uint32_t sibling;
+	// how many times the word that ends here is in the buffer
+	uint32_t count;
+	// highest count of this node and the ones below it
+	uint32_t best;
+	unsigned char ch;
+};
+
+struct wordindex {
+	// node 0 is the root
+	struct wordindex_node *nodes;
+	size_t n;
+	size_t cap;
+	// nodes that were let go of, linked through `sibling`, or 0
+	uint32_t free;
+	size_t nfree;
+	// distinct words
+	size_t nwords;
+};
+
+int wordindex_is_word_char(char ch);
+void wordindex_init(struct wordindex *w);
+void wordindex_free(struct wordindex *w);
+uint32_t wordindex_count(const struct wordindex *w, str_t word);
+void wordindex_add(struct wordindex *w, str_t word);
+void wordindex_remove(struct wordindex *w, str_t word);
+void wordindex_update(struct wordindex *w, str_t line, size_t lo, size_t hi, int add);
+size_t wordindex_complete(const struct wordindex *w, str_t prefix, string_t *out, size_t k);
+size_t wordindex_mem_usage(const struct wordindex *w);
+
+#endif
@@ -0,0 +1,125 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include "config.h"
+#include "wrap.h"
+
+// columns `ch` takes on screen (as drawn by render_str())
+int wrap_char_width(char ch) {
+	if (ch == '\t')
+		return TAB_WIDTH;
+	if (isprint((unsigned char) ch))
+		return 1;
+	return sizeof("<XX>") - 1;
+}
+
+// fills in (if `starts` isn't NULL) where each row but the first starts, and returns how
+// many rows there are
+static size_t break_line(str_t line, int width, size_t *starts) {
+	size_t nrows = 1;
+	int col = 0;
+	for (size_t i = 0; i < line.len; i++) {
+		int w = wrap_char_width(line.ptr[i]);
+		// a character wider than the whole row still gets a row of its own
+		if (col > 0 && col + w > width) {
+			if (starts != NULL)
+				starts[nrows] = i;
+			nrows++;
+			col = 0;
+		}
+		col += w;
+	}
+	return nrows;
+}
+
+// the layout of `bl` at `width` columns, kept with the line until it changes or is asked
+// for at another width
+const struct wraplayout *wrap_layout(struct bufline *bl, int width) {
+	if (bl->layout != NULL && bl->layout->width == width)
+		return bl->layout;
+
+	str_t line = string_as_str(bl->string);
+	size_t nrows = break_line(line, width, NULL);
+	struct wraplayout *l = realloc(bl->layout, sizeof(struct wraplayout) + sizeof(l->starts[0]) * nrows);
+	l->width = width;
+	l->nrows = nrows;
+	l->starts[0] = 0;
+	(void) break_line(line, width, l->starts);
+	bl->layout = l;
+	return l;
+}
+
+// the line's text changed
+void wrap_invalidate(struct bufline *bl) {
+	free(bl->layout);
+	bl->layout = NULL;
+}
+
+// the row that byte `idx` is on. the end of the line counts as being on the last row.
+size_t wrap_row_of(const struct wraplayout *l, size_t idx) {
+	size_t lo = 0;
+	size_t hi = l->nrows;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (l->starts[mid] <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+str_t wrap_row_str(const struct wraplayout *l, str_t line, size_t row) {
+	size_t end = row + 1 < l->nrows ? l->starts[row + 1] : line.len;
+	return (str_t) { .ptr = line.ptr + l->starts[row], .len = end - l->starts[row] };
+}
+
+// the byte on `row` that covers column `col` of the row, or the row's last one if the row
+// is shorter
+size_t wrap_idx_at_col(const struct wraplayout *l, str_t line, size_t row, int col) {
+	str_t s = wrap_row_str(l, line, row);
+	int x = 0;
+	for (size_t i = 0; i < s.len; i++) {
+		x += wrap_char_width(s.ptr[i]);
+		if (x > col)
+			return l->starts[row] + i;
+	}
+	return l->starts[row] + (s.len > 0 ? s.len - 1 : 0);
+}
+
+#ifdef MF_BUILD_TESTS
+#include <assert.h>
+
+void wrap_run_tests(void) {
+	struct bufline *bl = bufline_new_with_string(str_to_string(STR("abcdefghij")));
+	const struct wraplayout *l = wrap_layout(bl, 4);
+	assert(l->nrows == 3 && l->starts[1] == 4 && l->starts[2] == 8);
+	assert(wrap_row_of(l, 0) == 0 && wrap_row_of(l, 3) == 0 && wrap_row_of(l, 4) == 1);
+	assert(wrap_row_of(l, 9) == 2 && wrap_row_of(l, 10) == 2);
+	assert(str_eq(wrap_row_str(l, string_as_str(bl->string), 2), STR("ij")));
+	assert(wrap_idx_at_col(l, string_as_str(bl->string), 1, 2) == 6);
+	assert(wrap_idx_at_col(l, string_as_str(bl->string), 2, 3) == 9);
+	// cached until the width changes
+	assert(wrap_layout(bl, 4) == l);
+	l = wrap_layout(bl, 10);
+	assert(l->nrows == 1);
+	wrap_invalidate(bl);
+	assert(bl->layout == NULL);
+	bufline_free(bl);
+
+	// a tab or <XX> that doesn't fit goes to the next row whole
+	bl = bufline_new_with_string(str_to_string(STR("ab\tc\x01")));
+	l = wrap_layout(bl, 9);
+	assert(l->nrows == 3 && l->starts[1] == 2 && l->starts[2] == 4);
+	assert(wrap_idx_at_col(l, string_as_str(bl->string), 1, 5) == 2);
+	assert(wrap_idx_at_col(l, string_as_str(bl->string), 1, 8) == 3);
+	l = wrap_layout(bl, 2);
+	assert(l->nrows == 4 && l->starts[1] == 2 && l->starts[2] == 3 && l->starts[3] == 4);
+	bufline_free(bl);
+
+	bl = bufline_new_with_string(string_new());
+	l = wrap_layout(bl, 4);
+	assert(l->nrows == 1 && wrap_row_of(l, 0) == 0);
+	assert(wrap_idx_at_col(l, string_as_str(bl->string), 0, 3) == 0);
+	bufline_free(bl);
+}
+#endif
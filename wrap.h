@@ -0,0 +1,24 @@
+#ifndef __HAVE_WRAP_H
+#define __HAVE_WRAP_H
+
+#include <stddef.h>
+#include "bufline.h"
+
+// soft wrap: where a line is broken into screen rows at a given width. rows are broken
+// between characters, so that a tab or a <XX> is never split.
+struct wraplayout {
+	int width;
+	// at least 1
+	size_t nrows;
+	// byte index that each row starts at. starts[0] is 0.
+	size_t starts[];
+};
+
+int wrap_char_width(char ch);
+const struct wraplayout *wrap_layout(struct bufline *bl, int width);
+void wrap_invalidate(struct bufline *bl);
+size_t wrap_row_of(const struct wraplayout *l, size_t idx);
+str_t wrap_row_str(const struct wraplayout *l, str_t line, size_t row);
+size_t wrap_idx_at_col(const struct wraplayout *l, str_t line, size_t row, int col);
+
+#endif